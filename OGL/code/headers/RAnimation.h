@@ -0,0 +1,272 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RANIMATION_H
+#define RANIMATION_H
+
+#include "reactor.h"
+
+namespace Reactor
+{
+	/** Skinning limit shared with the content pipeline (ActorProcessor.MaxBones). */
+	#define R_MAX_BONES		70
+	/** R_MAX_BONES rounded up to a whole number of 4-wide SIMD lanes. */
+	#define R_POSE_STRIDE	72
+
+	/** One joint's local transform. */
+	struct RJointPose
+	{
+		RVector3 translation;
+		RQuaternion rotation;
+		RVector3 scale;
+	};
+
+	/** Local joint transforms in structure-of-arrays form, one float per joint per stream,
+		so four joints are processed per SSE instruction.
+	*/
+	struct alignas(16) RPose
+	{
+		RFLOAT tx[R_POSE_STRIDE], ty[R_POSE_STRIDE], tz[R_POSE_STRIDE];
+		RFLOAT qx[R_POSE_STRIDE], qy[R_POSE_STRIDE], qz[R_POSE_STRIDE], qw[R_POSE_STRIDE];
+		RFLOAT sx[R_POSE_STRIDE], sy[R_POSE_STRIDE], sz[R_POSE_STRIDE];
+
+		RVOID SetJoint(RINT Joint, const RJointPose& Pose);
+		RJointPose GetJoint(RINT Joint) const;
+	};
+
+	/** Bone hierarchy, bind pose and inverse bind matrices.
+		@remarks
+			Bones are stored parent-first (the order MeshHelper.FlattenSkeleton produces), which
+			lets model-space matrices be built in a single forward pass.
+	*/
+	class RSkeleton
+	{
+	public:
+		RSkeleton();
+
+		/** Appends a bone. Parent must be -1 or an earlier bone. */
+		RRESULT AddBone(const std::string& Name, RINT Parent, const RJointPose& BindPose, const RMatrix& InverseBindPose);
+
+		RINT GetBoneCount() const { return count; }
+		RINT GetParent(RINT Bone) const { return parents[Bone]; }
+		RINT FindBone(const std::string& Name) const;
+		const std::string& GetBoneName(RINT Bone) const { return names[Bone]; }
+		const RPose& GetBindPose() const { return bindPose; }
+		const RMatrix& GetInverseBindPose(RINT Bone) const { return inverseBind[Bone]; }
+
+		/** Local pose to model space: Out[i] = Out[parent] * local[i], with Root above the root bones. */
+		RVOID ComputeModelMatrices(const RPose& Local, const RMatrix& Root, RMatrix* Out) const;
+
+		/** Skinning palette: Palette[i] = Model[i] * InverseBindPose[i]. */
+		RVOID ComputeSkinPalette(const RMatrix* Model, RMatrix* Palette) const;
+
+	private:
+		std::vector<std::string> names;
+		RINT parents[R_MAX_BONES];
+		RPose bindPose;
+		RMatrix inverseBind[R_MAX_BONES];
+		RINT count;
+	};
+
+	/** Source keyframe as produced by the content importer, one bone at one time. */
+	struct RKeyframe
+	{
+		RINT bone;
+		RFLOAT time;
+		RJointPose pose;
+	};
+
+	/** Animation resampled at a fixed rate into SoA frames.
+		@remarks
+			Build() slerps the importer's sparse per-bone keys onto a uniform timeline so that
+			Sample() only has to blend two neighbouring frames: translation and scale are lerped
+			and rotations nlerped along the shortest path, four bones at a time.
+	*/
+	class RAnimationClip
+	{
+	public:
+		RAnimationClip();
+
+		RRESULT Build(const RSkeleton& Skeleton, RFLOAT Duration, const std::vector<RKeyframe>& Keyframes, RFLOAT SampleRate = 30.0f);
+		RVOID Sample(RFLOAT Time, RBOOL Loop, RPose& Out) const;
+		RVOID GetFrame(RINT Index, RPose& Out) const;
+
+		RFLOAT GetDuration() const { return duration; }
+		RFLOAT GetSampleRate() const { return sampleRate; }
+		RINT GetBoneCount() const { return boneCount; }
+		RINT GetFrameCount() const { return frameCount; }
+
+	private:
+		const RFLOAT* Frame(RINT Index) const { return &frames[Index * stride * 10]; }
+
+		RTaggedVector<RFLOAT, RMEM_ANIMATION> frames;	// per frame: tx ty tz qx qy qz qw sx sy sz, each stride floats
+		RINT boneCount;
+		RINT stride;
+		RINT frameCount;
+		RFLOAT sampleRate;
+		RFLOAT duration;
+	};
+
+	class RCompressedClip;
+	class RClipDecoder;
+	class RBlendTree;
+	class RCamera;
+
+	/** Update-rate tier picked by RAnimationSystem from visibility and screen size. */
+	typedef enum RANIM_LOD
+	{
+		RANIM_LOD_FULL		=	0x0000,	// evaluated every frame
+		RANIM_LOD_HALF		=	0x0001,	// every second frame, palette interpolated in between
+		RANIM_LOD_QUARTER	=	0x0002,	// every fourth frame, palette interpolated in between
+		RANIM_LOD_CULLED	=	0x0003,	// outside the view: clock advances, nothing is evaluated
+		RANIM_LOD_COUNT		=	0x0004
+	} RANIM_LOD;
+
+	/** Screen-size thresholds, as a fraction of the viewport height covered by the bounds. */
+	struct RAnimationLODSettings
+	{
+		RAnimationLODSettings() : halfRateSize(0.25f), quarterRateSize(0.08f) {}
+
+		RFLOAT halfRateSize;		// below this, update every second frame
+		RFLOAT quarterRateSize;		// below this, update every fourth frame
+	};
+
+	/** Counters for the last RAnimationSystem::Update. */
+	struct RAnimationStats
+	{
+		RINT evaluated;				// poses sampled and palettes built
+		RINT interpolated;			// palettes blended between two evaluations instead
+		RINT culled;				// not evaluated at all
+		RINT tiers[RANIM_LOD_COUNT];
+	};
+
+	/** One animated character: plays a clip on a skeleton and produces its skinning palette. */
+	class RAnimationInstance
+	{
+	public:
+		RAnimationInstance(const RSkeleton* Skeleton);
+		~RAnimationInstance();
+
+		RVOID Play(const RAnimationClip* Clip, RBOOL Loop = true);
+		/** Plays a compressed clip through a per-instance streaming decoder. */
+		RVOID Play(const RCompressedClip* Clip, RBOOL Loop = true);
+		/** Drives the pose from a compiled blend tree; its parameters start at their defaults. */
+		RVOID Play(const RBlendTree* Tree);
+		RVOID SetParameter(RINT Index, RFLOAT Value) { parameters[Index] = Value; }
+		RFLOAT GetParameter(RINT Index) const { return parameters[Index]; }
+		RVOID SetSpeed(RFLOAT Speed) { speed = Speed; }
+		RVOID SetTime(RFLOAT Time) { time = Time; }
+		RVOID SetRootTransform(const RMatrix& Root) { root = Root; }
+		/** World-space bounding sphere used to pick the update rate. A radius of 0 (the
+			default) keeps the instance at full rate.
+		*/
+		RVOID SetBounds(const RVector3& Center, RFLOAT Radius) { boundsCenter = Center; boundsRadius = Radius; }
+
+		RVOID Advance(RFLOAT ElapsedSeconds);
+		RVOID Evaluate();
+
+		RFLOAT GetTime() const { return time; }
+		const RSkeleton* GetSkeleton() const { return skeleton; }
+		const RBlendTree* GetBlendTree() const { return tree; }
+		RANIM_LOD GetLOD() const { return lod; }
+		const RPose& GetPose() const { return pose; }
+		const RMatrix* GetModelMatrices() const { return model; }
+		const RMatrix* GetPalette() const { return palette; }
+
+	private:
+		friend class RBlendTree;
+		friend class RAnimationSystem;
+
+		RVOID SamplePose();
+		RVOID ComputeMatrices();
+
+		const RSkeleton* skeleton;
+		const RAnimationClip* clip;
+		const RCompressedClip* compressed;
+		std::unique_ptr<RClipDecoder> decoder;
+		const RBlendTree* tree;
+		std::vector<RFLOAT> parameters;
+		RFLOAT time;
+		RFLOAT speed;
+		RBOOL loop;
+		RMatrix root;
+		RPose pose;
+		RMatrix model[R_MAX_BONES];
+		RMatrix palette[R_MAX_BONES];
+
+		// Reduced-rate state: palettes of the last two evaluations and the position between them.
+		RVector3 boundsCenter;
+		RFLOAT boundsRadius;
+		RANIM_LOD lod;
+		RINT phase;
+		RINT step;
+		RINT gap;
+		RBOOL stale;
+		RMatrix previous[R_MAX_BONES];
+		RMatrix target[R_MAX_BONES];
+	};
+
+	/** Advances and evaluates every registered RAnimationInstance on RThreadPool.
+		@remarks
+			Instances playing the same RBlendTree are kept next to each other so each task can
+			evaluate them as one batch.
+			With a camera set, each instance with bounds gets an RANIM_LOD tier every frame.
+			Reduced-rate instances are evaluated ahead, at the time of the frame before their next
+			evaluation, and their palettes are interpolated towards that result on the frames in
+			between, so they stay in time with full-rate ones. Evaluations are staggered across
+			frames. Culled instances only advance their clock and are evaluated afresh when they
+			come back into view. RGame runs this after its Update with its camera.
+	*/
+	class RAnimationSystem : public RSingleton<RAnimationSystem>
+	{
+	public:
+		RAnimationSystem();
+
+		RVOID Add(RAnimationInstance* Instance);
+		RVOID Remove(RAnimationInstance* Instance);
+		RVOID Update(RFLOAT ElapsedSeconds);
+		RINT GetInstanceCount() const { return (RINT)instances.size(); }
+
+		/** Camera for visibility and screen size; NULL updates everything every frame.
+			FieldOfView is the vertical angle in degrees, as passed to gluPerspective.
+		*/
+		RVOID SetCamera(const RCamera* Camera, RFLOAT FieldOfView = 45.0f, RFLOAT Aspect = 4.0f / 3.0f);
+		RVOID SetLODSettings(const RAnimationLODSettings& Settings) { settings = Settings; }
+		const RAnimationStats& GetStats() const { return stats; }
+
+	private:
+		RANIM_LOD SelectLOD(const RAnimationInstance& Instance) const;
+
+		std::vector<RAnimationInstance*> instances;
+		const RCamera* camera;
+		RFLOAT tanHalfFov;
+		RFLOAT cosCone, sinCone;
+		RAnimationLODSettings settings;
+		RAnimationStats stats;
+		RUINT frame;
+		RINT added;
+	};
+};
+
+#endif
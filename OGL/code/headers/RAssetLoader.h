@@ -0,0 +1,187 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RASSETLOADER_H
+#define RASSETLOADER_H
+
+#include "reactor.h"
+#include "RThreadPool.h"
+#include "RMeshFile.h"
+
+namespace Reactor
+{
+	typedef enum RASSET_TYPE
+	{
+		RASSET_TEXTURE		=	0x0000,
+		RASSET_MESH			=	0x0001
+	} RASSET_TYPE;
+
+	typedef enum RASSET_STATE
+	{
+		RASSET_QUEUED		=	0x0000,	// waiting for a worker
+		RASSET_DECODING		=	0x0001,	// file read and decode running on a worker
+		RASSET_DECODED		=	0x0002,	// CPU data ready, waiting for upload on the render thread
+		RASSET_RESIDENT		=	0x0003,	// GL objects created, CPU copy released
+		RASSET_FAILED		=	0x0004
+	} RASSET_STATE;
+
+	struct RMipLevel
+	{
+		RUINT offset;
+		RUINT size;
+		RINT width;
+		RINT height;
+	};
+
+	/** Decoded texture ready for glTexImage2D / glCompressedTexImage2D. */
+	struct RTextureData
+	{
+		RINT width;
+		RINT height;
+		GLenum internalFormat;
+		GLenum format;
+		GLenum type;
+		RBOOL compressed;
+		std::vector<RMipLevel> mips;
+		std::vector<unsigned char> pixels;
+	};
+
+	/** Decoded mesh streams ready for glBufferData. Either the vectors hold the data, or
+		mapping is set and the streams are uploaded straight from the mapped file.
+	*/
+	struct RMeshData
+	{
+		RUINT vertexStride;
+		RUINT vertexCount;
+		RUINT indexCount;
+		GLenum indexType;
+		std::vector<unsigned char> vertices;
+		std::vector<unsigned char> indices;
+		std::shared_ptr<RMeshFile> mapping;
+	};
+
+	class RAsset
+	{
+	public:
+		RAsset(const std::string& Path, RASSET_TYPE Type);
+
+		RASSET_STATE GetState() const { return (RASSET_STATE)state.load(); }
+		RBOOL IsResident() const { return GetState() == RASSET_RESIDENT; }
+		RBOOL IsFailed() const { return GetState() == RASSET_FAILED; }
+
+		std::string path;
+		RASSET_TYPE type;
+		std::string error;
+
+		// Valid once resident.
+		GLuint texture;
+		GLuint vertexBuffer;
+		GLuint indexBuffer;
+		RINT width, height;
+		RUINT vertexStride, vertexCount, indexCount;
+		GLenum indexType;
+		size_t residentBytes;	// GPU bytes charged to RMEM_TEXTURES or RMEM_MESHES
+		RUINT uploadSerial;
+
+		// Filled by the decoder, released after upload.
+		RTextureData textureData;
+		RMeshData meshData;
+
+		std::atomic<int> state;
+	};
+
+	typedef std::shared_ptr<RAsset> RAssetHandle;
+
+	/** Decodes a file's bytes into Asset.textureData or Asset.meshData. Runs on a worker thread. */
+	typedef std::function<RBOOL(const std::vector<unsigned char>& bytes, RAsset& Asset)> RAssetDecoder;
+
+	/** Decoder that opens the file itself, e.g. to memory-map it instead of reading it. */
+	typedef std::function<RBOOL(const std::string& Path, RAsset& Asset)> RAssetFileDecoder;
+
+	/** Loads textures and meshes without blocking the frame.
+		@remarks
+			Load() returns a handle immediately; the file is read and decoded on RThreadPool.
+			Decoded assets wait in a queue until PumpUploads() creates their GL objects on the
+			render thread, spending at most the configured time budget per call (at least one
+			asset is always uploaded so the queue drains). RGame pumps it once per frame; the
+			pump also deletes the GL objects of assets released since the last one.
+			DDS (DXT1/3/5, RGBA8/BGRA8), TGA (truecolor/grayscale, raw and RLE) and the native
+			.rmesh format (memory-mapped, see RMeshFile) are built in; other formats such as PNG
+			are added with RegisterDecoder.
+	*/
+	class RAssetLoader : public RSingleton<RAssetLoader>
+	{
+	public:
+		RAssetLoader();
+		~RAssetLoader();
+
+		RVOID RegisterDecoder(const std::string& Extension, RASSET_TYPE Type, const RAssetDecoder& Decoder);
+		RVOID RegisterFileDecoder(const std::string& Extension, RASSET_TYPE Type, const RAssetFileDecoder& Decoder);
+		RAssetHandle Load(const std::string& Path);
+		/** Blocks until Asset is decoded. On the render thread (the one calling PumpUploads,
+			or any thread before the first pump) it is then uploaded at once; elsewhere it is
+			moved to the front of the upload queue and becomes resident at the next pump.
+		*/
+		RVOID Wait(const RAssetHandle& Asset);
+		RVOID PumpUploads();
+		RVOID SetUploadBudget(RFLOAT Milliseconds);
+		RINT GetPendingCount();
+
+		/** Drops the asset from the cache. Safe on any thread: the GL objects are handed to
+			the next PumpUploads, which deletes them on the render thread.
+		*/
+		RVOID Release(const RAssetHandle& Asset);
+
+		/** Releases resident assets of Type that only the loader still references, oldest
+			first, until Bytes have been freed. Returns the bytes freed. Registered as the
+			RMEM_TEXTURES and RMEM_MESHES evictor, so budgets set on those tags are enforced.
+		*/
+		size_t Evict(RASSET_TYPE Type, size_t Bytes);
+
+	private:
+		RVOID Decode(RAssetHandle Asset);
+		RVOID Upload(RAsset& Asset);
+
+		struct RDecoderEntry
+		{
+			RASSET_TYPE type;
+			RAssetDecoder decoder;
+			RAssetFileDecoder fileDecoder;
+		};
+
+		std::map<std::string, RDecoderEntry> decoders;
+		std::map<std::string, RAssetHandle> assets;
+		std::deque<RAssetHandle> uploads;
+		std::vector<GLuint> deadTextures;		// released, waiting for PumpUploads to delete them
+		std::vector<GLuint> deadBuffers;
+		std::mutex lock;
+		std::condition_variable decoded;
+		std::thread::id renderThread;			// last caller of PumpUploads
+		std::atomic<int> pending;
+		RFLOAT uploadBudget;
+		RUINT uploadSerial;
+	};
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef RBLENDTREE_H
+#define RBLENDTREE_H
+
+#include "reactor.h"
+#include "RAnimation.h"
+
+namespace Reactor
+{
+	/** Largest number of inputs a single blend space node may have. */
+	#define R_BLEND_MAX_SPACE	16
+
+	typedef enum RBLEND_OP
+	{
+		RBLEND_CLIP			=	0x0000,	// sample a clip
+		RBLEND_LERP			=	0x0001,	// a -> b by weight
+		RBLEND_ADDITIVE		=	0x0002,	// a + weight * (b - reference)
+		RBLEND_LAYER		=	0x0003,	// a -> b by weight * per-bone mask
+		RBLEND_SPACE1D		=	0x0004,	// weighted sum of inputs placed on a line
+		RBLEND_SPACE2D		=	0x0005	// weighted sum of inputs placed on a plane
+	} RBLEND_OP;
+
+	/** Blend graph shared by every character that uses it.
+		@remarks
+			Nodes are added with the Add* calls, which return a node id to feed into later nodes.
+			Weights come from named parameters that each RAnimationInstance sets, or from a
+			constant when no parameter is given (-1); register parameters before the nodes
+			that use them, other indices are rejected. Compile() flattens the graph reachable from
+			the output into an instruction list with a small register file of poses, reusing a
+			register as soon as its last reader has run.
+			Evaluate() runs that list instruction by instruction over a batch of instances, so a
+			crowd sharing one tree pays for the dispatch once per batch and reads each clip while
+			it is still in cache. RAnimationSystem groups instances by tree for this.
+			Clips inside a tree sample at the instance time times their rate, looped; give
+			locomotion cycles rates that make their lengths match.
+	*/
+	class RBlendTree
+	{
+	public:
+		RBlendTree(const RSkeleton* Skeleton);
+
+		RINT AddParameter(const std::string& Name, RFLOAT Default = 0.0f);
+		RINT FindParameter(const std::string& Name) const;
+		RINT GetParameterCount() const { return (RINT)defaults.size(); }
+		const std::vector<RFLOAT>& GetDefaults() const { return defaults; }
+
+		/** Per-bone weights for RBLEND_LAYER: Weight on Root and its descendants, 0 elsewhere. */
+		RINT AddMask(RINT Root, RFLOAT Weight = 1.0f);
+
+		RINT AddClip(const RAnimationClip* Clip, RFLOAT Rate = 1.0f);
+		RINT AddLerp(RINT A, RINT B, RINT Parameter, RFLOAT Weight = 0.5f);
+		/** Adds the difference between Additive and Reference's first frame on top of Base. */
+		RINT AddAdditive(RINT Base, RINT Additive, const RAnimationClip* Reference, RINT Parameter, RFLOAT Weight = 1.0f);
+		RINT AddLayer(RINT Base, RINT Layer, RINT Mask, RINT Parameter, RFLOAT Weight = 1.0f);
+		/** Inputs[i] sits at Positions[i] on the line; the two around the parameter blend. */
+		RINT AddBlendSpace1D(RINT Parameter, const std::vector<RINT>& Inputs, const std::vector<RFLOAT>& Positions);
+		/** Inputs[i] sits at (Positions[2i], Positions[2i+1]); weights fall off with the squared distance. */
+		RINT AddBlendSpace2D(RINT ParameterX, RINT ParameterY, const std::vector<RINT>& Inputs, const std::vector<RFLOAT>& Positions);
+
+		RVOID SetOutput(RINT Node) { output = Node; compiled = false; }
+		RRESULT Compile();
+
+		RINT GetInstructionCount() const { return (RINT)program.size(); }
+		RINT GetRegisterCount() const { return registerCount; }
+
+		/** Writes the pose of each instance. All instances must be playing this tree. */
+		RVOID Evaluate(RAnimationInstance* const* Instances, RINT Count) const;
+
+	private:
+		struct RBlendNode
+		{
+			RBLEND_OP op;
+			RINT inputs[2];
+			RINT parameter[2];
+			RFLOAT weight;
+			RINT data;		// clip, mask, reference pose or first space input
+			RINT count;		// space inputs
+		};
+
+		struct RBlendInstruction
+		{
+			RBLEND_OP op;
+			RINT target;	// register, or -1 for the instance pose
+			RINT source[2];
+			RINT parameter[2];
+			RFLOAT weight;
+			RINT data;
+			RINT count;
+		};
+
+		RINT AddNode(const RBlendNode& Node);
+		/** -1 (constant weight) or a registered parameter; Evaluate reads it unchecked. */
+		RBOOL IsParameter(RINT Parameter) const { return Parameter >= -1 && Parameter < GetParameterCount(); }
+		RVOID Visit(RINT Node, std::vector<RINT>& Order, std::vector<RBOOL>& Visited) const;
+		/** The distinct nodes Node reads into Out; one wired to both inputs is listed once. */
+		RVOID Sources(const RBlendNode& Node, std::vector<RINT>& Out) const;
+		RINT SpaceWeights(const RBlendInstruction& Instruction, const RFLOAT* Parameters, RFLOAT* Weights, RINT* Slots) const;
+
+		const RSkeleton* skeleton;
+		RINT lanes;
+		std::vector<std::string> names;
+		std::vector<RFLOAT> defaults;
+		std::vector<RBlendNode> nodes;
+		std::vector<const RAnimationClip*> clips;
+		std::vector<RFLOAT> rates;
+		std::vector<RFLOAT> masks;				// R_POSE_STRIDE per mask
+		std::vector<RPose> references;
+		std::vector<RINT> spaceInputs;			// node ids, remapped to registers by Compile
+		std::vector<RFLOAT> spacePositions;		// two per space input
+		std::vector<RINT> spaceRegisters;
+		std::vector<RBlendInstruction> program;
+		RINT registerCount;
+		RINT output;
+		RBOOL compiled;
+	};
+};
+
+#endif
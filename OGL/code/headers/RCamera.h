@@ -41,6 +41,7 @@ namespace Reactor
 
 		RMatrix ViewMatrix;
 		RDOUBLE RotatedX, RotatedY, RotatedZ;	
+		RFLOAT FieldOfView;
 	
 	public:
 		RCamera();				//inits the values (Position: (0|0|0) Target: (0|0|-1) )
@@ -52,15 +53,22 @@ namespace Reactor
 		void RotateX ( RDOUBLE Angle );
 		void RotateY ( RDOUBLE Angle );
 		void RotateZ ( RDOUBLE Angle );
-		const RVector3& GetLookAt();
-		const RVector3& GetViewDir();
+		RVector3 GetLookAt();
+		RVector3 GetViewDir();
 		void MoveForward ( RDOUBLE Distance );
 		void MoveUpward ( RDOUBLE Distance );
 		void StrafeRight ( RDOUBLE Distance );
 
+		const RVector3& GetPosition() const { return Position; }
+		const RVector3& GetDirection() const { return ViewDir; }
+
 		void SetViewMatrix( const RMatrix& View );
 		const RMatrix& GetViewMatrix();
 
+		//Vertical field of view in degrees (45 by default), used by the projection and animation LOD
+		void SetFieldOfView( RFLOAT Degrees ) { FieldOfView = Degrees; }
+		RFLOAT GetFieldOfView() const { return FieldOfView; }
+
 
 	};
 };
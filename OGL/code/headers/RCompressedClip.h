@@ -0,0 +1,145 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RCOMPRESSEDCLIP_H
+#define RCOMPRESSEDCLIP_H
+
+#include "reactor.h"
+#include "RAnimation.h"
+
+namespace Reactor
+{
+	#define RCLIP_MAGIC		0x4D4E4152	// "RANM"
+	#define RCLIP_VERSION	1
+
+	typedef enum RCLIP_TRACK
+	{
+		RCLIP_ROTATION		=	0x0000,
+		RCLIP_TRANSLATION	=	0x0001,
+		RCLIP_SCALE			=	0x0002,
+		RCLIP_TRACK_COUNT	=	0x0003
+	} RCLIP_TRACK;
+
+	/** One quantized key (12 bytes).
+		@remarks
+			Rotations are smallest-three: the largest component is dropped (its index sits in the
+			top bits of track) and the other three are stored in 16 bits each. Translation and
+			scale are 16 bits per component inside the bone's range. need is the frame at which
+			playback first interpolates towards this key, i.e. the previous key's frame on the
+			same track; the stream is sorted by need, then bone, then track.
+	*/
+	struct RClipKey
+	{
+		uint16_t frame;
+		uint16_t need;
+		uint8_t bone;
+		uint8_t track;		// RCLIP_TRACK in bits 0-1, dropped rotation component in bits 2-3
+		uint16_t value[3];
+	};
+
+	struct RClipRange
+	{
+		RFLOAT minimum[3];
+		RFLOAT extent[3];
+	};
+
+	struct RClipCompressionSettings
+	{
+		RClipCompressionSettings() : rotationTolerance(0.0005f), translationTolerance(0.0005f), scaleTolerance(0.0005f) {}
+
+		RFLOAT rotationTolerance;		// radians
+		RFLOAT translationTolerance;	// model units
+		RFLOAT scaleTolerance;
+	};
+
+	/** Animation clip compressed for storage and streaming playback.
+		@remarks
+			Compress() takes a resampled RAnimationClip, drops every key that linear
+			interpolation between its kept neighbours reproduces within the tolerances, then
+			quantizes the rest. Keys are laid out in the order playback needs them, so an
+			RClipDecoder reads the stream strictly forwards.
+	*/
+	class RCompressedClip
+	{
+	public:
+		RCompressedClip();
+
+		RRESULT Compress(const RAnimationClip& Clip, const RClipCompressionSettings& Settings = RClipCompressionSettings());
+		RRESULT Save(const std::string& Path) const;
+		RRESULT Load(const std::string& Path);
+
+		RFLOAT GetDuration() const { return duration; }
+		RFLOAT GetSampleRate() const { return sampleRate; }
+		RINT GetBoneCount() const { return boneCount; }
+		RUINT GetKeyCount() const { return (RUINT)keys.size(); }
+		const RClipKey* GetKeys() const { return keys.empty() ? NULL : &keys[0]; }
+		const RClipRange& GetRange(RINT Bone, RCLIP_TRACK Track) const { return ranges[Bone * 2 + (Track == RCLIP_SCALE ? 1 : 0)]; }
+
+		/** Bytes used by the keys and ranges. */
+		size_t GetMemorySize() const;
+
+		/** Dequantizes a key into x, y, z (and w for rotations). */
+		RVOID Decode(const RClipKey& Key, RFLOAT* Out) const;
+
+	private:
+		RBOOL ValidateKeys(RUINT BoneCount) const;
+
+		RTaggedVector<RClipKey, RMEM_ANIMATION> keys;
+		RTaggedVector<RClipRange, RMEM_ANIMATION> ranges;	// translation and scale range per bone
+		RFLOAT duration;
+		RFLOAT sampleRate;
+		RINT boneCount;
+	};
+
+	/** Per-instance playback state for an RCompressedClip.
+		@remarks
+			Holds the two keys around the current time for every track and a cursor into the
+			key stream. Moving forward only decodes the keys that became needed; moving backward
+			(a loop wrapping around) restarts from the beginning of the stream.
+	*/
+	class RClipDecoder
+	{
+	public:
+		RClipDecoder();
+
+		RVOID Reset(const RCompressedClip* Clip);
+		RVOID Sample(RFLOAT Time, RBOOL Loop, RPose& Out);
+
+	private:
+		struct RTrackWindow
+		{
+			RFLOAT frame[2];
+			RFLOAT value[2][4];
+		};
+
+		RVOID Rewind();
+
+		const RCompressedClip* clip;
+		RUINT cursor;
+		RFLOAT lastFrame;
+		RTrackWindow tracks[R_MAX_BONES][RCLIP_TRACK_COUNT];
+	};
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RDEPTHSORT_H
+#define RDEPTHSORT_H
+
+#include "reactor.h"
+
+namespace Reactor
+{
+	struct RDepthSortStats
+	{
+		RUINT count;
+		RUINT passes;		// radix passes actually run (passes whose digit is constant are skipped)
+		RUINT descents;		// out-of-order neighbours found in last frame's order
+		RBOOL coherent;		// last frame's order was reused (possibly after an insertion fix-up)
+	};
+
+	/** Back-to-front ordering for alpha-blended geometry.
+		@remarks
+			Depths are quantized to SetKeyBits() bits between the nearest and farthest element
+			and sorted with an LSD radix sort, 8 bits per pass; histogram and scatter passes are
+			split across RThreadPool. Keys and the radix ping-pong buffers are frame scratch
+			(RFrameArena) that only lives for the call; the order is kept between calls, so once
+			Reserve() (or the first frame) has sized it, sorting does not touch the heap.
+			When the same elements are sorted again, last frame's order is checked first: if it is
+			still sorted it is returned as is, and if only a few neighbours are out of order
+			(SetCoherence(), as a fraction of the count) an insertion sort repairs it instead.
+	*/
+	class RDepthSorter
+	{
+	public:
+		RDepthSorter();
+
+		RVOID Reserve(RUINT Count);
+		RVOID SetKeyBits(RUINT Bits);
+		RVOID SetCoherence(RFLOAT Tolerance);
+
+		/** Forgets last frame's order, e.g. when the element set changed. */
+		RVOID Invalidate() { previousCount = 0; }
+
+		/** Returns indices of Depths ordered from the largest depth to the smallest. */
+		const RUINT* Sort(const RFLOAT* Depths, RUINT Count);
+
+		/** Same as Sort() with depth measured along ViewDir from Eye, for SoA positions. */
+		const RUINT* SortBackToFront(const RFLOAT* X, const RFLOAT* Y, const RFLOAT* Z, RUINT Count,
+									 const RVector3& Eye, const RVector3& ViewDir);
+
+		const RUINT* GetOrder() const { return order.empty() ? NULL : &order[0]; }
+		const RDepthSortStats& GetStats() const { return stats; }
+
+	private:
+		RVOID Quantize(const RFLOAT* Depths, RUINT Count);
+		RBOOL SortCoherent(RUINT Count);
+		RVOID SortRadix(RUINT Count);
+
+		RTaggedVector<RUINT, RMEM_RENDER> order;
+		uint32_t* keys;				// frame scratch, only set inside Sort
+		RUINT* histograms;
+		RFLOAT* ranges;
+		RUINT chunks;
+		RUINT chunkSize;
+		RUINT keyBits;
+		RFLOAT tolerance;
+		RUINT previousCount;
+		RDepthSortStats stats;
+	};
+
+	/** Alpha-blended draws collected during a frame and issued back-to-front.
+		@remarks
+			Add() each transparent object's centre with an id the renderer understands, Sort()
+			once the camera is known, then draw GetDrawId(0 .. GetCount()-1). Clear() keeps the
+			storage, and adding the same draws in the same order lets the sorter reuse last
+			frame's order.
+	*/
+	class RTransparentQueue
+	{
+	public:
+		RTransparentQueue();
+
+		RVOID Clear();
+		RVOID Add(const RVector3& Center, RUINT DrawId);
+		RVOID Sort(const RVector3& Eye, const RVector3& ViewDir);
+
+		RUINT GetCount() const { return (RUINT)ids.size(); }
+		RUINT GetDrawId(RUINT Index) const { return ids[order ? order[Index] : Index]; }
+		RDepthSorter& GetSorter() { return sorter; }
+
+	private:
+		RTaggedVector<RFLOAT, RMEM_RENDER> x, y, z;
+		RTaggedVector<RUINT, RMEM_RENDER> ids;
+		RDepthSorter sorter;
+		const RUINT* order;
+	};
+};
+
+#endif
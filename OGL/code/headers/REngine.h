@@ -27,29 +27,82 @@ THE SOFTWARE.
 
 #include "reactor.h"
 #include "RScene.h"
+#include "RMemoryTracker.h"
 
 namespace Reactor
 {
+	/** How many frames the CPU may queue ahead of the GPU before RenderToScreen blocks. */
+	typedef enum RFRAME_LATENCY_MODE
+	{
+		RLATENCY_THROUGHPUT		=	0x0000,	// wait on the oldest fence only when every slot is in flight
+		RLATENCY_LOW			=	0x0001	// wait on the previous frame's fence right before input is sampled
+	} RFRAME_LATENCY_MODE;
+
+	#define R_MAX_FRAMES_IN_FLIGHT 4
+
+	/** Frame pacing counters, all times in milliseconds and averaged over the last second. */
+	struct RFrameStats
+	{
+		RFLOAT cpuFrameTime;	// wall time between two RenderToScreen calls
+		RFLOAT fenceWaitTime;	// time the CPU spent blocked on GPU fences
+		RFLOAT overlap;			// fraction of the frame the CPU ran while the GPU was busy (0..1)
+		RFLOAT latency;			// time from input sampling to the frame's fence being signalled
+		RINT framesInFlight;	// fences currently outstanding
+	};
 
 	class REngine : public RSingleton<REngine>
 	{
 	private:
 		bool _fullscreen;
 		RColor clearColor;
-		int window;
+
+		RFRAME_LATENCY_MODE latencyMode;
+		RINT maxFramesInFlight;
+		RBOOL adaptiveVSync;
+		RINT swapInterval;
+		void* fences[R_MAX_FRAMES_IN_FLIGHT];
+		double fenceInputTime[R_MAX_FRAMES_IN_FLIGHT];
+		RINT fenceHead;
+		RINT fenceCount;
+		double inputTime;
+		double lastPresentTime;
+		RFrameStats stats;
+		RFrameStats accum;
+		RINT accumFrames;
+		double accumStart;
+
+		void WaitForFence(RINT slot);
+		void RetireFences();
 		
 	public:
-		const RECT& GetScreenSize();
-		void Init3DWindowed(const char* title, RECT &rect);
-		void Init3DFullscreen(const char* title, RINT width, RINT height, RINT color, RINT depth);
+		REngine();
+		RECT GetScreenSize();
+		/** Open the window and its GL context; fail with the platform's error if it cannot be created. */
+		RRESULT Init3DWindowed(const char* title, RECT &rect);
+		RRESULT Init3DFullscreen(const char* title, RINT width, RINT height, RINT color, RINT depth);
 		void Init3DNoRender();
 		void ToggleFullscreen();
 		void DisplayFPS(RBOOL display, RColor color = RColor(1,1,1,1));
         float GetFPS();
-		void OnResize(RINT width, RINT height);
+		void OnResize(RINT width, RINT height, RFLOAT fieldOfView = 45.0f);
 		void Clear(RBOOL DepthOnly = false);
 		void RenderToScreen();
 		void DestroyAll();
+
+		void SetFrameLatency(RFRAME_LATENCY_MODE mode, RINT framesInFlight = 2);
+		RFRAME_LATENCY_MODE GetFrameLatencyMode();
+		void SetVSync(RINT interval, RBOOL adaptive = false);
+		void WaitForFrameLatency();
+		const RFrameStats& GetFrameStats();
+
+		/** Memory accounting per subsystem, see RMemoryTracker. A budget of 0 disables it;
+			textures and meshes over budget are evicted by RAssetLoader at the end of the frame.
+		*/
+		RMemoryTagStats GetMemoryStats(RMEMORY_TAG tag);
+		void SetMemoryBudget(RMEMORY_TAG tag, size_t bytes);
+		std::string GetMemoryReportJSON();
+		/** Writes GetMemoryReportJSON() to path; R_INVALIDARG if it cannot be written. */
+		RRESULT DumpMemoryReport(const char* path);
 		
 	};
 };
@@ -0,0 +1,396 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef RENTITYWORLD_H
+#define RENTITYWORLD_H
+
+#include "reactor.h"
+#include "RPool.h"
+#include "RNode.h"
+#include "RMemory.h"
+#include "RThreadPool.h"
+#include <type_traits>
+
+namespace Reactor
+{
+	#define R_ENTITY_CHUNK_SIZE		(16 * 1024)
+	#define R_MAX_COMPONENTS		64
+	#define R_MAX_COMPONENT_ALIGN	16
+
+	class RScene;
+	struct REntityRecord;
+	struct RArchetype;
+
+	/** Entity id: the same 20-bit index / 12-bit generation handle as RPool. A handle
+		with generation 0 is a placeholder created by an RCommandBuffer.
+	*/
+	typedef RHandle<REntityRecord> REntity;
+
+	/** Bit i is set for component type id i. */
+	typedef uint64_t RComponentMask;
+
+	/** Registry of component types. Ids are handed out on first use, in any order, so
+		do not persist them.
+	*/
+	class RComponentRegistry
+	{
+	public:
+		static RUINT Register(size_t Size, size_t Alignment);
+		static size_t GetSize(RUINT Id);
+		static size_t GetAlignment(RUINT Id);
+		static RUINT GetCount();
+	};
+
+	/** Components are plain data: chunks move them with memcpy and never run their
+		constructors or destructors.
+	*/
+	template<class T> struct RComponentType
+	{
+		static RUINT Id()
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "components must be trivially copyable");
+			static_assert(alignof(T) <= R_MAX_COMPONENT_ALIGN, "component alignment is limited to 16 bytes");
+			static const RUINT id = RComponentRegistry::Register(sizeof(T), alignof(T));
+			return id;
+		}
+		static RComponentMask Mask() { return (RComponentMask)1 << Id(); }
+	};
+
+	template<class... C> inline RComponentMask RComponentMaskOf()
+	{
+		RComponentMask mask = 0;
+		int expand[] = { 0, (mask |= RComponentType<C>::Mask(), 0)... };
+		(void)expand;
+		return mask;
+	}
+
+	/** RNode interop: the transform of an entity mirrored from / to a scene node. */
+	struct RTransform
+	{
+		RAffine3x4 local;
+		RAffine3x4 world;
+	};
+
+	struct RNodeRef
+	{
+		RNodeHandle node;
+	};
+
+	struct REntityRecord
+	{
+		RArchetype* archetype;
+		RUINT chunk;
+		RUINT row;
+	};
+
+	struct RChunk
+	{
+		RBYTE* data;	// R_ENTITY_CHUNK_SIZE bytes: the REntity column, then one column per component
+		RUINT count;
+	};
+
+	/** Every entity with exactly the same set of components. Rows are packed: all chunks
+		are full except the last, so a chunk walk touches only live data.
+	*/
+	struct RArchetype
+	{
+		RComponentMask mask;
+		RUINT rowsPerChunk;
+		RUINT offsets[R_MAX_COMPONENTS];	// column offset within a chunk, ~0u when absent
+		std::vector<RUINT> components;
+		std::vector<RChunk> chunks;
+		RArchetype* addEdge[R_MAX_COMPONENTS];	// archetype reached by adding / removing a component
+		RArchetype* removeEdge[R_MAX_COMPONENTS];
+		RUINT count;
+	};
+
+	/** One chunk as seen by a system: Get<T>() is the column of T, GetCount() rows long. */
+	class RChunkView
+	{
+	public:
+		RUINT GetCount() const { return count; }
+		const REntity* GetEntities() const { return (const REntity*)data; }
+
+		/** NULL if the chunk's archetype does not have T. */
+		template<class T> T* Get() const
+		{
+			RUINT offset = archetype->offsets[RComponentType<T>::Id()];
+			return offset == ~0u ? NULL : (T*)(data + offset);
+		}
+
+	private:
+		friend class REntityWorld;
+		RArchetype* archetype;
+		RBYTE* data;
+		RUINT count;
+	};
+
+	/** Entities with every component of all and none of none. Created and owned by the
+		world; the list of matching archetypes only grows and is brought up to date from
+		the archetypes added since the last use, so a query never rescans the whole world.
+	*/
+	class RQuery
+	{
+	public:
+		RComponentMask GetAll() const { return all; }
+		RComponentMask GetNone() const { return none; }
+		const std::vector<RArchetype*>& GetArchetypes() const { return archetypes; }
+
+	private:
+		friend class REntityWorld;
+		RComponentMask all;
+		RComponentMask none;
+		std::vector<RArchetype*> archetypes;
+		size_t scanned;
+	};
+
+	/** Structural changes recorded for later, e.g. from inside a parallel system.
+		@remarks
+			Create returns a placeholder that Add, Remove and Destroy in the same buffer
+			accept; REntityWorld::Playback replaces it with the real entity. Recording
+			takes a lock, so several jobs may share a buffer. Commands run in the order
+			they were recorded.
+	*/
+	class RCommandBuffer
+	{
+	public:
+		RCommandBuffer();
+
+		REntity Create();
+		RVOID Destroy(REntity Entity);
+
+		template<class T> RVOID Add(REntity Entity, const T& Value = T())
+		{
+			Record(RCOMMAND_ADD, Entity, RComponentType<T>::Id(), &Value, sizeof(T));
+		}
+
+		template<class T> RVOID Remove(REntity Entity)
+		{
+			Record(RCOMMAND_REMOVE, Entity, RComponentType<T>::Id(), NULL, 0);
+		}
+
+		RBOOL IsEmpty() const { return stream.empty(); }
+		RVOID Clear();
+
+	private:
+		friend class REntityWorld;
+		typedef enum RCOMMAND_TYPE
+		{
+			RCOMMAND_CREATE		=	0x0000,
+			RCOMMAND_DESTROY	=	0x0001,
+			RCOMMAND_ADD		=	0x0002,
+			RCOMMAND_REMOVE		=	0x0003
+		} RCOMMAND_TYPE;
+
+		struct RCommand
+		{
+			uint32_t type;
+			REntity entity;
+			uint32_t component;
+			uint32_t size;	// bytes of component data following the command, padded to 16
+		};
+
+		RVOID Record(RCOMMAND_TYPE Type, REntity Entity, RUINT Component, const RVOID* Data, size_t Size);
+
+		std::vector<RBYTE> stream;
+		RUINT created;
+		std::mutex lock;
+	};
+
+	/** Archetype entity component system.
+		@remarks
+			Components of an archetype are stored column by column (SoA) in 16 KB chunks,
+			so a system reads each component it needs as one contiguous array. Adding or
+			removing a component moves the entity to another archetype; removal fills the
+			hole with the last row so chunks stay packed. Structural changes fail with
+			R_INVALIDARG while a ForEach is running; record them in an RCommandBuffer and
+			Playback it afterwards. Get on an entity is allowed at any time.
+			RNode interop: CreateFromNode gives an entity an RNodeRef and an RTransform.
+			PushTransforms copies RTransform::local into the nodes before
+			RScene::UpdateTransforms, PullTransforms copies the resulting world matrices back.
+	*/
+	class REntityWorld
+	{
+	public:
+		REntityWorld();
+		~REntityWorld();
+
+		REntity Create();
+
+		template<class... C> REntity Create(const C&... Components)
+		{
+			REntity entity = CreateIn(GetArchetype(RComponentMaskOf<C...>()));
+			if(!entity.IsNull()){
+				int expand[] = { 0, (*Get<C>(entity) = Components, 0)... };
+				(void)expand;
+			}
+			return entity;
+		}
+
+		/** Returns false for a stale entity or while iterating. */
+		RBOOL Destroy(REntity Entity);
+		RBOOL IsAlive(REntity Entity) const { return records.IsValid(Entity); }
+		RUINT GetCount() const { return records.GetCount(); }
+
+		/** Adds T, or overwrites it if the entity already has one. */
+		template<class T> RRESULT Add(REntity Entity, const T& Value = T())
+		{
+			return AddComponent(Entity, RComponentType<T>::Id(), &Value);
+		}
+
+		template<class T> RRESULT Remove(REntity Entity)
+		{
+			return RemoveComponent(Entity, RComponentType<T>::Id());
+		}
+
+		/** NULL if the entity is stale or has no T. Valid until the next structural change. */
+		template<class T> T* Get(REntity Entity)
+		{
+			const REntityRecord* record = records.Get(Entity);
+			if(record == NULL)
+				return NULL;
+			RUINT offset = record->archetype->offsets[RComponentType<T>::Id()];
+			if(offset == ~0u)
+				return NULL;
+			return (T*)(record->archetype->chunks[record->chunk].data + offset) + record->row;
+		}
+
+		template<class T> RBOOL Has(REntity Entity)
+		{
+			return Get<T>(Entity) != NULL;
+		}
+
+		/** Cached query for entities with all of C... */
+		template<class... C> RQuery* Query()
+		{
+			return Query(RComponentMaskOf<C...>(), 0);
+		}
+		RQuery* Query(RComponentMask All, RComponentMask None);
+
+		/** Calls Function(const RChunkView&) for every non-empty chunk matching Query. */
+		template<class F> RVOID ForEachChunk(RQuery* Query, const F& Function)
+		{
+			Refresh(Query);
+			++iterating;
+			for(size_t a=0; a<Query->archetypes.size(); a++){
+				RArchetype* archetype = Query->archetypes[a];
+				for(size_t c=0; c<archetype->chunks.size(); c++){
+					RChunkView view = View(archetype, (RUINT)c);
+					Function(view);
+				}
+			}
+			--iterating;
+		}
+
+		/** Like ForEachChunk, with the chunks spread over RThreadPool. Function must only
+			write to the rows of the chunk it is given.
+		*/
+		template<class F> RVOID ParallelForEachChunk(RQuery* Query, const F& Function)
+		{
+			Refresh(Query);
+			RScratchScope scratch;
+			RFrameVector<RChunkView> jobs;
+			for(size_t a=0; a<Query->archetypes.size(); a++)
+				for(size_t c=0; c<Query->archetypes[a]->chunks.size(); c++)
+					jobs.push_back(View(Query->archetypes[a], (RUINT)c));
+			if(jobs.empty())
+				return;
+			++iterating;
+			RThreadPool::Instance()->ParallelFor((RINT)jobs.size(), 1, [&](RINT begin, RINT end){
+				for(RINT i=begin; i<end; i++)
+					Function(jobs[i]);
+			});
+			--iterating;
+		}
+
+		/** Calls Function(REntity, C&...) for every entity that has all of C... */
+		template<class... C, class F> RVOID ForEach(const F& Function)
+		{
+			ForEachChunk(Query<C...>(), [&](const RChunkView& view){
+				Rows<F, C...>(Function, view.GetEntities(), view.GetCount(), view.template Get<C>()...);
+			});
+		}
+
+		template<class... C, class F> RVOID ParallelForEach(const F& Function)
+		{
+			ParallelForEachChunk(Query<C...>(), [&](const RChunkView& view){
+				Rows<F, C...>(Function, view.GetEntities(), view.GetCount(), view.template Get<C>()...);
+			});
+		}
+
+		/** Applies and clears Buffer. Fails while iterating. */
+		RRESULT Playback(RCommandBuffer& Buffer);
+
+		/** Entity mirroring Node, with RNodeRef and RTransform set from it. */
+		REntity CreateFromNode(RScene& Scene, RNodeHandle Node);
+		RVOID PushTransforms(RScene& Scene);
+		RVOID PullTransforms(RScene& Scene);
+
+		RUINT GetArchetypeCount() const { return (RUINT)archetypes.size(); }
+		RUINT GetChunkCount() const;
+
+		/** Destroys every entity and frees the chunks. Archetypes and queries are kept, so
+			RQuery pointers stay valid.
+		*/
+		RVOID Clear();
+
+	private:
+		REntityWorld(const REntityWorld&);
+		REntityWorld& operator=(const REntityWorld&);
+
+		template<class F, class... C> static RVOID Rows(const F& Function, const REntity* Entities, RUINT Count, C*... Columns)
+		{
+			for(RUINT i=0; i<Count; i++)
+				Function(Entities[i], Columns[i]...);
+		}
+
+		RChunkView View(RArchetype* Archetype, RUINT Chunk) const
+		{
+			RChunkView view;
+			view.archetype = Archetype;
+			view.data = Archetype->chunks[Chunk].data;
+			view.count = Archetype->chunks[Chunk].count;
+			return view;
+		}
+
+		RArchetype* GetArchetype(RComponentMask Mask);
+		REntity CreateIn(RArchetype* Archetype);
+		RRESULT AddComponent(REntity Entity, RUINT Component, const RVOID* Value);
+		RRESULT RemoveComponent(REntity Entity, RUINT Component);
+		RBOOL Move(REntity Entity, RArchetype* Target);
+		RBOOL AllocateRow(RArchetype* Archetype, REntity Entity, REntityRecord* Record);
+		RVOID FreeRow(const REntityRecord& Record);
+		RVOID Refresh(RQuery* Query);
+
+		RPool<REntityRecord> records;
+		std::vector<RArchetype*> archetypes;
+		std::map<RComponentMask, RArchetype*> archetypeMap;
+		std::vector<RQuery*> queries;
+		std::vector<REntity> placeholders;
+		RINT iterating;
+	};
+};
+
+#endif
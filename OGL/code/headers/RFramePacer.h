@@ -0,0 +1,118 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef RFRAMEPACER_H
+#define RFRAMEPACER_H
+
+#include "reactor.h"
+
+namespace Reactor
+{
+	/** What the game loop is doing, from most to least demanding. */
+	typedef enum RFRAME_STATE
+	{
+		RFRAME_FOCUSED		=	0x0000,
+		RFRAME_UNFOCUSED	=	0x0001,
+		RFRAME_PAUSED		=	0x0002,	// RGame::SetPaused
+		RFRAME_MINIMIZED	=	0x0003,	// window hidden
+		RFRAME_STATE_COUNT	=	0x0004
+	} RFRAME_STATE;
+
+	#define R_FRAMERATE_UNLIMITED	0.0f	// as fast as the swap interval allows
+	#define R_FRAMERATE_ON_DEMAND	-1.0f	// only when input arrives, the window changes or RGame::RequestRedraw is called
+	#define R_ON_DEMAND_WAIT		250.0	// ms the loop blocks at a time waiting for such an event
+
+	/** Pacing over the last second, times in milliseconds. */
+	struct RFramePacingStats
+	{
+		RFRAME_STATE state;
+		RFLOAT target;		// frame interval aimed for, 0 when unlimited or on demand
+		RFLOAT interval;	// average time between frame starts
+		RFLOAT jitter;		// RMS deviation of the interval from the target (or from the average)
+		RFLOAT maxError;	// largest deviation
+		RFLOAT sleep;		// average per frame spent asleep
+		RFLOAT spin;		// average per frame spent spinning after waking
+		RFLOAT oversleep;	// how late the OS woke us, on average
+		RFLOAT spinMargin;	// current wake-up margin left for spinning
+		RUINT frames;		// frames per second
+		RUINT idleWaits;	// on-demand waits that ended without a frame
+	};
+
+	/** Frame rate limiter for RGame's loop.
+		@remarks
+			Every state has its own target (frames per second, or one of the
+			R_FRAMERATE_ constants). Waits sleep through RPlatform::WaitEvents, so events
+			are still pumped, until SpinMargin before the deadline and spin-yield the rest:
+			OS sleeps wake late by a timer tick or more, spinning the last stretch does not.
+			The margin follows the oversleep actually observed, so it is small where timers
+			are precise and grows where they are not. A frame that falls more than one
+			interval behind resets the schedule instead of running a burst to catch up.
+	*/
+	class RFramePacer
+	{
+	public:
+		RFramePacer();
+
+		RVOID SetTarget(RFRAME_STATE State, RFLOAT FramesPerSecond);
+		RFLOAT GetTarget(RFRAME_STATE State) const { return targets[State]; }
+
+		/** Blocks until the next frame of State is due; returns false if, being on
+			demand, there was nothing to draw (the caller should loop and ask again).
+			HasWork is whether anything happened since the last frame.
+		*/
+		RBOOL Wait(RFRAME_STATE State, RBOOL HasWork);
+
+		/** Records that a frame starts now. */
+		RVOID BeginFrame();
+
+		const RFramePacingStats& GetStats() const { return stats; }
+
+	private:
+		RVOID SleepUntil(double Deadline);
+		RVOID Roll(double Now);
+
+		RFLOAT targets[RFRAME_STATE_COUNT];
+		RFRAME_STATE state;
+		double lastFrame;
+		double nextFrame;
+		double spinMargin;
+		double oversleepPeak;	// decaying maximum of recent oversleeps
+
+		double windowStart;
+		double sumInterval;
+		double sumInterval2;
+		double maxError;
+		double sumSleep;
+		double sumSpin;
+		double sumOversleep;
+		RUINT sleeps;
+		RUINT frames;
+		RUINT intervals;		// frame-to-frame gaps in sumInterval; fewer than frames
+		RUINT idleWaits;
+		RFramePacingStats stats;
+	};
+};
+
+#endif
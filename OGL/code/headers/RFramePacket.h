@@ -0,0 +1,177 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef RFRAMEPACKET_H
+#define RFRAMEPACKET_H
+
+#include "reactor.h"
+#include "RMemoryTracker.h"
+#include <mutex>
+#include <condition_variable>
+
+namespace Reactor
+{
+	struct RProgram;
+
+	typedef enum RRENDER_MODE
+	{
+		RRENDER_SYNCHRONOUS	=	0x0000,	// update, then draw, on the GLUT thread
+		RRENDER_THREADED	=	0x0001	// a simulation thread builds frame N+1 while the GLUT thread draws frame N
+	} RRENDER_MODE;
+
+	/** One draw in a frame packet. The engine does not interpret the GL names; they are
+		passed through to RGame::RenderFrame. A draw whose geometry is streamed this frame
+		puts it in the packet's dynamic data and refers to it by offset.
+	*/
+	struct RDrawItem
+	{
+		RAffine3x4 world;
+		RProgram* program;
+		GLuint vertexBuffer;
+		GLuint indexBuffer;
+		GLuint texture;
+		GLenum indexType;
+		RUINT firstIndex;
+		RUINT indexCount;
+		RUINT dynamicOffset;	// into GetDynamicData() / the dynamic GL buffer
+		RUINT dynamicSize;
+		RUINT drawId;			// game-defined
+		uint64_t sortKey;
+	};
+
+	/** Everything the render side needs to draw one frame, built by RGame::BuildFrame.
+		@remarks
+			Once published the packet is read-only for the simulation side until the
+			render side has drawn it. It must not point at simulation state that can change
+			meanwhile: copy transforms and streamed vertex data into it. GL names of resident
+			assets are fine, they only change on the render thread. The vectors keep their
+			storage between frames.
+	*/
+	class RFramePacket
+	{
+	public:
+		RFramePacket();
+
+		RVOID Reset();
+
+		/** A zeroed draw with an identity transform. */
+		RDrawItem& AddDraw();
+
+		/** Copies Bytes into the dynamic data and returns their offset, 16-byte aligned. */
+		RUINT AddDynamic(const RVOID* Data, RUINT Bytes);
+
+		/** Orders the draws by sortKey, keeping insertion order for equal keys. */
+		RVOID SortDraws();
+
+		RUINT GetDrawCount() const { return (RUINT)draws.size(); }
+		const RDrawItem& GetDraw(RUINT Index) const { return draws[Index]; }
+		const RBYTE* GetDynamicData() const { return dynamic.empty() ? NULL : &dynamic[0]; }
+		RUINT GetDynamicSize() const { return (RUINT)dynamic.size(); }
+
+		RUINT frame;
+		RFLOAT delta;
+		RMatrix view;
+		RVector3 eye;
+		RVector3 viewDir;
+		RFLOAT fieldOfView;
+		RFLOAT aspect;
+		RColor clearColor;
+
+		/** The dynamic data uploaded to a GL_ARRAY_BUFFER; set on the render side before
+			RenderFrame, 0 when there is no dynamic data.
+		*/
+		GLuint dynamicBuffer;
+
+	private:
+		RTaggedVector<RDrawItem, RMEM_RENDER> draws;
+		RTaggedVector<RBYTE, RMEM_RENDER> dynamic;
+	};
+
+	/** Times in milliseconds for the last frame on each side. */
+	struct RFramePipelineStats
+	{
+		RFLOAT buildTime;		// simulation: input, Update, animation and BuildFrame
+		RFLOAT renderTime;		// render: upload and RenderFrame
+		RFLOAT buildWait;		// simulation blocked until a packet slot was free
+		RFLOAT renderWait;		// render blocked until a packet was published
+		RUINT built;
+		RUINT rendered;
+	};
+
+	/** Two frame packets handed between the simulation and the render side.
+		@remarks
+			The simulation side fills one packet while the render side draws the other, so
+			the render side runs exactly one frame behind and neither ever reads a packet
+			the other is writing. Packets are drawn in the order they were published. Stop()
+			wakes both sides; Acquire* then return NULL.
+	*/
+	class RFramePipeline
+	{
+	public:
+		RFramePipeline();
+		~RFramePipeline();
+
+		RFramePacket* AcquireBuild();
+		RVOID Publish(RFramePacket* Packet);
+
+		RFramePacket* AcquireRender();
+		RVOID Release(RFramePacket* Packet);
+
+		/** Render side: uploads the packet's dynamic data and sets dynamicBuffer. */
+		RVOID UploadDynamic(RFramePacket* Packet);
+		/** Render side: deletes the GL buffer. */
+		RVOID DestroyBuffers();
+
+		RVOID Stop();
+		/** Empties both slots and clears the stop flag. Neither side may hold a packet. */
+		RVOID Reset();
+
+		RFramePipelineStats GetStats();
+		RVOID SetBuildTime(RFLOAT Milliseconds);
+		RVOID SetRenderTime(RFLOAT Milliseconds);
+
+	private:
+		typedef enum RSLOT_STATE
+		{
+			RSLOT_FREE		=	0x0000,
+			RSLOT_BUILDING	=	0x0001,
+			RSLOT_READY		=	0x0002,
+			RSLOT_RENDERING	=	0x0003
+		} RSLOT_STATE;
+
+		RFramePacket packets[2];
+		RSLOT_STATE states[2];
+		RUINT buildSlot;
+		RUINT renderSlot;
+		RBOOL stopped;
+		GLuint buffer;
+		RUINT bufferSize;
+		RFramePipelineStats stats;
+		std::mutex lock;
+		std::condition_variable changed;
+	};
+};
+
+#endif
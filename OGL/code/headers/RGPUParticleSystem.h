@@ -0,0 +1,98 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RGPUPARTICLESYSTEM_H
+#define RGPUPARTICLESYSTEM_H
+
+#include "reactor.h"
+#include "RParticleSystem.h"
+#include "RProgramCache.h"
+
+namespace Reactor
+{
+	/** One particle as stored in the GPU buffers (48 bytes, captured interleaved). */
+	struct RGPUParticle
+	{
+		RFLOAT position[3];
+		RFLOAT velocity[3];
+		RFLOAT random[4];		// x: size, y: color, z: rotate speed, w: unused
+		RFLOAT age;
+		RFLOAT invLifetime;
+	};
+
+	/** Particle backend that simulates on the GPU with transform feedback.
+		@remarks
+			Particles live in two buffers; each Update() runs a vertex shader over the source
+			buffer with rasterization discarded, captures the result into the other buffer and
+			swaps them. The CPU only spawns: new particles are written into a ring of slots and
+			uploaded with one or two glBufferSubData calls before the step. A slot is reused only
+			once the particle in it is older than the settings' duration, so like the XNA system
+			AddParticle() gives up when the ring is full.
+			The motion model and settings are the same as RParticleSystem. Needs GL 3.0 or
+			EXT_transform_feedback; Init() returns R_FALSE otherwise so callers can stay on the
+			CPU backend. Programs come from RProgramCache and run on Mesa llvmpipe.
+	*/
+	class RGPUParticleSystem : public RParticleSink
+	{
+	public:
+		RGPUParticleSystem(const RParticleSettings& Settings);
+		~RGPUParticleSystem();
+
+		static RBOOL IsSupported();
+
+		RRESULT Init();
+		RVOID Destroy();
+
+		RBOOL AddParticle(const RVector3& Position, const RVector3& Velocity);
+		RVOID Update(RFLOAT ElapsedSeconds);
+
+		/** Draws the particles as point sprites with the current modelview/projection matrices. */
+		RVOID Render(RINT ViewportHeight);
+
+		RUINT GetCapacity() const { return capacity; }
+		RUINT GetSlotsInUse() const { return used; }
+		GLuint GetBuffer() const { return buffers[source]; }
+		const RParticleSettings& GetSettings() const { return settings; }
+
+	private:
+		RVOID Upload();
+		RVOID BindStream();
+		RVOID UnbindStream();
+
+		RParticleSettings settings;
+		RProgram* simulate;
+		RProgram* draw;
+		GLuint buffers[2];
+		RUINT source;
+		RUINT capacity;
+		RUINT used;			// slots ever written; the step only runs over these
+		RUINT head;			// next ring slot to spawn into
+		RUINT firstPending;	// ring slot of pending[0]
+		RDOUBLE time;
+		std::vector<RDOUBLE> spawnTime;
+		std::vector<RGPUParticle> pending;
+	};
+};
+
+#endif
@@ -27,6 +27,10 @@ THE SOFTWARE.
 
 #include "reactor.h"
 #include "REngine.h"
+#include "RReplay.h"
+#include "RFramePacket.h"
+#include "RPlatform.h"
+#include "RFramePacer.h"
 
 namespace Reactor
 {
@@ -36,19 +40,81 @@ namespace Reactor
     private:
 		~RGame();
 	public:
-		void Run(int argc, char** argv);
+		/** Starts the platform layer; create the window (REngine::Init3D*) afterwards. */
+		void Run(int argc, char** argv, RPLATFORM_BACKEND Backend = RPLATFORM_GLUT);
+		/** Runs the frame loop until the window is closed or Quit is called, then calls
+			Unload and shuts down: simulation thread, workers, GL objects, window. Returns
+			afterwards instead of exiting the process.
+		*/
 		void Init();
+		/** Ends the loop in Init after the current frame; safe from any thread. */
+		void Quit();
 		virtual void Load(){};
 		virtual void Unload(){};
 		static void OnResize(int width, int height);
 		static void OnRender(void);
 		static void OnIdle(void);
+		/** Draws straight from game state on the GLUT thread; only called in
+			RRENDER_SYNCHRONOUS mode, after RenderFrame.
+		*/
 		virtual void Render(){};
 		virtual void Update(){};
+		/** Simulation side, after Update and animation: describe the frame to draw. */
+		virtual void BuildFrame(RFramePacket& Packet){};
+		/** GLUT thread: draw Packet and present it with Reactor().RenderToScreen(). In
+			threaded mode this runs while Update and BuildFrame work on the next frame, so
+			it may only read the packet and render-side state.
+		*/
+		virtual void RenderFrame(const RFramePacket& Packet){};
         virtual void Idle(){};
 		REngine& Reactor();
 		float GetFPS();
 
+		/** Takes effect at the start of the next frame. RRENDER_SYNCHRONOUS (the default)
+			keeps everything on the GLUT thread, which is the mode to debug in.
+		*/
+		void SetRenderMode(RRENDER_MODE Mode);
+		RRENDER_MODE GetRenderMode();
+		RFramePipelineStats GetFramePipelineStats();
+
+		/** Frame rate the loop holds in State: frames per second, R_FRAMERATE_UNLIMITED
+			or R_FRAMERATE_ON_DEMAND. Defaults: focused unlimited, unfocused 30, paused
+			and minimized on demand, which costs next to nothing while nothing changes.
+		*/
+		void SetFrameRateTarget(RFRAME_STATE State, float FramesPerSecond);
+		float GetFrameRateTarget(RFRAME_STATE State);
+		/** Paused games only draw frames on demand; what pausing means for Update is up to the game. */
+		void SetPaused(RBOOL Paused);
+		RBOOL IsPaused();
+		/** Asks for one frame while on demand, e.g. after changing something on screen. Safe from any thread. */
+		void RequestRedraw();
+		RFRAME_STATE GetFrameState();
+		RFramePacingStats GetFramePacingStats();
+		/** Camera used to pick animation update rates; see RAnimationSystem. */
+		void SetCamera(RCamera* Camera);
+		RCamera* GetCamera();
+
+		/** Seconds since the previous frame. During a replay this is the recorded value,
+			so logic that steps by it instead of reading a clock replays identically.
+		*/
+		float GetFrameDelta();
+
+		/** Logs every frame's input events and delta to Path until StopRecording. */
+		RRESULT StartRecording(const std::string& Path);
+		void StopRecording();
+
+		/** Drives the running game from a recorded log instead of live input; live
+			input resumes when the log ends.
+		*/
+		RRESULT StartReplay(const std::string& Path);
+		RBOOL IsReplaying();
+
+		/** Replays a log headlessly: no window, no GLUT loop and no Render or RenderFrame
+			calls, only Load, Update, animation, BuildFrame and Unload. Writes a per-frame timing CSV to ReportPath
+			(if not empty) for comparing builds on the same workload.
+		*/
+		RRESULT Replay(const std::string& Path, RREPLAY_MODE Mode, const std::string& ReportPath, RReplayReport* Report = NULL);
+
 	};
 };
 
@@ -28,27 +28,153 @@
 #define RINPUT_H
 
 #include "reactor.h"
+#include <atomic>
 
 namespace Reactor {
-    
+
+    /// Input codes share one space so keys, mouse and joystick buttons all get edge detection
+    #define R_INPUT_SPECIAL     256     // R_INPUT_SPECIAL + GLUT_KEY_*
+    #define R_INPUT_MOUSE       512     // R_INPUT_MOUSE + GLUT_LEFT_BUTTON etc.
+    #define R_INPUT_JOYSTICK    520     // R_INPUT_JOYSTICK + button (0-31)
+    #define R_INPUT_CODES       552
+    #define R_INPUT_WORDS       ((R_INPUT_CODES + 63) / 64)
+    #define R_INPUT_QUEUE_SIZE  1024    // power of two
+
+    typedef enum RINPUT_EVENT {
+        RINPUT_DOWN,
+        RINPUT_UP,
+        RINPUT_MOUSE_MOVE,
+        RINPUT_JOYSTICK_AXES
+    } RINPUT_EVENT;
+
+    /** One input event, 16 bytes.
+        @remarks
+            time is steady clock milliseconds, the same clock REngine uses for frame latency.
+            x and y are the mouse position, or the joystick x and y axes for
+            RINPUT_JOYSTICK_AXES, in which case code holds the z axis as a signed value.
+    */
+    struct RInputEvent
+    {
+        double time;
+        uint16_t code;
+        uint8_t type;
+        uint8_t pad;
+        int16_t x;
+        int16_t y;
+    };
+
+    /** Single producer, single consumer ring of input events.
+        @remarks
+            The window system callbacks push and the game thread pops; neither side locks or
+            allocates. When the consumer falls behind by a full ring new events are dropped and
+            counted rather than overwriting ones the consumer may be reading. Push must not
+            run on two threads at once; RInput serializes its producers before pushing.
+    */
+    class RInputQueue
+    {
+    public:
+        RInputQueue() : head(0), tail(0), dropped(0) {}
+
+        /// Producer side
+        RBOOL Push(const RInputEvent& Event){
+            uint32_t t = tail.load(std::memory_order_relaxed);
+            if(t - head.load(std::memory_order_acquire) >= R_INPUT_QUEUE_SIZE){
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            events[t & (R_INPUT_QUEUE_SIZE - 1)] = Event;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Consumer side
+        RBOOL Pop(RInputEvent& Event){
+            uint32_t h = head.load(std::memory_order_relaxed);
+            if(h == tail.load(std::memory_order_acquire))
+                return false;
+            Event = events[h & (R_INPUT_QUEUE_SIZE - 1)];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        RUINT GetDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+    private:
+        // head and tail sit on separate cache lines so the two threads do not share one.
+        RInputEvent events[R_INPUT_QUEUE_SIZE];
+        std::atomic<uint32_t> head;
+        char pad[64 - sizeof(std::atomic<uint32_t>)];
+        std::atomic<uint32_t> tail;
+        std::atomic<uint32_t> dropped;
+    };
+
+    /** Input state as of the last RInput::Update. pressed and released hold the edges seen
+        since the previous update, so a tap shorter than a frame shows up in both while held
+        is already clear again.
+    */
+    struct RInputSnapshot
+    {
+        uint64_t held[R_INPUT_WORDS];
+        uint64_t pressed[R_INPUT_WORDS];
+        uint64_t released[R_INPUT_WORDS];
+        RVector2 mouse;
+        RVector3 joystick;
+        double time;        // when the snapshot was taken
+    };
+
+    /** Keyboard, mouse and joystick input.
+        @remarks
+            The GLUT callbacks only timestamp and queue events. Call Update once per frame on
+            the game thread (RGame does this before Update) to fold the queued events into
+            the snapshot that all the queries read; GetEvents returns the raw events of that
+            frame, in order, for anything that needs sub-frame timing.
+    */
     class RInput : public RSingleton<RInput> {
     private:
 		~RInput();
-        static RVOID KeyFunc(RCHAR key, RINT x, RINT y);
-        static RVOID KeyUpFunc(RCHAR key, RINT x, RINT y);
+        static RVOID KeyFunc(RBYTE key, RINT x, RINT y);
+        static RVOID KeyUpFunc(RBYTE key, RINT x, RINT y);
         static RVOID SpecialKeyFunc(RINT key, RINT x, RINT y);
         static RVOID SpecialKeyUpFunc(RINT key, RINT x, RINT y);
         static RVOID MouseFunc(RINT button, RINT state, RINT x, RINT y);
+        static RVOID MotionFunc(RINT x, RINT y);
         static RVOID JoystickFunc(RUINT state, RINT x, RINT y, RINT z);
-        RBOOL* keys;
-        RBOOL* mbuttons;
-        RBOOL* jbuttons;
-        RVector3 joystick;
-        RVector2 mouse;
-        
+        static RVOID Post(RINPUT_EVENT type, RINT code, RINT x, RINT y);
+        RVOID Enqueue(const RInputEvent& Event);
+        RVOID Apply(const RInputEvent& e);
+        RVOID BeginFrame();
+        RInputQueue queue;
+        std::atomic_flag producing;     // serializes producers in front of the single-producer queue
+        RInputSnapshot snapshot;
+        std::vector<RInputEvent> frameEvents;
+        RUINT joyState;         // producer side, to turn joystick polls into button edges
+        RINT joyAxes[3];
+
     public:
+        RInput();
         RVOID Init();
         RVOID Destroy();
+
+        /** Drains the event queue into the snapshot. Call once per frame. */
+        RVOID Update();
+
+        /** Builds the frame from the given events instead of the queue, which is emptied
+            and ignored. Used to replay a recorded session.
+        */
+        RVOID Update(const RInputEvent* Events, RUINT Count);
+
+        /** Queues an event as if it came from the window system. Safe from any thread. */
+        RVOID Inject(const RInputEvent& Event);
+
+        const RInputSnapshot& GetSnapshot() { return snapshot; }
+        const std::vector<RInputEvent>& GetEvents() { return frameEvents; }
+        RUINT GetDroppedEvents() { return queue.GetDropped(); }
+
+        /// Queries on the shared code space (see R_INPUT_*)
+        RBOOL IsDown(RINT code);
+        RBOOL WasPressed(RINT code);
+        RBOOL WasReleased(RINT code);
+
         const RVector2& GetMouse();
         RVOID GetMouse(RINT &x, RINT &y);
         RVOID GetMouseButtonState(RBOOL &b1, RBOOL &b2, RBOOL &b3);
@@ -56,8 +182,11 @@ namespace Reactor {
         RBOOL IsJoyButtonDown(RINT button);
         RBOOL IsKeyDown(RBYTE key);
         RBOOL IsKeyUp(RBYTE key);
+        RBOOL IsKeyPressed(RBYTE key);
+        RBOOL IsKeyReleased(RBYTE key);
+        RBOOL IsSpecialKeyDown(RINT key);
         RVOID SetRepeat(RINT milliseconds);
         
     };
 };
-#endif
\ No newline at end of file
+#endif
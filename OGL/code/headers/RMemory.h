@@ -0,0 +1,125 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RMEMORY_H
+#define RMEMORY_H
+
+#include "reactor.h"
+#include <atomic>
+
+namespace Reactor
+{
+	#define R_FRAME_ARENA_BLOCK	(1 << 20)	// initial bytes per thread
+
+	struct RFrameArenaStats
+	{
+		RUINT frame;
+		RUINT threads;			// threads that have used the arena
+		size_t capacity;		// bytes reserved over all threads
+		size_t used;			// bytes handed out in the last completed frame
+		size_t peak;			// largest single-thread frame so far
+		RUINT overflows;		// allocations that did not fit and went to the heap
+	};
+
+	/** Linear allocator for memory that only lives until the end of the frame.
+		@remarks
+			Every thread bumps a pointer in its own block, so allocation is a few instructions
+			and never locks. EndFrame (called by RGame once per frame) releases everything at
+			once; each thread rewinds lazily on its next allocation. A frame that runs out of
+			block falls back to the heap, and the block is regrown to that frame's high-water
+			mark on the next reset, so a steady workload stops touching the heap after its
+			first few frames. Nothing allocated here is destructed.
+			A thread with an RScratchScope open is not rewound until the scope closes.
+	*/
+	class RFrameArena
+	{
+	public:
+		static RVOID* Allocate(size_t Bytes, size_t Alignment = 16);
+
+		template<class T> static T* Allocate(size_t Count)
+		{
+			return (T*)Allocate(sizeof(T) * Count, __max(alignof(T), (size_t)16));
+		}
+
+		/** Ends the frame: every allocation made before this call is released. */
+		static RVOID EndFrame();
+
+		/** Block size given to threads that have not allocated yet. */
+		static RVOID SetBlockSize(size_t Bytes);
+
+		static RFrameArenaStats GetStats();
+	};
+
+	/** Scratch memory for the current scope. Allocations made on this thread while the
+		scope is alive are released when it closes; scopes nest.
+	*/
+	class RScratchScope
+	{
+	public:
+		RScratchScope();
+		~RScratchScope();
+
+	private:
+		RScratchScope(const RScratchScope&);
+		RScratchScope& operator=(const RScratchScope&);
+		size_t mark;
+	};
+
+	/** std allocator over RFrameArena, for temporary containers. Deallocation is a no-op,
+		so reserve up front where the size is known.
+	*/
+	template<class T> class RFrameAllocator
+	{
+	public:
+		typedef T value_type;
+
+		RFrameAllocator() {}
+		template<class U> RFrameAllocator(const RFrameAllocator<U>&) {}
+
+		T* allocate(size_t Count) { return RFrameArena::Allocate<T>(Count); }
+		void deallocate(T*, size_t) {}
+
+		template<class U> bool operator==(const RFrameAllocator<U>&) const { return true; }
+		template<class U> bool operator!=(const RFrameAllocator<U>&) const { return false; }
+	};
+
+	template<class T> using RFrameVector = std::vector<T, RFrameAllocator<T> >;
+
+	/** Counts heap allocations, to check that a frame loop has stopped allocating.
+		@remarks
+			Only counts when the engine is built with R_COUNT_ALLOCATIONS, which replaces the
+			global operator new; otherwise the counts stay at zero. The frame arena's own
+			heap use is always counted.
+	*/
+	class RAllocationCounter
+	{
+	public:
+		static RBOOL IsEnabled();
+		static uint64_t GetCount();
+		static uint64_t GetBytes();
+		static RVOID Record(size_t Bytes);
+	};
+};
+
+#endif
@@ -0,0 +1,125 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RMEMORYTRACKER_H
+#define RMEMORYTRACKER_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Reactor
+{
+	/** Subsystem a piece of memory is charged to. */
+	typedef enum RMEMORY_TAG
+	{
+		RMEM_GENERAL	=	0x0000,
+		RMEM_SCENE		=	0x0001,
+		RMEM_RENDER		=	0x0002,
+		RMEM_TEXTURES	=	0x0003,
+		RMEM_MESHES		=	0x0004,
+		RMEM_ANIMATION	=	0x0005,
+		RMEM_PARTICLES	=	0x0006,
+		RMEM_AUDIO		=	0x0007,
+		RMEM_TAG_COUNT	=	0x0008
+	} RMEMORY_TAG;
+
+	struct RMemoryTagStats
+	{
+		size_t live;				// bytes currently charged
+		size_t peak;				// highest live value seen
+		size_t budget;				// 0 when unlimited
+		unsigned long long allocations;	// since startup
+		unsigned long long frees;
+		unsigned int frameAllocations;	// during the last completed frame
+		unsigned int overBudgetFrames;	// frames that ended over budget
+	};
+
+	/** Frees memory charged to Tag, e.g. by evicting cached assets; returns the bytes released.
+		Runs on the thread that calls EndFrame, the simulation thread in threaded mode, so it
+		must not make GL calls.
+	*/
+	typedef std::function<size_t(RMEMORY_TAG Tag, size_t Excess)> RMemoryEvictor;
+
+	/** Per-subsystem memory accounting.
+		@remarks
+			Allocate/Reallocate/Free put a 16-byte header in front of each block recording
+			its tag and size; RArray, RPool and the tagged std allocator go through them.
+			Memory owned elsewhere (GL textures and buffers) is charged with Track. All
+			counters are atomic, so any thread may allocate.
+			EndFrame, called once per frame by RGame, closes the per-frame counts and
+			enforces budgets: a tag over budget gets its evictor called with the excess,
+			and if that does not bring it back under, a warning is printed (once per
+			excursion) and the frame is counted in overBudgetFrames.
+	*/
+	class RMemoryTracker
+	{
+	public:
+		static void* Allocate(RMEMORY_TAG Tag, size_t Bytes);
+		static void* Reallocate(RMEMORY_TAG Tag, void* Pointer, size_t Bytes);
+		static void Free(void* Pointer);
+
+		/** Charges (positive) or releases (negative) memory not allocated through here. */
+		static void Track(RMEMORY_TAG Tag, long long Bytes);
+
+		static void SetBudget(RMEMORY_TAG Tag, size_t Bytes);
+		static void SetEvictor(RMEMORY_TAG Tag, const RMemoryEvictor& Evictor);
+
+		static void EndFrame();
+
+		static RMemoryTagStats GetStats(RMEMORY_TAG Tag);
+		static const char* GetTagName(RMEMORY_TAG Tag);
+
+		/** {"frame":n,"tags":{"scene":{"live":..,"peak":..,...},...}} */
+		static std::string ToJSON();
+	};
+
+	/** std allocator that charges Tag. */
+	template<class T, RMEMORY_TAG Tag> class RTaggedAllocator
+	{
+	public:
+		typedef T value_type;
+		template<class U> struct rebind { typedef RTaggedAllocator<U, Tag> other; };
+
+		RTaggedAllocator() {}
+		template<class U> RTaggedAllocator(const RTaggedAllocator<U, Tag>&) {}
+
+		T* allocate(size_t Count)
+		{
+			void* p = RMemoryTracker::Allocate(Tag, Count * sizeof(T));
+			if(p == NULL)
+				throw std::bad_alloc();
+			return (T*)p;
+		}
+		void deallocate(T* Pointer, size_t) { RMemoryTracker::Free(Pointer); }
+
+		template<class U> bool operator==(const RTaggedAllocator<U, Tag>&) const { return true; }
+		template<class U> bool operator!=(const RTaggedAllocator<U, Tag>&) const { return false; }
+	};
+
+	template<class T, RMEMORY_TAG Tag> using RTaggedVector = std::vector<T, RTaggedAllocator<T, Tag> >;
+};
+
+#endif
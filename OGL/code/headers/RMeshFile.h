@@ -0,0 +1,159 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RMESHFILE_H
+#define RMESHFILE_H
+
+#include "reactor.h"
+#include <stdint.h>
+
+namespace Reactor
+{
+	#define RMESH_MAGIC		0x48534D52	// "RMSH"
+	#define RMESH_VERSION	1
+	#define RMESH_ALIGNMENT	64
+
+	typedef enum RMESH_COMPONENT
+	{
+		RMESH_FLOAT32			=	0x0000,
+		RMESH_FLOAT16			=	0x0001,
+		RMESH_SNORM16			=	0x0002,
+		RMESH_UNORM16			=	0x0003,
+		RMESH_UNORM8			=	0x0004,
+		RMESH_UINT8				=	0x0005,
+		RMESH_SNORM10_10_10_2	=	0x0006	// packed, components must be 4
+	} RMESH_COMPONENT;
+
+	/** One vertex attribute inside the interleaved vertex stream. semantic is the bit index of
+		the matching RVERTEX_ATTRIB, so it doubles as the attribute slot.
+	*/
+	struct RMeshAttribute
+	{
+		uint32_t semantic;
+		uint32_t component;
+		uint32_t count;
+		uint32_t offset;
+	};
+
+	/** A level of detail is a range of the shared index stream. LODs run from finest to
+		coarsest with strictly decreasing maxScreenSize; past LOD 0 it is a fraction of the
+		viewport height in (0, 1]. LOD 0 may be unbounded (1e30).
+	*/
+	struct RMeshLod
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		float maxScreenSize;	// use this LOD while the projected size is at or below this
+		uint32_t reserved;
+	};
+
+	/** Fixed 128 byte header at the start of a .rmesh file. All offsets are from the start of
+		the file and aligned to RMESH_ALIGNMENT so streams can be handed to GL straight from
+		the mapping. contentHash is FNV-1a over every byte after the header.
+	*/
+	struct RMeshFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t contentHash;
+		uint32_t vertexStride;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t indexSize;			// 2 or 4
+		uint32_t attributeCount;
+		uint32_t lodCount;
+		uint64_t attributeOffset;
+		uint64_t lodOffset;
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		float boundsMin[3];
+		float boundsMax[3];
+		float boundsCenter[3];		// centre of the box; quantized positions are relative to it
+		float boundsRadius;
+		uint32_t reserved[4];
+	};
+
+	/** In-memory mesh used to write a .rmesh; the converter and optimizer tools fill this. */
+	struct RMeshBuildData
+	{
+		RMeshBuildData() : vertexStride(0)
+		{
+			memset(boundsMin, 0, sizeof(boundsMin));
+			memset(boundsMax, 0, sizeof(boundsMax));
+		}
+
+		uint32_t vertexStride;
+		std::vector<RMeshAttribute> attributes;
+		std::vector<unsigned char> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<RMeshLod> lods;
+		float boundsMin[3];			// computed by Write() when positions are RMESH_FLOAT32
+		float boundsMax[3];
+	};
+
+	/** A read-only, memory-mapped .rmesh.
+		@remarks
+			Open() maps the file and validates the header against the file size; nothing is
+			parsed or copied, so GetVertices()/GetIndices() can go straight into glBufferData.
+			Verify() recomputes the content hash and is meant for tools, not the load path.
+	*/
+	class RMeshFile
+	{
+	public:
+		RMeshFile();
+		~RMeshFile();
+
+		RRESULT Open(const std::string& Path);
+		RVOID Close();
+		RBOOL Verify() const;
+
+		const RMeshFileHeader& GetHeader() const { return *header; }
+		const RMeshAttribute* GetAttributes() const;
+		const RMeshLod* GetLods() const;
+		const void* GetVertices() const;
+		const void* GetIndices() const;
+		uint64_t GetVertexBytes() const;
+		uint64_t GetIndexBytes() const;
+
+		static RRESULT Write(const std::string& Path, const RMeshBuildData& Mesh);
+		static RRESULT Read(const std::string& Path, RMeshBuildData& Mesh);
+		static RUINT ComponentSize(RUINT Component, RUINT Count);
+		/** Whether the LODs fit in IndexCount indices and follow the ordering rules of RMeshLod. */
+		static RBOOL ValidateLods(const RMeshLod* Lods, RUINT LodCount, RUINT IndexCount);
+
+	private:
+		RMeshFile(const RMeshFile&);
+		RMeshFile& operator=(const RMeshFile&);
+
+		const unsigned char* base;
+		const RMeshFileHeader* header;
+		uint64_t size;
+#ifdef _WIN32
+		void* file;
+		void* mapping;
+#endif
+	};
+};
+
+#endif
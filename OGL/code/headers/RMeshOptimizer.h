@@ -0,0 +1,77 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RMESHOPTIMIZER_H
+#define RMESHOPTIMIZER_H
+
+#include "reactor.h"
+#include "RMeshFile.h"
+
+namespace Reactor
+{
+	/** Post-transform cache statistics for an index buffer, simulated with a FIFO cache. */
+	struct RVertexCacheStats
+	{
+		RFLOAT acmr;	// average cache misses per triangle (lower is better, 0.5 is ideal)
+		RFLOAT atvr;	// average transformed vertices per vertex (1.0 is ideal)
+	};
+
+	/** Offline mesh processing run on .rmesh build data before it is shipped.
+		@remarks
+			Run the stages in order: OptimizeVertexCache, OptimizeOverdraw (uses the clusters
+			the first stage found), OptimizeVertexFetch, then optionally Quantize.
+			The cache stage is Tipsify (Sander, Nehab, Barczak 2007); the overdraw stage sorts
+			its clusters so outward-facing ones draw first.
+	*/
+	class RMeshOptimizer
+	{
+	public:
+		/** True when every index names one of VertexCount vertices. The stages below leave
+			the mesh untouched (and AnalyzeVertexCache returns zeros) when this fails.
+		*/
+		static RBOOL ValidateIndices(const std::vector<uint32_t>& Indices, RUINT VertexCount);
+
+		static RVertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& Indices, RUINT VertexCount, RUINT CacheSize = 16);
+
+		/** Reorders triangles for the post-transform cache. Clusters receives the index
+			offset where each run of locally connected triangles starts.
+		*/
+		static RVOID OptimizeVertexCache(std::vector<uint32_t>& Indices, RUINT VertexCount, std::vector<RUINT>& Clusters, RUINT CacheSize = 16);
+
+		/** Reorders the clusters from OptimizeVertexCache front-to-back from any viewpoint
+			outside the mesh. Needs RMESH_FLOAT32 positions.
+		*/
+		static RVOID OptimizeOverdraw(RMeshBuildData& Mesh, const std::vector<RUINT>& Clusters);
+
+		/** Rewrites the vertex stream in first-use order and drops unreferenced vertices. */
+		static RVOID OptimizeVertexFetch(RMeshBuildData& Mesh);
+
+		/** Packs float positions to 4 x SNORM16 relative to the bounds box, normals to
+			SNORM 10-10-10-2 and texture coordinates to FLOAT16. Other attributes are copied.
+		*/
+		static RVOID Quantize(RMeshBuildData& Mesh);
+	};
+};
+
+#endif
@@ -28,28 +28,60 @@ THE SOFTWARE.
 #define __RNODE__
 
 #include "reactor.h"
+#include "RPool.h"
 
 using namespace std;
 namespace Reactor {
-	
+
+	class RNode;
+	struct RSceneMesh;
+	struct RSceneTexture;
+	typedef RHandle<RNode> RNodeHandle;
+	typedef RHandle<RSceneMesh> RMeshHandle;
+	typedef RHandle<RSceneTexture> RTextureHandle;
+
+	/** Scene graph node.
+		@remarks
+			Nodes live in RScene's node pool (RScene::CreateNode) and refer to their parent,
+			first child and next sibling by handle, so removing a node can never leave
+			another one pointing at freed memory. The world transform is refreshed by
+			RScene::UpdateTransforms.
+	*/
 	class RNode
 	{
 	private:
-		RArray<RNode>* childNodes;
-		const RNode* parent;
+		friend class RScene;
+		friend class RSceneFile;
 		string name;
+		RNodeHandle self;
+		RNodeHandle parent;
+		RNodeHandle firstChild;
+		RNodeHandle nextSibling;
+		RINT childCount;
+		RAffine3x4 local;
+		RAffine3x4 world;
 	public:
 		RNode();
-		~RNode();
 		
-		string GetName();
+		string GetName() const;
 		void SetName(const string& Name);
+		RNodeHandle GetHandle() const { return self; }
 		void SetParent(const RNode& ParentNode);
+		/** The parent node, or this node if it is a root. */
 		const RNode& GetParent();
 		
 		void AddChild(const RNode& ChildNode);
-		const RNode& GetChild(RINT index);
+		/** Children in the order they were added; NULL when index is out of range. */
+		const RNode* GetChild(RINT index);
 		const RNode* GetChild(const string& Name);
+		RINT GetChildCount() const { return childCount; }
+
+		void SetLocalTransform(const RAffine3x4& Transform) { local = Transform; }
+		const RAffine3x4& GetLocalTransform() const { return local; }
+		const RAffine3x4& GetWorldTransform() const { return world; }
+
+		RMeshHandle mesh;
+		RTextureHandle texture;
 		
 		RBOOL operator == (const RNode& n);
 		RBOOL operator != (const RNode& n);
@@ -57,4 +89,4 @@ namespace Reactor {
 	};
 };
 
-#endif
\ No newline at end of file
+#endif
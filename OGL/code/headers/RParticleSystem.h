@@ -0,0 +1,171 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RPARTICLESYSTEM_H
+#define RPARTICLESYSTEM_H
+
+#include "reactor.h"
+#include <atomic>
+#include "RDepthSort.h"
+
+namespace Reactor
+{
+	/** Per-system settings, ported from PointParticleSettings in the XNA engine. Times are in seconds. */
+	struct RParticleSettings
+	{
+		RParticleSettings();
+
+		RINT textureId;
+		RINT maxParticles;
+		RFLOAT duration;
+		RFLOAT durationRandomness;			// > 0 lets some particles die earlier than duration
+		RFLOAT emitterVelocitySensitivity;	// how much of the emitter's own motion particles inherit
+		RFLOAT minHorizontalVelocity, maxHorizontalVelocity;
+		RFLOAT minVerticalVelocity, maxVerticalVelocity;
+		RVector3 gravity;					// acceleration, can point in any direction (wind, rising fire)
+		RFLOAT drag;						// linear damping per second, 0 disables
+		RFLOAT endVelocity;					// speed multiplier reached at the end of life, 1 keeps speed
+		RVector4 minColor, maxColor;
+		RFLOAT minRotateSpeed, maxRotateSpeed;
+		RFLOAT minStartSize, maxStartSize;
+		RFLOAT minEndSize, maxEndSize;
+	};
+
+	/** One particle vertex as written by RParticleSystem::WriteVertices, for point sprites. */
+	struct RParticleVertex
+	{
+		RFLOAT x, y, z, size;
+		RFLOAT r, g, b, a;
+		RFLOAT rotation;
+	};
+
+	/** Anything an RParticleEmitter can spawn into. Also holds the spawn randomization shared
+		by the CPU and GPU backends, so both turn the same settings into the same particles.
+	*/
+	class RParticleSink
+	{
+	public:
+		virtual ~RParticleSink() {}
+
+		/** Adds a particle; returns false when the system is full. */
+		virtual RBOOL AddParticle(const RVector3& Position, const RVector3& Velocity) = 0;
+
+	protected:
+		RParticleSink() : seed(0x9E3779B9u) {}
+
+		RFLOAT Random();
+		RVector3 EmissionVelocity(const RParticleSettings& Settings, const RVector3& EmitterVelocity);
+
+		uint32_t seed;
+	};
+
+	/** CPU particle simulation with structure-of-arrays storage.
+		@remarks
+			Each attribute lives in its own 16-byte aligned float stream, so Update() runs SSE
+			kernels four particles at a time (scalar when SSE is unavailable), split across
+			RThreadPool. Particles that reach the end of their life are removed by moving the last
+			live particle into their slot, so the streams stay dense and the order is not stable.
+			The motion model matches the XNA version: the emission velocity is scaled from 1 to
+			endVelocity over the particle's life, gravity accelerates it and drag damps it.
+	*/
+	class RParticleSystem : public RParticleSink
+	{
+	public:
+		RParticleSystem(const RParticleSettings& Settings);
+		~RParticleSystem();
+
+		RBOOL AddParticle(const RVector3& Position, const RVector3& Velocity);
+		RVOID Update(RFLOAT ElapsedSeconds);
+		RVOID Clear();
+
+		/** Orders the live particles back-to-front for alpha blending; pass the result to
+			WriteVertices. Valid until the next Update() or AddParticle().
+		*/
+		const RUINT* SortBackToFront(const RVector3& Eye, const RVector3& ViewDir);
+
+		/** Writes the live particles as interleaved vertices, in Order if given; Out needs room
+			for GetCount() entries.
+		*/
+		RUINT WriteVertices(RParticleVertex* Out, const RUINT* Order = NULL) const;
+
+		RUINT GetCount() const { return count; }
+		RUINT GetCapacity() const { return capacity; }
+		const RParticleSettings& GetSettings() const { return settings; }
+		RVector3 GetPosition(RUINT Index) const;
+		RVector3 GetVelocity(RUINT Index) const;
+		RVector4 GetColor(RUINT Index) const;
+		RFLOAT GetSize(RUINT Index) const;
+
+		typedef enum RPARTICLE_STREAM
+		{
+			RPS_POSITION_X = 0, RPS_POSITION_Y, RPS_POSITION_Z,
+			RPS_VELOCITY_X, RPS_VELOCITY_Y, RPS_VELOCITY_Z,
+			RPS_AGE, RPS_INV_LIFETIME,
+			RPS_START_SIZE, RPS_END_SIZE, RPS_SIZE,
+			RPS_ROTATION, RPS_ROTATE_SPEED,
+			RPS_COLOR_R, RPS_COLOR_G, RPS_COLOR_B, RPS_COLOR_A, RPS_ALPHA,
+			RPS_COUNT
+		} RPARTICLE_STREAM;
+
+		/** Raw access to one stream, GetCount() floats long. */
+		const RFLOAT* GetStream(RPARTICLE_STREAM Stream) const { return streams[Stream]; }
+
+	private:
+		RVOID Simulate(RINT Begin, RINT End, RFLOAT Dt, RFLOAT DragFactor);
+		RVOID Compact();
+
+		RParticleSettings settings;
+		RFLOAT* streams[RPS_COUNT];
+		RVOID* block;
+		RUINT capacity;
+		RUINT count;
+		RDepthSorter sorter;
+		std::atomic<int> dead;
+	};
+
+	/** Spawns particles along the path of a moving object at a fixed rate.
+		@remarks
+			Ported from PointParticleEmitter. SetBudget() caps the particles spawned in a single
+			Update() so a long frame or a large rate cannot stall the next one; the time that did
+			not fit is dropped rather than carried into later frames.
+	*/
+	class RParticleEmitter
+	{
+	public:
+		RParticleEmitter(RParticleSink* System, RFLOAT ParticlesPerSecond, const RVector3& InitialPosition);
+
+		RVOID SetBudget(RINT MaxPerFrame) { budget = MaxPerFrame; }
+		RINT GetBudget() const { return budget; }
+		RVOID Update(RFLOAT ElapsedSeconds, const RVector3& NewPosition);
+
+	private:
+		RParticleSink* system;
+		RFLOAT timeBetweenParticles;
+		RFLOAT timeLeftOver;
+		RVector3 previousPosition;
+		RINT budget;
+	};
+};
+
+#endif
@@ -0,0 +1,155 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef RPLATFORM_H
+#define RPLATFORM_H
+
+#include "reactor.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace Reactor
+{
+	typedef enum RPLATFORM_BACKEND
+	{
+		RPLATFORM_GLUT		=	0x0000,	// window, GL context and input through GLUT
+		RPLATFORM_HEADLESS	=	0x0001,	// no window and no GL context; frames still run
+		RPLATFORM_CUSTOM	=	0x0002	// a backend passed to RPlatform::Init
+	} RPLATFORM_BACKEND;
+
+	/** Window system behind RPlatform. Implement this to run the engine on another
+		window system (GLFW, X11/EGL); every call is made on the thread that owns the GL context.
+	*/
+	class RPlatformBackend
+	{
+	public:
+		virtual ~RPlatformBackend() {}
+
+		virtual RRESULT Init(int* argc, char** argv) = 0;
+		virtual RRESULT OpenWindow(const char* Title, const RECT& Rect, RBOOL Fullscreen) = 0;
+		virtual RVOID CloseWindow() = 0;
+		/** Dispatches the pending window and input events without blocking. Returns false
+			once the user has closed the window.
+		*/
+		virtual RBOOL PumpEvents() = 0;
+		virtual RVOID SwapBuffers() = 0;
+		/** Interval as for wglSwapIntervalEXT: negative values ask for adaptive vsync. */
+		virtual RBOOL SetSwapInterval(RINT Interval) = 0;
+		virtual RECT GetScreenSize() = 0;
+		virtual RBOOL IsWindowVisible() = 0;
+		virtual RBOOL IsWindowFocused() = 0;
+		/** False for backends without a GL context; the engine then skips all GL work. */
+		virtual RBOOL HasContext() = 0;
+		/** Longest sleep between two PumpEvents calls while waiting; 0 if events cannot arrive. */
+		virtual RFLOAT GetWaitSlice() = 0;
+		virtual RVOID Shutdown() = 0;
+		/** For backends whose event loop never returns: calls Frame from that loop once per
+			iteration and does not come back. The default returns false, meaning the caller
+			drives the loop with PumpEvents.
+		*/
+		virtual RBOOL RunLoop(RVOID (*Frame)()) { return false; }
+	};
+
+	/** The window, GL context and event pump the engine runs on.
+		@remarks
+			RGame::Init drives the frame loop itself through PumpEvents instead of handing
+			control to glutMainLoop, so the loop can block while there is nothing to do, stop
+			when the window is closed or Quit is requested, and return for a clean shutdown.
+			That needs freeglut or Apple GLUT; with any other GLUT the same loop runs from
+			glutMainLoop's idle callback (RunLoop) and closing the window ends the process.
+			GLUT cannot wait on its event queue, so WaitEvents sleeps in slices of
+			GetWaitSlice() with a pump in between. NotifyEvent (input, resize, expose) and
+			RequestQuit may be called from any thread and wake a WaitEvents in progress.
+	*/
+	class RPlatform : public RSingleton<RPlatform>
+	{
+	public:
+		RPlatform();
+		~RPlatform();
+
+		RRESULT Init(RPLATFORM_BACKEND Backend, int* argc, char** argv);
+		/** Takes ownership of Backend. */
+		RRESULT Init(RPlatformBackend* Backend, int* argc, char** argv);
+		RBOOL IsInitialized() { return backend != NULL; }
+		RPLATFORM_BACKEND GetBackend() { return type; }
+
+		/** R_INVALIDARG without a backend or when the backend cannot create the window. */
+		RRESULT OpenWindow(const char* Title, const RECT& Rect, RBOOL Fullscreen);
+		RVOID CloseWindow();
+
+		/** False once the window was closed or RequestQuit was called. */
+		RBOOL PumpEvents();
+		/** See RPlatformBackend::RunLoop. */
+		RBOOL RunLoop(RVOID (*Frame)());
+		/** Blocks for up to Milliseconds, pumping events, until RequestQuit or, with
+			ReturnOnEvent, until NotifyEvent.
+		*/
+		RVOID WaitEvents(double Milliseconds, RBOOL ReturnOnEvent = true);
+
+		/** Something that may need a new frame happened. */
+		RVOID NotifyEvent();
+		/** True if NotifyEvent was called since the last call. */
+		RBOOL ConsumeEvents() { return events.exchange(0) != 0; }
+
+		RVOID SwapBuffers();
+		RBOOL SetSwapInterval(RINT Interval);
+		RINT GetSwapInterval() { return swapInterval; }
+
+		RECT GetScreenSize();
+		RBOOL IsWindowVisible();
+		/** GLUT has no focus events: asks the OS instead (the foreground window on Windows,
+			the active application on macOS). Always true on other platforms.
+		*/
+		RBOOL IsWindowFocused();
+		RBOOL HasContext();
+		/** True when input arrives through GLUT callbacks (see RInput::Init). */
+		RBOOL HasGLUT() { return backend != NULL && type == RPLATFORM_GLUT; }
+
+		/** Milliseconds on a monotonic clock. */
+		double GetTime();
+
+		RVOID SetResizeHandler(void (*Handler)(int width, int height)) { resizeHandler = Handler; }
+		void (*GetResizeHandler())(int, int) { return resizeHandler; }
+
+		RVOID RequestQuit();
+		RBOOL IsQuitRequested() { return quit; }
+
+		/** Closes the window and releases the backend; Init may be called again. */
+		RVOID Shutdown();
+
+	private:
+		RPlatformBackend* backend;
+		RPLATFORM_BACKEND type;
+		RINT swapInterval;
+		void (*resizeHandler)(int, int);
+		std::atomic<bool> quit;
+		std::atomic<RUINT> events;
+		std::mutex lock;
+		std::condition_variable quitSignal;
+	};
+};
+
+#endif
@@ -0,0 +1,199 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RPOOL_H
+#define RPOOL_H
+
+#include "reactor.h"
+
+namespace Reactor
+{
+	#define R_HANDLE_INDEX_BITS	20
+	#define R_HANDLE_INDEX_MASK	((1u << R_HANDLE_INDEX_BITS) - 1)
+	#define R_HANDLE_GENERATION_MASK	((1u << (32 - R_HANDLE_INDEX_BITS)) - 1)
+
+	/** 32-bit reference to an object in an RPool<T>: a 20-bit slot index and a 12-bit
+		generation. Destroying the object bumps the slot's generation, so an old handle
+		resolves to NULL instead of to whatever reuses the slot. The zero handle is null.
+	*/
+	template<class T> struct RHandle
+	{
+		uint32_t value;
+
+		RHandle() : value(0) {}
+		RHandle(uint32_t Index, uint32_t Generation) : value((Generation << R_HANDLE_INDEX_BITS) | Index) {}
+
+		uint32_t GetIndex() const { return value & R_HANDLE_INDEX_MASK; }
+		uint32_t GetGeneration() const { return value >> R_HANDLE_INDEX_BITS; }
+		RBOOL IsNull() const { return value == 0; }
+
+		bool operator==(const RHandle& h) const { return value == h.value; }
+		bool operator!=(const RHandle& h) const { return value != h.value; }
+	};
+
+	/** Typed object pool with generational handles.
+		@remarks
+			Objects live in slabs of SlabSize slots that are never moved or freed before
+			the pool is destroyed, so a pointer from Get stays valid until its object is
+			destroyed; free slots are kept on a LIFO list and reused first. Slabs are charged
+			to the pool's RMEMORY_TAG. ForEach walks the slabs in slot
+			order, which is dense as long as the pool is not badly fragmented. Not thread safe.
+	*/
+	template<class T, RUINT SlabSize = 1024> class RPool
+	{
+	public:
+		explicit RPool(RMEMORY_TAG Tag = RMEM_GENERAL) : count(0), freeList(R_HANDLE_INDEX_MASK), tag(Tag) {}
+		~RPool()
+		{
+			Clear();
+			for(size_t i=0; i<slabs.size(); i++)
+				RMemoryTracker::Free(slabs[i]);
+		}
+
+		template<class... Args> RHandle<T> Create(Args&&... args)
+		{
+			uint32_t index;
+			if(freeList != R_HANDLE_INDEX_MASK){
+				index = freeList;
+				freeList = slots[index].next;
+			} else {
+				index = (uint32_t)slots.size();
+				if(index >= R_HANDLE_INDEX_MASK)
+					return RHandle<T>();
+				if(index % SlabSize == 0){
+					RStorage* slab = (RStorage*)RMemoryTracker::Allocate(tag, sizeof(RStorage) * SlabSize);
+					if(slab == NULL)
+						return RHandle<T>();
+					slabs.push_back(slab);
+				}
+				RSlot slot = { 1, R_HANDLE_INDEX_MASK, false };
+				slots.push_back(slot);
+			}
+			new (Address(index)) T(std::forward<Args>(args)...);
+			slots[index].alive = true;
+			count++;
+			return RHandle<T>(index, slots[index].generation);
+		}
+
+		/** Destroys the object; returns false if the handle was already stale. */
+		RBOOL Destroy(RHandle<T> Handle)
+		{
+			if(!IsValid(Handle))
+				return false;
+			uint32_t index = Handle.GetIndex();
+			Address(index)->~T();
+			RSlot& slot = slots[index];
+			slot.alive = false;
+			slot.generation = (slot.generation + 1) & R_HANDLE_GENERATION_MASK;
+			if(slot.generation == 0)
+				slot.generation = 1;
+			slot.next = freeList;
+			freeList = index;
+			count--;
+			return true;
+		}
+
+		RBOOL IsValid(RHandle<T> Handle) const
+		{
+			uint32_t index = Handle.GetIndex();
+			return !Handle.IsNull() && index < slots.size() && slots[index].alive && slots[index].generation == Handle.GetGeneration();
+		}
+
+		/** NULL for a null or stale handle. */
+		T* Get(RHandle<T> Handle)
+		{
+			return IsValid(Handle) ? Address(Handle.GetIndex()) : NULL;
+		}
+
+		const T* Get(RHandle<T> Handle) const
+		{
+			return IsValid(Handle) ? Address(Handle.GetIndex()) : NULL;
+		}
+
+		/** Calls Function(T&, RHandle<T>) for every live object in slot order. */
+		template<class F> RVOID ForEach(F Function)
+		{
+			for(uint32_t i=0; i<(uint32_t)slots.size(); i++){
+				if(slots[i].alive)
+					Function(*Address(i), RHandle<T>(i, slots[i].generation));
+			}
+		}
+
+		RVOID Reserve(RUINT Count)
+		{
+			slots.reserve(Count);
+			slabs.reserve((Count + SlabSize - 1) / SlabSize);
+		}
+
+		/** Destroys every object. The slabs are kept for reuse and every outstanding
+			handle becomes stale.
+		*/
+		RVOID Clear()
+		{
+			freeList = R_HANDLE_INDEX_MASK;
+			for(uint32_t i=(uint32_t)slots.size(); i-- > 0; ){
+				if(slots[i].alive)
+					Destroy(RHandle<T>(i, slots[i].generation));
+			}
+			// Rebuild the list in slot order so refilling the pool packs it from the front.
+			freeList = R_HANDLE_INDEX_MASK;
+			for(uint32_t i=(uint32_t)slots.size(); i-- > 0; ){
+				slots[i].next = freeList;
+				freeList = i;
+			}
+		}
+
+		RUINT GetCount() const { return count; }
+		RUINT GetCapacity() const { return (RUINT)(slabs.size() * SlabSize); }
+
+		/** One past the highest slot ever used, for index-based side tables. */
+		RUINT GetSlotCount() const { return (RUINT)slots.size(); }
+
+	private:
+		typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type RStorage;
+
+		struct RSlot
+		{
+			uint32_t generation;
+			uint32_t next;		// free list link
+			bool alive;
+		};
+
+		T* Address(uint32_t Index) const
+		{
+			return (T*)&slabs[Index / SlabSize][Index % SlabSize];
+		}
+
+		RPool(const RPool&);
+		RPool& operator=(const RPool&);
+
+		std::vector<RStorage*> slabs;
+		std::vector<RSlot> slots;
+		RUINT count;
+		uint32_t freeList;
+		RMEMORY_TAG tag;
+	};
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RPROGRAMCACHE_H
+#define RPROGRAMCACHE_H
+
+#include "reactor.h"
+#include <stdint.h>
+
+namespace Reactor
+{
+	/** Vertex attributes a program permutation is linked against. Each bit is bound to
+		the attribute slot of the same index and exposed to the shader as R_HAS_<NAME>.
+	*/
+	typedef enum RVERTEX_ATTRIB
+	{
+		RVA_POSITION		=	0x0001,
+		RVA_NORMAL			=	0x0002,
+		RVA_TEXCOORD0		=	0x0004,
+		RVA_TEXCOORD1		=	0x0008,
+		RVA_TANGENT			=	0x0010,
+		RVA_COLOR			=	0x0020,
+		RVA_BLENDINDICES	=	0x0040,
+		RVA_BLENDWEIGHTS	=	0x0080
+	} RVERTEX_ATTRIB;
+
+	typedef enum RPROGRAM_STATE
+	{
+		RPROGRAM_PENDING	=	0x0000,	// compile/link issued, status not queried yet
+		RPROGRAM_READY		=	0x0001,
+		RPROGRAM_FAILED		=	0x0002
+	} RPROGRAM_STATE;
+
+	/** Identifies one permutation of an effect: the effect name, its preprocessor defines
+		and the vertex layout. Defines are kept sorted so insertion order doesn't change the hash.
+		Feedback varyings, in buffer order, are captured interleaved with transform feedback.
+	*/
+	class RProgramKey
+	{
+	public:
+		RProgramKey();
+		RProgramKey(const std::string& Effect, RUINT VertexLayout = RVA_POSITION);
+
+		void AddDefine(const std::string& Name, const std::string& Value = "1");
+		void AddFeedbackVarying(const std::string& Name);
+		uint64_t GetHash() const;
+
+		std::string effect;
+		std::vector<std::pair<std::string, std::string> > defines;
+		std::vector<std::string> feedbackVaryings;
+		RUINT vertexLayout;
+	};
+
+	struct RProgram
+	{
+		GLuint id;
+		GLuint vertexShader;
+		GLuint fragmentShader;
+		RPROGRAM_STATE state;
+		uint64_t keyHash;
+		uint64_t sourceHash;
+		std::string log;
+	};
+
+	struct RProgramCacheStats
+	{
+		RUINT requests;			// Request() calls
+		RUINT memoryHits;		// permutation already known this run
+		RUINT binaryLoads;		// linked from the on-disk binary cache
+		RUINT compiles;			// compiled from source
+		RUINT failures;
+	};
+
+	/** Lazily builds and caches GLSL programs keyed by RProgramKey.
+		@remarks
+			Effect sources are read from <source directory>/<effect>.vert and .frag, or
+			registered in memory with RegisterSource. Request() never blocks: it either links
+			from the binary cache or issues the compile and link and returns immediately, letting
+			the driver compile in the background. The status is only queried when the program
+			is first bound (or by Update(), which resolves programs the driver reports complete).
+			Linked binaries are written to the cache directory and reused on the next run as
+			long as the driver and the preprocessed source hash still match.
+	*/
+	class RProgramCache : public RSingleton<RProgramCache>
+	{
+	public:
+		RProgramCache();
+		~RProgramCache();
+
+		RVOID SetSourceDirectory(const std::string& Path);
+		RVOID SetCacheDirectory(const std::string& Path);
+		RVOID RegisterSource(const std::string& Effect, const std::string& VertexSource, const std::string& FragmentSource);
+
+		RProgram* Request(const RProgramKey& Key);
+		RBOOL IsReady(RProgram* Program);
+		GLuint Bind(RProgram* Program);
+		RVOID Update();
+		/** Deletes every program and shader (needs the GL context). RSingleton::Destroy()
+			still tears down the cache itself.
+		*/
+		RVOID Clear();
+
+		const RProgramCacheStats& GetStats();
+
+	private:
+		RBOOL LoadSource(const std::string& Effect, std::string& Vertex, std::string& Fragment);
+		std::string Preprocess(const std::string& Source, const RProgramKey& Key);
+		std::string BinaryPath(uint64_t KeyHash);
+		RBOOL LoadBinary(RProgram* Program);
+		RVOID SaveBinary(RProgram* Program);
+		RVOID Resolve(RProgram* Program);
+		uint64_t DriverHash();
+
+		std::map<uint64_t, RProgram*> programs;
+		std::map<std::string, std::pair<std::string, std::string> > sources;
+		std::string sourceDirectory;
+		std::string cacheDirectory;
+		uint64_t driverHash;
+		RBOOL parallelCompile;
+		RProgramCacheStats stats;
+	};
+};
+
+#endif
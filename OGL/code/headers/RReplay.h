@@ -0,0 +1,128 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RREPLAY_H
+#define RREPLAY_H
+
+#include "reactor.h"
+#include "RInput.h"
+
+namespace Reactor
+{
+	#define RREPLAY_MAGIC	0x4C504552	// "REPL"
+	#define RREPLAY_VERSION	1
+
+	typedef enum RREPLAY_MODE {
+		RREPLAY_REALTIME,	// frames are paced by their recorded deltas
+		RREPLAY_FAST		// frames run back to back
+	} RREPLAY_MODE;
+
+	struct RReplayFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t frameCount;
+	};
+
+	struct RReplayFrameHeader
+	{
+		RFLOAT delta;		// seconds
+		uint32_t eventCount;
+	};
+
+	/** An RInputEvent as stored in a log, 12 bytes. time is milliseconds after the start of the frame. */
+	struct RReplayEvent
+	{
+		RFLOAT time;
+		uint16_t code;
+		uint8_t type;
+		uint8_t pad;
+		int16_t x;
+		int16_t y;
+	};
+
+	/** Per-frame CPU times of a replayed frame, in milliseconds. */
+	struct RReplayFrameTiming
+	{
+		RFLOAT delta;
+		RFLOAT update;
+		RFLOAT animation;
+		RFLOAT render;		// RGame::BuildFrame; nothing is drawn headless
+		RFLOAT total;
+		RUINT allocations;	// heap allocations, when built with R_COUNT_ALLOCATIONS
+	};
+
+	/** Summary of a replay run, over RReplayFrameTiming::total. */
+	struct RReplayReport
+	{
+		RUINT frames;
+		RFLOAT wallTime;	// ms from the first frame to the end of the last
+		RFLOAT mean;
+		RFLOAT p50;
+		RFLOAT p95;
+		RFLOAT p99;
+		RFLOAT max;
+		RUINT allocatingFrames;	// frames after the first that allocated
+	};
+
+	/** Binary log of the input events and frame delta of every frame of a session.
+		@remarks
+			Create and WriteFrame record; Open and ReadFrame play back. Event times are
+			stored relative to the frame they were consumed in and rebased on read, so a
+			replay sees the same sub-frame spacing as the recording. Writes go through stdio
+			buffering; the frame count in the header is patched on Close.
+	*/
+	class RInputLog
+	{
+	public:
+		RInputLog();
+		~RInputLog();
+
+		RRESULT Create(const std::string& Path);
+		/** R_INVALIDARG when the file is missing or is not a log of this version. */
+		RRESULT Open(const std::string& Path);
+		RVOID Close();
+		RBOOL IsOpen() const { return file != NULL; }
+		RBOOL IsWriting() const { return writing; }
+		RUINT GetFrameCount() const { return frameCount; }
+
+		/** FrameStart is the clock value (ms) the event times are measured from. */
+		RRESULT WriteFrame(RFLOAT Delta, const std::vector<RInputEvent>& Events, double FrameStart);
+
+		/** Returns false at the end of the log. Event times come back as FrameStart plus their offset. */
+		RBOOL ReadFrame(RFLOAT& Delta, std::vector<RInputEvent>& Events, double FrameStart);
+
+		/** Writes one CSV line per frame after a commented summary, and fills Report. */
+		static RRESULT WriteReport(const std::string& Path, const std::vector<RReplayFrameTiming>& Frames, RFLOAT WallTime, RReplayReport* Report = NULL);
+
+	private:
+		FILE* file;
+		RBOOL writing;
+		RUINT frameCount;
+		RUINT frameIndex;
+		std::vector<RReplayEvent> buffer;
+	};
+};
+
+#endif
@@ -27,16 +27,77 @@ THE SOFTWARE.
 
 #include "reactor.h"
 #include "RNode.h"
+#include "RAssetLoader.h"
+#include "RParticleSystem.h"
 
 namespace Reactor {
+
+	struct RSceneMesh
+	{
+		RAssetHandle asset;
+	};
+
+	struct RSceneTexture
+	{
+		RAssetHandle asset;
+	};
+
+	typedef RHandle<RLight> RLightHandle;
+	typedef RHandle<RParticleEmitter> REmitterHandle;
 	
+	/** Owns the objects of the scene in typed pools addressed by handles.
+		@remarks
+			Nodes are created and re-parented through the scene so it can keep the
+			hierarchy links and a flat parent-before-child walk order, rebuilt only when the
+			hierarchy changes. The order follows the pool's slot order where it can, so
+			UpdateTransforms sweeps the node slabs front to back. Lights, emitters, meshes and textures are created
+			and destroyed directly on their pools.
+	*/
 	class RScene : public RSingleton<RScene>
 	{
 	private:
-		RScene();
+		friend class RSceneFile;
 		~RScene();
+		struct RNodeLink
+		{
+			RNode* node;
+			const RNode* parent;
+		};
+		RVOID Unlink(RNode& Node);
+		RVOID RebuildOrder();
+		RPool<RNode> nodes;
+		RPool<RLight> lights;
+		RPool<RParticleEmitter> emitters;
+		RPool<RSceneMesh> meshes;
+		RPool<RSceneTexture> textures;
+		std::vector<RNodeLink> order;
+		std::vector<RNode*> stack;
+		std::vector<RUINT> depths;
+		RBOOL orderDirty;
 	public:
-		
+		RScene();
+
+		/** Null handle when the pool is full or Parent is not a live node. */
+		RNodeHandle CreateNode(const string& Name, RNodeHandle Parent = RNodeHandle());
+		/** Destroys the node and everything below it. */
+		RVOID DestroyNode(RNodeHandle Node);
+		/** A null Parent makes Node a root. Fails if Parent is Node or one of its descendants. */
+		RRESULT SetParent(RNodeHandle Node, RNodeHandle Parent);
+		RNode* GetNode(RNodeHandle Node) { return nodes.Get(Node); }
+
+		/** Recomputes every node's world transform from the local ones. */
+		RVOID UpdateTransforms();
+
+		RMeshHandle AddMesh(const RAssetHandle& Asset);
+		RTextureHandle AddTexture(const RAssetHandle& Asset);
+
+		RPool<RNode>& GetNodes() { return nodes; }
+		RPool<RLight>& GetLights() { return lights; }
+		RPool<RParticleEmitter>& GetEmitters() { return emitters; }
+		RPool<RSceneMesh>& GetMeshes() { return meshes; }
+		RPool<RSceneTexture>& GetTextures() { return textures; }
+
+		RVOID Clear();
 	};
 	
 	
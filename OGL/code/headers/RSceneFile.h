@@ -0,0 +1,181 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef RSCENEFILE_H
+#define RSCENEFILE_H
+
+#include "reactor.h"
+#include "RScene.h"
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+
+namespace Reactor
+{
+	#define RSCENE_MAGIC		0x4E435352	// "RSCN"
+	#define RSCENE_VERSION		1
+	#define RSCENE_ALIGNMENT	64
+
+	/** Pointer stored in a snapshot. On disk it holds an offset from the start of the
+		file (0 for null); RSceneFile::Open turns it into a real pointer in place.
+	*/
+	template<class T> struct RSceneRef
+	{
+		union
+		{
+			uint64_t offset;
+			T* pointer;
+		};
+		T* Get() const { return pointer; }
+	};
+
+	/** A mesh or texture the scene refers to, reloaded through RAssetLoader by path. */
+	struct RSceneFileResource
+	{
+		RSceneRef<const char> path;
+		uint32_t type;				// RASSET_TYPE
+		uint32_t reserved;
+	};
+
+	/** One node, in parent-before-child order. */
+	struct RSceneFileNode
+	{
+		RSceneRef<const char> name;
+		RSceneRef<RSceneFileNode> parent;
+		RSceneRef<RSceneFileNode> firstChild;
+		RSceneRef<RSceneFileNode> nextSibling;
+		RSceneRef<RSceneFileResource> mesh;
+		RSceneRef<RSceneFileResource> texture;
+		uint32_t childCount;
+		uint32_t reserved;
+		float local[12];			// RAffine3x4::m
+	};
+
+	/** Fixed 128 byte header at the start of a .rscene file. Sections are aligned to
+		RSCENE_ALIGNMENT; the relocation table lists the file offset of every RSceneRef
+		(null ones stay null). contentHash is FNV-1a over every byte after the header.
+	*/
+	struct RSceneFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t contentHash;
+		uint64_t fileSize;
+		uint32_t nodeCount;
+		uint32_t resourceCount;
+		uint32_t relocationCount;
+		uint32_t reserved0;
+		uint64_t nodeOffset;
+		uint64_t resourceOffset;
+		uint64_t stringOffset;
+		uint64_t stringBytes;
+		uint64_t relocationOffset;
+		uint32_t reserved[14];
+	};
+
+	/** Completion of a SaveAsync; the image is already captured when it is returned. */
+	class RSceneSave
+	{
+	public:
+		RSceneSave() : done(false), result(R_OK) {}
+
+		RBOOL IsDone();
+		RVOID Wait();
+		/** R_OK once written; meaningless before IsDone. */
+		RRESULT GetResult() { return result; }
+
+	private:
+		friend class RSceneFile;
+		RVOID Finish(RRESULT Result);
+
+		std::mutex lock;
+		std::condition_variable finished;
+		bool done;
+		RRESULT result;
+	};
+
+	typedef std::shared_ptr<RSceneSave> RSceneSaveHandle;
+
+	/** Binary snapshot of an RScene: the node hierarchy, local transforms and the meshes
+		and textures the nodes use.
+		@remarks
+			A snapshot is a single relocatable image. Open() maps it (or reads it with one
+			read), applies the relocation table so every RSceneRef becomes a pointer, and
+			the nodes can be walked straight from the image; Instantiate() then rebuilds
+			the scene's pools from it without any parsing. Capture() flattens a scene into
+			such an image in one pass over the nodes and does not touch the disk, so
+			SaveAsync() only holds the caller for the copy and leaves hashing and writing
+			to RThreadPool. Call them from the thread that updates the scene (Update) so
+			the copy is consistent. Files are written to a temporary name and renamed, so
+			an interrupted save leaves the previous one intact.
+			Lights and particle emitters are not part of the snapshot.
+	*/
+	class RSceneFile
+	{
+	public:
+		RSceneFile();
+		~RSceneFile();
+
+		/** Map memory-maps the file copy-on-write; otherwise it is read into one buffer. */
+		RRESULT Open(const std::string& Path, RBOOL Map = true);
+		RVOID Close();
+		RBOOL Verify() const;
+
+		const RSceneFileHeader& GetHeader() const { return *header; }
+		const RSceneFileNode* GetNodes() const;
+		const RSceneFileResource* GetResources() const;
+
+		/** Replaces Scene's nodes, meshes and textures with the snapshot's. Resources
+			are requested from RAssetLoader and stream in as usual.
+		*/
+		RRESULT Instantiate(RScene& Scene) const;
+
+		static RRESULT Capture(RScene& Scene, std::vector<unsigned char>& Image);
+		static RRESULT Save(RScene& Scene, const std::string& Path);
+		/** Captures now, writes on RThreadPool. Wait for the previous save to a path
+			before starting another to the same one.
+		*/
+		static RSceneSaveHandle SaveAsync(RScene& Scene, const std::string& Path);
+		/** Writes a captured image: fills in the content hash, then writes and renames. */
+		static RRESULT Write(std::vector<unsigned char>& Image, const std::string& Path);
+
+	private:
+		RSceneFile(const RSceneFile&);
+		RSceneFile& operator=(const RSceneFile&);
+
+		RRESULT Relocate();
+
+		unsigned char* base;
+		const RSceneFileHeader* header;
+		uint64_t size;
+		RBOOL mapped;
+#ifdef _WIN32
+		void* file;
+		void* mapping;
+#endif
+	};
+};
+
+#endif
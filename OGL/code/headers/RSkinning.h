@@ -0,0 +1,60 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef RSKINNING_H
+#define RSKINNING_H
+
+#include "reactor.h"
+
+namespace Reactor
+{
+	/** Source vertex streams for CPU skinning, four influences per vertex. */
+	struct RSkinStreams
+	{
+		const RFLOAT* positions;	// x y z per vertex
+		const RFLOAT* normals;		// x y z per vertex, or NULL
+		const uint8_t* indices;		// 4 bone indices per vertex
+		const RFLOAT* weights;		// 4 weights per vertex, summing to 1
+		RUINT count;
+	};
+
+	/** Dual quaternion skinning.
+		@remarks
+			BuildDualQuaternionPalette converts a matrix palette (e.g.
+			RAnimationInstance::GetPalette) to 32 bytes per bone. That is half the size of the
+			matrices to stream per vertex here, or to upload as vertex shader uniforms.
+			SkinDualQuaternion blends four bones per vertex with sign correction, renormalizes
+			and transforms positions and normals. It runs four vertices per SSE iteration and
+			splits large meshes over RThreadPool.
+	*/
+	class RSkinning
+	{
+	public:
+		static RVOID BuildDualQuaternionPalette(const RMatrix* Palette, RINT Count, RDualQuaternion* Out);
+		static RVOID SkinDualQuaternion(const RDualQuaternion* Palette, const RSkinStreams& In, RFLOAT* OutPositions, RFLOAT* OutNormals);
+	};
+};
+
+#endif
@@ -0,0 +1,107 @@
+/*
+Reactor 3D MIT License
+
+Copyright (c) 2010 Reiser Games
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RTHREADPOOL_H
+#define RTHREADPOOL_H
+
+#include "reactor.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+
+namespace Reactor
+{
+	/** Engine-wide worker threads.
+		@remarks
+			Enqueue() runs fire-and-forget tasks (file reads, decoding). ParallelFor() splits
+			a range into chunks that the workers and the calling thread pull until the range
+			is exhausted, and returns once every chunk has run. The range lives on the
+			caller's stack and the task is called through a pointer, so ParallelFor does not
+			allocate. The pool starts on first use with one thread per hardware core minus
+			the caller.
+	*/
+	class RThreadPool : public RSingleton<RThreadPool>
+	{
+	public:
+		typedef std::function<void()> RTask;
+		typedef std::function<void(RINT begin, RINT end)> RRangeTask;
+
+		RThreadPool();
+		~RThreadPool();
+
+		RVOID Init(RINT threadCount = 0);
+		RVOID Shutdown();
+		RINT GetThreadCount();
+
+		RVOID Enqueue(const RTask& task);
+
+		/** task is any callable taking (RINT begin, RINT end). */
+		template<class F> RVOID ParallelFor(RINT count, RINT grain, const F& task)
+		{
+			if(count <= 0)
+				return;
+			RRange range;
+			range.next = 0;
+			range.done = 0;
+			range.helpers = 0;
+			range.invoke = &Invoke<F>;
+			range.task = &task;
+			range.count = count;
+			range.grain = __max(1, grain);
+			range.chunks = (count + range.grain - 1) / range.grain;
+			Run(range);
+		}
+
+	private:
+		struct RRange
+		{
+			std::atomic<int> next;
+			std::atomic<int> done;
+			std::atomic<int> helpers;	// workers that may still touch it
+			RVOID (*invoke)(const RVOID* task, RINT begin, RINT end);
+			const RVOID* task;
+			RINT count, grain, chunks;
+		};
+
+		template<class F> static RVOID Invoke(const RVOID* task, RINT begin, RINT end)
+		{
+			(*(const F*)task)(begin, end);
+		}
+
+		RVOID Run(RRange& range);
+		static RVOID Drain(RRange& range);
+		RVOID WorkerMain();
+
+		std::vector<std::thread> workers;
+		std::deque<RTask> tasks;
+		std::vector<RRange*> ranges;
+		std::mutex lock;
+		std::condition_variable wake;
+		std::atomic<bool> running;	// read without the lock by Enqueue and GetThreadCount
+	};
+};
+
+#endif
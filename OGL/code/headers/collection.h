@@ -25,6 +25,8 @@ THE SOFTWARE.
 #ifndef RCOLLECTION
 #define RCOLLECTION
 
+#include "RMemoryTracker.h"
+
 
 
 
@@ -38,8 +40,9 @@ namespace Reactor
 	{
 	public:
 		/*@{*/
-		RArray( void ){ m_pData = NULL; m_nSize = 0; m_nMaxSize = 0; }
-		RArray( const RArray<T>& a ) { for( int i=0; i < a.m_nSize; i++ ) Add( a.m_pData[i] ); }
+		RArray( void ){ m_pData = NULL; m_nSize = 0; m_nMaxSize = 0; m_tag = RMEM_GENERAL; }
+		explicit RArray( RMEMORY_TAG tag ){ m_pData = NULL; m_nSize = 0; m_nMaxSize = 0; m_tag = tag; }
+		RArray( const RArray<T>& a ) { m_pData = NULL; m_nSize = 0; m_nMaxSize = 0; m_tag = a.m_tag; for( int i=0; i < a.m_nSize; i++ ) Add( a.m_pData[i] ); }
 		~RArray() { RemoveAll(); }
 
 		const T& operator[]( int nIndex ) const { return GetAt( nIndex ); }
@@ -67,12 +70,15 @@ namespace Reactor
 		RRESULT Remove( int nIndex );
 		void    RemoveAll() { SetSize(0); }
 		void	Reset() { m_nSize = 0; }
+		/** Subsystem the storage is charged to (see RMemoryTracker); set before the first Add. */
+		void	SetMemoryTag( RMEMORY_TAG tag ) { m_tag = tag; }
 		/*@}*/
 	protected:
 		/*@{*/
 		T*  m_pData;        /**< the actual array of data */
 		int m_nSize;        /**<  # of elements (upperBound - 1) */
 		int m_nMaxSize;     /**<  max allocated */
+		RMEMORY_TAG m_tag;  /**<  memory accounting tag */
 
 		RRESULT SetSizeInternal( int nNewMaxSize );  /**< This version doesn't call ctor or dtor. */
 		/*@}*/
@@ -92,7 +98,7 @@ namespace Reactor
 			// Shrink to 0 size & cleanup
 			if( m_pData )
 			{
-				free( m_pData );
+				RMemoryTracker::Free( m_pData );
 				m_pData = NULL;
 			}
 
@@ -114,7 +120,7 @@ namespace Reactor
 			if( sizeof( TYPE ) > UINT_MAX / ( unsigned int )nNewMaxSize )
 				return R_INVALIDARG;
 
-			TYPE* pDataNew = ( TYPE* )realloc( m_pData, nNewMaxSize * sizeof( TYPE ) );
+			TYPE* pDataNew = ( TYPE* )RMemoryTracker::Reallocate( m_tag, m_pData, nNewMaxSize * sizeof( TYPE ) );
 			if( pDataNew == NULL )
 				return R_OUTOFMEMORY;
 
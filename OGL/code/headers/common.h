@@ -130,7 +130,9 @@ typedef uint64_t GLuint64EXT;
 
 #endif
 
-typedef long RRESULT;
+// 32 bits like HRESULT: with a 64-bit long the error codes below would be positive
+// and FAILED would never see them.
+typedef int RRESULT;
 #define R_OK	((RRESULT)0L)
 #define R_FALSE ((RRESULT)1L)
 #define R_INVALIDARG	((RRESULT)0x80070057L)
@@ -64,6 +64,8 @@ namespace Reactor {
 #include "types/RVector4.h"
 #include "types/RQuaternion.h"
 #include "types/RMatrix.h"
+#include "types/RDualQuaternion.h"
+#include "types/RAffine3x4.h"
 
 namespace Reactor{
 
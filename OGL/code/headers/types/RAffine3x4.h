@@ -0,0 +1,185 @@
+
+#ifndef RAffine3x4H
+#define RAffine3x4H
+
+#include "../reactor.h"
+#include "RMatrix.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define R_AFFINE_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace Reactor
+{
+    /** Affine transform stored as the top three rows of a 4x4 matrix.
+        @remarks
+            The implied bottom row is (0 0 0 1), so the type is 48 bytes instead of 64, a
+            product costs 36 multiplies instead of 64, and the inverse only has to invert
+            the 3x3 part. m[row * 4 + column], column 3 is the translation. This is the
+            transpose of RMatrix's column-major layout, which keeps each row in one SSE
+            register. Converts implicitly to and from RMatrix; the conversion from RMatrix
+            drops the bottom row, so only pass affine matrices (no projections).
+    */
+    class alignas(16) RAffine3x4
+    {
+    public:
+        float m[12];
+
+        /// Identity
+        inline RAffine3x4()
+        {
+            setIdentity();
+        }
+
+        inline RAffine3x4(float m11, float m12, float m13, float m14,
+                          float m21, float m22, float m23, float m24,
+                          float m31, float m32, float m33, float m34)
+        {
+            m[0] = m11; m[1] = m12; m[2]  = m13; m[3]  = m14;
+            m[4] = m21; m[5] = m22; m[6]  = m23; m[7]  = m24;
+            m[8] = m31; m[9] = m32; m[10] = m33; m[11] = m34;
+        }
+
+        inline RAffine3x4(const RMatrix& Matrix)
+        {
+            const float* s = Matrix.m;
+            for(int r=0; r<3; r++){
+                m[r * 4]     = s[r];
+                m[r * 4 + 1] = s[4 + r];
+                m[r * 4 + 2] = s[8 + r];
+                m[r * 4 + 3] = s[12 + r];
+            }
+        }
+
+        inline operator RMatrix() const
+        {
+            RMatrix out;
+            float* d = out.m;
+            for(int r=0; r<3; r++){
+                d[r]      = m[r * 4];
+                d[4 + r]  = m[r * 4 + 1];
+                d[8 + r]  = m[r * 4 + 2];
+                d[12 + r] = m[r * 4 + 3];
+            }
+            d[3] = d[7] = d[11] = 0.0f;
+            d[15] = 1.0f;
+            return out;
+        }
+
+        inline void setIdentity()
+        {
+            for(int i=0; i<12; i++)
+                m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+        }
+
+        /// Scale, then rotate, then translate
+        static RAffine3x4 FromTRS(const RVector3& Translation, const RQuaternion& Rotation, const RVector3& Scale)
+        {
+            const RQuaternion& q = Rotation;
+            return RAffine3x4(
+                (1.0f - 2.0f * (q.y * q.y + q.z * q.z)) * Scale.x, 2.0f * (q.x * q.y - q.w * q.z) * Scale.y, 2.0f * (q.x * q.z + q.w * q.y) * Scale.z, Translation.x,
+                2.0f * (q.x * q.y + q.w * q.z) * Scale.x, (1.0f - 2.0f * (q.x * q.x + q.z * q.z)) * Scale.y, 2.0f * (q.y * q.z - q.w * q.x) * Scale.z, Translation.y,
+                2.0f * (q.x * q.z - q.w * q.y) * Scale.x, 2.0f * (q.y * q.z + q.w * q.x) * Scale.y, (1.0f - 2.0f * (q.x * q.x + q.y * q.y)) * Scale.z, Translation.z);
+        }
+
+        inline RVector3 GetTranslation() const
+        {
+            return RVector3(m[3], m[7], m[11]);
+        }
+
+        inline void SetTranslation(const RVector3& Translation)
+        {
+            m[3] = Translation.x;
+            m[7] = Translation.y;
+            m[11] = Translation.z;
+        }
+
+        /** Out = A * B (B applied first). Out may alias A or B. */
+        static inline void Multiply(const RAffine3x4& A, const RAffine3x4& B, RAffine3x4* Out)
+        {
+#ifdef R_AFFINE_SSE
+            __m128 b0 = _mm_load_ps(B.m), b1 = _mm_load_ps(B.m + 4), b2 = _mm_load_ps(B.m + 8);
+            // B's implicit (0, 0, 0, 1) row only passes A's translation through: mask it in
+            // instead of multiplying, leaving three products per row.
+            __m128 w = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+            __m128 r[3];
+            for(int i=0; i<3; i++){
+                const float* a = A.m + i * 4;
+                r[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), b0), _mm_mul_ps(_mm_set1_ps(a[1]), b1)),
+                                  _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[2]), b2), _mm_and_ps(_mm_load_ps(a), w)));
+            }
+            _mm_store_ps(Out->m, r[0]);
+            _mm_store_ps(Out->m + 4, r[1]);
+            _mm_store_ps(Out->m + 8, r[2]);
+#else
+            float r[12];
+            for(int i=0; i<3; i++){
+                const float* a = A.m + i * 4;
+                for(int j=0; j<4; j++)
+                    r[i * 4 + j] = a[0] * B.m[j] + a[1] * B.m[4 + j] + a[2] * B.m[8 + j];
+                r[i * 4 + 3] += a[3];
+            }
+            memcpy(Out->m, r, sizeof(r));
+#endif
+        }
+
+        inline RAffine3x4 operator* (const RAffine3x4& rkM) const
+        {
+            RAffine3x4 out;
+            Multiply(*this, rkM, &out);
+            return out;
+        }
+
+        inline RVector3 TransformPoint(const RVector3& p) const
+        {
+            return RVector3(m[0] * p.x + m[1] * p.y + m[2]  * p.z + m[3],
+                            m[4] * p.x + m[5] * p.y + m[6]  * p.z + m[7],
+                            m[8] * p.x + m[9] * p.y + m[10] * p.z + m[11]);
+        }
+
+        inline RVector3 TransformVector(const RVector3& v) const
+        {
+            return RVector3(m[0] * v.x + m[1] * v.y + m[2]  * v.z,
+                            m[4] * v.x + m[5] * v.y + m[6]  * v.z,
+                            m[8] * v.x + m[9] * v.y + m[10] * v.z);
+        }
+
+        /** Inverse of any invertible affine transform: the 3x3 part is inverted through its
+            cofactors and the translation becomes -inverse(3x3) * t. Returns false and leaves
+            Out untouched when the 3x3 part is singular.
+        */
+        bool Invert(RAffine3x4* Out) const
+        {
+            float c00 = m[5] * m[10] - m[6] * m[9];
+            float c01 = m[6] * m[8]  - m[4] * m[10];
+            float c02 = m[4] * m[9]  - m[5] * m[8];
+            float det = m[0] * c00 + m[1] * c01 + m[2] * c02;
+            if(fabsf(det) < 1e-12f)
+                return false;
+            float inv = 1.0f / det;
+            RAffine3x4 r(
+                c00 * inv, (m[2] * m[9] - m[1] * m[10]) * inv, (m[1] * m[6] - m[2] * m[5]) * inv, 0.0f,
+                c01 * inv, (m[0] * m[10] - m[2] * m[8]) * inv, (m[2] * m[4] - m[0] * m[6]) * inv, 0.0f,
+                c02 * inv, (m[1] * m[8] - m[0] * m[9]) * inv,  (m[0] * m[5] - m[1] * m[4]) * inv, 0.0f);
+            r.SetTranslation(-r.TransformVector(GetTranslation()));
+            *Out = r;
+            return true;
+        }
+
+        /** Inverse when the 3x3 part is a pure rotation (orthonormal): transpose it and
+            rotate the negated translation. No division, no determinant.
+        */
+        RAffine3x4 InverseOrthonormal() const
+        {
+            RAffine3x4 r(
+                m[0], m[4], m[8],  0.0f,
+                m[1], m[5], m[9],  0.0f,
+                m[2], m[6], m[10], 0.0f);
+            r.SetTranslation(-r.TransformVector(GetTranslation()));
+            return r;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,165 @@
+
+#ifndef RDualQuaternionH
+#define RDualQuaternionH
+
+#include "../reactor.h"
+#include "RQuaternion.h"
+#include "RMatrix.h"
+
+namespace Reactor
+{
+    /** Rigid transform (rotation then translation) as a unit dual quaternion.
+        @remarks
+            real holds the rotation and dual holds 0.5 * translation * real. Blending dual
+            quaternions and renormalizing gives skinning without the volume loss ("candy
+            wrapper") of blended matrices, and a bone takes 8 floats instead of 16.
+            Scale is not representable; matrices given to the constructor must be rigid.
+    */
+    class alignas(16) RDualQuaternion
+    {
+    public:
+        RQuaternion real;
+        RQuaternion dual;
+
+        /// Identity transform
+        inline RDualQuaternion()
+        : real(1, 0, 0, 0), dual(0, 0, 0, 0)
+        {
+        }
+
+        inline RDualQuaternion(const RQuaternion& Real, const RQuaternion& Dual)
+        : real(Real), dual(Dual)
+        {
+        }
+
+        /// Rotation followed by translation
+        inline RDualQuaternion(const RQuaternion& Rotation, const RVector3& Translation)
+        {
+            FromRotationTranslation(Rotation, Translation);
+        }
+
+        /// From the rotation and translation of a rigid column-major matrix
+        inline RDualQuaternion(const RMatrix& Transform)
+        {
+            FromMatrix(Transform);
+        }
+
+        void FromRotationTranslation(const RQuaternion& Rotation, const RVector3& Translation){
+            real = Rotation;
+            dual = RQuaternion(0, Translation.x * 0.5f, Translation.y * 0.5f, Translation.z * 0.5f) * Rotation;
+        }
+
+        void FromMatrix(const RMatrix& Transform){
+            // Shoemake's conversion on the upper 3x3; element (row, column) is m[column * 4 + row].
+            const float* m = Transform.m;
+            float trace = m[0] + m[5] + m[10];
+            RQuaternion q;
+            if(trace > 0.0f){
+                float s = sqrtf(trace + 1.0f) * 2.0f;
+                q = RQuaternion(0.25f * s, (m[6] - m[9]) / s, (m[8] - m[2]) / s, (m[1] - m[4]) / s);
+            } else if(m[0] > m[5] && m[0] > m[10]){
+                float s = sqrtf(1.0f + m[0] - m[5] - m[10]) * 2.0f;
+                q = RQuaternion((m[6] - m[9]) / s, 0.25f * s, (m[4] + m[1]) / s, (m[8] + m[2]) / s);
+            } else if(m[5] > m[10]){
+                float s = sqrtf(1.0f + m[5] - m[0] - m[10]) * 2.0f;
+                q = RQuaternion((m[8] - m[2]) / s, (m[4] + m[1]) / s, 0.25f * s, (m[9] + m[6]) / s);
+            } else {
+                float s = sqrtf(1.0f + m[10] - m[0] - m[5]) * 2.0f;
+                q = RQuaternion((m[1] - m[4]) / s, (m[8] + m[2]) / s, (m[9] + m[6]) / s, 0.25f * s);
+            }
+            q.normalise();
+            FromRotationTranslation(q, RVector3(m[12], m[13], m[14]));
+        }
+
+        RMatrix ToMatrix() const{
+            RMatrix out;
+            const RQuaternion& q = real;
+            float* m = out.m;
+            m[0] = 1.0f - 2.0f * (q.y * q.y + q.z * q.z);
+            m[1] = 2.0f * (q.x * q.y + q.w * q.z);
+            m[2] = 2.0f * (q.x * q.z - q.w * q.y);
+            m[3] = 0.0f;
+            m[4] = 2.0f * (q.x * q.y - q.w * q.z);
+            m[5] = 1.0f - 2.0f * (q.x * q.x + q.z * q.z);
+            m[6] = 2.0f * (q.y * q.z + q.w * q.x);
+            m[7] = 0.0f;
+            m[8] = 2.0f * (q.x * q.z + q.w * q.y);
+            m[9] = 2.0f * (q.y * q.z - q.w * q.x);
+            m[10] = 1.0f - 2.0f * (q.x * q.x + q.y * q.y);
+            m[11] = 0.0f;
+            RVector3 t = GetTranslation();
+            m[12] = t.x;
+            m[13] = t.y;
+            m[14] = t.z;
+            m[15] = 1.0f;
+            return out;
+        }
+
+        inline const RQuaternion& GetRotation() const{
+            return real;
+        }
+
+        /// t = 2 * dual * conjugate(real)
+        RVector3 GetTranslation() const{
+            RQuaternion t = dual * real.UnitInverse();
+            return RVector3(t.x * 2.0f, t.y * 2.0f, t.z * 2.0f);
+        }
+
+        /// Composition: (a * b) applies b first, like RMatrix multiplication
+        RDualQuaternion operator* (const RDualQuaternion& rkQ) const{
+            return RDualQuaternion(real * rkQ.real, real * rkQ.dual + dual * rkQ.real);
+        }
+
+        RDualQuaternion operator* (float fScalar) const{
+            return RDualQuaternion(real * fScalar, dual * fScalar);
+        }
+
+        RDualQuaternion operator+ (const RDualQuaternion& rkQ) const{
+            return RDualQuaternion(real + rkQ.real, dual + rkQ.dual);
+        }
+
+        /// Inverse of a unit dual quaternion
+        RDualQuaternion Inverse() const{
+            return RDualQuaternion(real.UnitInverse(), dual.UnitInverse());
+        }
+
+        /// Scales back to unit length and removes the drift between real and dual
+        void Normalize(){
+            float length = sqrtf(real.Norm());
+            if(length <= 0.0f)
+                return;
+            float inv = 1.0f / length;
+            real = real * inv;
+            dual = dual * inv;
+            dual = dual - real * real.Dot(dual);
+        }
+
+        RVector3 TransformVector(const RVector3& v) const{
+            // v + 2 r x (r x v + w v)
+            RVector3 r(real.x, real.y, real.z);
+            RVector3 c = r.crossProduct(v) + v * real.w;
+            return v + r.crossProduct(c) * 2.0f;
+        }
+
+        inline RVector3 TransformPoint(const RVector3& p) const{
+            return TransformVector(p) + GetTranslation();
+        }
+
+        /** Dual quaternion linear blending (Kavan et al. 2007) of Count transforms.
+            @remarks
+                Each input is flipped into the hemisphere of the first so blends take the
+                short way round.
+        */
+        static RDualQuaternion Blend(const RDualQuaternion* Transforms, const float* Weights, int Count){
+            RDualQuaternion out(RQuaternion(0, 0, 0, 0), RQuaternion(0, 0, 0, 0));
+            for(int i=0; i<Count; i++){
+                float w = Transforms[i].real.Dot(Transforms[0].real) < 0.0f ? -Weights[i] : Weights[i];
+                out = out + Transforms[i] * w;
+            }
+            out.Normalize();
+            return out;
+        }
+    };
+}
+
+#endif
@@ -600,10 +600,10 @@ namespace Reactor
                             rkT = rkQ;
                         }
 
-                        if (abs(fCos) < 1 - msEpsilon)
+                        if (fabs(fCos) < 1 - msEpsilon)
                         {
                             // Standard case (slerp)
-                            float fSin = sqrt(1 - sqrt(fCos));
+                            float fSin = sqrt(1 - fCos * fCos);
                             float fAngle = atan2(fSin, fCos);
                             float fInvSin = 1.0f / fSin;
                             float fCoeff0 = sin((1.0f - fT) * fAngle) * fInvSin;
@@ -0,0 +1,610 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RAnimation.h"
+#include "../headers/RCompressedClip.h"
+#include "../headers/RBlendTree.h"
+#include "../headers/RCamera.h"
+#include "../headers/RQuaternionBatch.h"
+#include "../headers/RThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define R_ANIMATION_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace Reactor {
+
+    // Stream order inside a clip frame.
+    enum { R_TX = 0, R_TY, R_TZ, R_QX, R_QY, R_QZ, R_QW, R_SX, R_SY, R_SZ, R_STREAMS };
+
+    // Out = A * B where both are affine (bottom row 0 0 0 1): the w terms drop out, leaving
+    // 12 products per matrix instead of 16. Out may alias A or B.
+    static inline void __multiplyAffine(const float* a, const float* b, float* out){
+#ifdef R_ANIMATION_SSE
+        __m128 c0 = _mm_loadu_ps(a), c1 = _mm_loadu_ps(a + 4), c2 = _mm_loadu_ps(a + 8), c3 = _mm_loadu_ps(a + 12);
+        __m128 r[4];
+        for(int j=0; j<4; j++){
+            r[j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(b[j * 4])), _mm_mul_ps(c1, _mm_set1_ps(b[j * 4 + 1]))),
+                              _mm_mul_ps(c2, _mm_set1_ps(b[j * 4 + 2])));
+        }
+        r[3] = _mm_add_ps(r[3], c3);
+        for(int j=0; j<4; j++)
+            _mm_storeu_ps(out + j * 4, r[j]);
+#else
+        float r[16];
+        for(int j=0; j<4; j++){
+            for(int i=0; i<3; i++)
+                r[j * 4 + i] = a[i] * b[j * 4] + a[4 + i] * b[j * 4 + 1] + a[8 + i] * b[j * 4 + 2];
+            r[j * 4 + 3] = 0.0f;
+        }
+        r[12] += a[12];
+        r[13] += a[13];
+        r[14] += a[14];
+        r[15] = 1.0f;
+        memcpy(out, r, sizeof(r));
+#endif
+    }
+
+    RVOID RPose::SetJoint(RINT Joint, const RJointPose& Pose){
+        tx[Joint] = Pose.translation.x;
+        ty[Joint] = Pose.translation.y;
+        tz[Joint] = Pose.translation.z;
+        qx[Joint] = Pose.rotation.x;
+        qy[Joint] = Pose.rotation.y;
+        qz[Joint] = Pose.rotation.z;
+        qw[Joint] = Pose.rotation.w;
+        sx[Joint] = Pose.scale.x;
+        sy[Joint] = Pose.scale.y;
+        sz[Joint] = Pose.scale.z;
+    }
+
+    RJointPose RPose::GetJoint(RINT Joint) const{
+        RJointPose pose;
+        pose.translation = RVector3(tx[Joint], ty[Joint], tz[Joint]);
+        pose.rotation = RQuaternion(qw[Joint], qx[Joint], qy[Joint], qz[Joint]);
+        pose.scale = RVector3(sx[Joint], sy[Joint], sz[Joint]);
+        return pose;
+    }
+
+    static RJointPose __identityJoint(){
+        RJointPose pose;
+        pose.translation = RVector3(0.0f, 0.0f, 0.0f);
+        pose.rotation = RQuaternion(1.0f, 0.0f, 0.0f, 0.0f);
+        pose.scale = RVector3(1.0f, 1.0f, 1.0f);
+        return pose;
+    }
+
+    RSkeleton::RSkeleton() : count(0){
+        RJointPose identity = __identityJoint();
+        for(int i=0; i<R_POSE_STRIDE; i++)
+            bindPose.SetJoint(i, identity);
+        for(int i=0; i<R_MAX_BONES; i++)
+            parents[i] = -1;
+    }
+
+    RRESULT RSkeleton::AddBone(const std::string& Name, RINT Parent, const RJointPose& BindPose, const RMatrix& InverseBindPose){
+        if(count >= R_MAX_BONES || Parent >= count || Parent < -1)
+            return R_INVALIDARG;
+        names.push_back(Name);
+        parents[count] = Parent;
+        bindPose.SetJoint(count, BindPose);
+        inverseBind[count] = InverseBindPose;
+        ++count;
+        return R_OK;
+    }
+
+    RINT RSkeleton::FindBone(const std::string& Name) const{
+        for(RINT i=0; i<count; i++){
+            if(names[i] == Name)
+                return i;
+        }
+        return -1;
+    }
+
+    RVOID RSkeleton::ComputeModelMatrices(const RPose& Local, const RMatrix& Root, RMatrix* Out) const{
+        // Local TRS to matrices, four joints at a time.
+        RINT i = 0;
+#ifdef R_ANIMATION_SSE
+        const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+        for(; i<count; i+=4){
+            __m128 x = _mm_load_ps(Local.qx + i), y = _mm_load_ps(Local.qy + i);
+            __m128 z = _mm_load_ps(Local.qz + i), w = _mm_load_ps(Local.qw + i);
+            __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+            __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+            __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+            __m128 sx = _mm_load_ps(Local.sx + i), sy = _mm_load_ps(Local.sy + i), sz = _mm_load_ps(Local.sz + i);
+
+            __m128 c0 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+            __m128 c1 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+            __m128 c2 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+            __m128 c3 = zero;
+            __m128 c4 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+            __m128 c5 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+            __m128 c6 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+            __m128 c7 = zero;
+            __m128 c8 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+            __m128 c9 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+            __m128 c10 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+            __m128 c11 = zero;
+            __m128 c12 = _mm_load_ps(Local.tx + i), c13 = _mm_load_ps(Local.ty + i), c14 = _mm_load_ps(Local.tz + i);
+            __m128 c15 = one;
+            _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+            _MM_TRANSPOSE4_PS(c4, c5, c6, c7);
+            _MM_TRANSPOSE4_PS(c8, c9, c10, c11);
+            _MM_TRANSPOSE4_PS(c12, c13, c14, c15);
+
+            // After the transposes register k of each group holds joint i + k's column.
+            __m128 columns[4][4] = { { c0, c4, c8, c12 }, { c1, c5, c9, c13 }, { c2, c6, c10, c14 }, { c3, c7, c11, c15 } };
+            for(int k=0; k<4 && i + k < count; k++){
+                for(int c=0; c<4; c++)
+                    _mm_storeu_ps(Out[i + k].m + c * 4, columns[k][c]);
+            }
+        }
+#else
+        for(; i<count; i++){
+            RFLOAT x = Local.qx[i], y = Local.qy[i], z = Local.qz[i], w = Local.qw[i];
+            RFLOAT* m = Out[i].m;
+            m[0] = (1.0f - 2.0f * (y * y + z * z)) * Local.sx[i];
+            m[1] = 2.0f * (x * y + w * z) * Local.sx[i];
+            m[2] = 2.0f * (x * z - w * y) * Local.sx[i];
+            m[3] = 0.0f;
+            m[4] = 2.0f * (x * y - w * z) * Local.sy[i];
+            m[5] = (1.0f - 2.0f * (x * x + z * z)) * Local.sy[i];
+            m[6] = 2.0f * (y * z + w * x) * Local.sy[i];
+            m[7] = 0.0f;
+            m[8] = 2.0f * (x * z + w * y) * Local.sz[i];
+            m[9] = 2.0f * (y * z - w * x) * Local.sz[i];
+            m[10] = (1.0f - 2.0f * (x * x + y * y)) * Local.sz[i];
+            m[11] = 0.0f;
+            m[12] = Local.tx[i];
+            m[13] = Local.ty[i];
+            m[14] = Local.tz[i];
+            m[15] = 1.0f;
+        }
+#endif
+
+        // Parents come first, so one forward pass resolves the whole hierarchy. Local and root
+        // transforms are affine, so the products skip the bottom row.
+        for(i=0; i<count; i++){
+            const RMatrix& parent = parents[i] < 0 ? Root : Out[parents[i]];
+            __multiplyAffine(parent.m, Out[i].m, Out[i].m);
+        }
+    }
+
+    RVOID RSkeleton::ComputeSkinPalette(const RMatrix* Model, RMatrix* Palette) const{
+        for(RINT i=0; i<count; i++)
+            __multiplyAffine(Model[i].m, inverseBind[i].m, Palette[i].m);
+    }
+
+    RAnimationClip::RAnimationClip() : boneCount(0), stride(0), frameCount(0), sampleRate(30.0f), duration(0.0f){
+    }
+
+    RRESULT RAnimationClip::Build(const RSkeleton& Skeleton, RFLOAT Duration, const std::vector<RKeyframe>& Keyframes, RFLOAT SampleRate){
+        if(Duration <= 0.0f || SampleRate <= 0.0f)
+            return R_INVALIDARG;
+
+        boneCount = Skeleton.GetBoneCount();
+        std::vector<std::vector<const RKeyframe*> > tracks(boneCount);
+        for(size_t k=0; k<Keyframes.size(); k++){
+            if(Keyframes[k].bone < 0 || Keyframes[k].bone >= boneCount)
+                return R_INVALIDARG;
+            tracks[Keyframes[k].bone].push_back(&Keyframes[k]);
+        }
+        for(RINT b=0; b<boneCount; b++){
+            std::stable_sort(tracks[b].begin(), tracks[b].end(), [](const RKeyframe* a, const RKeyframe* b){
+                return a->time < b->time;
+            });
+        }
+
+        duration = Duration;
+        sampleRate = SampleRate;
+        stride = (boneCount + 3) & ~3;
+        frameCount = (RINT)ceil(Duration * SampleRate) + 1;
+        frames.assign(frameCount * stride * R_STREAMS, 0.0f);
+
+        RJointPose identity = __identityJoint();
+        // Rotation end keys and blend factors for the frame, slerped in one batch per frame.
+        std::vector<RFLOAT> targets(stride * 4), blend(stride);
+        for(RINT f=0; f<frameCount; f++){
+            RFLOAT t = __min(f / SampleRate, Duration);
+            RFLOAT* frame = &frames[f * stride * R_STREAMS];
+            for(RINT b=0; b<stride; b++){
+                RJointPose pose = identity;
+                RQuaternion target = identity.rotation;
+                RFLOAT u = 0.0f;
+                if(b < boneCount && tracks[b].empty()){
+                    pose = Skeleton.GetBindPose().GetJoint(b);
+                } else if(b < boneCount){
+                    const std::vector<const RKeyframe*>& keys = tracks[b];
+                    size_t next = 0;
+                    while(next < keys.size() && keys[next]->time <= t)
+                        ++next;
+                    if(next == 0){
+                        pose = keys[0]->pose;
+                    } else if(next == keys.size()){
+                        pose = keys.back()->pose;
+                    } else {
+                        const RJointPose& a = keys[next - 1]->pose;
+                        const RJointPose& c = keys[next]->pose;
+                        RFLOAT span = keys[next]->time - keys[next - 1]->time;
+                        u = span > 0.0f ? (t - keys[next - 1]->time) / span : 0.0f;
+                        pose.translation = RVector3(a.translation.x + (c.translation.x - a.translation.x) * u,
+                                                    a.translation.y + (c.translation.y - a.translation.y) * u,
+                                                    a.translation.z + (c.translation.z - a.translation.z) * u);
+                        pose.rotation = a.rotation;
+                        target = c.rotation;
+                        pose.scale = RVector3(a.scale.x + (c.scale.x - a.scale.x) * u,
+                                              a.scale.y + (c.scale.y - a.scale.y) * u,
+                                              a.scale.z + (c.scale.z - a.scale.z) * u);
+                    }
+                }
+                if(u == 0.0f)
+                    target = pose.rotation;
+                RFLOAT values[R_STREAMS] = { pose.translation.x, pose.translation.y, pose.translation.z,
+                                             pose.rotation.x, pose.rotation.y, pose.rotation.z, pose.rotation.w,
+                                             pose.scale.x, pose.scale.y, pose.scale.z };
+                for(int s=0; s<R_STREAMS; s++)
+                    frame[s * stride + b] = values[s];
+                targets[b] = target.x;
+                targets[stride + b] = target.y;
+                targets[stride * 2 + b] = target.z;
+                targets[stride * 3 + b] = target.w;
+                blend[b] = u;
+            }
+            RQuaternionStreams rotations = { frame + R_QX * stride, frame + R_QY * stride, frame + R_QZ * stride, frame + R_QW * stride };
+            RQuaternionStreams ends = { &targets[0], &targets[stride], &targets[stride * 2], &targets[stride * 3] };
+            RQuaternionBatch::Slerp(rotations, ends, &blend[0], 0.0f, rotations, (RUINT)stride);
+        }
+        return R_OK;
+    }
+
+    RVOID RAnimationClip::Sample(RFLOAT Time, RBOOL Loop, RPose& Out) const{
+        if(frameCount == 0)
+            return;
+        if(Loop){
+            Time = fmodf(Time, duration);
+            if(Time < 0.0f)
+                Time += duration;
+        }
+        RFLOAT position = __max(0.0f, __min(Time, duration)) * sampleRate;
+        RINT f0 = __min((RINT)position, frameCount - 1);
+        RINT f1 = __min(f0 + 1, frameCount - 1);
+        RFLOAT alpha = position - f0;
+
+        const RFLOAT* a = Frame(f0);
+        const RFLOAT* b = Frame(f1);
+        RFLOAT* out[R_STREAMS] = { Out.tx, Out.ty, Out.tz, Out.qx, Out.qy, Out.qz, Out.qw, Out.sx, Out.sy, Out.sz };
+
+        RINT i = 0;
+#ifdef R_ANIMATION_SSE
+        const __m128 t = _mm_set1_ps(alpha);
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        for(; i<stride; i+=4){
+            // Translation and scale: plain lerp.
+            const int linear[6] = { R_TX, R_TY, R_TZ, R_SX, R_SY, R_SZ };
+            for(int s=0; s<6; s++){
+                __m128 va = _mm_loadu_ps(a + linear[s] * stride + i);
+                __m128 vb = _mm_loadu_ps(b + linear[s] * stride + i);
+                _mm_store_ps(out[linear[s]] + i, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), t)));
+            }
+
+            // Rotation: nlerp along the shortest arc, as RQuaternion::nlerp(t, a, b, true).
+            __m128 ax = _mm_loadu_ps(a + R_QX * stride + i), ay = _mm_loadu_ps(a + R_QY * stride + i);
+            __m128 az = _mm_loadu_ps(a + R_QZ * stride + i), aw = _mm_loadu_ps(a + R_QW * stride + i);
+            __m128 bx = _mm_loadu_ps(b + R_QX * stride + i), by = _mm_loadu_ps(b + R_QY * stride + i);
+            __m128 bz = _mm_loadu_ps(b + R_QZ * stride + i), bw = _mm_loadu_ps(b + R_QW * stride + i);
+            __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+            __m128 flip = _mm_and_ps(dot, sign);
+            bx = _mm_xor_ps(bx, flip);
+            by = _mm_xor_ps(by, flip);
+            bz = _mm_xor_ps(bz, flip);
+            bw = _mm_xor_ps(bw, flip);
+            __m128 x = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(bx, ax), t));
+            __m128 y = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(by, ay), t));
+            __m128 z = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(bz, az), t));
+            __m128 w = _mm_add_ps(aw, _mm_mul_ps(_mm_sub_ps(bw, aw), t));
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))));
+            __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), length);
+            _mm_store_ps(Out.qx + i, _mm_mul_ps(x, inv));
+            _mm_store_ps(Out.qy + i, _mm_mul_ps(y, inv));
+            _mm_store_ps(Out.qz + i, _mm_mul_ps(z, inv));
+            _mm_store_ps(Out.qw + i, _mm_mul_ps(w, inv));
+        }
+#else
+        for(; i<stride; i++){
+            for(int s=0; s<R_STREAMS; s++){
+                if(s < R_QX || s > R_QW)
+                    out[s][i] = a[s * stride + i] + (b[s * stride + i] - a[s * stride + i]) * alpha;
+            }
+            RQuaternion qa(a[R_QW * stride + i], a[R_QX * stride + i], a[R_QY * stride + i], a[R_QZ * stride + i]);
+            RQuaternion qb(b[R_QW * stride + i], b[R_QX * stride + i], b[R_QY * stride + i], b[R_QZ * stride + i]);
+            RQuaternion q = RQuaternion::nlerp(alpha, qa, qb, true);
+            Out.qx[i] = q.x;
+            Out.qy[i] = q.y;
+            Out.qz[i] = q.z;
+            Out.qw[i] = q.w;
+        }
+#endif
+    }
+
+    RVOID RAnimationClip::GetFrame(RINT Index, RPose& Out) const{
+        const RFLOAT* frame = Frame(__max(0, __min(Index, frameCount - 1)));
+        RFLOAT* out[R_STREAMS] = { Out.tx, Out.ty, Out.tz, Out.qx, Out.qy, Out.qz, Out.qw, Out.sx, Out.sy, Out.sz };
+        for(int s=0; s<R_STREAMS; s++)
+            memcpy(out[s], frame + s * stride, stride * sizeof(RFLOAT));
+    }
+
+    RAnimationInstance::RAnimationInstance(const RSkeleton* Skeleton)
+        : skeleton(Skeleton), clip(NULL), compressed(NULL), tree(NULL), time(0.0f), speed(1.0f), loop(true),
+          boundsCenter(0.0f, 0.0f, 0.0f), boundsRadius(0.0f), lod(RANIM_LOD_FULL), phase(0), step(0), gap(1), stale(true){
+        pose = Skeleton->GetBindPose();
+    }
+
+    RAnimationInstance::~RAnimationInstance(){
+    }
+
+    RVOID RAnimationInstance::Play(const RAnimationClip* Clip, RBOOL Loop){
+        clip = Clip;
+        compressed = NULL;
+        tree = NULL;
+        loop = Loop;
+        time = 0.0f;
+    }
+
+    RVOID RAnimationInstance::Play(const RCompressedClip* Clip, RBOOL Loop){
+        clip = NULL;
+        compressed = Clip;
+        tree = NULL;
+        if(!decoder)
+            decoder.reset(new RClipDecoder());
+        decoder->Reset(Clip);
+        loop = Loop;
+        time = 0.0f;
+    }
+
+    RVOID RAnimationInstance::Play(const RBlendTree* Tree){
+        clip = NULL;
+        compressed = NULL;
+        tree = Tree;
+        parameters = Tree->GetDefaults();
+        loop = true;
+        time = 0.0f;
+    }
+
+    RVOID RAnimationInstance::Advance(RFLOAT ElapsedSeconds){
+        if(tree != NULL){
+            // Tree clips loop on their own; the instance clock just runs.
+            time += ElapsedSeconds * speed;
+            return;
+        }
+        if(clip == NULL && compressed == NULL)
+            return;
+        time += ElapsedSeconds * speed;
+        RFLOAT duration = clip ? clip->GetDuration() : compressed->GetDuration();
+        if(loop){
+            time = fmodf(time, duration);
+            if(time < 0.0f)
+                time += duration;
+        } else {
+            time = __max(0.0f, __min(time, duration));
+        }
+    }
+
+    RVOID RAnimationInstance::Evaluate(){
+        SamplePose();
+        ComputeMatrices();
+    }
+
+    RVOID RAnimationInstance::SamplePose(){
+        if(clip != NULL){
+            clip->Sample(time, loop, pose);
+        } else if(compressed != NULL){
+            decoder->Sample(time, loop, pose);
+        } else if(tree != NULL){
+            RAnimationInstance* self = this;
+            tree->Evaluate(&self, 1);
+        } else {
+            pose = skeleton->GetBindPose();
+        }
+    }
+
+    RVOID RAnimationInstance::ComputeMatrices(){
+        skeleton->ComputeModelMatrices(pose, root, model);
+        skeleton->ComputeSkinPalette(model, palette);
+    }
+
+    static const RINT __periods[RANIM_LOD_COUNT] = { 1, 2, 4, 0 };
+
+    // Out = A + (B - A) * T over Count matrices.
+    static void __lerpPalette(const RMatrix* A, const RMatrix* B, RFLOAT T, RMatrix* Out, RINT Count){
+        for(RINT i=0; i<Count; i++){
+            const float* a = A[i].m;
+            const float* b = B[i].m;
+            float* out = Out[i].m;
+            for(int k=0; k<16; k++)
+                out[k] = a[k] + (b[k] - a[k]) * T;
+        }
+    }
+
+    RAnimationSystem::RAnimationSystem()
+        : camera(NULL), tanHalfFov(0.0f), cosCone(0.0f), sinCone(0.0f), frame(0), added(0){
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    RVOID RAnimationSystem::Add(RAnimationInstance* Instance){
+        // Spread reduced-rate evaluations over the four-frame cycle.
+        Instance->phase = added++ & 3;
+        Instance->stale = true;
+        instances.push_back(Instance);
+    }
+
+    RVOID RAnimationSystem::Remove(RAnimationInstance* Instance){
+        std::vector<RAnimationInstance*>::iterator it = std::find(instances.begin(), instances.end(), Instance);
+        if(it != instances.end()){
+            *it = instances.back();
+            instances.pop_back();
+        }
+    }
+
+    RVOID RAnimationSystem::SetCamera(const RCamera* Camera, RFLOAT FieldOfView, RFLOAT Aspect){
+        camera = Camera;
+        tanHalfFov = tanf(FieldOfView * 0.5f * (RFLOAT)PIdiv180);
+        // Cone around the view direction that encloses the whole frustum.
+        RFLOAT cone = atanf(tanHalfFov * sqrtf(1.0f + Aspect * Aspect));
+        cosCone = cosf(cone);
+        sinCone = sinf(cone);
+    }
+
+    RANIM_LOD RAnimationSystem::SelectLOD(const RAnimationInstance& Instance) const{
+        if(camera == NULL || Instance.boundsRadius <= 0.0f)
+            return RANIM_LOD_FULL;
+        const RVector3& eye = camera->GetPosition();
+        const RVector3& dir = camera->GetDirection();
+        RFLOAT dx = Instance.boundsCenter.x - eye.x, dy = Instance.boundsCenter.y - eye.y, dz = Instance.boundsCenter.z - eye.z;
+        RFLOAT radius = Instance.boundsRadius;
+        RFLOAT distance = sqrtf(dx * dx + dy * dy + dz * dz);
+        if(distance <= radius)
+            return RANIM_LOD_FULL;
+        RFLOAT depth = dx * dir.x + dy * dir.y + dz * dir.z;
+        // Sphere against the view cone: the centre's angle off-axis may exceed the cone by
+        // at most the sphere's angular radius.
+        RFLOAT lateral = sqrtf(__max(0.0f, distance * distance - depth * depth));
+        if(depth * sinCone - lateral * cosCone < -radius)
+            return RANIM_LOD_CULLED;
+        RFLOAT size = radius / (__max(depth, radius) * tanHalfFov);
+        if(size >= settings.halfRateSize)
+            return RANIM_LOD_FULL;
+        return size >= settings.quarterRateSize ? RANIM_LOD_HALF : RANIM_LOD_QUARTER;
+    }
+
+    RVOID RAnimationSystem::Update(RFLOAT ElapsedSeconds){
+        memset(&stats, 0, sizeof(stats));
+        if(instances.empty())
+            return;
+        // Group instances by blend tree. Trees rarely change, so the list is almost always
+        // already in order; an insertion sort is linear then and, unlike std::stable_sort,
+        // never allocates a merge buffer.
+        for(size_t i=1; i<instances.size(); i++){
+            RAnimationInstance* instance = instances[i];
+            size_t j = i;
+            for(; j > 0 && instances[j - 1]->tree > instance->tree; j--)
+                instances[j] = instances[j - 1];
+            instances[j] = instance;
+        }
+
+        std::atomic<int> counts[3 + RANIM_LOD_COUNT];
+        for(int i=0; i<3 + RANIM_LOD_COUNT; i++)
+            counts[i] = 0;
+
+        RAnimationInstance** list = &instances[0];
+        RUINT now = frame++;
+        // A character is a few microseconds of work; batch several per task.
+        RThreadPool::Instance()->ParallelFor((RINT)instances.size(), 8, [this, list, now, ElapsedSeconds, &counts](RINT begin, RINT end){
+            int local[3 + RANIM_LOD_COUNT] = { 0 };
+            RAnimationInstance* due[8];
+            RFLOAT saved[8];
+            RINT pending = 0;
+
+            // Samples the gathered instances, same-tree runs as one batch, then builds their palettes.
+            auto flush = [&](){
+                for(RINT i=0; i<pending; ){
+                    const RBlendTree* tree = due[i]->tree;
+                    RINT run = i + 1;
+                    if(tree != NULL){
+                        while(run < pending && due[run]->tree == tree)
+                            run++;
+                        tree->Evaluate(due + i, run - i);
+                    } else {
+                        due[i]->SamplePose();
+                    }
+                    i = run;
+                }
+                for(RINT i=0; i<pending; i++){
+                    RAnimationInstance* instance = due[i];
+                    instance->time = saved[i];
+                    instance->ComputeMatrices();
+                    if(instance->gap > 1){
+                        memcpy(instance->target, instance->palette, sizeof(instance->palette));
+                        if(instance->stale)
+                            memcpy(instance->previous, instance->target, sizeof(instance->target));
+                        __lerpPalette(instance->previous, instance->target, 1.0f / instance->gap, instance->palette, instance->skeleton->GetBoneCount());
+                    }
+                    instance->stale = false;
+                }
+                pending = 0;
+            };
+
+            for(RINT i=begin; i<end; i++){
+                RAnimationInstance* instance = list[i];
+                instance->Advance(ElapsedSeconds);
+                RANIM_LOD lod = SelectLOD(*instance);
+                local[3 + lod]++;
+                if(lod == RANIM_LOD_CULLED){
+                    instance->lod = lod;
+                    instance->stale = true;
+                    local[2]++;
+                    continue;
+                }
+
+                RINT period = __periods[lod];
+                RINT slot = (RINT)((now + instance->phase) % period);
+                // A faster tier than the one the last evaluation was planned for takes effect now.
+                RBOOL faster = lod < instance->lod;
+                instance->lod = lod;
+                if(!instance->stale && !faster && slot != 0 && instance->step + 1 < instance->gap){
+                    instance->step++;
+                    __lerpPalette(instance->previous, instance->target, (RFLOAT)(instance->step + 1) / instance->gap,
+                                  instance->palette, instance->skeleton->GetBoneCount());
+                    local[1]++;
+                    continue;
+                }
+
+                // Evaluate at the last frame before the next scheduled evaluation and interpolate
+                // towards it until then.
+                instance->gap = period - slot;
+                instance->step = 0;
+                if(instance->gap > 1)
+                    memcpy(instance->previous, instance->palette, sizeof(instance->palette));
+                saved[pending] = instance->time;
+                instance->time += (instance->gap - 1) * ElapsedSeconds * instance->speed;
+                due[pending++] = instance;
+                local[0]++;
+                if(pending == 8)
+                    flush();
+            }
+            flush();
+            for(int i=0; i<3 + RANIM_LOD_COUNT; i++){
+                if(local[i])
+                    counts[i] += local[i];
+            }
+        });
+
+        stats.evaluated = counts[0];
+        stats.interpolated = counts[1];
+        stats.culled = counts[2];
+        for(int i=0; i<RANIM_LOD_COUNT; i++)
+            stats.tiers[i] = counts[3 + i];
+    }
+};
@@ -0,0 +1,527 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RAssetLoader.h"
+#include "../headers/RMemory.h"
+#include "../headers/RMemoryTracker.h"
+#include <chrono>
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace Reactor {
+
+    static RUINT __read32(const unsigned char* p){
+        return (RUINT)p[0] | ((RUINT)p[1] << 8) | ((RUINT)p[2] << 16) | ((RUINT)p[3] << 24);
+    }
+
+    static RUINT __read16(const unsigned char* p){
+        return (RUINT)p[0] | ((RUINT)p[1] << 8);
+    }
+
+    static RBOOL __decodeDDS(const std::vector<unsigned char>& bytes, RAsset& asset){
+        if(bytes.size() < 128 || memcmp(&bytes[0], "DDS ", 4) != 0){
+            asset.error = "not a DDS file";
+            return false;
+        }
+        const unsigned char* h = &bytes[0];
+        RTextureData& tex = asset.textureData;
+        tex.height = (RINT)__read32(h + 12);
+        tex.width = (RINT)__read32(h + 16);
+        RUINT mipCount = __max(1u, __read32(h + 28));
+        RUINT pfFlags = __read32(h + 80);
+        RUINT fourCC = __read32(h + 84);
+        RUINT bitCount = __read32(h + 88);
+        RUINT rMask = __read32(h + 92);
+        RUINT caps2 = __read32(h + 112);
+
+        if(tex.width <= 0 || tex.height <= 0 || tex.width > 65536 || tex.height > 65536){
+            asset.error = "invalid DDS dimensions";
+            return false;
+        }
+
+        if(caps2 & 0x200){
+            asset.error = "cube map DDS is not supported by the 2D texture path";
+            return false;
+        }
+
+        RUINT blockSize = 0;
+        tex.compressed = (pfFlags & 0x4) != 0;
+        if(tex.compressed){
+            if(fourCC == __read32((const unsigned char*)"DXT1")){
+                tex.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+                blockSize = 8;
+            } else if(fourCC == __read32((const unsigned char*)"DXT3")){
+                tex.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+                blockSize = 16;
+            } else if(fourCC == __read32((const unsigned char*)"DXT5")){
+                tex.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+                blockSize = 16;
+            } else {
+                asset.error = "unsupported DDS fourCC";
+                return false;
+            }
+            tex.format = tex.internalFormat;
+            tex.type = 0;
+        } else if(bitCount == 32){
+            tex.internalFormat = GL_RGBA;
+            tex.format = (rMask == 0x00ff0000) ? GL_BGRA : GL_RGBA;
+            tex.type = GL_UNSIGNED_BYTE;
+        } else {
+            asset.error = "unsupported DDS pixel format";
+            return false;
+        }
+
+        // Sizes in size_t: a large uncompressed level overflows 32 bits.
+        size_t offset = 0;
+        size_t available = bytes.size() - 128;
+        RINT w = tex.width, hgt = tex.height;
+        for(RUINT i=0; i<mipCount; i++){
+            size_t size = tex.compressed ? (size_t)__max(1, (w + 3) / 4) * (size_t)__max(1, (hgt + 3) / 4) * blockSize : (size_t)w * (size_t)hgt * 4;
+            if(size > available - offset)
+                break;
+            // RMipLevel keeps 32-bit offsets and sizes.
+            if(offset + size > 0xFFFFFFFFu){
+                asset.error = "DDS mip chain too large";
+                return false;
+            }
+            RMipLevel mip;
+            mip.width = w;
+            mip.height = hgt;
+            mip.offset = (RUINT)offset;
+            mip.size = (RUINT)size;
+            tex.mips.push_back(mip);
+            offset += size;
+            w = __max(1, w / 2);
+            hgt = __max(1, hgt / 2);
+        }
+        if(tex.mips.empty()){
+            asset.error = "truncated DDS file";
+            return false;
+        }
+        tex.pixels.assign(bytes.begin() + 128, bytes.begin() + 128 + offset);
+        return true;
+    }
+
+    #define R_MAX_TGA_SIZE 16384	// per side; also keeps the level size within RMipLevel's 32 bits
+
+    static RBOOL __decodeTGA(const std::vector<unsigned char>& bytes, RAsset& asset){
+        if(bytes.size() < 18){
+            asset.error = "truncated TGA header";
+            return false;
+        }
+        const unsigned char* h = &bytes[0];
+        RUINT imageType = h[2];
+        RINT width = (RINT)__read16(h + 12);
+        RINT height = (RINT)__read16(h + 14);
+        RUINT bpp = h[16];
+        RBOOL topDown = (h[17] & 0x20) != 0;
+        RBOOL rle = (imageType == 10 || imageType == 11);
+        RBOOL gray = (imageType == 3 || imageType == 11);
+        RUINT pixelSize = bpp / 8;
+
+        if(h[1] != 0 || !(imageType == 2 || imageType == 3 || rle) ||
+           !(pixelSize == 4 || pixelSize == 3 || (gray && pixelSize == 1))){
+            asset.error = "unsupported TGA format";
+            return false;
+        }
+
+        RTextureData& tex = asset.textureData;
+        tex.width = width;
+        tex.height = height;
+        tex.compressed = false;
+        tex.type = GL_UNSIGNED_BYTE;
+        tex.format = gray ? GL_LUMINANCE : (pixelSize == 4 ? GL_BGRA : GL_BGR);
+        tex.internalFormat = gray ? GL_LUMINANCE : (pixelSize == 4 ? GL_RGBA : GL_RGB);
+
+        if(width == 0 || height == 0 || bytes.size() < 18u + h[0]){
+            asset.error = "truncated TGA header";
+            return false;
+        }
+        if(width > R_MAX_TGA_SIZE || height > R_MAX_TGA_SIZE){
+            asset.error = "TGA image too large";
+            return false;
+        }
+        // Checked before resizing so a lying header cannot ask for gigabytes. An RLE
+        // packet is at least a count byte and one pixel and expands to 128 pixels at most.
+        size_t total = (size_t)width * (size_t)height * pixelSize;
+        const unsigned char* src = h + 18 + h[0];
+        const unsigned char* end = &bytes[0] + bytes.size();
+        size_t limit = rle ? (size_t)(end - src) / (1 + pixelSize) * 128 * pixelSize : (size_t)(end - src);
+        if(total > limit){
+            asset.error = "truncated TGA data";
+            return false;
+        }
+        tex.pixels.resize(total);
+        unsigned char* dst = &tex.pixels[0];
+
+        if(!rle){
+            memcpy(dst, src, total);
+        } else {
+            size_t written = 0;
+            while(written < total){
+                if(src >= end){
+                    asset.error = "truncated TGA data";
+                    return false;
+                }
+                RUINT packet = *src++;
+                RUINT count = (packet & 0x7f) + 1;
+                size_t bytesOut = __min((size_t)(count * pixelSize), total - written);
+                if(packet & 0x80){
+                    if(src + pixelSize > end){
+                        asset.error = "truncated TGA data";
+                        return false;
+                    }
+                    for(RUINT i=0; i<bytesOut; i+=pixelSize)
+                        memcpy(dst + written + i, src, pixelSize);
+                    src += pixelSize;
+                } else {
+                    if((size_t)(end - src) < bytesOut){
+                        asset.error = "truncated TGA data";
+                        return false;
+                    }
+                    memcpy(dst + written, src, bytesOut);
+                    src += bytesOut;
+                }
+                written += bytesOut;
+            }
+        }
+
+        // GL expects the bottom row first, which is the TGA default.
+        if(topDown){
+            RScratchScope scope;
+            RUINT pitch = width * pixelSize;
+            unsigned char* row = RFrameArena::Allocate<unsigned char>(pitch);
+            for(RINT y=0; y<height/2; y++){
+                unsigned char* a = dst + y * pitch;
+                unsigned char* b = dst + (height - 1 - y) * pitch;
+                memcpy(row, a, pitch);
+                memcpy(a, b, pitch);
+                memcpy(b, row, pitch);
+            }
+        }
+
+        RMipLevel mip;
+        mip.offset = 0;
+        mip.size = (RUINT)total;
+        mip.width = width;
+        mip.height = height;
+        tex.mips.push_back(mip);
+        return true;
+    }
+
+    static RBOOL __decodeRMesh(const std::string& path, RAsset& asset){
+        std::shared_ptr<RMeshFile> file(new RMeshFile());
+        if(FAILED(file->Open(path))){
+            asset.error = "invalid rmesh file " + path;
+            return false;
+        }
+        const RMeshFileHeader& h = file->GetHeader();
+        RMeshData& mesh = asset.meshData;
+        mesh.vertexStride = h.vertexStride;
+        mesh.vertexCount = h.vertexCount;
+        mesh.indexCount = h.indexCount;
+        mesh.indexType = h.indexSize == 4 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+        mesh.mapping = file;
+        return true;
+    }
+
+    static std::string __extension(const std::string& path){
+        size_t dot = path.find_last_of('.');
+        if(dot == std::string::npos)
+            return "";
+        std::string ext = path.substr(dot + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext;
+    }
+
+    RAsset::RAsset(const std::string& Path, RASSET_TYPE Type){
+        path = Path;
+        type = Type;
+        texture = vertexBuffer = indexBuffer = 0;
+        width = height = 0;
+        vertexStride = vertexCount = indexCount = 0;
+        indexType = GL_UNSIGNED_SHORT;
+        residentBytes = 0;
+        uploadSerial = 0;
+        state = RASSET_QUEUED;
+    }
+
+    RAssetLoader::RAssetLoader(){
+        pending = 0;
+        uploadBudget = 2.0f;
+        RegisterDecoder("dds", RASSET_TEXTURE, __decodeDDS);
+        RegisterDecoder("tga", RASSET_TEXTURE, __decodeTGA);
+        RegisterFileDecoder("rmesh", RASSET_MESH, __decodeRMesh);
+        uploadSerial = 0;
+        RMemoryTracker::SetEvictor(RMEM_TEXTURES, [this](RMEMORY_TAG, size_t Excess){ return Evict(RASSET_TEXTURE, Excess); });
+        RMemoryTracker::SetEvictor(RMEM_MESHES, [this](RMEMORY_TAG, size_t Excess){ return Evict(RASSET_MESH, Excess); });
+    }
+
+    RAssetLoader::~RAssetLoader(){
+        RMemoryTracker::SetEvictor(RMEM_TEXTURES, RMemoryEvictor());
+        RMemoryTracker::SetEvictor(RMEM_MESHES, RMemoryEvictor());
+    }
+
+    RVOID RAssetLoader::RegisterDecoder(const std::string& Extension, RASSET_TYPE Type, const RAssetDecoder& Decoder){
+        std::unique_lock<std::mutex> guard(lock);
+        RDecoderEntry entry;
+        entry.type = Type;
+        entry.decoder = Decoder;
+        decoders[__extension("." + Extension)] = entry;
+    }
+
+    RVOID RAssetLoader::RegisterFileDecoder(const std::string& Extension, RASSET_TYPE Type, const RAssetFileDecoder& Decoder){
+        std::unique_lock<std::mutex> guard(lock);
+        RDecoderEntry entry;
+        entry.type = Type;
+        entry.fileDecoder = Decoder;
+        decoders[__extension("." + Extension)] = entry;
+    }
+
+    RVOID RAssetLoader::SetUploadBudget(RFLOAT Milliseconds){
+        uploadBudget = Milliseconds;
+    }
+
+    RINT RAssetLoader::GetPendingCount(){
+        return pending.load();
+    }
+
+    RAssetHandle RAssetLoader::Load(const std::string& Path){
+        std::unique_lock<std::mutex> guard(lock);
+        std::map<std::string, RAssetHandle>::iterator it = assets.find(Path);
+        if(it != assets.end())
+            return it->second;
+
+        std::map<std::string, RDecoderEntry>::iterator dec = decoders.find(__extension(Path));
+        RAssetHandle asset(new RAsset(Path, dec != decoders.end() ? dec->second.type : RASSET_TEXTURE));
+        assets[Path] = asset;
+        if(dec == decoders.end()){
+            asset->error = "no decoder registered for " + Path;
+            asset->state = RASSET_FAILED;
+            return asset;
+        }
+        ++pending;
+        guard.unlock();
+
+        RThreadPool::Instance()->Enqueue([this, asset](){ Decode(asset); });
+        return asset;
+    }
+
+    RVOID RAssetLoader::Decode(RAssetHandle Asset){
+        Asset->state = RASSET_DECODING;
+
+        RDecoderEntry entry;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            entry = decoders[__extension(Asset->path)];
+        }
+
+        RBOOL ok = false;
+        if(entry.fileDecoder){
+            ok = entry.fileDecoder(Asset->path, *Asset);
+        } else {
+            std::vector<unsigned char> bytes;
+            FILE* f = fopen(Asset->path.c_str(), "rb");
+            if(f != NULL){
+                fseek(f, 0, SEEK_END);
+                long size = ftell(f);
+                fseek(f, 0, SEEK_SET);
+                if(size > 0){
+                    bytes.resize(size);
+                    ok = fread(&bytes[0], 1, size, f) == (size_t)size;
+                }
+                fclose(f);
+            }
+            if(!ok)
+                Asset->error = "could not read " + Asset->path;
+            else
+                ok = entry.decoder(bytes, *Asset);
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        if(ok){
+            Asset->state = RASSET_DECODED;
+            uploads.push_back(Asset);
+        } else {
+            Asset->state = RASSET_FAILED;
+            --pending;
+        }
+        decoded.notify_all();
+    }
+
+    RVOID RAssetLoader::Upload(RAsset& Asset){
+        if(Asset.type == RASSET_TEXTURE){
+            RTextureData& tex = Asset.textureData;
+            glGenTextures(1, &Asset.texture);
+            glBindTexture(GL_TEXTURE_2D, Asset.texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for(size_t i=0; i<tex.mips.size(); i++){
+                const RMipLevel& mip = tex.mips[i];
+                const unsigned char* data = &tex.pixels[mip.offset];
+                if(tex.compressed)
+                    glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, tex.internalFormat, mip.width, mip.height, 0, mip.size, data);
+                else
+                    glTexImage2D(GL_TEXTURE_2D, (GLint)i, tex.internalFormat, mip.width, mip.height, 0, tex.format, tex.type, data);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, tex.mips.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)tex.mips.size() - 1);
+            Asset.width = tex.width;
+            Asset.height = tex.height;
+            Asset.residentBytes = tex.pixels.size();
+            RTextureData empty;
+            std::swap(tex, empty);
+        } else {
+            RMeshData& mesh = Asset.meshData;
+            const void* vertices = mesh.vertices.empty() ? NULL : &mesh.vertices[0];
+            const void* indices = mesh.indices.empty() ? NULL : &mesh.indices[0];
+            size_t vertexBytes = mesh.vertices.size();
+            size_t indexBytes = mesh.indices.size();
+            if(mesh.mapping){
+                vertices = mesh.mapping->GetVertices();
+                indices = mesh.mapping->GetIndices();
+                vertexBytes = (size_t)mesh.mapping->GetVertexBytes();
+                indexBytes = (size_t)mesh.mapping->GetIndexBytes();
+            }
+            glGenBuffers(1, &Asset.vertexBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, Asset.vertexBuffer);
+            glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices, GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            if(indexBytes > 0){
+                glGenBuffers(1, &Asset.indexBuffer);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Asset.indexBuffer);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            }
+            Asset.vertexStride = mesh.vertexStride;
+            Asset.vertexCount = mesh.vertexCount;
+            Asset.indexCount = mesh.indexCount;
+            Asset.indexType = mesh.indexType;
+            Asset.residentBytes = vertexBytes + indexBytes;
+            RMeshData empty;
+            std::swap(mesh, empty);
+        }
+        RMemoryTracker::Track(Asset.type == RASSET_TEXTURE ? RMEM_TEXTURES : RMEM_MESHES, (long long)Asset.residentBytes);
+        Asset.uploadSerial = ++uploadSerial;
+        Asset.state = RASSET_RESIDENT;
+        --pending;
+    }
+
+    RVOID RAssetLoader::Wait(const RAssetHandle& Asset){
+        std::unique_lock<std::mutex> guard(lock);
+        while(Asset->GetState() < RASSET_DECODED)
+            decoded.wait(guard);
+        if(Asset->GetState() != RASSET_DECODED)
+            return;
+        if(renderThread != std::thread::id() && renderThread != std::this_thread::get_id()){
+            // No GL context here (the simulation thread in threaded mode). Blocking until the
+            // render thread uploads could deadlock on the frame pipeline, so the asset jumps
+            // the queue instead and the next pump uploads it first.
+            std::deque<RAssetHandle>::iterator it = std::find(uploads.begin(), uploads.end(), Asset);
+            if(it != uploads.end()){
+                uploads.erase(it);
+                uploads.push_front(Asset);
+            }
+            return;
+        }
+        guard.unlock();
+        // Leaves its entry in the upload queue; PumpUploads skips assets already resident.
+        Upload(*Asset);
+    }
+
+    RVOID RAssetLoader::PumpUploads(){
+        using namespace std::chrono;
+        steady_clock::time_point start = steady_clock::now();
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            renderThread = std::this_thread::get_id();
+            if(!deadTextures.empty())
+                glDeleteTextures((GLsizei)deadTextures.size(), &deadTextures[0]);
+            if(!deadBuffers.empty())
+                glDeleteBuffers((GLsizei)deadBuffers.size(), &deadBuffers[0]);
+            deadTextures.clear();
+            deadBuffers.clear();
+        }
+        for(;;){
+            RAssetHandle asset;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                if(uploads.empty())
+                    return;
+                asset = uploads.front();
+                uploads.pop_front();
+            }
+            if(asset->GetState() == RASSET_DECODED)
+                Upload(*asset);
+            if(duration<float, std::milli>(steady_clock::now() - start).count() >= uploadBudget)
+                return;
+        }
+    }
+
+    RVOID RAssetLoader::Release(const RAssetHandle& Asset){
+        // Budget eviction runs at the end of the simulation step, which in threaded mode has
+        // no GL context, so the names are only queued here. The budget sees the bytes go now.
+        RMemoryTracker::Track(Asset->type == RASSET_TEXTURE ? RMEM_TEXTURES : RMEM_MESHES, -(long long)Asset->residentBytes);
+        Asset->residentBytes = 0;
+
+        std::unique_lock<std::mutex> guard(lock);
+        if(Asset->texture != 0)
+            deadTextures.push_back(Asset->texture);
+        if(Asset->vertexBuffer != 0)
+            deadBuffers.push_back(Asset->vertexBuffer);
+        if(Asset->indexBuffer != 0)
+            deadBuffers.push_back(Asset->indexBuffer);
+        Asset->texture = Asset->vertexBuffer = Asset->indexBuffer = 0;
+        assets.erase(Asset->path);
+    }
+
+    size_t RAssetLoader::Evict(RASSET_TYPE Type, size_t Bytes){
+        // Only assets nobody outside the cache holds a handle to, oldest upload first.
+        std::vector<RAssetHandle> candidates;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            for(std::map<std::string, RAssetHandle>::iterator it = assets.begin(); it != assets.end(); ++it){
+                const RAssetHandle& asset = it->second;
+                if(asset->type == Type && asset->residentBytes > 0 && asset.use_count() == 1)
+                    candidates.push_back(asset);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const RAssetHandle& a, const RAssetHandle& b){
+            return a->uploadSerial < b->uploadSerial;
+        });
+        size_t freed = 0;
+        for(size_t i=0; i<candidates.size() && freed < Bytes; i++){
+            // The cache and this list; anything more means it was loaded again meanwhile.
+            if(candidates[i].use_count() > 2)
+                continue;
+            freed += candidates[i]->residentBytes;
+            Release(candidates[i]);
+        }
+        return freed;
+    }
+};
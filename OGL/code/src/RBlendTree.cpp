@@ -0,0 +1,490 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RBlendTree.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define R_BLEND_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace Reactor {
+
+    // Four joints of one stream. The kernels below are written once against this and compile
+    // to SSE where it is available.
+#ifdef R_BLEND_SSE
+    struct RLane { __m128 v; };
+    static inline RLane __load(const float* p){ RLane r = { _mm_load_ps(p) }; return r; }
+    static inline RLane __loadUnaligned(const float* p){ RLane r = { _mm_loadu_ps(p) }; return r; }
+    static inline void __store(float* p, RLane a){ _mm_store_ps(p, a.v); }
+    static inline RLane __set(float f){ RLane r = { _mm_set1_ps(f) }; return r; }
+    static inline RLane operator+(RLane a, RLane b){ RLane r = { _mm_add_ps(a.v, b.v) }; return r; }
+    static inline RLane operator-(RLane a, RLane b){ RLane r = { _mm_sub_ps(a.v, b.v) }; return r; }
+    static inline RLane operator*(RLane a, RLane b){ RLane r = { _mm_mul_ps(a.v, b.v) }; return r; }
+    // a with the sign of s flipped in, per lane.
+    static inline RLane __flip(RLane a, RLane s){ RLane r = { _mm_xor_ps(a.v, _mm_and_ps(s.v, _mm_set1_ps(-0.0f))) }; return r; }
+    static inline RLane __rsqrt(RLane a){ RLane r = { _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(a.v)) }; return r; }
+#else
+    struct RLane { float v[4]; };
+    static inline RLane __load(const float* p){ RLane r; for(int i=0; i<4; i++) r.v[i] = p[i]; return r; }
+    static inline RLane __loadUnaligned(const float* p){ return __load(p); }
+    static inline void __store(float* p, RLane a){ for(int i=0; i<4; i++) p[i] = a.v[i]; }
+    static inline RLane __set(float f){ RLane r; for(int i=0; i<4; i++) r.v[i] = f; return r; }
+    static inline RLane operator+(RLane a, RLane b){ for(int i=0; i<4; i++) a.v[i] += b.v[i]; return a; }
+    static inline RLane operator-(RLane a, RLane b){ for(int i=0; i<4; i++) a.v[i] -= b.v[i]; return a; }
+    static inline RLane operator*(RLane a, RLane b){ for(int i=0; i<4; i++) a.v[i] *= b.v[i]; return a; }
+    static inline RLane __flip(RLane a, RLane s){ for(int i=0; i<4; i++) a.v[i] = s.v[i] < 0.0f ? -a.v[i] : a.v[i]; return a; }
+    static inline RLane __rsqrt(RLane a){ for(int i=0; i<4; i++) a.v[i] = 1.0f / sqrtf(a.v[i]); return a; }
+#endif
+
+    struct RLaneQuat { RLane x, y, z, w; };
+
+    static inline RLaneQuat __loadQuat(const RPose& P, RINT i){
+        RLaneQuat q = { __load(P.qx + i), __load(P.qy + i), __load(P.qz + i), __load(P.qw + i) };
+        return q;
+    }
+
+    static inline void __storeQuat(RPose& P, RINT i, const RLaneQuat& q){
+        RLane inv = __rsqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+        __store(P.qx + i, q.x * inv);
+        __store(P.qy + i, q.y * inv);
+        __store(P.qz + i, q.z * inv);
+        __store(P.qw + i, q.w * inv);
+    }
+
+    static inline RLane __dot(const RLaneQuat& a, const RLaneQuat& b){
+        return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    }
+
+    static inline RLaneQuat __multiply(const RLaneQuat& a, const RLaneQuat& b){
+        RLaneQuat r;
+        r.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+        r.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+        r.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+        r.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+        return r;
+    }
+
+    static inline void __linearStreams(const RPose& P, const RFLOAT* Out[6]){
+        Out[0] = P.tx; Out[1] = P.ty; Out[2] = P.tz; Out[3] = P.sx; Out[4] = P.sy; Out[5] = P.sz;
+    }
+
+    static inline void __linearStreams(RPose& P, RFLOAT* Out[6]){
+        Out[0] = P.tx; Out[1] = P.ty; Out[2] = P.tz; Out[3] = P.sx; Out[4] = P.sy; Out[5] = P.sz;
+    }
+
+    // Out = A -> B by Weight, or by Weight * Mask[joint] when a mask is given. Out may alias A or B.
+    static void __blend(const RPose& A, const RPose& B, const RFLOAT* Mask, RFLOAT Weight, RPose& Out, RINT Lanes){
+        const RFLOAT* a[6]; const RFLOAT* b[6]; RFLOAT* out[6];
+        __linearStreams(A, a); __linearStreams(B, b); __linearStreams(Out, out);
+        RLane weight = __set(Weight);
+        for(RINT i=0; i<Lanes; i+=4){
+            RLane t = Mask ? __loadUnaligned(Mask + i) * weight : weight;
+            for(int s=0; s<6; s++){
+                RLane va = __load(a[s] + i);
+                __store(out[s] + i, va + (__load(b[s] + i) - va) * t);
+            }
+            RLaneQuat qa = __loadQuat(A, i), qb = __loadQuat(B, i);
+            RLane dot = __dot(qa, qb);
+            RLaneQuat q;
+            q.x = qa.x + (__flip(qb.x, dot) - qa.x) * t;
+            q.y = qa.y + (__flip(qb.y, dot) - qa.y) * t;
+            q.z = qa.z + (__flip(qb.z, dot) - qa.z) * t;
+            q.w = qa.w + (__flip(qb.w, dot) - qa.w) * t;
+            __storeQuat(Out, i, q);
+        }
+    }
+
+    // Out = Base + Weight * (Additive - Reference); rotations apply the weighted delta
+    // Additive * Reference^-1 in front of Base.
+    static void __additive(const RPose& Base, const RPose& Additive, const RPose& Reference, RFLOAT Weight, RPose& Out, RINT Lanes){
+        const RFLOAT* base[6]; const RFLOAT* add[6]; const RFLOAT* ref[6]; RFLOAT* out[6];
+        __linearStreams(Base, base); __linearStreams(Additive, add); __linearStreams(Reference, ref); __linearStreams(Out, out);
+        RLane t = __set(Weight), zero = __set(0.0f), one = __set(1.0f);
+        for(RINT i=0; i<Lanes; i+=4){
+            for(int s=0; s<6; s++)
+                __store(out[s] + i, __load(base[s] + i) + (__load(add[s] + i) - __load(ref[s] + i)) * t);
+            RLaneQuat r = __loadQuat(Reference, i);
+            r.x = zero - r.x; r.y = zero - r.y; r.z = zero - r.z;
+            RLaneQuat delta = __multiply(__loadQuat(Additive, i), r);
+            // nlerp from identity along the shortest arc.
+            RLaneQuat scaled;
+            scaled.x = __flip(delta.x, delta.w) * t;
+            scaled.y = __flip(delta.y, delta.w) * t;
+            scaled.z = __flip(delta.z, delta.w) * t;
+            scaled.w = one + (__flip(delta.w, delta.w) - one) * t;
+            RLane inv = __rsqrt(__dot(scaled, scaled));
+            scaled.x = scaled.x * inv; scaled.y = scaled.y * inv; scaled.z = scaled.z * inv; scaled.w = scaled.w * inv;
+            __storeQuat(Out, i, __multiply(scaled, __loadQuat(Base, i)));
+        }
+    }
+
+    // Out (+)= Weight * In, rotations sign-aligned with what Out already holds. Normalize after the last input.
+    static void __accumulate(const RPose& In, RFLOAT Weight, RBOOL First, RPose& Out, RINT Lanes){
+        const RFLOAT* in[6]; RFLOAT* out[6];
+        __linearStreams(In, in); __linearStreams(Out, out);
+        RLane w = __set(Weight);
+        for(RINT i=0; i<Lanes; i+=4){
+            RLaneQuat q = __loadQuat(In, i);
+            if(First){
+                for(int s=0; s<6; s++)
+                    __store(out[s] + i, __load(in[s] + i) * w);
+                __store(Out.qx + i, q.x * w);
+                __store(Out.qy + i, q.y * w);
+                __store(Out.qz + i, q.z * w);
+                __store(Out.qw + i, q.w * w);
+                continue;
+            }
+            for(int s=0; s<6; s++)
+                __store(out[s] + i, __load(out[s] + i) + __load(in[s] + i) * w);
+            RLaneQuat acc = __loadQuat(Out, i);
+            RLane dot = __dot(acc, q);
+            __store(Out.qx + i, acc.x + __flip(q.x, dot) * w);
+            __store(Out.qy + i, acc.y + __flip(q.y, dot) * w);
+            __store(Out.qz + i, acc.z + __flip(q.z, dot) * w);
+            __store(Out.qw + i, acc.w + __flip(q.w, dot) * w);
+        }
+    }
+
+    static void __normalizeRotations(RPose& Out, RINT Lanes){
+        for(RINT i=0; i<Lanes; i+=4)
+            __storeQuat(Out, i, __loadQuat(Out, i));
+    }
+
+    static inline RFLOAT __weight(const RFLOAT* Parameters, RINT Parameter, RFLOAT Constant){
+        return Parameter >= 0 ? Parameters[Parameter] : Constant;
+    }
+
+
+    RBlendTree::RBlendTree(const RSkeleton* Skeleton)
+        : skeleton(Skeleton), registerCount(0), output(-1), compiled(false){
+        lanes = (Skeleton->GetBoneCount() + 3) & ~3;
+    }
+
+    RINT RBlendTree::AddParameter(const std::string& Name, RFLOAT Default){
+        RINT index = FindParameter(Name);
+        if(index >= 0)
+            return index;
+        names.push_back(Name);
+        defaults.push_back(Default);
+        return (RINT)defaults.size() - 1;
+    }
+
+    RINT RBlendTree::FindParameter(const std::string& Name) const{
+        for(size_t i=0; i<names.size(); i++){
+            if(names[i] == Name)
+                return (RINT)i;
+        }
+        return -1;
+    }
+
+    RINT RBlendTree::AddMask(RINT Root, RFLOAT Weight){
+        if(Root < 0 || Root >= skeleton->GetBoneCount())
+            return -1;
+        size_t offset = masks.size();
+        masks.resize(offset + R_POSE_STRIDE, 0.0f);
+        RFLOAT* mask = &masks[offset];
+        // Bones are parent-first, so one forward pass marks the whole subtree.
+        std::vector<RBOOL> inside(skeleton->GetBoneCount(), false);
+        for(RINT b=Root; b<skeleton->GetBoneCount(); b++){
+            RINT parent = skeleton->GetParent(b);
+            inside[b] = b == Root || (parent >= 0 && inside[parent]);
+            if(inside[b])
+                mask[b] = Weight;
+        }
+        return (RINT)(offset / R_POSE_STRIDE);
+    }
+
+    RINT RBlendTree::AddNode(const RBlendNode& Node){
+        nodes.push_back(Node);
+        compiled = false;
+        return (RINT)nodes.size() - 1;
+    }
+
+    RINT RBlendTree::AddClip(const RAnimationClip* Clip, RFLOAT Rate){
+        if(Clip == NULL)
+            return -1;
+        RBlendNode node = { RBLEND_CLIP, { -1, -1 }, { -1, -1 }, 0.0f, (RINT)clips.size(), 0 };
+        clips.push_back(Clip);
+        rates.push_back(Rate);
+        return AddNode(node);
+    }
+
+    RINT RBlendTree::AddLerp(RINT A, RINT B, RINT Parameter, RFLOAT Weight){
+        if(A < 0 || B < 0 || A >= (RINT)nodes.size() || B >= (RINT)nodes.size() || !IsParameter(Parameter))
+            return -1;
+        RBlendNode node = { RBLEND_LERP, { A, B }, { Parameter, -1 }, Weight, -1, 0 };
+        return AddNode(node);
+    }
+
+    RINT RBlendTree::AddAdditive(RINT Base, RINT Additive, const RAnimationClip* Reference, RINT Parameter, RFLOAT Weight){
+        if(Base < 0 || Additive < 0 || Base >= (RINT)nodes.size() || Additive >= (RINT)nodes.size() ||
+           !IsParameter(Parameter))
+            return -1;
+        references.push_back(skeleton->GetBindPose());
+        if(Reference != NULL)
+            Reference->GetFrame(0, references.back());
+        RBlendNode node = { RBLEND_ADDITIVE, { Base, Additive }, { Parameter, -1 }, Weight, (RINT)references.size() - 1, 0 };
+        return AddNode(node);
+    }
+
+    RINT RBlendTree::AddLayer(RINT Base, RINT Layer, RINT Mask, RINT Parameter, RFLOAT Weight){
+        if(Base < 0 || Layer < 0 || Base >= (RINT)nodes.size() || Layer >= (RINT)nodes.size() ||
+           Mask < 0 || Mask >= (RINT)(masks.size() / R_POSE_STRIDE) || !IsParameter(Parameter))
+            return -1;
+        RBlendNode node = { RBLEND_LAYER, { Base, Layer }, { Parameter, -1 }, Weight, Mask, 0 };
+        return AddNode(node);
+    }
+
+    RINT RBlendTree::AddBlendSpace1D(RINT Parameter, const std::vector<RINT>& Inputs, const std::vector<RFLOAT>& Positions){
+        if(Inputs.empty() || Inputs.size() > R_BLEND_MAX_SPACE || Positions.size() != Inputs.size())
+            return -1;
+        std::vector<RFLOAT> positions;
+        for(size_t i=0; i<Positions.size(); i++){
+            positions.push_back(Positions[i]);
+            positions.push_back(0.0f);
+        }
+        RINT node = AddBlendSpace2D(Parameter, -1, Inputs, positions);
+        if(node >= 0)
+            nodes[node].op = RBLEND_SPACE1D;
+        return node;
+    }
+
+    RINT RBlendTree::AddBlendSpace2D(RINT ParameterX, RINT ParameterY, const std::vector<RINT>& Inputs, const std::vector<RFLOAT>& Positions){
+        if(Inputs.empty() || Inputs.size() > R_BLEND_MAX_SPACE || Positions.size() != Inputs.size() * 2 ||
+           !IsParameter(ParameterX) || !IsParameter(ParameterY))
+            return -1;
+        for(size_t i=0; i<Inputs.size(); i++){
+            if(Inputs[i] < 0 || Inputs[i] >= (RINT)nodes.size())
+                return -1;
+        }
+        RBlendNode node = { RBLEND_SPACE2D, { -1, -1 }, { ParameterX, ParameterY }, 0.0f, (RINT)spaceInputs.size(), (RINT)Inputs.size() };
+        spaceInputs.insert(spaceInputs.end(), Inputs.begin(), Inputs.end());
+        spacePositions.insert(spacePositions.end(), Positions.begin(), Positions.end());
+        return AddNode(node);
+    }
+
+    RVOID RBlendTree::Visit(RINT Node, std::vector<RINT>& Order, std::vector<RBOOL>& Visited) const{
+        if(Visited[Node])
+            return;
+        Visited[Node] = true;
+        const RBlendNode& node = nodes[Node];
+        if(node.op == RBLEND_SPACE1D || node.op == RBLEND_SPACE2D){
+            for(RINT i=0; i<node.count; i++)
+                Visit(spaceInputs[node.data + i], Order, Visited);
+        } else {
+            for(int i=0; i<2; i++){
+                if(node.inputs[i] >= 0)
+                    Visit(node.inputs[i], Order, Visited);
+            }
+        }
+        Order.push_back(Node);
+    }
+
+    RVOID RBlendTree::Sources(const RBlendNode& Node, std::vector<RINT>& Out) const{
+        Out.clear();
+        if(Node.op == RBLEND_SPACE1D || Node.op == RBLEND_SPACE2D){
+            for(RINT i=0; i<Node.count; i++)
+                Out.push_back(spaceInputs[Node.data + i]);
+        } else {
+            for(int i=0; i<2; i++){
+                if(Node.inputs[i] >= 0)
+                    Out.push_back(Node.inputs[i]);
+            }
+        }
+        std::sort(Out.begin(), Out.end());
+        Out.erase(std::unique(Out.begin(), Out.end()), Out.end());
+    }
+
+    RRESULT RBlendTree::Compile(){
+        if(output < 0 || output >= (RINT)nodes.size())
+            return R_INVALIDARG;
+
+        std::vector<RINT> order;
+        std::vector<RBOOL> visited(nodes.size(), false);
+        Visit(output, order, visited);
+
+        // Readers per node, so a register is released right after its last one.
+        std::vector<RINT> readers(nodes.size(), 0);
+        std::vector<RINT> sources;
+        for(size_t n=0; n<order.size(); n++){
+            Sources(nodes[order[n]], sources);
+            for(size_t i=0; i<sources.size(); i++)
+                readers[sources[i]]++;
+        }
+
+        program.clear();
+        spaceRegisters.assign(spaceInputs.size(), -1);
+        registerCount = 0;
+        std::vector<RINT> location(nodes.size(), -1);
+        std::vector<RINT> released;
+        for(size_t n=0; n<order.size(); n++){
+            const RBlendNode& node = nodes[order[n]];
+            RBlendInstruction instruction = { node.op, -1, { -1, -1 }, { node.parameter[0], node.parameter[1] }, node.weight, node.data, node.count };
+
+            // The target is picked before the sources are released: a blend space accumulates
+            // into it one input at a time.
+            if(order[n] != output){
+                if(released.empty()){
+                    instruction.target = registerCount++;
+                } else {
+                    instruction.target = released.back();
+                    released.pop_back();
+                }
+                location[order[n]] = instruction.target;
+            }
+
+            if(node.op == RBLEND_SPACE1D || node.op == RBLEND_SPACE2D){
+                for(RINT i=0; i<node.count; i++)
+                    spaceRegisters[node.data + i] = location[spaceInputs[node.data + i]];
+            } else {
+                for(int i=0; i<2; i++){
+                    if(node.inputs[i] >= 0)
+                        instruction.source[i] = location[node.inputs[i]];
+                }
+            }
+            Sources(node, sources);
+            for(size_t i=0; i<sources.size(); i++){
+                if(--readers[sources[i]] == 0)
+                    released.push_back(location[sources[i]]);
+            }
+            program.push_back(instruction);
+        }
+        compiled = true;
+        return R_OK;
+    }
+
+    RINT RBlendTree::SpaceWeights(const RBlendInstruction& Instruction, const RFLOAT* Parameters, RFLOAT* Weights, RINT* Slots) const{
+        const RFLOAT* positions = &spacePositions[Instruction.data * 2];
+        RFLOAT x = __weight(Parameters, Instruction.parameter[0], 0.0f);
+        if(Instruction.op == RBLEND_SPACE1D){
+            // The nearest input at or below and at or above the parameter.
+            RINT below = -1, above = -1;
+            for(RINT i=0; i<Instruction.count; i++){
+                RFLOAT p = positions[i * 2];
+                if(p <= x && (below < 0 || p > positions[below * 2]))
+                    below = i;
+                if(p >= x && (above < 0 || p < positions[above * 2]))
+                    above = i;
+            }
+            if(below < 0 || above < 0 || below == above){
+                Slots[0] = below >= 0 ? below : above;
+                Weights[0] = 1.0f;
+                return 1;
+            }
+            RFLOAT t = (x - positions[below * 2]) / (positions[above * 2] - positions[below * 2]);
+            Slots[0] = below; Weights[0] = 1.0f - t;
+            Slots[1] = above; Weights[1] = t;
+            return 2;
+        }
+
+        RFLOAT y = __weight(Parameters, Instruction.parameter[1], 0.0f);
+        RFLOAT total = 0.0f;
+        for(RINT i=0; i<Instruction.count; i++){
+            RFLOAT dx = x - positions[i * 2], dy = y - positions[i * 2 + 1];
+            RFLOAT distance = dx * dx + dy * dy;
+            if(distance < 1e-8f){
+                Slots[0] = i;
+                Weights[0] = 1.0f;
+                return 1;
+            }
+            Weights[i] = 1.0f / distance;
+            total += Weights[i];
+        }
+        // Inputs that would contribute under 1% are skipped rather than blended.
+        RINT used = 0;
+        RFLOAT kept = 0.0f;
+        for(RINT i=0; i<Instruction.count; i++){
+            RFLOAT w = Weights[i] / total;
+            if(w >= 0.01f){
+                Slots[used] = i;
+                Weights[used++] = w;
+                kept += w;
+            }
+        }
+        for(RINT i=0; i<used; i++)
+            Weights[i] /= kept;
+        return used;
+    }
+
+    RVOID RBlendTree::Evaluate(RAnimationInstance* const* Instances, RINT Count) const{
+        if(!compiled || program.empty())
+            return;
+
+        // Instruction-major over small batches: each instruction's clip data and mask stay
+        // in cache across the batch, and the register file stays small.
+        const RINT batch = 8;
+        static thread_local std::vector<RPose> scratch;
+        size_t needed = (size_t)registerCount * batch;
+        if(scratch.size() < needed){
+            // Clips only write their own bones; keep the unused lanes finite.
+            scratch.resize(needed, skeleton->GetBindPose());
+        }
+
+        for(RINT first=0; first<Count; first+=batch){
+            RINT size = __min(batch, Count - first);
+            RAnimationInstance* const* group = Instances + first;
+            for(size_t p=0; p<program.size(); p++){
+                const RBlendInstruction& in = program[p];
+                for(RINT k=0; k<size; k++){
+                    RAnimationInstance* instance = group[k];
+                    if(instance->parameters.size() < defaults.size()){
+                        // Parameters added after Play start at their defaults.
+                        instance->parameters.insert(instance->parameters.end(), defaults.begin() + instance->parameters.size(), defaults.end());
+                    }
+                    const RFLOAT* parameters = instance->parameters.empty() ? NULL : &instance->parameters[0];
+                    RPose& out = in.target < 0 ? instance->pose : scratch[in.target * batch + k];
+                    switch(in.op){
+                    case RBLEND_CLIP:
+                        clips[in.data]->Sample(instance->time * rates[in.data], true, out);
+                        break;
+                    case RBLEND_LERP:
+                        __blend(scratch[in.source[0] * batch + k], scratch[in.source[1] * batch + k], NULL,
+                                __max(0.0f, __min(1.0f, __weight(parameters, in.parameter[0], in.weight))), out, lanes);
+                        break;
+                    case RBLEND_LAYER:
+                        __blend(scratch[in.source[0] * batch + k], scratch[in.source[1] * batch + k], &masks[in.data * R_POSE_STRIDE],
+                                __max(0.0f, __min(1.0f, __weight(parameters, in.parameter[0], in.weight))), out, lanes);
+                        break;
+                    case RBLEND_ADDITIVE:
+                        __additive(scratch[in.source[0] * batch + k], scratch[in.source[1] * batch + k], references[in.data],
+                                   __weight(parameters, in.parameter[0], in.weight), out, lanes);
+                        break;
+                    case RBLEND_SPACE1D:
+                    case RBLEND_SPACE2D: {
+                        RFLOAT weights[R_BLEND_MAX_SPACE];
+                        RINT slots[R_BLEND_MAX_SPACE];
+                        RINT used = SpaceWeights(in, parameters, weights, slots);
+                        for(RINT i=0; i<used; i++)
+                            __accumulate(scratch[spaceRegisters[in.data + slots[i]] * batch + k], weights[i], i == 0, out, lanes);
+                        __normalizeRotations(out, lanes);
+                        break;
+                    }
+                    }
+                }
+            }
+        }
+    }
+};
@@ -36,6 +36,7 @@ namespace Reactor
 		ViewMatrix = RMatrix();
 		//Only to be sure:
 		RotatedX = RotatedY = RotatedZ = 0.0;
+		FieldOfView = 45.0f;
 	}
 
 	void RCamera::Move (const RVector3& Direction)
@@ -121,16 +122,14 @@ namespace Reactor
 
 	}
 
-	const RVector3& RCamera::GetLookAt()
+	RVector3 RCamera::GetLookAt()
 	{
-		RVector3* v = new RVector3(Position+ViewDir);
-		return *v;
+		return Position+ViewDir;
 	}
 	
-	const RVector3& RCamera::GetViewDir()
+	RVector3 RCamera::GetViewDir()
 	{
-		RVector3* v = new RVector3(ViewMatrix.Forward());
-		return *v;
+		return ViewMatrix.Forward();
 	}
 
 	void RCamera::MoveForward( RDOUBLE Distance )
@@ -168,4 +167,9 @@ namespace Reactor
 
 		
 	}
+
+	const RMatrix& RCamera::GetViewMatrix()
+	{
+		return ViewMatrix;
+	}
 };
\ No newline at end of file
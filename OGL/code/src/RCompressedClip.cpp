@@ -0,0 +1,380 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RCompressedClip.h"
+
+namespace Reactor {
+
+    static const RFLOAT __sqrt2 = 1.41421356f;
+
+    struct RClipFileHeader
+    {
+        RUINT magic;
+        RUINT version;
+        RFLOAT duration;
+        RFLOAT sampleRate;
+        RUINT boneCount;
+        RUINT keyCount;
+    };
+
+    static uint16_t __quantize(RFLOAT Value, RFLOAT Minimum, RFLOAT Extent){
+        if(Extent <= 0.0f)
+            return 0;
+        RFLOAT q = (Value - Minimum) / Extent * 65535.0f + 0.5f;
+        return (uint16_t)__max(0.0f, __min(65535.0f, q));
+    }
+
+    static void __packRotation(const RFLOAT* Q, RClipKey& Key){
+        int largest = 0;
+        for(int i=1; i<4; i++){
+            if(fabsf(Q[i]) > fabsf(Q[largest]))
+                largest = i;
+        }
+        // q and -q are the same rotation; make the dropped component positive so it can be
+        // rebuilt as sqrt(1 - |rest|^2). The other three are then within +-1/sqrt(2).
+        RFLOAT sign = Q[largest] < 0.0f ? -1.0f : 1.0f;
+        int k = 0;
+        for(int i=0; i<4; i++){
+            if(i != largest)
+                Key.value[k++] = __quantize(Q[i] * sign * __sqrt2, -1.0f, 2.0f);
+        }
+        Key.track = (uint8_t)(RCLIP_ROTATION | (largest << 2));
+    }
+
+    static RFLOAT __rotationError(const RFLOAT* A, const RFLOAT* B){
+        RFLOAT dot = fabsf(A[0] * B[0] + A[1] * B[1] + A[2] * B[2] + A[3] * B[3]);
+        return 2.0f * acosf(__min(1.0f, dot));
+    }
+
+    static void __interpolate(RCLIP_TRACK Track, const RFLOAT* A, const RFLOAT* B, RFLOAT T, RFLOAT* Out){
+        if(Track != RCLIP_ROTATION){
+            for(int i=0; i<3; i++)
+                Out[i] = A[i] + (B[i] - A[i]) * T;
+            return;
+        }
+        // Shortest-arc nlerp, the same blend RClipDecoder uses at runtime.
+        RFLOAT sign = (A[0] * B[0] + A[1] * B[1] + A[2] * B[2] + A[3] * B[3]) < 0.0f ? -1.0f : 1.0f;
+        RFLOAT length = 0.0f;
+        for(int i=0; i<4; i++){
+            Out[i] = A[i] + (B[i] * sign - A[i]) * T;
+            length += Out[i] * Out[i];
+        }
+        length = length > 0.0f ? 1.0f / sqrtf(length) : 0.0f;
+        for(int i=0; i<4; i++)
+            Out[i] *= length;
+    }
+
+    RCompressedClip::RCompressedClip() : duration(0.0f), sampleRate(30.0f), boneCount(0){
+    }
+
+    size_t RCompressedClip::GetMemorySize() const{
+        return keys.size() * sizeof(RClipKey) + ranges.size() * sizeof(RClipRange);
+    }
+
+    RRESULT RCompressedClip::Compress(const RAnimationClip& Clip, const RClipCompressionSettings& Settings){
+        RINT frameCount = Clip.GetFrameCount();
+        if(frameCount == 0 || frameCount > 65535 || Clip.GetBoneCount() > R_MAX_BONES)
+            return R_INVALIDARG;
+
+        boneCount = Clip.GetBoneCount();
+        duration = Clip.GetDuration();
+        sampleRate = Clip.GetSampleRate();
+        keys.clear();
+        ranges.assign(boneCount * 2, RClipRange());
+
+        std::vector<RPose> poses(frameCount);
+        for(RINT f=0; f<frameCount; f++)
+            Clip.GetFrame(f, poses[f]);
+
+        std::vector<RFLOAT> values(frameCount * 4);
+        std::vector<RINT> kept;
+        for(RINT b=0; b<boneCount; b++){
+            for(int track=0; track<RCLIP_TRACK_COUNT; track++){
+                // Gather the curve.
+                for(RINT f=0; f<frameCount; f++){
+                    const RPose& p = poses[f];
+                    RFLOAT* v = &values[f * 4];
+                    if(track == RCLIP_ROTATION){
+                        v[0] = p.qx[b]; v[1] = p.qy[b]; v[2] = p.qz[b]; v[3] = p.qw[b];
+                    } else if(track == RCLIP_TRANSLATION){
+                        v[0] = p.tx[b]; v[1] = p.ty[b]; v[2] = p.tz[b]; v[3] = 0.0f;
+                    } else {
+                        v[0] = p.sx[b]; v[1] = p.sy[b]; v[2] = p.sz[b]; v[3] = 0.0f;
+                    }
+                }
+
+                RClipRange* range = NULL;
+                if(track != RCLIP_ROTATION){
+                    range = &ranges[b * 2 + (track == RCLIP_SCALE ? 1 : 0)];
+                    for(int i=0; i<3; i++){
+                        RFLOAT lo = values[i], hi = values[i];
+                        for(RINT f=1; f<frameCount; f++){
+                            lo = __min(lo, values[f * 4 + i]);
+                            hi = __max(hi, values[f * 4 + i]);
+                        }
+                        range->minimum[i] = lo;
+                        range->extent[i] = hi - lo;
+                    }
+                }
+
+                // Greedy error-bounded fit: from each kept key, reach as far as a straight
+                // interpolation stays within tolerance of every frame it skips.
+                RFLOAT tolerance = track == RCLIP_ROTATION ? Settings.rotationTolerance :
+                                   track == RCLIP_TRANSLATION ? Settings.translationTolerance : Settings.scaleTolerance;
+                kept.clear();
+                kept.push_back(0);
+                RINT anchor = 0;
+                while(anchor < frameCount - 1){
+                    RINT end = anchor + 1;
+                    while(end + 1 < frameCount){
+                        RINT candidate = end + 1;
+                        RBOOL fits = true;
+                        for(RINT k=anchor + 1; k<candidate && fits; k++){
+                            RFLOAT fit[4];
+                            __interpolate((RCLIP_TRACK)track, &values[anchor * 4], &values[candidate * 4],
+                                          (RFLOAT)(k - anchor) / (RFLOAT)(candidate - anchor), fit);
+                            RFLOAT error = 0.0f;
+                            if(track == RCLIP_ROTATION){
+                                error = __rotationError(fit, &values[k * 4]);
+                            } else {
+                                for(int i=0; i<3; i++)
+                                    error = __max(error, fabsf(fit[i] - values[k * 4 + i]));
+                            }
+                            fits = error <= tolerance;
+                        }
+                        if(!fits)
+                            break;
+                        end = candidate;
+                    }
+                    kept.push_back(end);
+                    anchor = end;
+                }
+                // A constant curve needs a single key.
+                if(kept.size() == 2){
+                    RFLOAT error = 0.0f;
+                    for(RINT f=1; f<frameCount; f++){
+                        if(track == RCLIP_ROTATION){
+                            error = __max(error, __rotationError(&values[0], &values[f * 4]));
+                        } else {
+                            for(int i=0; i<3; i++)
+                                error = __max(error, fabsf(values[i] - values[f * 4 + i]));
+                        }
+                    }
+                    if(error <= tolerance)
+                        kept.pop_back();
+                }
+
+                for(size_t k=0; k<kept.size(); k++){
+                    RClipKey key;
+                    key.frame = (uint16_t)kept[k];
+                    key.need = (uint16_t)(k == 0 ? 0 : kept[k - 1]);
+                    key.bone = (uint8_t)b;
+                    const RFLOAT* v = &values[kept[k] * 4];
+                    if(track == RCLIP_ROTATION){
+                        __packRotation(v, key);
+                    } else {
+                        key.track = (uint8_t)track;
+                        for(int i=0; i<3; i++)
+                            key.value[i] = __quantize(v[i], range->minimum[i], range->extent[i]);
+                    }
+                    keys.push_back(key);
+                }
+            }
+        }
+
+        std::stable_sort(keys.begin(), keys.end(), [](const RClipKey& a, const RClipKey& b){
+            if(a.need != b.need)
+                return a.need < b.need;
+            if(a.bone != b.bone)
+                return a.bone < b.bone;
+            return (a.track & 3) < (b.track & 3);
+        });
+        return R_OK;
+    }
+
+    RVOID RCompressedClip::Decode(const RClipKey& Key, RFLOAT* Out) const{
+        int track = Key.track & 3;
+        if(track == RCLIP_ROTATION){
+            int largest = (Key.track >> 2) & 3;
+            RFLOAT sum = 0.0f;
+            int k = 0;
+            for(int i=0; i<4; i++){
+                if(i == largest)
+                    continue;
+                Out[i] = (Key.value[k++] / 65535.0f * 2.0f - 1.0f) / __sqrt2;
+                sum += Out[i] * Out[i];
+            }
+            Out[largest] = sqrtf(__max(0.0f, 1.0f - sum));
+            return;
+        }
+        const RClipRange& range = ranges[Key.bone * 2 + (track == RCLIP_SCALE ? 1 : 0)];
+        for(int i=0; i<3; i++)
+            Out[i] = range.minimum[i] + Key.value[i] / 65535.0f * range.extent[i];
+        Out[3] = 0.0f;
+    }
+
+    RRESULT RCompressedClip::Save(const std::string& Path) const{
+        FILE* f = fopen(Path.c_str(), "wb");
+        if(f == NULL)
+            return R_INVALIDARG;
+        RClipFileHeader header = { RCLIP_MAGIC, RCLIP_VERSION, duration, sampleRate, (RUINT)boneCount, (RUINT)keys.size() };
+        RBOOL ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        if(ok && !ranges.empty())
+            ok = fwrite(&ranges[0], sizeof(RClipRange), ranges.size(), f) == ranges.size();
+        if(ok && !keys.empty())
+            ok = fwrite(&keys[0], sizeof(RClipKey), keys.size(), f) == keys.size();
+        fclose(f);
+        return ok ? R_OK : R_INVALIDARG;
+    }
+
+    RBOOL RCompressedClip::ValidateKeys(RUINT BoneCount) const{
+        // Each track must read as the chain Compress emits: the first key needed at frame 0,
+        // every later key needed at its predecessor's frame, in stream order.
+        std::vector<RINT> last(BoneCount * RCLIP_TRACK_COUNT, -1);
+        for(size_t k=0; k<keys.size(); k++){
+            const RClipKey& key = keys[k];
+            int track = key.track & 3;
+            if(key.bone >= BoneCount || track >= RCLIP_TRACK_COUNT || (key.track >> 4) != 0 ||
+               (track != RCLIP_ROTATION && (key.track >> 2) != 0))
+                return false;
+            if(k > 0 && key.need < keys[k - 1].need)
+                return false;
+            RINT& previous = last[key.bone * RCLIP_TRACK_COUNT + track];
+            if(previous < 0 ? (key.need != 0 || key.frame != 0) : (key.need != previous || key.frame <= previous))
+                return false;
+            previous = key.frame;
+        }
+        // The decoder holds a window per track; one that never receives a key reads garbage.
+        for(size_t i=0; i<last.size(); i++){
+            if(last[i] < 0)
+                return false;
+        }
+        return true;
+    }
+
+    RRESULT RCompressedClip::Load(const std::string& Path){
+        FILE* f = fopen(Path.c_str(), "rb");
+        if(f == NULL)
+            return R_INVALIDARG;
+        fseek(f, 0, SEEK_END);
+        long length = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        RClipFileHeader header;
+        RBOOL ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == RCLIP_MAGIC &&
+                   header.version == RCLIP_VERSION && header.boneCount <= R_MAX_BONES;
+        // Sized against the file before anything is allocated from the header.
+        ok = ok && length >= 0 && (uint64_t)header.boneCount * 2 * sizeof(RClipRange) +
+             (uint64_t)header.keyCount * sizeof(RClipKey) <= (uint64_t)length - sizeof(header);
+        if(ok){
+            ranges.resize(header.boneCount * 2);
+            keys.resize(header.keyCount);
+            ok = (ranges.empty() || fread(&ranges[0], sizeof(RClipRange), ranges.size(), f) == ranges.size()) &&
+                 (keys.empty() || fread(&keys[0], sizeof(RClipKey), keys.size(), f) == keys.size());
+        }
+        fclose(f);
+        ok = ok && header.sampleRate > 0.0f && header.duration > 0.0f && ValidateKeys(header.boneCount);
+        if(!ok){
+            keys.clear();
+            ranges.clear();
+            boneCount = 0;
+            return R_INVALIDARG;
+        }
+        duration = header.duration;
+        sampleRate = header.sampleRate;
+        boneCount = (RINT)header.boneCount;
+        return R_OK;
+    }
+
+    RClipDecoder::RClipDecoder() : clip(NULL), cursor(0), lastFrame(-1.0f){
+    }
+
+    RVOID RClipDecoder::Reset(const RCompressedClip* Clip){
+        clip = Clip;
+        Rewind();
+    }
+
+    RVOID RClipDecoder::Rewind(){
+        cursor = 0;
+        lastFrame = -1.0f;
+        for(int b=0; b<R_MAX_BONES; b++){
+            for(int t=0; t<RCLIP_TRACK_COUNT; t++)
+                tracks[b][t].frame[1] = -1.0f;
+        }
+    }
+
+    RVOID RClipDecoder::Sample(RFLOAT Time, RBOOL Loop, RPose& Out){
+        if(clip == NULL || clip->GetKeyCount() == 0)
+            return;
+        RFLOAT duration = clip->GetDuration();
+        if(Loop){
+            Time = fmodf(Time, duration);
+            if(Time < 0.0f)
+                Time += duration;
+        }
+        RFLOAT frame = __max(0.0f, __min(Time, duration)) * clip->GetSampleRate();
+        if(frame < lastFrame)
+            Rewind();
+        lastFrame = frame;
+
+        // Pull in every key whose interval has started; the stream is ordered for this.
+        const RClipKey* keys = clip->GetKeys();
+        RUINT count = clip->GetKeyCount();
+        while(cursor < count && keys[cursor].need <= frame){
+            const RClipKey& key = keys[cursor++];
+            RTrackWindow& window = tracks[key.bone][key.track & 3];
+            RFLOAT value[4];
+            clip->Decode(key, value);
+            if(window.frame[1] < 0.0f){
+                // First key of the track: hold it until the next one arrives.
+                window.frame[0] = key.frame;
+                memcpy(window.value[0], value, sizeof(value));
+            } else {
+                window.frame[0] = window.frame[1];
+                memcpy(window.value[0], window.value[1], sizeof(value));
+            }
+            window.frame[1] = key.frame;
+            memcpy(window.value[1], value, sizeof(value));
+        }
+
+        for(RINT b=0; b<clip->GetBoneCount(); b++){
+            RFLOAT result[RCLIP_TRACK_COUNT][4];
+            for(int t=0; t<RCLIP_TRACK_COUNT; t++){
+                const RTrackWindow& window = tracks[b][t];
+                RFLOAT span = window.frame[1] - window.frame[0];
+                RFLOAT u = span > 0.0f ? __max(0.0f, __min(1.0f, (frame - window.frame[0]) / span)) : 0.0f;
+                __interpolate((RCLIP_TRACK)t, window.value[0], window.value[1], u, result[t]);
+            }
+            Out.qx[b] = result[RCLIP_ROTATION][0];
+            Out.qy[b] = result[RCLIP_ROTATION][1];
+            Out.qz[b] = result[RCLIP_ROTATION][2];
+            Out.qw[b] = result[RCLIP_ROTATION][3];
+            Out.tx[b] = result[RCLIP_TRANSLATION][0];
+            Out.ty[b] = result[RCLIP_TRANSLATION][1];
+            Out.tz[b] = result[RCLIP_TRANSLATION][2];
+            Out.sx[b] = result[RCLIP_SCALE][0];
+            Out.sy[b] = result[RCLIP_SCALE][1];
+            Out.sz[b] = result[RCLIP_SCALE][2];
+        }
+    }
+};
@@ -0,0 +1,264 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RDepthSort.h"
+#include "../headers/RMemory.h"
+#include "../headers/RThreadPool.h"
+
+namespace Reactor {
+
+    // Below this many elements per chunk the threading overhead outweighs the work.
+    static const RUINT R_SORT_MIN_CHUNK = 16384;
+    static const RUINT R_SORT_MAX_CHUNKS = 64;
+
+    RDepthSorter::RDepthSorter() : keys(NULL), histograms(NULL), ranges(NULL), chunks(1), chunkSize(0), keyBits(16), tolerance(0.01f), previousCount(0){
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    RVOID RDepthSorter::Reserve(RUINT Count){
+        order.reserve(Count);
+    }
+
+    RVOID RDepthSorter::SetKeyBits(RUINT Bits){
+        keyBits = __max(8u, __min(32u, Bits));
+        previousCount = 0;
+    }
+
+    RVOID RDepthSorter::SetCoherence(RFLOAT Tolerance){
+        tolerance = __max(0.0f, Tolerance);
+    }
+
+    const RUINT* RDepthSorter::SortBackToFront(const RFLOAT* X, const RFLOAT* Y, const RFLOAT* Z, RUINT Count,
+                                               const RVector3& Eye, const RVector3& ViewDir){
+        if(Count == 0)
+            return Sort(NULL, 0);
+        RScratchScope scope;
+        RFLOAT* out = RFrameArena::Allocate<RFLOAT>(Count);
+        RFLOAT dx = ViewDir.x, dy = ViewDir.y, dz = ViewDir.z;
+        RFLOAT bias = Eye.x * dx + Eye.y * dy + Eye.z * dz;
+        RThreadPool::Instance()->ParallelFor((RINT)Count, R_SORT_MIN_CHUNK, [=](RINT begin, RINT end){
+            for(RINT i=begin; i<end; i++)
+                out[i] = X[i] * dx + Y[i] * dy + Z[i] * dz - bias;
+        });
+        return Sort(out, Count);
+    }
+
+    const RUINT* RDepthSorter::Sort(const RFLOAT* Depths, RUINT Count){
+        Reserve(Count);
+        stats.count = Count;
+        stats.passes = 0;
+        stats.descents = 0;
+        stats.coherent = false;
+        if(Count == 0){
+            previousCount = 0;
+            return NULL;
+        }
+
+        chunks = __min(R_SORT_MAX_CHUNKS, __max(1u, Count / R_SORT_MIN_CHUNK));
+        chunks = __min(chunks, (RUINT)RThreadPool::Instance()->GetThreadCount() + 1);
+        chunkSize = (Count + chunks - 1) / chunks;
+
+        RScratchScope scope;
+        keys = RFrameArena::Allocate<uint32_t>(Count);
+        histograms = RFrameArena::Allocate<RUINT>(chunks * 256);
+        ranges = RFrameArena::Allocate<RFLOAT>(chunks * 2);
+        Quantize(Depths, Count);
+        if(previousCount != Count || !SortCoherent(Count))
+            SortRadix(Count);
+        keys = NULL;
+        histograms = NULL;
+        ranges = NULL;
+        previousCount = Count;
+        return &order[0];
+    }
+
+    RVOID RDepthSorter::Quantize(const RFLOAT* Depths, RUINT Count){
+        RFLOAT* range = ranges;
+        RUINT size = chunkSize;
+        RThreadPool::Instance()->ParallelFor((RINT)chunks, 1, [=](RINT begin, RINT end){
+            for(RINT c=begin; c<end; c++){
+                RUINT first = c * size, last = __min(first + size, Count);
+                RFLOAT lo = Depths[first], hi = Depths[first];
+                for(RUINT i=first + 1; i<last; i++){
+                    lo = __min(lo, Depths[i]);
+                    hi = __max(hi, Depths[i]);
+                }
+                range[c * 2] = lo;
+                range[c * 2 + 1] = hi;
+            }
+        });
+        RFLOAT lo = range[0], hi = range[1];
+        for(RUINT c=1; c<chunks; c++){
+            lo = __min(lo, range[c * 2]);
+            hi = __max(hi, range[c * 2 + 1]);
+        }
+
+        // Farthest gets key 0 so an ascending sort yields back-to-front.
+        double maxKey = keyBits == 32 ? 4294967295.0 : (double)((1u << keyBits) - 1);
+        RFLOAT scale = hi > lo ? (RFLOAT)(maxKey / (hi - lo)) : 0.0f;
+        uint32_t* out = keys;
+        RThreadPool::Instance()->ParallelFor((RINT)Count, R_SORT_MIN_CHUNK, [=](RINT begin, RINT end){
+            for(RINT i=begin; i<end; i++){
+                double k = (double)(hi - Depths[i]) * scale;
+                out[i] = (uint32_t)__min(k, maxKey);
+            }
+        });
+    }
+
+    RBOOL RDepthSorter::SortCoherent(RUINT Count){
+        if(tolerance <= 0.0f || order.size() != Count)
+            return false;
+
+        RUINT* previous = &order[0];
+        const uint32_t* key = keys;
+        RUINT* counts = histograms;
+        RUINT size = chunkSize;
+        RThreadPool::Instance()->ParallelFor((RINT)chunks, 1, [=](RINT begin, RINT end){
+            for(RINT c=begin; c<end; c++){
+                RUINT first = __max(1u, c * size), last = __min(c * size + size, Count);
+                RUINT descents = 0;
+                for(RUINT i=first; i<last; i++)
+                    descents += key[previous[i]] < key[previous[i - 1]];
+                counts[c] = descents;
+            }
+        });
+        RUINT descents = 0;
+        for(RUINT c=0; c<chunks; c++)
+            descents += counts[c];
+        stats.descents = descents;
+        if(descents > (RUINT)(Count * tolerance))
+            return false;
+
+        // Nearly sorted: insertion sort is linear in the number of moves, which is capped so a
+        // few elements travelling far cannot cost more than a radix sort would.
+        RUINT budget = Count * 4;
+        for(RUINT i=1; i<Count && descents; i++){
+            RUINT value = previous[i];
+            uint32_t k = key[value];
+            RUINT j = i;
+            while(j > 0 && key[previous[j - 1]] > k){
+                previous[j] = previous[j - 1];
+                --j;
+                if(--budget == 0){
+                    previous[j] = value;
+                    return false;
+                }
+            }
+            previous[j] = value;
+        }
+        stats.coherent = true;
+        return true;
+    }
+
+    RVOID RDepthSorter::SortRadix(RUINT Count){
+        order.resize(Count);
+        RUINT* orderTmp = RFrameArena::Allocate<RUINT>(Count);
+        uint32_t* srcKeys = keys;
+        uint32_t* dstKeys = RFrameArena::Allocate<uint32_t>(Count);
+        RUINT* srcOrder = NULL;             // identity until the first pass runs
+        RUINT* dstOrder = orderTmp;
+        RUINT* histogram = histograms;
+        RUINT size = chunkSize;
+        RUINT passes = (keyBits + 7) / 8;
+
+        for(RUINT pass=0; pass<passes; pass++){
+            RUINT shift = pass * 8;
+            RThreadPool::Instance()->ParallelFor((RINT)chunks, 1, [=](RINT begin, RINT end){
+                for(RINT c=begin; c<end; c++){
+                    RUINT* h = histogram + c * 256;
+                    memset(h, 0, 256 * sizeof(RUINT));
+                    RUINT first = c * size, last = __min(first + size, Count);
+                    for(RUINT i=first; i<last; i++)
+                        ++h[(srcKeys[i] >> shift) & 0xFF];
+                }
+            });
+
+            // Exclusive prefix over (digit, chunk) so each chunk scatters into its own slots
+            // and the sort stays stable.
+            RUINT running = 0;
+            RBOOL constant = false;
+            for(RUINT d=0; d<256; d++){
+                RUINT bucket = running;
+                for(RUINT c=0; c<chunks; c++){
+                    RUINT n = histogram[c * 256 + d];
+                    histogram[c * 256 + d] = running;
+                    running += n;
+                }
+                if(running - bucket == Count)
+                    constant = true;
+            }
+            if(constant)
+                continue;
+
+            RThreadPool::Instance()->ParallelFor((RINT)chunks, 1, [=](RINT begin, RINT end){
+                for(RINT c=begin; c<end; c++){
+                    RUINT* offset = histogram + c * 256;
+                    RUINT first = c * size, last = __min(first + size, Count);
+                    for(RUINT i=first; i<last; i++){
+                        uint32_t k = srcKeys[i];
+                        RUINT slot = offset[(k >> shift) & 0xFF]++;
+                        dstKeys[slot] = k;
+                        dstOrder[slot] = srcOrder ? srcOrder[i] : i;
+                    }
+                }
+            });
+            std::swap(srcKeys, dstKeys);
+            dstOrder = srcOrder ? srcOrder : &order[0];
+            srcOrder = (dstOrder == &order[0]) ? orderTmp : &order[0];
+            ++stats.passes;
+        }
+
+        if(srcOrder == NULL){
+            for(RUINT i=0; i<Count; i++)
+                order[i] = i;
+        } else if(srcOrder != &order[0]){
+            memcpy(&order[0], srcOrder, Count * sizeof(RUINT));
+        }
+    }
+
+    RTransparentQueue::RTransparentQueue() : order(NULL){
+    }
+
+    RVOID RTransparentQueue::Clear(){
+        x.clear();
+        y.clear();
+        z.clear();
+        ids.clear();
+        order = NULL;
+    }
+
+    RVOID RTransparentQueue::Add(const RVector3& Center, RUINT DrawId){
+        x.push_back(Center.x);
+        y.push_back(Center.y);
+        z.push_back(Center.z);
+        ids.push_back(DrawId);
+        order = NULL;
+    }
+
+    RVOID RTransparentQueue::Sort(const RVector3& Eye, const RVector3& ViewDir){
+        if(ids.empty())
+            return;
+        order = sorter.SortBackToFront(&x[0], &y[0], &z[0], (RUINT)ids.size(), Eye, ViewDir);
+    }
+};
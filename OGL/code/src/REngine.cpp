@@ -22,50 +22,84 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 #include "../headers/REngine.h"
+#include "../headers/RPlatform.h"
+#include "../headers/RTimer.h"
+
+#if defined(__APPLE__)
+#include <OpenGL/OpenGL.h>
+#include <OpenGL/glext.h>
+#define R_FENCE_SYNC 1
+#define rFenceSync glFenceSyncAPPLE
+#define rClientWaitSync glClientWaitSyncAPPLE
+#define rDeleteSync glDeleteSyncAPPLE
+#elif defined(GL_SYNC_GPU_COMMANDS_COMPLETE)
+#define R_FENCE_SYNC 1
+#define rFenceSync glFenceSync
+#define rClientWaitSync glClientWaitSync
+#define rDeleteSync glDeleteSync
+#endif
 
 namespace Reactor
 {
+	REngine::REngine()
+	{
+		_fullscreen = false;
+		latencyMode = RLATENCY_THROUGHPUT;
+		maxFramesInFlight = 2;
+		adaptiveVSync = false;
+		swapInterval = 1;
+		for(int i=0; i<R_MAX_FRAMES_IN_FLIGHT; i++){
+			fences[i] = NULL;
+			fenceInputTime[i] = 0.0;
+		}
+		fenceHead = 0;
+		fenceCount = 0;
+		inputTime = lastPresentTime = accumStart = RTimer::Now();
+		memset(&stats, 0, sizeof(RFrameStats));
+		memset(&accum, 0, sizeof(RFrameStats));
+		accumFrames = 0;
+	}
 	
-    const RECT& REngine::GetScreenSize(){
-        int w = glutGet(GLUT_SCREEN_WIDTH);
-        int h = glutGet(GLUT_SCREEN_HEIGHT);
-		const RECT* r = new RECT(0, 0, w, h);
-        return *r;
+    RECT REngine::GetScreenSize(){
+        return RPlatform::Instance()->GetScreenSize();
     }
 	
     
 
-	void REngine::Init3DWindowed(const char* title, RECT &rect)
+	RRESULT REngine::Init3DWindowed(const char* title, RECT &rect)
 	{
-		
-		glutInitWindowSize (rect.right - rect.left, rect.bottom - rect.top);
-		glutInitWindowPosition(rect.left, rect.top);
-		window = glutCreateWindow(title);
-		
+		RRESULT hr = RPlatform::Instance()->OpenWindow(title, rect, false);
+		if(FAILED(hr))
+			return hr;
 		this->_fullscreen = false;
 		//REngine::_instance->shaderManager.InitializeStockShaders();
+		return R_OK;
 	}
 
-	void REngine::Init3DFullscreen(const char* title, RINT width, RINT height, RINT color, RINT depth)
+	RRESULT REngine::Init3DFullscreen(const char* title, RINT width, RINT height, RINT color, RINT depth)
 	{
 		RECT rect;
 		rect.left=0;
 		rect.right=width;
 		rect.top=0;
 		rect.bottom=height;
-		glutInitWindowSize (rect.right - rect.left, rect.bottom - rect.top);
-		glutInitWindowPosition(rect.left, rect.top);
-		glutCreateWindow(title);
-		std::ostringstream str;
-		str << width << "x" << height << ":" << depth;
-		glutGameModeString(str.str().c_str());
-		
-		
+		RRESULT hr = RPlatform::Instance()->OpenWindow(title, rect, true);
+		if(FAILED(hr))
+			return hr;
 		this->_fullscreen = true;
-		
+		return R_OK;
+	}
+
+	void REngine::Init3DNoRender()
+	{
+		// Same frame loop, no window and no GL context.
+		RPlatform* platform = RPlatform::Instance();
+		if(!platform->IsInitialized() || platform->GetBackend() != RPLATFORM_HEADLESS)
+			platform->Init(RPLATFORM_HEADLESS, NULL, NULL);
+		this->_fullscreen = false;
 	}
 	
-	void REngine::OnResize(RINT width, RINT height)
+	void REngine::OnResize(RINT width, RINT height, RFLOAT fieldOfView)
 	{
 		// Prevent a divide by zero, when window is too short
 		// (you cant make a window of zero width).
@@ -82,7 +116,7 @@ namespace Reactor
 		glViewport(0, 0, width, height);
 
 		// Set the correct perspective.
-		gluPerspective(45,ratio,1,1000);
+		gluPerspective(fieldOfView,ratio,1,1000);
 		glMatrixMode(GL_MODELVIEW);
 		
 		//Call Update on the current Camera...
@@ -90,6 +124,8 @@ namespace Reactor
 
 	void REngine::Clear(RBOOL DepthOnly)
 	{
+		if(!RPlatform::Instance()->HasContext())
+			return;
 		if(DepthOnly)
 		{
 			glClearDepth(1.0f);
@@ -105,22 +141,185 @@ namespace Reactor
 	
 	
 
+	void REngine::SetFrameLatency(RFRAME_LATENCY_MODE mode, RINT framesInFlight)
+	{
+		latencyMode = mode;
+		maxFramesInFlight = __max(1, __min(framesInFlight, R_MAX_FRAMES_IN_FLIGHT));
+	}
+
+	RFRAME_LATENCY_MODE REngine::GetFrameLatencyMode()
+	{
+		return latencyMode;
+	}
+
+	void REngine::SetVSync(RINT interval, RBOOL adaptive)
+	{
+		swapInterval = interval;
+		adaptiveVSync = adaptive;
+		// Adaptive vsync is a negative interval: tear instead of waiting a whole
+		// extra refresh when a frame misses its deadline.
+		int value = (adaptive && interval > 0) ? -interval : interval;
+		RPlatform::Instance()->SetSwapInterval(value);
+	}
+
+	void REngine::WaitForFence(RINT slot)
+	{
+#ifdef R_FENCE_SYNC
+		GLsync fence = (GLsync)fences[slot];
+		if(fence == NULL)
+			return;
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		for(;;)
+		{
+			GLenum status = rClientWaitSync(fence, flags, 1000000000ull);
+			if(status != GL_TIMEOUT_EXPIRED)
+				break;
+			flags = 0;
+		}
+#endif
+	}
+
+	void REngine::RetireFences()
+	{
+#ifdef R_FENCE_SYNC
+		double now = RTimer::Now();
+		while(fenceCount > 0)
+		{
+			GLsync fence = (GLsync)fences[fenceHead];
+			GLenum status = rClientWaitSync(fence, 0, 0);
+			if(status == GL_TIMEOUT_EXPIRED)
+				break;
+			rDeleteSync(fence);
+			fences[fenceHead] = NULL;
+			accum.latency += (RFLOAT)(now - fenceInputTime[fenceHead]);
+			fenceHead = (fenceHead + 1) % R_MAX_FRAMES_IN_FLIGHT;
+			--fenceCount;
+		}
+#endif
+	}
+
+	void REngine::WaitForFrameLatency()
+	{
+		if(latencyMode == RLATENCY_LOW)
+		{
+			// Block until the GPU has caught up to within maxFramesInFlight-1
+			// frames so input is sampled as late as possible.
+			double start = RTimer::Now();
+			while(fenceCount > maxFramesInFlight - 1)
+			{
+				WaitForFence(fenceHead);
+				RetireFences();
+			}
+			accum.fenceWaitTime += (RFLOAT)(RTimer::Now() - start);
+		}
+		inputTime = RTimer::Now();
+	}
+
 	void REngine::RenderToScreen()
 	{
+		RPlatform* platform = RPlatform::Instance();
+		if(!platform->HasContext())
+			return;
+		platform->SwapBuffers();
+
+#ifdef R_FENCE_SYNC
+		RetireFences();
+		// The ring is full when WaitForFrameLatency was skipped; never overwrite a live fence.
+		while(fenceCount >= R_MAX_FRAMES_IN_FLIGHT)
+		{
+			WaitForFence(fenceHead);
+			RetireFences();
+		}
+		RINT slot = (fenceHead + fenceCount) % R_MAX_FRAMES_IN_FLIGHT;
+		fences[slot] = (void*)rFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		fenceInputTime[slot] = inputTime;
+		++fenceCount;
 		glFlush();
-		glFinish();
-		glutSwapBuffers();
+
+		if(latencyMode == RLATENCY_THROUGHPUT)
+		{
+			double start = RTimer::Now();
+			while(fenceCount > maxFramesInFlight)
+			{
+				WaitForFence(fenceHead);
+				RetireFences();
+			}
+			accum.fenceWaitTime += (RFLOAT)(RTimer::Now() - start);
+		}
+#else
+		glFlush();
+#endif
+
+		double now = RTimer::Now();
+		accum.cpuFrameTime += (RFLOAT)(now - lastPresentTime);
+		lastPresentTime = now;
+		++accumFrames;
+		if(now - accumStart >= 1000.0)
+		{
+			RFLOAT frames = (RFLOAT)accumFrames;
+			stats.cpuFrameTime = accum.cpuFrameTime / frames;
+			stats.fenceWaitTime = accum.fenceWaitTime / frames;
+			stats.latency = accum.latency / frames;
+			stats.overlap = (stats.cpuFrameTime > 0.0f) ?
+				__max(0.0f, 1.0f - stats.fenceWaitTime / stats.cpuFrameTime) : 0.0f;
+			memset(&accum, 0, sizeof(RFrameStats));
+			accumFrames = 0;
+			accumStart = now;
+		}
+		stats.framesInFlight = fenceCount;
+	}
+
+	const RFrameStats& REngine::GetFrameStats()
+	{
+		return stats;
+	}
+
+	RMemoryTagStats REngine::GetMemoryStats(RMEMORY_TAG tag)
+	{
+		return RMemoryTracker::GetStats(tag);
+	}
+
+	void REngine::SetMemoryBudget(RMEMORY_TAG tag, size_t bytes)
+	{
+		RMemoryTracker::SetBudget(tag, bytes);
+	}
+
+	std::string REngine::GetMemoryReportJSON()
+	{
+		return RMemoryTracker::ToJSON();
+	}
+
+	RRESULT REngine::DumpMemoryReport(const char* path)
+	{
+		if(path == NULL)
+			return R_INVALIDARG;
+		FILE* f = fopen(path, "w");
+		if(f == NULL)
+			return R_INVALIDARG;
+		std::string json = RMemoryTracker::ToJSON();
+		bool ok = fwrite(json.data(), 1, json.size(), f) == json.size();
+		ok = fputc('\n', f) != EOF && ok;
+		ok = fclose(f) == 0 && ok;
+		return ok ? R_OK : R_INVALIDARG;
 	}
 
 	void REngine::DestroyAll()
 	{
-		if(this->_fullscreen)
+		RPlatform* platform = RPlatform::Instance();
+#ifdef R_FENCE_SYNC
+		while(fenceCount > 0)
 		{
-			glutLeaveGameMode();
+			if(platform->HasContext())
+				rDeleteSync((GLsync)fences[fenceHead]);
+			fences[fenceHead] = NULL;
+			fenceHead = (fenceHead + 1) % R_MAX_FRAMES_IN_FLIGHT;
+			--fenceCount;
 		}
-		glutDestroyWindow(0);
-		
-		delete this;
+#endif
+		platform->CloseWindow();
+
+		// Last: this object is gone afterwards, and the next Instance() starts fresh.
+		REngine::Destroy();
 	}
 
 };
\ No newline at end of file
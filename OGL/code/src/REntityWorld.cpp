@@ -0,0 +1,398 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include "../headers/REntityWorld.h"
+#include "../headers/RScene.h"
+
+namespace Reactor {
+
+    static size_t __componentSize[R_MAX_COMPONENTS];
+    static size_t __componentAlignment[R_MAX_COMPONENTS];
+    static std::atomic<RUINT> __componentCount(0);
+
+    RUINT RComponentRegistry::Register(size_t Size, size_t Alignment){
+        RUINT id = __componentCount++;
+        assert(id < R_MAX_COMPONENTS && "too many component types");
+        __componentSize[id] = Size;
+        __componentAlignment[id] = Alignment;
+        return id;
+    }
+
+    size_t RComponentRegistry::GetSize(RUINT Id){
+        return __componentSize[Id];
+    }
+
+    size_t RComponentRegistry::GetAlignment(RUINT Id){
+        return __componentAlignment[Id];
+    }
+
+    RUINT RComponentRegistry::GetCount(){
+        return __componentCount;
+    }
+
+    RCommandBuffer::RCommandBuffer(){
+        created = 0;
+    }
+
+    REntity RCommandBuffer::Create(){
+        REntity entity;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            entity = REntity(++created, 0);
+        }
+        Record(RCOMMAND_CREATE, entity, 0, NULL, 0);
+        return entity;
+    }
+
+    RVOID RCommandBuffer::Destroy(REntity Entity){
+        Record(RCOMMAND_DESTROY, Entity, 0, NULL, 0);
+    }
+
+    RVOID RCommandBuffer::Record(RCOMMAND_TYPE Type, REntity Entity, RUINT Component, const RVOID* Data, size_t Size){
+        RCommand command;
+        command.type = Type;
+        command.entity = Entity;
+        command.component = Component;
+        command.size = (uint32_t)((Size + 15) & ~(size_t)15);
+        std::unique_lock<std::mutex> guard(lock);
+        size_t at = stream.size();
+        stream.resize(at + sizeof(RCommand) + command.size);
+        memcpy(&stream[at], &command, sizeof(RCommand));
+        if(Size > 0)
+            memcpy(&stream[at + sizeof(RCommand)], Data, Size);
+    }
+
+    RVOID RCommandBuffer::Clear(){
+        std::unique_lock<std::mutex> guard(lock);
+        stream.clear();
+        created = 0;
+    }
+
+    REntityWorld::REntityWorld()
+    : records(RMEM_SCENE)
+    {
+        iterating = 0;
+    }
+
+    REntityWorld::~REntityWorld(){
+        Clear();
+        for(size_t i=0; i<archetypes.size(); i++)
+            delete archetypes[i];
+        for(size_t i=0; i<queries.size(); i++)
+            delete queries[i];
+    }
+
+    RArchetype* REntityWorld::GetArchetype(RComponentMask Mask){
+        std::map<RComponentMask, RArchetype*>::iterator it = archetypeMap.find(Mask);
+        if(it != archetypeMap.end())
+            return it->second;
+
+        RArchetype* archetype = new RArchetype();
+        archetype->mask = Mask;
+        archetype->count = 0;
+        for(RUINT i=0; i<R_MAX_COMPONENTS; i++){
+            archetype->offsets[i] = ~0u;
+            archetype->addEdge[i] = archetype->removeEdge[i] = NULL;
+            if(Mask & ((RComponentMask)1 << i))
+                archetype->components.push_back(i);
+        }
+
+        // Start from the row count the sizes allow and back off until the alignment
+        // padding between the columns fits too.
+        size_t rowBytes = sizeof(REntity);
+        for(size_t i=0; i<archetype->components.size(); i++)
+            rowBytes += RComponentRegistry::GetSize(archetype->components[i]);
+        size_t rows = R_ENTITY_CHUNK_SIZE / rowBytes;
+        for(; rows > 0; rows--){
+            size_t offset = rows * sizeof(REntity);
+            for(size_t i=0; i<archetype->components.size(); i++){
+                RUINT id = archetype->components[i];
+                size_t alignment = RComponentRegistry::GetAlignment(id);
+                offset = (offset + alignment - 1) & ~(alignment - 1);
+                archetype->offsets[id] = (RUINT)offset;
+                offset += rows * RComponentRegistry::GetSize(id);
+            }
+            if(offset <= R_ENTITY_CHUNK_SIZE)
+                break;
+        }
+        if(rows == 0){
+            delete archetype;
+            return NULL;
+        }
+        archetype->rowsPerChunk = (RUINT)rows;
+        archetypes.push_back(archetype);
+        archetypeMap[Mask] = archetype;
+        return archetype;
+    }
+
+    RBOOL REntityWorld::AllocateRow(RArchetype* Archetype, REntity Entity, REntityRecord* Record){
+        if(Archetype->chunks.empty() || Archetype->chunks.back().count == Archetype->rowsPerChunk){
+            RChunk chunk;
+            chunk.data = (RBYTE*)RMemoryTracker::Allocate(RMEM_SCENE, R_ENTITY_CHUNK_SIZE);
+            if(chunk.data == NULL)
+                return false;
+            chunk.count = 0;
+            Archetype->chunks.push_back(chunk);
+        }
+        RChunk& chunk = Archetype->chunks.back();
+        Record->archetype = Archetype;
+        Record->chunk = (RUINT)Archetype->chunks.size() - 1;
+        Record->row = chunk.count++;
+        ((REntity*)chunk.data)[Record->row] = Entity;
+        Archetype->count++;
+        return true;
+    }
+
+    RVOID REntityWorld::FreeRow(const REntityRecord& Record){
+        // Fill the hole with the archetype's last row so every chunk but the last stays full.
+        RArchetype* archetype = Record.archetype;
+        RChunk& hole = archetype->chunks[Record.chunk];
+        RChunk& last = archetype->chunks.back();
+        RUINT lastRow = last.count - 1;
+        if(&hole != &last || Record.row != lastRow){
+            REntity moved = ((REntity*)last.data)[lastRow];
+            ((REntity*)hole.data)[Record.row] = moved;
+            for(size_t i=0; i<archetype->components.size(); i++){
+                RUINT id = archetype->components[i];
+                size_t size = RComponentRegistry::GetSize(id);
+                RUINT offset = archetype->offsets[id];
+                memcpy(hole.data + offset + Record.row * size, last.data + offset + lastRow * size, size);
+            }
+            REntityRecord* record = records.Get(moved);
+            record->chunk = Record.chunk;
+            record->row = Record.row;
+        }
+        if(--last.count == 0){
+            RMemoryTracker::Free(last.data);
+            archetype->chunks.pop_back();
+        }
+        archetype->count--;
+    }
+
+    REntity REntityWorld::CreateIn(RArchetype* Archetype){
+        if(Archetype == NULL || iterating > 0)
+            return REntity();
+        REntity entity = records.Create();
+        if(entity.IsNull())
+            return entity;
+        if(!AllocateRow(Archetype, entity, records.Get(entity))){
+            records.Destroy(entity);
+            return REntity();
+        }
+        return entity;
+    }
+
+    REntity REntityWorld::Create(){
+        return CreateIn(GetArchetype(0));
+    }
+
+    RBOOL REntityWorld::Destroy(REntity Entity){
+        REntityRecord* record = records.Get(Entity);
+        if(record == NULL || iterating > 0)
+            return false;
+        FreeRow(*record);
+        records.Destroy(Entity);
+        return true;
+    }
+
+    RBOOL REntityWorld::Move(REntity Entity, RArchetype* Target){
+        REntityRecord* record = records.Get(Entity);
+        REntityRecord from = *record;
+        if(!AllocateRow(Target, Entity, record))
+            return false;
+        RBYTE* src = from.archetype->chunks[from.chunk].data;
+        RBYTE* dst = Target->chunks[record->chunk].data;
+        for(size_t i=0; i<Target->components.size(); i++){
+            RUINT id = Target->components[i];
+            if(from.archetype->offsets[id] == ~0u)
+                continue;
+            size_t size = RComponentRegistry::GetSize(id);
+            memcpy(dst + Target->offsets[id] + record->row * size, src + from.archetype->offsets[id] + from.row * size, size);
+        }
+        FreeRow(from);
+        return true;
+    }
+
+    RRESULT REntityWorld::AddComponent(REntity Entity, RUINT Component, const RVOID* Value){
+        REntityRecord* record = records.Get(Entity);
+        if(record == NULL || Component >= R_MAX_COMPONENTS || Component >= RComponentRegistry::GetCount())
+            return R_INVALIDARG;
+        RArchetype* archetype = record->archetype;
+        if(archetype->offsets[Component] == ~0u){
+            if(iterating > 0)
+                return R_INVALIDARG;
+            RArchetype* target = archetype->addEdge[Component];
+            if(target == NULL){
+                target = GetArchetype(archetype->mask | ((RComponentMask)1 << Component));
+                if(target == NULL)
+                    return R_OUTOFMEMORY;
+                archetype->addEdge[Component] = target;
+                target->removeEdge[Component] = archetype;
+            }
+            if(!Move(Entity, target))
+                return R_OUTOFMEMORY;
+        }
+        size_t size = RComponentRegistry::GetSize(Component);
+        RBYTE* column = record->archetype->chunks[record->chunk].data + record->archetype->offsets[Component];
+        memcpy(column + record->row * size, Value, size);
+        return R_OK;
+    }
+
+    RRESULT REntityWorld::RemoveComponent(REntity Entity, RUINT Component){
+        REntityRecord* record = records.Get(Entity);
+        if(record == NULL || Component >= R_MAX_COMPONENTS || Component >= RComponentRegistry::GetCount())
+            return R_INVALIDARG;
+        RArchetype* archetype = record->archetype;
+        if(archetype->offsets[Component] == ~0u)
+            return R_OK;
+        if(iterating > 0)
+            return R_INVALIDARG;
+        RArchetype* target = archetype->removeEdge[Component];
+        if(target == NULL){
+            target = GetArchetype(archetype->mask & ~((RComponentMask)1 << Component));
+            if(target == NULL)
+                return R_OUTOFMEMORY;
+            archetype->removeEdge[Component] = target;
+            target->addEdge[Component] = archetype;
+        }
+        if(!Move(Entity, target))
+            return R_OUTOFMEMORY;
+        return R_OK;
+    }
+
+    RQuery* REntityWorld::Query(RComponentMask All, RComponentMask None){
+        for(size_t i=0; i<queries.size(); i++){
+            if(queries[i]->all == All && queries[i]->none == None)
+                return queries[i];
+        }
+        RQuery* query = new RQuery();
+        query->all = All;
+        query->none = None;
+        query->scanned = 0;
+        queries.push_back(query);
+        return query;
+    }
+
+    RVOID REntityWorld::Refresh(RQuery* Query){
+        for(; Query->scanned < archetypes.size(); Query->scanned++){
+            RArchetype* archetype = archetypes[Query->scanned];
+            if((archetype->mask & Query->all) == Query->all && (archetype->mask & Query->none) == 0)
+                Query->archetypes.push_back(archetype);
+        }
+    }
+
+    RRESULT REntityWorld::Playback(RCommandBuffer& Buffer){
+        if(iterating > 0)
+            return R_INVALIDARG;
+        std::unique_lock<std::mutex> guard(Buffer.lock);
+        placeholders.assign(Buffer.created, REntity());
+        size_t at = 0;
+        while(at < Buffer.stream.size()){
+            RCommandBuffer::RCommand command;
+            memcpy(&command, &Buffer.stream[at], sizeof(command));
+            const RBYTE* data = &Buffer.stream[0] + at + sizeof(command);
+            at += sizeof(command) + command.size;
+
+            REntity entity = command.entity;
+            if(!entity.IsNull() && entity.GetGeneration() == 0){
+                if(command.type == RCommandBuffer::RCOMMAND_CREATE){
+                    placeholders[entity.GetIndex() - 1] = Create();
+                    continue;
+                }
+                if(entity.GetIndex() > placeholders.size())
+                    continue;
+                entity = placeholders[entity.GetIndex() - 1];
+            }
+            switch(command.type){
+            case RCommandBuffer::RCOMMAND_DESTROY:
+                Destroy(entity);
+                break;
+            case RCommandBuffer::RCOMMAND_ADD:
+                AddComponent(entity, command.component, data);
+                break;
+            case RCommandBuffer::RCOMMAND_REMOVE:
+                RemoveComponent(entity, command.component);
+                break;
+            }
+        }
+        Buffer.stream.clear();
+        Buffer.created = 0;
+        return R_OK;
+    }
+
+    REntity REntityWorld::CreateFromNode(RScene& Scene, RNodeHandle Node){
+        RNode* node = Scene.GetNode(Node);
+        if(node == NULL)
+            return REntity();
+        RNodeRef ref;
+        ref.node = Node;
+        RTransform transform;
+        transform.local = node->GetLocalTransform();
+        transform.world = node->GetWorldTransform();
+        return Create(ref, transform);
+    }
+
+    RVOID REntityWorld::PushTransforms(RScene& Scene){
+        ParallelForEachChunk(Query<RNodeRef, RTransform>(), [&](const RChunkView& view){
+            const RNodeRef* refs = view.Get<RNodeRef>();
+            const RTransform* transforms = view.Get<RTransform>();
+            for(RUINT i=0; i<view.GetCount(); i++){
+                RNode* node = Scene.GetNode(refs[i].node);
+                if(node != NULL)
+                    node->SetLocalTransform(transforms[i].local);
+            }
+        });
+    }
+
+    RVOID REntityWorld::PullTransforms(RScene& Scene){
+        ParallelForEachChunk(Query<RNodeRef, RTransform>(), [&](const RChunkView& view){
+            const RNodeRef* refs = view.Get<RNodeRef>();
+            RTransform* transforms = view.Get<RTransform>();
+            for(RUINT i=0; i<view.GetCount(); i++){
+                RNode* node = Scene.GetNode(refs[i].node);
+                if(node != NULL)
+                    transforms[i].world = node->GetWorldTransform();
+            }
+        });
+    }
+
+    RUINT REntityWorld::GetChunkCount() const{
+        size_t count = 0;
+        for(size_t i=0; i<archetypes.size(); i++)
+            count += archetypes[i]->chunks.size();
+        return (RUINT)count;
+    }
+
+    RVOID REntityWorld::Clear(){
+        for(size_t i=0; i<archetypes.size(); i++){
+            RArchetype* archetype = archetypes[i];
+            for(size_t c=0; c<archetype->chunks.size(); c++)
+                RMemoryTracker::Free(archetype->chunks[c].data);
+            archetype->chunks.clear();
+            archetype->count = 0;
+        }
+        records.Clear();
+    }
+};
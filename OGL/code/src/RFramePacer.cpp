@@ -0,0 +1,151 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include "../headers/RFramePacer.h"
+#include "../headers/RPlatform.h"
+#include <thread>
+
+namespace Reactor {
+
+    RFramePacer::RFramePacer(){
+        targets[RFRAME_FOCUSED] = R_FRAMERATE_UNLIMITED;
+        targets[RFRAME_UNFOCUSED] = 30.0f;
+        targets[RFRAME_PAUSED] = R_FRAMERATE_ON_DEMAND;
+        targets[RFRAME_MINIMIZED] = R_FRAMERATE_ON_DEMAND;
+        state = RFRAME_FOCUSED;
+        lastFrame = nextFrame = -1.0;
+        spinMargin = 1.0;
+        oversleepPeak = 0.0;
+        windowStart = -1.0;
+        sumInterval = sumInterval2 = maxError = 0.0;
+        sumSleep = sumSpin = sumOversleep = 0.0;
+        sleeps = frames = intervals = idleWaits = 0;
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    RVOID RFramePacer::SetTarget(RFRAME_STATE State, RFLOAT FramesPerSecond){
+        targets[State] = FramesPerSecond;
+        if(State == state)
+            nextFrame = -1.0;
+    }
+
+    RBOOL RFramePacer::Wait(RFRAME_STATE State, RBOOL HasWork){
+        if(State != state){
+            // The gap across a state change says nothing about either state's pacing.
+            state = State;
+            lastFrame = nextFrame = -1.0;
+        }
+        RFLOAT fps = targets[State];
+        if(fps < 0.0f){
+            if(HasWork)
+                return true;
+            RPlatform::Instance()->WaitEvents(R_ON_DEMAND_WAIT, true);
+            idleWaits++;
+            Roll(RPlatform::Instance()->GetTime());
+            return false;
+        }
+        if(fps > 0.0f && nextFrame >= 0.0)
+            SleepUntil(nextFrame);
+        return true;
+    }
+
+    RVOID RFramePacer::SleepUntil(double Deadline){
+        RPlatform* platform = RPlatform::Instance();
+        double now = platform->GetTime();
+        double sleepFor = Deadline - now - spinMargin;
+        if(sleepFor > 0.0){
+            platform->WaitEvents(sleepFor, false);
+            double woke = platform->GetTime();
+            double over = __max(0.0, woke - (now + sleepFor));
+            oversleepPeak = __max(over, oversleepPeak * 0.9);
+            spinMargin = __min(16.0, __max(0.2, oversleepPeak * 1.25 + 0.1));
+            sumSleep += woke - now;
+            sumOversleep += over;
+            sleeps++;
+        }
+        double spinStart = platform->GetTime();
+        while(platform->GetTime() < Deadline)
+            std::this_thread::yield();
+        sumSpin += platform->GetTime() - spinStart;
+    }
+
+    RVOID RFramePacer::BeginFrame(){
+        double now = RPlatform::Instance()->GetTime();
+        RFLOAT fps = targets[state];
+        double interval = fps > 0.0f ? 1000.0 / fps : 0.0;
+        // On-demand frames have no rhythm to measure.
+        if(lastFrame >= 0.0 && fps >= 0.0f){
+            double dt = now - lastFrame;
+            sumInterval += dt;
+            sumInterval2 += dt * dt;
+            double reference = interval > 0.0 ? interval : stats.interval;
+            maxError = __max(maxError, fabs(dt - reference));
+            intervals++;
+        }
+        frames++;
+        if(interval > 0.0){
+            // Keep to the grid of deadlines; when more than an interval behind, start over.
+            nextFrame = nextFrame < 0.0 ? now + interval : nextFrame + interval;
+            if(nextFrame < now)
+                nextFrame = now + interval;
+        }
+        lastFrame = now;
+        Roll(now);
+    }
+
+    RVOID RFramePacer::Roll(double Now){
+        if(windowStart < 0.0)
+            windowStart = Now;
+        if(Now - windowStart < 1000.0)
+            return;
+        RFLOAT fps = targets[state];
+        double target = fps > 0.0f ? 1000.0 / fps : 0.0;
+        // The first frame after a state change and on-demand frames add no interval.
+        double n = (double)__max(frames, 1u);
+        double samples = (double)__max(intervals, 1u);
+        double mean = sumInterval / samples;
+        double meanSquare = sumInterval2 / samples;
+        // E[(x - r)^2] = E[x^2] - 2 r E[x] + r^2, r being the target or, without one, the mean.
+        double reference = target > 0.0 ? target : mean;
+        double error2 = meanSquare - 2.0 * reference * mean + reference * reference;
+
+        stats.state = state;
+        stats.target = (RFLOAT)target;
+        stats.interval = (RFLOAT)mean;
+        stats.jitter = (RFLOAT)sqrt(__max(0.0, error2));
+        stats.maxError = (RFLOAT)maxError;
+        stats.sleep = (RFLOAT)(sumSleep / n);
+        stats.spin = (RFLOAT)(sumSpin / n);
+        stats.oversleep = sleeps > 0 ? (RFLOAT)(sumOversleep / sleeps) : 0.0f;
+        stats.spinMargin = (RFLOAT)spinMargin;
+        stats.frames = frames;
+        stats.idleWaits = idleWaits;
+
+        windowStart = Now;
+        sumInterval = sumInterval2 = maxError = 0.0;
+        sumSleep = sumSpin = sumOversleep = 0.0;
+        sleeps = frames = intervals = idleWaits = 0;
+    }
+};
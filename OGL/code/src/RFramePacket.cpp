@@ -0,0 +1,196 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include "../headers/RFramePacket.h"
+#include "../headers/RMemory.h"
+#include "../headers/RTimer.h"
+
+namespace Reactor {
+
+    RFramePacket::RFramePacket(){
+        Reset();
+        dynamicBuffer = 0;
+    }
+
+    RVOID RFramePacket::Reset(){
+        frame = 0;
+        delta = 0.0f;
+        view = RMatrix();
+        eye = RVector3(0, 0, 0);
+        viewDir = RVector3(0, 0, -1);
+        fieldOfView = 45.0f;
+        aspect = 1.0f;
+        clearColor = RColor(0, 0, 0, 1);
+        draws.clear();
+        dynamic.clear();
+    }
+
+    RDrawItem& RFramePacket::AddDraw(){
+        // Value-initialized: zero fields and an identity transform.
+        draws.resize(draws.size() + 1);
+        return draws.back();
+    }
+
+    RUINT RFramePacket::AddDynamic(const RVOID* Data, RUINT Bytes){
+        size_t offset = (dynamic.size() + 15) & ~(size_t)15;
+        dynamic.resize(offset + Bytes);
+        if(Bytes > 0)
+            memcpy(&dynamic[offset], Data, Bytes);
+        return (RUINT)offset;
+    }
+
+    RVOID RFramePacket::SortDraws(){
+        // std::stable_sort takes its merge buffer from the heap. Sorting (key, index) pairs in
+        // frame scratch is stable through the index and allocation-free once the arena is warm.
+        RUINT count = (RUINT)draws.size();
+        RBOOL sorted = true;
+        for(RUINT i=1; i<count && sorted; i++)
+            sorted = draws[i - 1].sortKey <= draws[i].sortKey;
+        if(sorted)
+            return;
+
+        RScratchScope scope;
+        std::pair<uint64_t, RUINT>* order = RFrameArena::Allocate<std::pair<uint64_t, RUINT> >(count);
+        for(RUINT i=0; i<count; i++)
+            order[i] = std::make_pair(draws[i].sortKey, i);
+        std::sort(order, order + count);
+        RDrawItem* copy = RFrameArena::Allocate<RDrawItem>(count);
+        memcpy(copy, &draws[0], count * sizeof(RDrawItem));
+        for(RUINT i=0; i<count; i++)
+            draws[i] = copy[order[i].second];
+    }
+
+    RFramePipeline::RFramePipeline(){
+        states[0] = states[1] = RSLOT_FREE;
+        buildSlot = renderSlot = 0;
+        stopped = false;
+        buffer = 0;
+        bufferSize = 0;
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    RFramePipeline::~RFramePipeline(){
+    }
+
+    RFramePacket* RFramePipeline::AcquireBuild(){
+        double start = RTimer::Now();
+        std::unique_lock<std::mutex> guard(lock);
+        while(!stopped && states[buildSlot] != RSLOT_FREE)
+            changed.wait(guard);
+        stats.buildWait = (RFLOAT)(RTimer::Now() - start);
+        if(stopped)
+            return NULL;
+        states[buildSlot] = RSLOT_BUILDING;
+        RFramePacket* packet = &packets[buildSlot];
+        packet->Reset();
+        return packet;
+    }
+
+    RVOID RFramePipeline::Publish(RFramePacket* Packet){
+        std::unique_lock<std::mutex> guard(lock);
+        RUINT slot = (RUINT)(Packet - packets);
+        states[slot] = RSLOT_READY;
+        buildSlot = slot ^ 1;
+        stats.built++;
+        changed.notify_all();
+    }
+
+    RFramePacket* RFramePipeline::AcquireRender(){
+        double start = RTimer::Now();
+        std::unique_lock<std::mutex> guard(lock);
+        while(!stopped && states[renderSlot] != RSLOT_READY)
+            changed.wait(guard);
+        stats.renderWait = (RFLOAT)(RTimer::Now() - start);
+        if(stopped)
+            return NULL;
+        states[renderSlot] = RSLOT_RENDERING;
+        return &packets[renderSlot];
+    }
+
+    RVOID RFramePipeline::Release(RFramePacket* Packet){
+        std::unique_lock<std::mutex> guard(lock);
+        RUINT slot = (RUINT)(Packet - packets);
+        states[slot] = RSLOT_FREE;
+        renderSlot = slot ^ 1;
+        stats.rendered++;
+        changed.notify_all();
+    }
+
+    RVOID RFramePipeline::UploadDynamic(RFramePacket* Packet){
+        RUINT size = Packet->GetDynamicSize();
+        Packet->dynamicBuffer = 0;
+        if(size == 0)
+            return;
+        if(buffer == 0)
+            glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        // Orphan the previous contents so the driver never waits for last frame's draws.
+        if(size > bufferSize){
+            RMemoryTracker::Track(RMEM_RENDER, (long long)size - (long long)bufferSize);
+            bufferSize = size;
+        }
+        glBufferData(GL_ARRAY_BUFFER, bufferSize, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, Packet->GetDynamicData());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        Packet->dynamicBuffer = buffer;
+    }
+
+    RVOID RFramePipeline::DestroyBuffers(){
+        if(buffer != 0){
+            glDeleteBuffers(1, &buffer);
+            RMemoryTracker::Track(RMEM_RENDER, -(long long)bufferSize);
+        }
+        buffer = 0;
+        bufferSize = 0;
+    }
+
+    RVOID RFramePipeline::Stop(){
+        std::unique_lock<std::mutex> guard(lock);
+        stopped = true;
+        changed.notify_all();
+    }
+
+    RVOID RFramePipeline::Reset(){
+        std::unique_lock<std::mutex> guard(lock);
+        states[0] = states[1] = RSLOT_FREE;
+        buildSlot = renderSlot = 0;
+        stopped = false;
+    }
+
+    RFramePipelineStats RFramePipeline::GetStats(){
+        std::unique_lock<std::mutex> guard(lock);
+        return stats;
+    }
+
+    RVOID RFramePipeline::SetBuildTime(RFLOAT Milliseconds){
+        std::unique_lock<std::mutex> guard(lock);
+        stats.buildTime = Milliseconds;
+    }
+
+    RVOID RFramePipeline::SetRenderTime(RFLOAT Milliseconds){
+        std::unique_lock<std::mutex> guard(lock);
+        stats.renderTime = Milliseconds;
+    }
+};
@@ -0,0 +1,332 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RGPUParticleSystem.h"
+
+#if defined(__APPLE__)
+#include <OpenGL/glext.h>
+// The legacy 2.1 context only has transform feedback as EXT_transform_feedback, and
+// GLSL 1.20, so the shaders below are written against the R_* qualifiers.
+#define R_TRANSFORM_FEEDBACK 1
+#define R_TRANSFORM_FEEDBACK_BUFFER GL_TRANSFORM_FEEDBACK_BUFFER_EXT
+#define R_RASTERIZER_DISCARD GL_RASTERIZER_DISCARD_EXT
+#define rBindBufferBase glBindBufferBaseEXT
+#define rBeginTransformFeedback glBeginTransformFeedbackEXT
+#define rEndTransformFeedback glEndTransformFeedbackEXT
+#define R_GLSL_VERTEX "#version 120\n#define R_IN attribute\n#define R_OUT varying\n"
+#define R_GLSL_FRAGMENT "#version 120\n#define R_IN varying\n#define R_TEXTURE texture2D\n"
+#elif defined(GL_TRANSFORM_FEEDBACK_BUFFER) && defined(GL_RASTERIZER_DISCARD)
+#define R_TRANSFORM_FEEDBACK 1
+#define R_TRANSFORM_FEEDBACK_BUFFER GL_TRANSFORM_FEEDBACK_BUFFER
+#define R_RASTERIZER_DISCARD GL_RASTERIZER_DISCARD
+#define rBindBufferBase glBindBufferBase
+#define rBeginTransformFeedback glBeginTransformFeedback
+#define rEndTransformFeedback glEndTransformFeedback
+#endif
+
+#ifndef R_GLSL_VERTEX
+#define R_GLSL_VERTEX "#version 130\n#define R_IN in\n#define R_OUT out\n"
+#define R_GLSL_FRAGMENT "#version 130\n#define R_IN in\n#define R_TEXTURE texture\n"
+#endif
+
+namespace Reactor {
+
+    // Attribute slots follow RVERTEX_ATTRIB: velocity rides in the normal slot, the random
+    // values in the color slot and (age, 1 / lifetime) in the first texture coordinate.
+    static const char* __simulateVertex =
+        R_GLSL_VERTEX
+        "R_IN vec3 R_POSITION;\n"
+        "R_IN vec3 R_NORMAL;\n"
+        "R_IN vec2 R_TEXCOORD0;\n"
+        "R_IN vec4 R_COLOR;\n"
+        "uniform float Dt;\n"
+        "uniform vec3 Gravity;\n"
+        "uniform float DragFactor;\n"
+        "uniform float EndVelocity;\n"
+        "R_OUT vec3 outPosition;\n"
+        "R_OUT vec3 outVelocity;\n"
+        "R_OUT vec4 outRandom;\n"
+        "R_OUT vec2 outTime;\n"
+        "void main(){\n"
+        "    outRandom = R_COLOR;\n"
+        "    outPosition = R_POSITION;\n"
+        "    outVelocity = R_NORMAL;\n"
+        "    outTime = R_TEXCOORD0;\n"
+        "    if(R_TEXCOORD0.x * R_TEXCOORD0.y < 1.0){\n"
+        "        float age = R_TEXCOORD0.x + Dt;\n"
+        "        float t = min(age * R_TEXCOORD0.y, 1.0);\n"
+        "        outVelocity = (R_NORMAL + Gravity * Dt) * DragFactor;\n"
+        "        outPosition = R_POSITION + outVelocity * (1.0 + (EndVelocity - 1.0) * t) * Dt;\n"
+        "        outTime.x = age;\n"
+        "    }\n"
+        "    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);\n"
+        "}\n";
+
+    static const char* __simulateFragment =
+        R_GLSL_FRAGMENT
+        "void main(){ gl_FragColor = vec4(0.0); }\n";
+
+    static const char* __drawVertex =
+        R_GLSL_VERTEX
+        "R_IN vec3 R_POSITION;\n"
+        "R_IN vec2 R_TEXCOORD0;\n"
+        "R_IN vec4 R_COLOR;\n"
+        "uniform vec2 StartSize;\n"
+        "uniform vec2 EndSize;\n"
+        "uniform vec2 RotateSpeed;\n"
+        "uniform vec4 MinColor;\n"
+        "uniform vec4 MaxColor;\n"
+        "uniform float ViewportHeight;\n"
+        "R_OUT vec4 vColor;\n"
+        "R_OUT vec2 vRotation;\n"
+        "void main(){\n"
+        "    float t = R_TEXCOORD0.x * R_TEXCOORD0.y;\n"
+        "    vRotation = vec2(1.0, 0.0);\n"
+        "    if(t >= 1.0){\n"
+        "        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+        "        gl_PointSize = 0.0;\n"
+        "        vColor = vec4(0.0);\n"
+        "        return;\n"
+        "    }\n"
+        "    vec4 position = gl_ModelViewProjectionMatrix * vec4(R_POSITION, 1.0);\n"
+        "    float size = mix(mix(StartSize.x, StartSize.y, R_COLOR.x), mix(EndSize.x, EndSize.y, R_COLOR.x), t);\n"
+        "    gl_Position = position;\n"
+        "    gl_PointSize = size * gl_ProjectionMatrix[1][1] / position.w * ViewportHeight * 0.5;\n"
+        "    vColor = mix(MinColor, MaxColor, R_COLOR.y);\n"
+        "    vColor.a *= t * (1.0 - t) * (1.0 - t) * 6.7;\n"
+        "    float angle = mix(RotateSpeed.x, RotateSpeed.y, R_COLOR.z) * R_TEXCOORD0.x;\n"
+        "    vRotation = vec2(cos(angle), sin(angle));\n"
+        "}\n";
+
+    static const char* __drawFragment =
+        R_GLSL_FRAGMENT
+        "R_IN vec4 vColor;\n"
+        "R_IN vec2 vRotation;\n"
+        "uniform sampler2D Texture;\n"
+        "uniform float Textured;\n"
+        "void main(){\n"
+        "    vec2 c = gl_PointCoord - 0.5;\n"
+        "    c = vec2(c.x * vRotation.x - c.y * vRotation.y, c.x * vRotation.y + c.y * vRotation.x) + 0.5;\n"
+        "    gl_FragColor = vColor * (Textured > 0.5 ? R_TEXTURE(Texture, c) : vec4(1.0));\n"
+        "}\n";
+
+    RGPUParticleSystem::RGPUParticleSystem(const RParticleSettings& Settings) : settings(Settings){
+        simulate = NULL;
+        draw = NULL;
+        buffers[0] = buffers[1] = 0;
+        source = 0;
+        capacity = (RUINT)__max(1, Settings.maxParticles);
+        used = 0;
+        head = 0;
+        firstPending = 0;
+        time = 0.0;
+    }
+
+    RGPUParticleSystem::~RGPUParticleSystem(){
+        Destroy();
+    }
+
+    RBOOL RGPUParticleSystem::IsSupported(){
+#ifdef R_TRANSFORM_FEEDBACK
+        const char* version = (const char*)glGetString(GL_VERSION);
+        if(version != NULL && atoi(version) >= 3)
+            return true;
+        const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+        return extensions != NULL && strstr(extensions, "GL_EXT_transform_feedback") != NULL;
+#else
+        return false;
+#endif
+    }
+
+    RRESULT RGPUParticleSystem::Init(){
+        if(!IsSupported())
+            return R_FALSE;
+#ifdef R_TRANSFORM_FEEDBACK
+        RProgramCache* cache = RProgramCache::Instance();
+        cache->RegisterSource("particles_gpu_simulate", __simulateVertex, __simulateFragment);
+        cache->RegisterSource("particles_gpu_draw", __drawVertex, __drawFragment);
+
+        RProgramKey simulateKey("particles_gpu_simulate", RVA_POSITION | RVA_NORMAL | RVA_TEXCOORD0 | RVA_COLOR);
+        simulateKey.AddFeedbackVarying("outPosition");
+        simulateKey.AddFeedbackVarying("outVelocity");
+        simulateKey.AddFeedbackVarying("outRandom");
+        simulateKey.AddFeedbackVarying("outTime");
+        simulate = cache->Request(simulateKey);
+        draw = cache->Request(RProgramKey("particles_gpu_draw", RVA_POSITION | RVA_TEXCOORD0 | RVA_COLOR));
+
+        glGenBuffers(2, buffers);
+        for(int i=0; i<2; i++){
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(RGPUParticle), NULL, GL_DYNAMIC_COPY);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        RMemoryTracker::Track(RMEM_PARTICLES, 2 * (long long)(capacity * sizeof(RGPUParticle)));
+        spawnTime.assign(capacity, -1.0e30);
+        pending.reserve(capacity);
+        return R_OK;
+#else
+        return R_FALSE;
+#endif
+    }
+
+    RVOID RGPUParticleSystem::Destroy(){
+        if(buffers[0] != 0){
+            glDeleteBuffers(2, buffers);
+            buffers[0] = buffers[1] = 0;
+            RMemoryTracker::Track(RMEM_PARTICLES, -2 * (long long)(capacity * sizeof(RGPUParticle)));
+        }
+        // Programs belong to RProgramCache.
+        simulate = NULL;
+        draw = NULL;
+        used = head = 0;
+        pending.clear();
+    }
+
+    RBOOL RGPUParticleSystem::AddParticle(const RVector3& Position, const RVector3& Velocity){
+        if(buffers[0] == 0 || time - spawnTime[head] < settings.duration)
+            return false;
+
+        RVector3 velocity = EmissionVelocity(settings, Velocity);
+        RGPUParticle p;
+        p.position[0] = Position.x;
+        p.position[1] = Position.y;
+        p.position[2] = Position.z;
+        p.velocity[0] = velocity.x;
+        p.velocity[1] = velocity.y;
+        p.velocity[2] = velocity.z;
+        p.random[0] = Random();
+        p.random[1] = Random();
+        p.random[2] = Random();
+        p.random[3] = 0.0f;
+        p.age = 0.0f;
+        p.invLifetime = (1.0f + Random() * settings.durationRandomness) / __max(settings.duration, 0.0001f);
+
+        if(pending.empty())
+            firstPending = head;
+        pending.push_back(p);
+        spawnTime[head] = time;
+        used = __max(used, head + 1);
+        head = (head + 1) % capacity;
+        return true;
+    }
+
+    RVOID RGPUParticleSystem::Upload(){
+        if(pending.empty())
+            return;
+        RUINT count = (RUINT)pending.size();
+        RUINT first = __min(count, capacity - firstPending);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[source]);
+        glBufferSubData(GL_ARRAY_BUFFER, firstPending * sizeof(RGPUParticle), first * sizeof(RGPUParticle), &pending[0]);
+        if(first < count)
+            glBufferSubData(GL_ARRAY_BUFFER, 0, (count - first) * sizeof(RGPUParticle), &pending[first]);
+        pending.clear();
+    }
+
+    RVOID RGPUParticleSystem::BindStream(){
+        const GLsizei stride = sizeof(RGPUParticle);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[source]);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid*)offsetof(RGPUParticle, position));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid*)offsetof(RGPUParticle, velocity));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (const GLvoid*)offsetof(RGPUParticle, age));
+        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, stride, (const GLvoid*)offsetof(RGPUParticle, random));
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glEnableVertexAttribArray(5);
+    }
+
+    RVOID RGPUParticleSystem::UnbindStream(){
+        glDisableVertexAttribArray(0);
+        glDisableVertexAttribArray(1);
+        glDisableVertexAttribArray(2);
+        glDisableVertexAttribArray(5);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    RVOID RGPUParticleSystem::Update(RFLOAT ElapsedSeconds){
+#ifdef R_TRANSFORM_FEEDBACK
+        if(buffers[0] == 0 || ElapsedSeconds <= 0.0f)
+            return;
+        time += ElapsedSeconds;
+        Upload();
+        if(used == 0 || !RProgramCache::Instance()->IsReady(simulate))
+            return;
+
+        GLuint program = RProgramCache::Instance()->Bind(simulate);
+        glUniform1f(glGetUniformLocation(program, "Dt"), ElapsedSeconds);
+        glUniform3f(glGetUniformLocation(program, "Gravity"), settings.gravity.x, settings.gravity.y, settings.gravity.z);
+        glUniform1f(glGetUniformLocation(program, "DragFactor"), settings.drag > 0.0f ? expf(-settings.drag * ElapsedSeconds) : 1.0f);
+        glUniform1f(glGetUniformLocation(program, "EndVelocity"), settings.endVelocity);
+
+        BindStream();
+        rBindBufferBase(R_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[source ^ 1]);
+        glEnable(R_RASTERIZER_DISCARD);
+        rBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, used);
+        rEndTransformFeedback();
+        glDisable(R_RASTERIZER_DISCARD);
+        rBindBufferBase(R_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        UnbindStream();
+        glUseProgram(0);
+        source ^= 1;
+#endif
+    }
+
+    RVOID RGPUParticleSystem::Render(RINT ViewportHeight){
+        if(used == 0 || draw == NULL || !RProgramCache::Instance()->IsReady(draw))
+            return;
+
+        GLuint program = RProgramCache::Instance()->Bind(draw);
+        glUniform2f(glGetUniformLocation(program, "StartSize"), settings.minStartSize, settings.maxStartSize);
+        glUniform2f(glGetUniformLocation(program, "EndSize"), settings.minEndSize, settings.maxEndSize);
+        glUniform2f(glGetUniformLocation(program, "RotateSpeed"), settings.minRotateSpeed, settings.maxRotateSpeed);
+        glUniform4f(glGetUniformLocation(program, "MinColor"), settings.minColor.x, settings.minColor.y, settings.minColor.z, settings.minColor.w);
+        glUniform4f(glGetUniformLocation(program, "MaxColor"), settings.maxColor.x, settings.maxColor.y, settings.maxColor.z, settings.maxColor.w);
+        glUniform1f(glGetUniformLocation(program, "ViewportHeight"), (GLfloat)ViewportHeight);
+        glUniform1f(glGetUniformLocation(program, "Textured"), settings.textureId != 0 ? 1.0f : 0.0f);
+        glUniform1i(glGetUniformLocation(program, "Texture"), 0);
+        if(settings.textureId != 0){
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, settings.textureId);
+        }
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+#ifdef GL_POINT_SPRITE
+        glEnable(GL_POINT_SPRITE);      // compatibility contexts only fill gl_PointCoord with this on
+#endif
+        BindStream();
+        glDrawArrays(GL_POINTS, 0, used);
+        UnbindStream();
+#ifdef GL_POINT_SPRITE
+        glDisable(GL_POINT_SPRITE);
+#endif
+        glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+        glUseProgram(0);
+    }
+};
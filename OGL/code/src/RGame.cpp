@@ -22,18 +22,176 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 #include "../headers/RGame.h"
+#include "../headers/RAssetLoader.h"
+#include "../headers/RAnimation.h"
+#include "../headers/RCamera.h"
+#include "../headers/RInput.h"
+#include "../headers/RReplay.h"
+#include "../headers/RMemory.h"
+#include "../headers/RMemoryTracker.h"
+#include "../headers/RPlatform.h"
+#include "../headers/RThreadPool.h"
+#include "../headers/RTimer.h"
+#include <thread>
 
 namespace Reactor
 {
-	static int __ticks = 0;
     static int __frames = 0;
-    static int __timebase = 0;
+    static double __timebase = 0.0;
     static float __fps = 0.0f;
-	void RGame::Run(int argc, char** argv)
+    static double __lastUpdate = -1.0;
+    static RCamera* __camera = NULL;
+    static RInputLog __record;
+    static RInputLog __replay;
+    static std::vector<RInputEvent> __replayEvents;
+    static float __delta = 0.0f;
+    static std::atomic<float> __aspect(1.0f);
+    static RFramePipeline __pipeline;
+    static RFramePacket __headlessPacket;
+    static RRENDER_MODE __renderMode = RRENDER_SYNCHRONOUS;
+    static RRENDER_MODE __requestedMode = RRENDER_SYNCHRONOUS;
+    static std::thread* __simulation = NULL;
+    static RUINT __frameIndex = 0;
+    static RFramePacer __pacer;
+    static std::atomic<bool> __paused(false);
+    static std::atomic<bool> __redraw(true);
+
+    static void __fillPacket(RFramePacket* packet, float delta)
+    {
+        packet->frame = ++__frameIndex;
+        packet->delta = delta;
+        packet->aspect = __aspect;
+        if(__camera != NULL){
+            packet->view = __camera->GetViewMatrix();
+            packet->eye = __camera->GetPosition();
+            packet->viewDir = __camera->GetDirection();
+        }
+    }
+
+    /** One frame of input, game logic, animation and building Packet. While a replay is
+        open the frame delta and input come from the log instead; returns false once it
+        runs out. Timing, when given, receives the CPU time of each stage.
+    */
+    static bool __step(float delta, RFramePacket* packet, RReplayFrameTiming* timing)
+    {
+        uint64_t allocations = RAllocationCounter::GetCount();
+        RInput* input = RInput::Instance();
+        double frameStart = input->GetSnapshot().time;
+        if(__replay.IsOpen()){
+            if(__replay.ReadFrame(delta, __replayEvents, frameStart)){
+                input->Update(__replayEvents.empty() ? NULL : &__replayEvents[0], (RUINT)__replayEvents.size());
+            } else {
+                __replay.Close();
+                if(timing != NULL)
+                    return false;
+                input->Update();
+            }
+        } else {
+            input->Update();
+        }
+        if(__record.IsOpen())
+            __record.WriteFrame(delta, input->GetEvents(), frameStart);
+        __delta = delta;
+
+        double t0 = RTimer::Now();
+        RGame::Instance()->Update();
+
+        // Animation runs after game logic so it sees this frame's camera and actor placement.
+        double t1 = RTimer::Now();
+        RAnimationSystem* animation = RAnimationSystem::Instance();
+        if(animation->GetInstanceCount() > 0){
+            animation->SetCamera(__camera, __camera != NULL ? __camera->GetFieldOfView() : 45.0f, __aspect);
+            animation->Update(delta);
+        }
+        double t2 = RTimer::Now();
+        __fillPacket(packet, delta);
+        RGame::Instance()->BuildFrame(*packet);
+        double t3 = RTimer::Now();
+        RFrameArena::EndFrame();
+        RMemoryTracker::EndFrame();
+
+        if(timing != NULL){
+            timing->delta = delta * 1000.0f;
+            timing->update = (RFLOAT)(t1 - t0);
+            timing->animation = (RFLOAT)(t2 - t1);
+            timing->render = (RFLOAT)(t3 - t2);
+            timing->total = (RFLOAT)(t3 - t0);
+            timing->allocations = (RUINT)(RAllocationCounter::GetCount() - allocations);
+        }
+        return true;
+    }
+
+    /** Render side of a frame: draws the oldest published packet. Without a GL context
+        (headless) the packet is only retired.
+    */
+    static void __draw()
+    {
+        RFramePacket* packet = __pipeline.AcquireRender();
+        if(packet == NULL)
+            return;
+        double start = RTimer::Now();
+        if(RPlatform::Instance()->HasContext()){
+            __pipeline.UploadDynamic(packet);
+            RGame::Instance()->RenderFrame(*packet);
+            if(__renderMode == RRENDER_SYNCHRONOUS)
+                RGame::Instance()->Render();
+        }
+        __pipeline.SetRenderTime((RFLOAT)(RTimer::Now() - start));
+        __pipeline.Release(packet);
+    }
+
+    static void __simulationMain()
+    {
+        double last = RTimer::Now();
+        for(;;){
+            RFramePacket* packet = __pipeline.AcquireBuild();
+            if(packet == NULL)
+                break;
+            double start = RTimer::Now();
+            __step((float)((start - last) * 0.001), packet, NULL);
+            last = start;
+            __pipeline.SetBuildTime((RFLOAT)(RTimer::Now() - start));
+            __pipeline.Publish(packet);
+        }
+    }
+
+    /** Starts or stops the simulation thread; only called on the GLUT thread between frames. */
+    static void __applyRenderMode()
+    {
+        if(__requestedMode == __renderMode)
+            return;
+        if(__simulation != NULL){
+            __pipeline.Stop();
+            __simulation->join();
+            delete __simulation;
+            __simulation = NULL;
+            // A packet built but not drawn yet is dropped.
+            __pipeline.Reset();
+        }
+        __renderMode = __requestedMode;
+        if(__renderMode == RRENDER_THREADED)
+            __simulation = new std::thread(__simulationMain);
+    }
+
+    /** Stops the simulation thread and the workers, then releases GL objects and the
+        window while the context still exists.
+    */
+    static void __shutdown()
+    {
+        __requestedMode = RRENDER_SYNCHRONOUS;
+        __applyRenderMode();
+        RThreadPool::Instance()->Shutdown();
+        RGame::Instance()->Unload();
+        RPlatform* platform = RPlatform::Instance();
+        if(platform->HasContext())
+            __pipeline.DestroyBuffers();
+        REngine::Instance()->DestroyAll();
+        platform->Shutdown();
+    }
+
+	void RGame::Run(int argc, char** argv, RPLATFORM_BACKEND Backend)
 	{
-			//glutSetWorkingDirectory(argv[0]);
-			glutInit(&argc, argv);
-			glutInitDisplayMode (GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+		RPlatform::Instance()->Init(Backend, &argc, argv);
 	}
 	RGame::~RGame()
 	{	
@@ -44,44 +202,205 @@ namespace Reactor
         return __fps;
     }
     
+    /** One pass of the frame loop; false once the platform wants to stop. */
+    static bool __iterate()
+    {
+        RPlatform* platform = RPlatform::Instance();
+        if(!platform->PumpEvents())
+            return false;
+        RBOOL changed = platform->ConsumeEvents();
+        if(__redraw.exchange(false))
+            changed = true;
+        if(__pacer.Wait(RGame::Instance()->GetFrameState(), changed)){
+            __pacer.BeginFrame();
+            RGame::OnIdle();
+        }
+        return true;
+    }
+
+    /** The loop body for backends that own the loop and never return from it. */
+    static void __loopFrame()
+    {
+        if(!__iterate()){
+            __shutdown();
+            exit(0);
+        }
+    }
+
 	void RGame::Init()
 	{
-		glutDisplayFunc(OnRender);
-		glutReshapeFunc(OnResize);
-		glutIdleFunc(OnIdle);
-		glutMainLoop();
-		
-		
-		//delete this;
+		RPlatform* platform = RPlatform::Instance();
+		if(!platform->IsInitialized())
+			platform->Init(RPLATFORM_HEADLESS, NULL, NULL);
+		platform->SetResizeHandler(OnResize);
+		if(platform->RunLoop(__loopFrame))
+			return;
+		while(__iterate())
+		{
+		}
+		__shutdown();
+	}
+
+	void RGame::Quit()
+	{
+		RPlatform::Instance()->RequestQuit();
 	}
 
 	void RGame::OnIdle()
 	{
-        
-        int time = glutGet(GLUT_ELAPSED_TIME);
-        if (time - __timebase > 1000) {
-            __fps = __frames*1000.0f/(float)(time-__timebase);
+        double time = RPlatform::Instance()->GetTime();
+        if (time - __timebase > 1000.0) {
+            __fps = (float)(__frames * 1000.0 / (time - __timebase));
             __timebase = time;
             __frames = 0;
         }
-        if(time-__ticks > (1/60)){
-            __ticks = time;
-            ++__frames;
-            RGame::Instance()->OnRender();
-        }
+        ++__frames;
+        RGame::Instance()->OnRender();
 		RGame::Instance()->Idle();
 	}
 	
 	void RGame::OnResize(int width, int height)
 	{
-		RGame::Instance()->Reactor().OnResize(width, height);
+		__aspect = height > 0 ? width / (float)height : 1.0f;
+		RGame::Instance()->Reactor().OnResize(width, height, __camera != NULL ? __camera->GetFieldOfView() : 45.0f);
 	}
 
 	void RGame::OnRender()
 	{
-        RGame::Instance()->Update();
-		RGame::Instance()->Render();
-		
+		RGame::Instance()->Reactor().WaitForFrameLatency();
+		if(RPlatform::Instance()->HasContext())
+			RAssetLoader::Instance()->PumpUploads();
+        __applyRenderMode();
+        if(__renderMode == RRENDER_SYNCHRONOUS){
+            double time = RPlatform::Instance()->GetTime();
+            float elapsed = __lastUpdate < 0.0 ? 0.0f : (float)((time - __lastUpdate) * 0.001);
+            __lastUpdate = time;
+            double start = RTimer::Now();
+            RFramePacket* packet = __pipeline.AcquireBuild();
+            __step(elapsed, packet, NULL);
+            __pipeline.SetBuildTime((RFLOAT)(RTimer::Now() - start));
+            __pipeline.Publish(packet);
+        }
+        __draw();
+	}
+
+	void RGame::SetRenderMode(RRENDER_MODE Mode)
+	{
+		__requestedMode = Mode;
+	}
+
+	RRENDER_MODE RGame::GetRenderMode()
+	{
+		return __requestedMode;
+	}
+
+	RFramePipelineStats RGame::GetFramePipelineStats()
+	{
+		return __pipeline.GetStats();
+	}
+
+	void RGame::SetFrameRateTarget(RFRAME_STATE State, float FramesPerSecond)
+	{
+		__pacer.SetTarget(State, FramesPerSecond);
+	}
+
+	float RGame::GetFrameRateTarget(RFRAME_STATE State)
+	{
+		return __pacer.GetTarget(State);
+	}
+
+	void RGame::SetPaused(RBOOL Paused)
+	{
+		__paused = Paused ? true : false;
+		RequestRedraw();
+	}
+
+	RBOOL RGame::IsPaused()
+	{
+		return __paused;
+	}
+
+	void RGame::RequestRedraw()
+	{
+		__redraw = true;
+		RPlatform::Instance()->NotifyEvent();
+	}
+
+	RFRAME_STATE RGame::GetFrameState()
+	{
+		RPlatform* platform = RPlatform::Instance();
+		if(!platform->IsWindowVisible())
+			return RFRAME_MINIMIZED;
+		if(__paused)
+			return RFRAME_PAUSED;
+		if(!platform->IsWindowFocused())
+			return RFRAME_UNFOCUSED;
+		return RFRAME_FOCUSED;
+	}
+
+	RFramePacingStats RGame::GetFramePacingStats()
+	{
+		return __pacer.GetStats();
+	}
+
+	RRESULT RGame::StartRecording(const std::string& Path)
+	{
+		return __record.Create(Path);
+	}
+
+	void RGame::StopRecording()
+	{
+		__record.Close();
+	}
+
+	RRESULT RGame::StartReplay(const std::string& Path)
+	{
+		return __replay.Open(Path);
+	}
+
+	RBOOL RGame::IsReplaying()
+	{
+		return __replay.IsOpen();
+	}
+
+	RRESULT RGame::Replay(const std::string& Path, RREPLAY_MODE Mode, const std::string& ReportPath, RReplayReport* Report)
+	{
+		RRESULT result = __replay.Open(Path);
+		if(FAILED(result))
+			return result;
+		Load();
+		std::vector<RReplayFrameTiming> frames;
+		frames.reserve(__replay.GetFrameCount());
+		double start = RTimer::Now();
+		double due = start;
+		RReplayFrameTiming timing;
+		while(__headlessPacket.Reset(), __step(0.0f, &__headlessPacket, &timing)){
+			frames.push_back(timing);
+			if(Mode == RREPLAY_REALTIME){
+				due += timing.delta;
+				double wait = due - RTimer::Now();
+				if(wait > 0.0)
+					std::this_thread::sleep_for(std::chrono::microseconds((long long)(wait * 1000.0)));
+			}
+		}
+		RFLOAT wall = (RFLOAT)(RTimer::Now() - start);
+		Unload();
+		return RInputLog::WriteReport(ReportPath, frames, wall, Report);
+	}
+
+	float RGame::GetFrameDelta()
+	{
+		return __delta;
+	}
+
+	void RGame::SetCamera(RCamera* Camera)
+	{
+		__camera = Camera;
+	}
+
+	RCamera* RGame::GetCamera()
+	{
+		return __camera;
 	}
 
 	REngine& RGame::Reactor()
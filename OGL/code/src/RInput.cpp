@@ -21,133 +21,240 @@
  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  THE SOFTWARE.
  */
+
 #include "../headers/RInput.h"
+#include "../headers/RPlatform.h"
+#include "../headers/RTimer.h"
+#include <thread>
 
 namespace Reactor {
-    
+
+    static inline RBOOL __test(const uint64_t* bits, RINT code){
+        if(code < 0 || code >= R_INPUT_CODES)
+            return false;
+        return (bits[code >> 6] >> (code & 63)) & 1;
+    }
+
+    RInput::RInput(){
+        memset(snapshot.held, 0, sizeof(snapshot.held));
+        memset(snapshot.pressed, 0, sizeof(snapshot.pressed));
+        memset(snapshot.released, 0, sizeof(snapshot.released));
+        snapshot.mouse = RVector2(0, 0);
+        snapshot.joystick = RVector3(0, 0, 0);
+        snapshot.time = RTimer::Now();
+        joyState = 0;
+        joyAxes[0] = joyAxes[1] = joyAxes[2] = 0;
+        producing.clear();
+        frameEvents.reserve(R_INPUT_QUEUE_SIZE);
+    }
+
     RInput::~RInput(){
-        if(keys != null){
-        delete keys;
-        delete mbuttons;
-        }
     }
     
     RVOID RInput::Init(){
-        keys = new bool[256];
-        for(int i=0; i<256; i++){
-            keys[i] = false;
-        }
-        mbuttons = new bool[3];
-        for(int i=0; i<3; i++){
-            mbuttons[i] = false;
-        }
-        jbuttons = new bool[32];
-        for(int i=0; i<32; i++){
-            jbuttons[i] = false;
-        }
-        mouse = RVector2(0,0);
+        // Headless and custom backends post their input with Inject instead.
+        if(!RPlatform::Instance()->HasGLUT())
+            return;
         glutKeyboardFunc(KeyFunc);
         glutKeyboardUpFunc(KeyUpFunc);
         glutSpecialFunc(SpecialKeyFunc);
         glutSpecialUpFunc(SpecialKeyUpFunc);
         glutSetKeyRepeat(0);
         glutJoystickFunc(JoystickFunc, 5);
-        glutMouseFunc(MouseFunc);   
+        glutMouseFunc(MouseFunc);
+        glutMotionFunc(MotionFunc);
+        glutPassiveMotionFunc(MotionFunc);
+    }
+
+    RVOID RInput::Post(RINPUT_EVENT type, RINT code, RINT x, RINT y){
+        RInputEvent e;
+        e.time = RTimer::Now();
+        e.code = (uint16_t)code;
+        e.type = (uint8_t)type;
+        e.pad = 0;
+        e.x = (int16_t)x;
+        e.y = (int16_t)y;
+        Instance()->Enqueue(e);
+    }
+
+    RVOID RInput::Inject(const RInputEvent& Event){
+        Enqueue(Event);
+    }
+
+    RVOID RInput::Enqueue(const RInputEvent& Event){
+        // The ring takes one producer at a time; Inject may run on any thread next to the
+        // window callbacks, so producers take turns here. Uncontended this is one exchange.
+        while(producing.test_and_set(std::memory_order_acquire))
+            std::this_thread::yield();
+        queue.Push(Event);
+        producing.clear(std::memory_order_release);
+        RPlatform::Instance()->NotifyEvent();
     }
     
     RVOID RInput::JoystickFunc(RUINT state, RINT x, RINT y, RINT z){
-        for(int i=0;i<32;i++){      
-            Instance()->jbuttons[i] =  (state & (1<<i));
+        // GLUT polls the full joystick state; only the changes are queued.
+        RInput* input = Instance();
+        RUINT changed = state ^ input->joyState;
+        for(int i=0; changed != 0; i++, changed >>= 1){
+            if(changed & 1)
+                Post((state & (1u << i)) ? RINPUT_DOWN : RINPUT_UP, R_INPUT_JOYSTICK + i, x, y);
+        }
+        input->joyState = state;
+        if(x != input->joyAxes[0] || y != input->joyAxes[1] || z != input->joyAxes[2]){
+            Post(RINPUT_JOYSTICK_AXES, (uint16_t)(int16_t)z, x, y);
+            input->joyAxes[0] = x;
+            input->joyAxes[1] = y;
+            input->joyAxes[2] = z;
         }
-        Instance()->joystick = RVector3(x, y, z);
-        
     }
-    RVOID RInput::KeyFunc(RCHAR key, RINT x, RINT y){
-        fprintf(stdout, "Key Out: %c", key);
-        
-        Instance()->keys[key] = true;
-        Instance()->mouse = RVector2(x, y);
-        
+
+    RVOID RInput::KeyFunc(RBYTE key, RINT x, RINT y){
+        Post(RINPUT_DOWN, key, x, y);
     }
     
-    RVOID RInput::KeyUpFunc(RCHAR key, RINT x, RINT y){
-        fprintf(stdout, "Key Up: %c", key);
-        Instance()->keys[key] = false;
-        Instance()->mouse = RVector2(x, y);
-        
+    RVOID RInput::KeyUpFunc(RBYTE key, RINT x, RINT y){
+        Post(RINPUT_UP, key, x, y);
     }
     
     RVOID RInput::SpecialKeyFunc(RINT key, RINT x, RINT y){
-        fprintf(stdout, "Key Up: %c", key);
-        Instance()->keys[key] = true;
-        Instance()->mouse = RVector2(x, y);
+        if(key >= 0 && key < 256)
+            Post(RINPUT_DOWN, R_INPUT_SPECIAL + key, x, y);
     }
     
     RVOID RInput::SpecialKeyUpFunc(RINT key, RINT x, RINT y){
-        fprintf(stdout, "Key Up: %c", key);
-        Instance()->keys[key] = false;
-        Instance()->mouse = RVector2(x, y);
+        if(key >= 0 && key < 256)
+            Post(RINPUT_UP, R_INPUT_SPECIAL + key, x, y);
     }
     
     RVOID RInput::MouseFunc(RINT button, RINT state, RINT x, RINT y){
-        
-        if(state == GLUT_UP)
-            Instance()->mbuttons[button] = false;
-        else
-            Instance()->mbuttons[button] = true;
+        if(button >= 0 && button < R_INPUT_JOYSTICK - R_INPUT_MOUSE)
+            Post(state == GLUT_UP ? RINPUT_UP : RINPUT_DOWN, R_INPUT_MOUSE + button, x, y);
+    }
+
+    RVOID RInput::MotionFunc(RINT x, RINT y){
+        Post(RINPUT_MOUSE_MOVE, 0, x, y);
+    }
+
+    RVOID RInput::BeginFrame(){
+        memset(snapshot.pressed, 0, sizeof(snapshot.pressed));
+        memset(snapshot.released, 0, sizeof(snapshot.released));
+        frameEvents.clear();
+    }
+
+    RVOID RInput::Apply(const RInputEvent& e){
+        frameEvents.push_back(e);
+        if(e.type == RINPUT_JOYSTICK_AXES){
+            snapshot.joystick = RVector3(e.x, e.y, (int16_t)e.code);
+            return;
+        }
+        // Key and joystick events carry x and y too, but only the mouse moves the pointer.
+        if(e.type == RINPUT_MOUSE_MOVE || (e.code >= R_INPUT_MOUSE && e.code < R_INPUT_JOYSTICK))
+            snapshot.mouse = RVector2(e.x, e.y);
+        if(e.code >= R_INPUT_CODES || e.type == RINPUT_MOUSE_MOVE)
+            return;
+        uint64_t bit = 1ull << (e.code & 63);
+        uint64_t& held = snapshot.held[e.code >> 6];
+        if(e.type == RINPUT_DOWN){
+            if(!(held & bit))
+                snapshot.pressed[e.code >> 6] |= bit;
+            held |= bit;
+        } else {
+            if(held & bit)
+                snapshot.released[e.code >> 6] |= bit;
+            held &= ~bit;
+        }
+    }
+
+    RVOID RInput::Update(){
+        BeginFrame();
+        RInputEvent e;
+        while(queue.Pop(e))
+            Apply(e);
+        snapshot.time = RTimer::Now();
+    }
+
+    RVOID RInput::Update(const RInputEvent* Events, RUINT Count){
+        BeginFrame();
+        RInputEvent e;
+        while(queue.Pop(e)){
+        }
+        for(RUINT i=0; i<Count; i++)
+            Apply(Events[i]);
+        snapshot.time = RTimer::Now();
     }
     
     RVOID RInput::Destroy(){
-        delete keys;
-        delete mbuttons;
-        delete jbuttons;
-        keys = NULL;
-        mbuttons = NULL;
-        jbuttons = NULL;
+        RInputEvent e;
+        while(queue.Pop(e)){
+        }
+        frameEvents.clear();
+        memset(snapshot.held, 0, sizeof(snapshot.held));
+        memset(snapshot.pressed, 0, sizeof(snapshot.pressed));
+        memset(snapshot.released, 0, sizeof(snapshot.released));
+        joyState = 0;
+    }
+
+    RBOOL RInput::IsDown(RINT code){
+        return __test(snapshot.held, code);
+    }
+
+    RBOOL RInput::WasPressed(RINT code){
+        return __test(snapshot.pressed, code);
+    }
+
+    RBOOL RInput::WasReleased(RINT code){
+        return __test(snapshot.released, code);
     }
     
     RBOOL RInput::IsKeyDown(RBYTE key){
-        bool ret = keys[key];
-        return ret;
+        return IsDown(key);
     }
     
     RBOOL RInput::IsKeyUp(RBYTE key){
-        bool ret = !(keys[key]);
-        return ret;
+        return !IsDown(key);
+    }
+
+    RBOOL RInput::IsKeyPressed(RBYTE key){
+        return WasPressed(key);
+    }
+
+    RBOOL RInput::IsKeyReleased(RBYTE key){
+        return WasReleased(key);
+    }
+
+    RBOOL RInput::IsSpecialKeyDown(RINT key){
+        return key >= 0 && key < 256 && IsDown(R_INPUT_SPECIAL + key);
     }
     
     RBOOL RInput::IsJoyButtonDown(RINT button){
-        if(button<32){
-            bool ret = jbuttons[button];
-            return ret;
-        } else {
-            return false;
-        }
+        return button >= 0 && button < 32 && IsDown(R_INPUT_JOYSTICK + button);
     }
     
     RVOID RInput::SetRepeat(RINT milliseconds){
+        if(!RPlatform::Instance()->HasGLUT())
+            return;
         glutSetKeyRepeat(milliseconds);
     }
     
     const RVector2& RInput::GetMouse(){
-        return mouse;
+        return snapshot.mouse;
     }
     
     RVOID RInput::GetMouse(RINT &x, RINT &y){
-        x = (int)mouse.x;
-        y = (int)mouse.y;
+        x = (int)snapshot.mouse.x;
+        y = (int)snapshot.mouse.y;
         return;
     }
     
     RVOID RInput::GetMouseButtonState(RBOOL &b1, RBOOL &b2, RBOOL &b3){
-        b1 = mbuttons[GLUT_LEFT_BUTTON];
-        b2 = mbuttons[GLUT_MIDDLE_BUTTON];
-        b3 = mbuttons[GLUT_RIGHT_BUTTON];
+        b1 = IsDown(R_INPUT_MOUSE + GLUT_LEFT_BUTTON);
+        b2 = IsDown(R_INPUT_MOUSE + GLUT_MIDDLE_BUTTON);
+        b3 = IsDown(R_INPUT_MOUSE + GLUT_RIGHT_BUTTON);
         return;
     }
     
     const RVector3& RInput::GetJoystick(){
-        return joystick;
+        return snapshot.joystick;
     }
     
-};
\ No newline at end of file
+};
@@ -0,0 +1,216 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include "../headers/RMemory.h"
+#include <mutex>
+
+namespace Reactor
+{
+    static std::atomic<uint64_t> __allocations(0);
+    static std::atomic<uint64_t> __allocatedBytes(0);
+
+    RBOOL RAllocationCounter::IsEnabled(){
+#ifdef R_COUNT_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    uint64_t RAllocationCounter::GetCount(){
+        return __allocations.load(std::memory_order_relaxed);
+    }
+
+    uint64_t RAllocationCounter::GetBytes(){
+        return __allocatedBytes.load(std::memory_order_relaxed);
+    }
+
+    RVOID RAllocationCounter::Record(size_t Bytes){
+        __allocations.fetch_add(1, std::memory_order_relaxed);
+        __allocatedBytes.fetch_add(Bytes, std::memory_order_relaxed);
+    }
+
+    // Heap block taken when a frame outgrows its thread's arena block; freed on rewind.
+    struct RArenaSpill
+    {
+        RArenaSpill* next;
+    };
+
+    struct RArenaThread
+    {
+        RArenaThread();
+        ~RArenaThread();
+
+        char* block;
+        size_t offset;
+        size_t need;                    // bytes this frame would have needed without spilling
+        RArenaSpill* spills;
+        RUINT frame;
+        RINT depth;                     // open RScratchScopes
+        std::atomic<size_t> capacity;   // read by GetStats from other threads
+        std::atomic<size_t> high;
+    };
+
+    static std::mutex __lock;
+    static std::vector<RArenaThread*> __threads;
+    static std::atomic<RUINT> __frame(0);
+    static std::atomic<size_t> __blockSize(R_FRAME_ARENA_BLOCK);
+    static std::atomic<RUINT> __overflows(0);
+    static size_t __lastUsed = 0;
+    static size_t __peak = 0;
+
+    RArenaThread::RArenaThread()
+    : block(NULL), offset(0), need(0), spills(NULL), frame(__frame.load()), depth(0), capacity(0), high(0){
+        std::unique_lock<std::mutex> guard(__lock);
+        __threads.push_back(this);
+    }
+
+    RArenaThread::~RArenaThread(){
+        {
+            std::unique_lock<std::mutex> guard(__lock);
+            __threads.erase(std::find(__threads.begin(), __threads.end(), this));
+        }
+        while(spills != NULL){
+            RArenaSpill* next = spills->next;
+            RMemoryTracker::Free(spills);
+            spills = next;
+        }
+        RMemoryTracker::Free(block);
+    }
+
+    static thread_local RArenaThread __local;
+
+    static RVOID __rewind(RArenaThread& t, RUINT frame){
+        while(t.spills != NULL){
+            RArenaSpill* next = t.spills->next;
+            RMemoryTracker::Free(t.spills);
+            t.spills = next;
+        }
+        if(t.need > t.capacity.load(std::memory_order_relaxed)){
+            // Regrow to last frame's high-water mark (rounded to 64 KB) so it fits next time.
+            size_t size = (t.need + 0xFFFF) & ~(size_t)0xFFFF;
+            RMemoryTracker::Free(t.block);
+            t.block = (char*)RMemoryTracker::Allocate(RMEM_GENERAL, size);
+            RAllocationCounter::Record(size);
+            t.capacity.store(t.block != NULL ? size : 0, std::memory_order_relaxed);
+        }
+        t.offset = 0;
+        t.need = 0;
+        t.frame = frame;
+    }
+
+    RVOID* RFrameArena::Allocate(size_t Bytes, size_t Alignment){
+        RArenaThread& t = __local;
+        RUINT frame = __frame.load(std::memory_order_relaxed);
+        if(t.frame != frame && t.depth == 0)
+            __rewind(t, frame);
+        if(t.block == NULL && t.capacity.load(std::memory_order_relaxed) == 0){
+            size_t size = __blockSize.load(std::memory_order_relaxed);
+            t.block = (char*)RMemoryTracker::Allocate(RMEM_GENERAL, size);
+            RAllocationCounter::Record(size);
+            t.capacity.store(t.block != NULL ? size : 0, std::memory_order_relaxed);
+        }
+
+        size_t start = (t.offset + Alignment - 1) & ~(Alignment - 1);
+        if(t.block != NULL && start + Bytes <= t.capacity.load(std::memory_order_relaxed)){
+            t.offset = start + Bytes;
+            t.need = __max(t.need, t.offset);
+            if(t.offset > t.high.load(std::memory_order_relaxed))
+                t.high.store(t.offset, std::memory_order_relaxed);
+            return t.block + start;
+        }
+
+        size_t size = sizeof(RArenaSpill) + Bytes + Alignment;
+        RArenaSpill* spill = (RArenaSpill*)RMemoryTracker::Allocate(RMEM_GENERAL, size);
+        if(spill == NULL)
+            return NULL;
+        RAllocationCounter::Record(size);
+        __overflows.fetch_add(1, std::memory_order_relaxed);
+        spill->next = t.spills;
+        t.spills = spill;
+        t.need = __max(t.need, t.capacity.load(std::memory_order_relaxed)) + Bytes + Alignment;
+        uintptr_t p = (uintptr_t)(spill + 1);
+        return (RVOID*)((p + Alignment - 1) & ~(uintptr_t)(Alignment - 1));
+    }
+
+    RVOID RFrameArena::EndFrame(){
+        std::unique_lock<std::mutex> guard(__lock);
+        size_t used = 0;
+        for(size_t i=0; i<__threads.size(); i++){
+            size_t high = __threads[i]->high.exchange(0, std::memory_order_relaxed);
+            used += high;
+            __peak = __max(__peak, high);
+        }
+        __lastUsed = used;
+        __frame.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    RVOID RFrameArena::SetBlockSize(size_t Bytes){
+        __blockSize.store(__max(Bytes, (size_t)4096), std::memory_order_relaxed);
+    }
+
+    RFrameArenaStats RFrameArena::GetStats(){
+        std::unique_lock<std::mutex> guard(__lock);
+        RFrameArenaStats stats;
+        stats.frame = __frame.load(std::memory_order_relaxed);
+        stats.threads = (RUINT)__threads.size();
+        stats.capacity = 0;
+        for(size_t i=0; i<__threads.size(); i++)
+            stats.capacity += __threads[i]->capacity.load(std::memory_order_relaxed);
+        stats.used = __lastUsed;
+        stats.peak = __peak;
+        stats.overflows = __overflows.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    RScratchScope::RScratchScope(){
+        RArenaThread& t = __local;
+        RUINT frame = __frame.load(std::memory_order_relaxed);
+        if(t.frame != frame && t.depth == 0)
+            __rewind(t, frame);
+        mark = t.offset;
+        t.depth++;
+    }
+
+    RScratchScope::~RScratchScope(){
+        RArenaThread& t = __local;
+        t.offset = mark;
+        t.depth--;
+    }
+};
+
+#ifdef R_COUNT_ALLOCATIONS
+void* operator new(size_t Bytes){
+    Reactor::RAllocationCounter::Record(Bytes);
+    void* p = malloc(Bytes ? Bytes : 1);
+    if(p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* Pointer) noexcept{
+    free(Pointer);
+}
+#endif
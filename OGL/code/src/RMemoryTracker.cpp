@@ -0,0 +1,211 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include "../headers/RMemoryTracker.h"
+#include <mutex>
+#include <sstream>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+namespace Reactor
+{
+    // Precedes every tracked block; 16 bytes so the block keeps malloc's alignment.
+    struct RMemoryHeader
+    {
+        uint32_t tag;
+        uint32_t magic;
+        uint64_t size;
+    };
+
+    #define R_MEMORY_MAGIC 0x4D454D52   // "RMEM"
+
+    struct RMemoryTagState
+    {
+        std::atomic<long long> live;
+        std::atomic<long long> peak;
+        std::atomic<unsigned long long> allocations;
+        std::atomic<unsigned long long> frees;
+        std::atomic<unsigned int> frameAllocations;
+        // Only touched by EndFrame and the setters, under __lock.
+        size_t budget;
+        unsigned int lastFrameAllocations;
+        unsigned int overBudgetFrames;
+        bool warned;
+        RMemoryEvictor evictor;
+    };
+
+    static RMemoryTagState __tags[RMEM_TAG_COUNT];
+    static std::mutex __lock;
+    static unsigned int __frame = 0;
+
+    static const char* __tagNames[RMEM_TAG_COUNT] = {
+        "general", "scene", "render", "textures", "meshes", "animation", "particles", "audio"
+    };
+
+    static void __charge(RMEMORY_TAG Tag, long long Bytes){
+        RMemoryTagState& t = __tags[Tag];
+        long long live = t.live.fetch_add(Bytes, std::memory_order_relaxed) + Bytes;
+        long long peak = t.peak.load(std::memory_order_relaxed);
+        while(live > peak && !t.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)){
+        }
+    }
+
+    void* RMemoryTracker::Allocate(RMEMORY_TAG Tag, size_t Bytes){
+        return Reallocate(Tag, NULL, Bytes);
+    }
+
+    void* RMemoryTracker::Reallocate(RMEMORY_TAG Tag, void* Pointer, size_t Bytes){
+        if(Tag < 0 || Tag >= RMEM_TAG_COUNT)
+            Tag = RMEM_GENERAL;
+        RMemoryHeader* header = NULL;
+        long long old = 0;
+        if(Pointer != NULL){
+            header = (RMemoryHeader*)Pointer - 1;
+            assert(header->magic == R_MEMORY_MAGIC);
+            old = (long long)header->size;
+            // A block keeps the tag it was first charged to.
+            Tag = (RMEMORY_TAG)header->tag;
+        }
+        header = (RMemoryHeader*)realloc(header, sizeof(RMemoryHeader) + Bytes);
+        if(header == NULL)
+            return NULL;
+        header->tag = (uint32_t)Tag;
+        header->magic = R_MEMORY_MAGIC;
+        header->size = Bytes;
+        RMemoryTagState& t = __tags[Tag];
+        t.allocations.fetch_add(1, std::memory_order_relaxed);
+        t.frameAllocations.fetch_add(1, std::memory_order_relaxed);
+        __charge(Tag, (long long)Bytes - old);
+        return header + 1;
+    }
+
+    void RMemoryTracker::Free(void* Pointer){
+        if(Pointer == NULL)
+            return;
+        RMemoryHeader* header = (RMemoryHeader*)Pointer - 1;
+        assert(header->magic == R_MEMORY_MAGIC);
+        RMemoryTagState& t = __tags[header->tag];
+        t.frees.fetch_add(1, std::memory_order_relaxed);
+        t.live.fetch_sub((long long)header->size, std::memory_order_relaxed);
+        header->magic = 0;
+        free(header);
+    }
+
+    void RMemoryTracker::Track(RMEMORY_TAG Tag, long long Bytes){
+        if(Tag < 0 || Tag >= RMEM_TAG_COUNT || Bytes == 0)
+            return;
+        if(Bytes > 0){
+            __tags[Tag].allocations.fetch_add(1, std::memory_order_relaxed);
+            __tags[Tag].frameAllocations.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            __tags[Tag].frees.fetch_add(1, std::memory_order_relaxed);
+        }
+        __charge(Tag, Bytes);
+    }
+
+    void RMemoryTracker::SetBudget(RMEMORY_TAG Tag, size_t Bytes){
+        std::unique_lock<std::mutex> guard(__lock);
+        __tags[Tag].budget = Bytes;
+        __tags[Tag].warned = false;
+    }
+
+    void RMemoryTracker::SetEvictor(RMEMORY_TAG Tag, const RMemoryEvictor& Evictor){
+        std::unique_lock<std::mutex> guard(__lock);
+        __tags[Tag].evictor = Evictor;
+    }
+
+    void RMemoryTracker::EndFrame(){
+        std::unique_lock<std::mutex> guard(__lock);
+        __frame++;
+        for(int i=0; i<RMEM_TAG_COUNT; i++){
+            RMemoryTagState& t = __tags[i];
+            t.lastFrameAllocations = t.frameAllocations.exchange(0, std::memory_order_relaxed);
+            if(t.budget == 0)
+                continue;
+            long long live = t.live.load(std::memory_order_relaxed);
+            if(live > (long long)t.budget && t.evictor){
+                // The evictor frees through this tracker; do not hold the lock meanwhile.
+                RMemoryEvictor evictor = t.evictor;
+                size_t excess = (size_t)(live - (long long)t.budget);
+                guard.unlock();
+                evictor((RMEMORY_TAG)i, excess);
+                guard.lock();
+                live = t.live.load(std::memory_order_relaxed);
+            }
+            if(live > (long long)t.budget){
+                t.overBudgetFrames++;
+                if(!t.warned){
+                    fprintf(stderr, "Reactor: %s memory over budget: %lld of %llu bytes\n",
+                            __tagNames[i], live, (unsigned long long)t.budget);
+                    t.warned = true;
+                }
+            } else {
+                t.warned = false;
+            }
+        }
+    }
+
+    RMemoryTagStats RMemoryTracker::GetStats(RMEMORY_TAG Tag){
+        RMemoryTagStats stats;
+        const RMemoryTagState& t = __tags[Tag];
+        std::unique_lock<std::mutex> guard(__lock);
+        long long live = t.live.load(std::memory_order_relaxed);
+        stats.live = live > 0 ? (size_t)live : 0;
+        stats.peak = (size_t)t.peak.load(std::memory_order_relaxed);
+        stats.budget = t.budget;
+        stats.allocations = t.allocations.load(std::memory_order_relaxed);
+        stats.frees = t.frees.load(std::memory_order_relaxed);
+        stats.frameAllocations = t.lastFrameAllocations;
+        stats.overBudgetFrames = t.overBudgetFrames;
+        return stats;
+    }
+
+    const char* RMemoryTracker::GetTagName(RMEMORY_TAG Tag){
+        return Tag >= 0 && Tag < RMEM_TAG_COUNT ? __tagNames[Tag] : "unknown";
+    }
+
+    std::string RMemoryTracker::ToJSON(){
+        std::ostringstream out;
+        size_t live = 0;
+        unsigned int frame;
+        {
+            std::unique_lock<std::mutex> guard(__lock);
+            frame = __frame;
+        }
+        out << "{\"frame\":" << frame << ",\"tags\":{";
+        for(int i=0; i<RMEM_TAG_COUNT; i++){
+            RMemoryTagStats s = GetStats((RMEMORY_TAG)i);
+            live += s.live;
+            out << (i ? "," : "") << "\"" << __tagNames[i] << "\":{"
+                << "\"live\":" << s.live << ",\"peak\":" << s.peak << ",\"budget\":" << s.budget
+                << ",\"allocations\":" << s.allocations << ",\"frees\":" << s.frees
+                << ",\"frameAllocations\":" << s.frameAllocations << ",\"overBudgetFrames\":" << s.overBudgetFrames << "}";
+        }
+        out << "},\"live\":" << live << "}";
+        return out.str();
+    }
+};
@@ -0,0 +1,308 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RMeshFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+// Not <unistd.h> or <fcntl.h>: both define R_OK for access() over the engine's.
+#endif
+
+namespace Reactor {
+
+    static uint64_t __fnv1a(const unsigned char* p, uint64_t length){
+        uint64_t hash = 14695981039346656037ull;
+        for(uint64_t i=0; i<length; i++){
+            hash ^= p[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint64_t __align(uint64_t offset){
+        return (offset + RMESH_ALIGNMENT - 1) & ~(uint64_t)(RMESH_ALIGNMENT - 1);
+    }
+
+    // Written so that neither side can wrap: offsets come straight from the file.
+    static RBOOL __inRange(uint64_t Offset, uint64_t Bytes, uint64_t Size){
+        return Offset <= Size && Bytes <= Size - Offset;
+    }
+
+    RUINT RMeshFile::ComponentSize(RUINT Component, RUINT Count){
+        switch(Component){
+            case RMESH_FLOAT32: return 4 * Count;
+            case RMESH_FLOAT16:
+            case RMESH_SNORM16:
+            case RMESH_UNORM16: return 2 * Count;
+            case RMESH_UNORM8:
+            case RMESH_UINT8: return Count;
+            case RMESH_SNORM10_10_10_2: return 4;
+        }
+        return 0;
+    }
+
+    RBOOL RMeshFile::ValidateLods(const RMeshLod* Lods, RUINT LodCount, RUINT IndexCount){
+        for(RUINT i=0; i<LodCount; i++){
+            const RMeshLod& lod = Lods[i];
+            if((uint64_t)lod.firstIndex + lod.indexCount > IndexCount || lod.indexCount % 3 != 0)
+                return false;
+            // !(x > 0) also rejects NaN.
+            if(!(lod.maxScreenSize > 0.0f) || (i > 0 && !(lod.maxScreenSize <= 1.0f && lod.maxScreenSize < Lods[i-1].maxScreenSize)))
+                return false;
+        }
+        return true;
+    }
+
+    RMeshFile::RMeshFile(){
+        base = NULL;
+        header = NULL;
+        size = 0;
+#ifdef _WIN32
+        file = NULL;
+        mapping = NULL;
+#endif
+    }
+
+    RMeshFile::~RMeshFile(){
+        Close();
+    }
+
+    RRESULT RMeshFile::Open(const std::string& Path){
+        Close();
+#ifdef _WIN32
+        HANDLE f = CreateFileA(Path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if(f == INVALID_HANDLE_VALUE)
+            return R_INVALIDARG;
+        LARGE_INTEGER length;
+        GetFileSizeEx(f, &length);
+        HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(m == NULL){
+            CloseHandle(f);
+            return R_OUTOFMEMORY;
+        }
+        base = (const unsigned char*)MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+        file = f;
+        mapping = m;
+        size = (uint64_t)length.QuadPart;
+#else
+        FILE* f = fopen(Path.c_str(), "rb");
+        if(f == NULL)
+            return R_INVALIDARG;
+        struct stat st;
+        if(fstat(fileno(f), &st) != 0 || st.st_size <= 0){
+            fclose(f);
+            return R_INVALIDARG;
+        }
+        size = (uint64_t)st.st_size;
+        void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+        // The mapping keeps the file alive; the stream isn't needed any more.
+        fclose(f);
+        if(p == MAP_FAILED){
+            size = 0;
+            return R_OUTOFMEMORY;
+        }
+        // The streams are read front to back exactly once by the upload. The advice
+        // values are not flags, so each takes its own call.
+        madvise(p, size, MADV_SEQUENTIAL);
+        madvise(p, size, MADV_WILLNEED);
+        base = (const unsigned char*)p;
+#endif
+        if(base == NULL){
+            Close();
+            return R_OUTOFMEMORY;
+        }
+
+        header = (const RMeshFileHeader*)base;
+        RBOOL valid = size >= sizeof(RMeshFileHeader) &&
+            header->magic == RMESH_MAGIC && header->version == RMESH_VERSION &&
+            (header->indexSize == 2 || header->indexSize == 4) && header->vertexStride != 0 &&
+            // Every count and stride is 32 bits, so the byte counts themselves fit in 64.
+            __inRange(header->attributeOffset, (uint64_t)header->attributeCount * sizeof(RMeshAttribute), size) &&
+            __inRange(header->lodOffset, (uint64_t)header->lodCount * sizeof(RMeshLod), size) &&
+            __inRange(header->vertexOffset, GetVertexBytes(), size) &&
+            __inRange(header->indexOffset, GetIndexBytes(), size) &&
+            ValidateLods(GetLods(), header->lodCount, header->indexCount);
+        if(!valid){
+            Close();
+            return R_INVALIDARG;
+        }
+        return R_OK;
+    }
+
+    RVOID RMeshFile::Close(){
+#ifdef _WIN32
+        if(base != NULL)
+            UnmapViewOfFile(base);
+        if(mapping != NULL)
+            CloseHandle((HANDLE)mapping);
+        if(file != NULL)
+            CloseHandle((HANDLE)file);
+        file = mapping = NULL;
+#else
+        if(base != NULL)
+            munmap((void*)base, size);
+#endif
+        base = NULL;
+        header = NULL;
+        size = 0;
+    }
+
+    RBOOL RMeshFile::Verify() const {
+        if(header == NULL)
+            return false;
+        return __fnv1a(base + sizeof(RMeshFileHeader), size - sizeof(RMeshFileHeader)) == header->contentHash;
+    }
+
+    const RMeshAttribute* RMeshFile::GetAttributes() const {
+        return (const RMeshAttribute*)(base + header->attributeOffset);
+    }
+
+    const RMeshLod* RMeshFile::GetLods() const {
+        return (const RMeshLod*)(base + header->lodOffset);
+    }
+
+    const void* RMeshFile::GetVertices() const {
+        return base + header->vertexOffset;
+    }
+
+    const void* RMeshFile::GetIndices() const {
+        return base + header->indexOffset;
+    }
+
+    uint64_t RMeshFile::GetVertexBytes() const {
+        return (uint64_t)header->vertexStride * header->vertexCount;
+    }
+
+    uint64_t RMeshFile::GetIndexBytes() const {
+        return (uint64_t)header->indexSize * header->indexCount;
+    }
+
+    RRESULT RMeshFile::Write(const std::string& Path, const RMeshBuildData& Mesh){
+        if(Mesh.vertexStride == 0 || Mesh.vertices.size() % Mesh.vertexStride != 0)
+            return R_INVALIDARG;
+        if(!Mesh.lods.empty() && !ValidateLods(&Mesh.lods[0], (RUINT)Mesh.lods.size(), (RUINT)Mesh.indices.size()))
+            return R_INVALIDARG;
+
+        RMeshFileHeader h;
+        memset(&h, 0, sizeof(RMeshFileHeader));
+        h.magic = RMESH_MAGIC;
+        h.version = RMESH_VERSION;
+        h.vertexStride = Mesh.vertexStride;
+        h.vertexCount = (uint32_t)(Mesh.vertices.size() / Mesh.vertexStride);
+        h.indexCount = (uint32_t)Mesh.indices.size();
+        h.indexSize = h.vertexCount > 0xFFFF ? 4 : 2;
+        h.attributeCount = (uint32_t)Mesh.attributes.size();
+
+        std::vector<RMeshLod> lods = Mesh.lods;
+        if(lods.empty()){
+            RMeshLod lod = { 0, h.indexCount, 1e30f, 0 };
+            lods.push_back(lod);
+        }
+        h.lodCount = (uint32_t)lods.size();
+
+        memcpy(h.boundsMin, Mesh.boundsMin, sizeof(h.boundsMin));
+        memcpy(h.boundsMax, Mesh.boundsMax, sizeof(h.boundsMax));
+        for(size_t a=0; a<Mesh.attributes.size(); a++){
+            const RMeshAttribute& attr = Mesh.attributes[a];
+            if(attr.semantic != 0 || attr.component != RMESH_FLOAT32 || attr.count < 3 || h.vertexCount == 0)
+                continue;
+            for(int k=0; k<3; k++){
+                h.boundsMin[k] = std::numeric_limits<float>::max();
+                h.boundsMax[k] = -std::numeric_limits<float>::max();
+            }
+            for(uint32_t v=0; v<h.vertexCount; v++){
+                float p[3];
+                memcpy(p, &Mesh.vertices[v * Mesh.vertexStride + attr.offset], sizeof(p));
+                for(int k=0; k<3; k++){
+                    h.boundsMin[k] = __min(h.boundsMin[k], p[k]);
+                    h.boundsMax[k] = __max(h.boundsMax[k], p[k]);
+                }
+            }
+        }
+        float radius2 = 0.0f;
+        for(int k=0; k<3; k++)
+            h.boundsCenter[k] = 0.5f * (h.boundsMin[k] + h.boundsMax[k]);
+        for(int k=0; k<3; k++){
+            float e = h.boundsMax[k] - h.boundsCenter[k];
+            radius2 += e * e;
+        }
+        h.boundsRadius = sqrt(radius2);
+
+        h.attributeOffset = __align(sizeof(RMeshFileHeader));
+        h.lodOffset = __align(h.attributeOffset + h.attributeCount * sizeof(RMeshAttribute));
+        h.vertexOffset = __align(h.lodOffset + h.lodCount * sizeof(RMeshLod));
+        h.indexOffset = __align(h.vertexOffset + Mesh.vertices.size());
+        uint64_t total = h.indexOffset + (uint64_t)h.indexCount * h.indexSize;
+
+        std::vector<unsigned char> file(total, 0);
+        if(h.attributeCount)
+            memcpy(&file[h.attributeOffset], &Mesh.attributes[0], h.attributeCount * sizeof(RMeshAttribute));
+        memcpy(&file[h.lodOffset], &lods[0], h.lodCount * sizeof(RMeshLod));
+        if(!Mesh.vertices.empty())
+            memcpy(&file[h.vertexOffset], &Mesh.vertices[0], Mesh.vertices.size());
+        for(uint32_t i=0; i<h.indexCount; i++){
+            if(h.indexSize == 2){
+                uint16_t index = (uint16_t)Mesh.indices[i];
+                memcpy(&file[h.indexOffset + i * 2], &index, 2);
+            } else {
+                memcpy(&file[h.indexOffset + i * 4], &Mesh.indices[i], 4);
+            }
+        }
+        h.contentHash = __fnv1a(&file[0] + sizeof(RMeshFileHeader), total - sizeof(RMeshFileHeader));
+        memcpy(&file[0], &h, sizeof(RMeshFileHeader));
+
+        FILE* f = fopen(Path.c_str(), "wb");
+        if(f == NULL)
+            return R_INVALIDARG;
+        size_t written = fwrite(&file[0], 1, file.size(), f);
+        fclose(f);
+        return written == file.size() ? R_OK : R_OUTOFMEMORY;
+    }
+
+    RRESULT RMeshFile::Read(const std::string& Path, RMeshBuildData& Mesh){
+        RMeshFile file;
+        RRESULT hr = file.Open(Path);
+        if(FAILED(hr))
+            return hr;
+        const RMeshFileHeader& h = file.GetHeader();
+        Mesh.vertexStride = h.vertexStride;
+        Mesh.attributes.assign(file.GetAttributes(), file.GetAttributes() + h.attributeCount);
+        Mesh.lods.assign(file.GetLods(), file.GetLods() + h.lodCount);
+        const unsigned char* v = (const unsigned char*)file.GetVertices();
+        Mesh.vertices.assign(v, v + file.GetVertexBytes());
+        Mesh.indices.resize(h.indexCount);
+        for(uint32_t i=0; i<h.indexCount; i++){
+            if(h.indexSize == 2)
+                Mesh.indices[i] = ((const uint16_t*)file.GetIndices())[i];
+            else
+                Mesh.indices[i] = ((const uint32_t*)file.GetIndices())[i];
+        }
+        memcpy(Mesh.boundsMin, h.boundsMin, sizeof(Mesh.boundsMin));
+        memcpy(Mesh.boundsMax, h.boundsMax, sizeof(Mesh.boundsMax));
+        return R_OK;
+    }
+};
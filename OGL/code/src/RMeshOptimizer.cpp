@@ -0,0 +1,358 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RMeshOptimizer.h"
+
+namespace Reactor {
+
+    RBOOL RMeshOptimizer::ValidateIndices(const std::vector<uint32_t>& Indices, RUINT VertexCount){
+        for(size_t i=0; i<Indices.size(); i++){
+            if(Indices[i] >= VertexCount)
+                return false;
+        }
+        return true;
+    }
+
+    RVertexCacheStats RMeshOptimizer::AnalyzeVertexCache(const std::vector<uint32_t>& Indices, RUINT VertexCount, RUINT CacheSize){
+        RVertexCacheStats stats = { 0.0f, 0.0f };
+        if(Indices.empty() || VertexCount == 0 || !ValidateIndices(Indices, VertexCount))
+            return stats;
+
+        // FIFO: a vertex is in the cache if it entered within the last CacheSize misses.
+        std::vector<RUINT> entered(VertexCount, 0);
+        RUINT misses = 0;
+        RUINT time = CacheSize + 1;
+        for(size_t i=0; i<Indices.size(); i++){
+            uint32_t v = Indices[i];
+            if(time - entered[v] > CacheSize){
+                entered[v] = time++;
+                ++misses;
+            }
+        }
+
+        RUINT used = 0;
+        std::vector<bool> referenced(VertexCount, false);
+        for(size_t i=0; i<Indices.size(); i++){
+            if(!referenced[Indices[i]]){
+                referenced[Indices[i]] = true;
+                ++used;
+            }
+        }
+        stats.acmr = (RFLOAT)misses / (RFLOAT)(Indices.size() / 3);
+        stats.atvr = (RFLOAT)misses / (RFLOAT)used;
+        return stats;
+    }
+
+    RVOID RMeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& Indices, RUINT VertexCount, std::vector<RUINT>& Clusters, RUINT CacheSize){
+        Clusters.clear();
+        RUINT triangleCount = (RUINT)(Indices.size() / 3);
+        if(triangleCount == 0 || !ValidateIndices(Indices, VertexCount))
+            return;
+
+        // Vertex -> triangle adjacency in CSR form.
+        std::vector<RUINT> live(VertexCount, 0);
+        for(size_t i=0; i<Indices.size(); i++)
+            ++live[Indices[i]];
+        std::vector<RUINT> offsets(VertexCount + 1, 0);
+        for(RUINT v=0; v<VertexCount; v++)
+            offsets[v + 1] = offsets[v] + live[v];
+        std::vector<RUINT> adjacency(Indices.size());
+        std::vector<RUINT> fill(offsets.begin(), offsets.end() - 1);
+        for(RUINT t=0; t<triangleCount; t++){
+            for(int k=0; k<3; k++)
+                adjacency[fill[Indices[t * 3 + k]]++] = t;
+        }
+
+        std::vector<RUINT> cacheTime(VertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> deadEnd;
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> output;
+        output.reserve(Indices.size());
+
+        RUINT time = CacheSize + 1;
+        RUINT cursor = 0;
+        RBOOL jumped = true;
+        int fanning = 0;
+        while(live[fanning] == 0 && ++fanning < (int)VertexCount){}
+
+        while(fanning >= 0 && fanning < (int)VertexCount){
+            if(jumped)
+                Clusters.push_back((RUINT)output.size());
+            candidates.clear();
+
+            for(RUINT a=offsets[fanning]; a<offsets[fanning + 1]; a++){
+                RUINT t = adjacency[a];
+                if(emitted[t])
+                    continue;
+                emitted[t] = true;
+                for(int k=0; k<3; k++){
+                    uint32_t v = Indices[t * 3 + k];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    if(time - cacheTime[v] > CacheSize)
+                        cacheTime[v] = time++;
+                }
+            }
+
+            // Prefer a candidate that will still be in the cache after its remaining
+            // triangles are emitted, and among those the one that entered the cache first.
+            int best = -1;
+            int bestPriority = -1;
+            for(size_t c=0; c<candidates.size(); c++){
+                uint32_t v = candidates[c];
+                if(live[v] == 0)
+                    continue;
+                int priority = 0;
+                if(time - cacheTime[v] + 2 * live[v] <= CacheSize)
+                    priority = time - cacheTime[v];
+                if(priority > bestPriority){
+                    bestPriority = priority;
+                    best = (int)v;
+                }
+            }
+
+            jumped = false;
+            if(best < 0){
+                jumped = true;
+                while(!deadEnd.empty()){
+                    uint32_t d = deadEnd.back();
+                    deadEnd.pop_back();
+                    if(live[d] > 0){
+                        best = (int)d;
+                        break;
+                    }
+                }
+                while(best < 0 && cursor < VertexCount){
+                    if(live[cursor] > 0)
+                        best = (int)cursor;
+                    ++cursor;
+                }
+            }
+            fanning = best;
+        }
+        Indices.swap(output);
+    }
+
+    RVOID RMeshOptimizer::OptimizeOverdraw(RMeshBuildData& Mesh, const std::vector<RUINT>& Clusters){
+        const RMeshAttribute* position = NULL;
+        for(size_t a=0; a<Mesh.attributes.size(); a++){
+            if(Mesh.attributes[a].semantic == 0 && Mesh.attributes[a].component == RMESH_FLOAT32)
+                position = &Mesh.attributes[a];
+        }
+        if(position == NULL || Clusters.size() < 2 || Mesh.vertexStride == 0 ||
+           !ValidateIndices(Mesh.indices, (RUINT)(Mesh.vertices.size() / Mesh.vertexStride)))
+            return;
+        RUINT triangleCount = (RUINT)(Mesh.indices.size() / 3);
+        for(size_t c=0; c<Clusters.size(); c++){
+            if(Clusters[c] % 3 != 0 || Clusters[c] > triangleCount * 3 || (c > 0 && Clusters[c] < Clusters[c - 1]))
+                return;
+        }
+
+        struct RCluster {
+            RUINT begin, end;
+            float sortKey;
+        };
+
+        std::vector<float> centroid(3, 0.0f);
+        std::vector<RCluster> clusters(Clusters.size());
+        std::vector<float> clusterCentroid(Clusters.size() * 3, 0.0f);
+        std::vector<float> clusterNormal(Clusters.size() * 3, 0.0f);
+        std::vector<float> clusterArea(Clusters.size(), 0.0f);
+        float totalArea = 0.0f;
+
+        for(size_t c=0; c<Clusters.size(); c++){
+            clusters[c].begin = Clusters[c];
+            clusters[c].end = (c + 1 < Clusters.size()) ? Clusters[c + 1] : triangleCount * 3;
+            for(RUINT i=clusters[c].begin; i<clusters[c].end; i+=3){
+                float p[3][3];
+                for(int k=0; k<3; k++)
+                    memcpy(p[k], &Mesh.vertices[Mesh.indices[i + k] * Mesh.vertexStride + position->offset], sizeof(p[k]));
+                float e1[3], e2[3], n[3];
+                for(int k=0; k<3; k++){
+                    e1[k] = p[1][k] - p[0][k];
+                    e2[k] = p[2][k] - p[0][k];
+                }
+                n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+                n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+                n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+                float area = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * 0.5f;
+                for(int k=0; k<3; k++){
+                    float tc = (p[0][k] + p[1][k] + p[2][k]) / 3.0f;
+                    clusterCentroid[c * 3 + k] += tc * area;
+                    centroid[k] += tc * area;
+                    clusterNormal[c * 3 + k] += n[k];
+                }
+                clusterArea[c] += area;
+                totalArea += area;
+            }
+        }
+        if(totalArea <= 0.0f)
+            return;
+        for(int k=0; k<3; k++)
+            centroid[k] /= totalArea;
+
+        // Clusters whose normal points away from the mesh centre are likely to occlude
+        // the rest from any outside viewpoint, so they are drawn first.
+        for(size_t c=0; c<clusters.size(); c++){
+            float key = 0.0f;
+            float length = 0.0f;
+            for(int k=0; k<3; k++)
+                length += clusterNormal[c * 3 + k] * clusterNormal[c * 3 + k];
+            length = sqrt(length);
+            if(clusterArea[c] > 0.0f && length > 0.0f){
+                for(int k=0; k<3; k++){
+                    float d = clusterCentroid[c * 3 + k] / clusterArea[c] - centroid[k];
+                    key += d * clusterNormal[c * 3 + k] / length;
+                }
+            }
+            clusters[c].sortKey = key;
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), [](const RCluster& a, const RCluster& b){
+            return a.sortKey > b.sortKey;
+        });
+
+        std::vector<uint32_t> output;
+        output.reserve(Mesh.indices.size());
+        for(size_t c=0; c<clusters.size(); c++)
+            output.insert(output.end(), Mesh.indices.begin() + clusters[c].begin, Mesh.indices.begin() + clusters[c].end);
+        Mesh.indices.swap(output);
+    }
+
+    RVOID RMeshOptimizer::OptimizeVertexFetch(RMeshBuildData& Mesh){
+        if(Mesh.vertexStride == 0)
+            return;
+        RUINT vertexCount = (RUINT)(Mesh.vertices.size() / Mesh.vertexStride);
+        if(!ValidateIndices(Mesh.indices, vertexCount))
+            return;
+        std::vector<uint32_t> remap(vertexCount, 0xFFFFFFFF);
+        std::vector<unsigned char> vertices;
+        vertices.reserve(Mesh.vertices.size());
+        uint32_t next = 0;
+        for(size_t i=0; i<Mesh.indices.size(); i++){
+            uint32_t v = Mesh.indices[i];
+            if(remap[v] == 0xFFFFFFFF){
+                remap[v] = next++;
+                vertices.insert(vertices.end(), Mesh.vertices.begin() + v * Mesh.vertexStride,
+                                Mesh.vertices.begin() + (v + 1) * Mesh.vertexStride);
+            }
+            Mesh.indices[i] = remap[v];
+        }
+        Mesh.vertices.swap(vertices);
+    }
+
+    static uint16_t __toHalf(float value){
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        uint32_t sign = (bits >> 16) & 0x8000;
+        int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+        uint32_t mantissa = bits & 0x7FFFFF;
+        if(exponent <= 0)
+            return (uint16_t)sign;                                  // flush denormals to zero
+        if(exponent >= 31)
+            return (uint16_t)(sign | 0x7C00);                       // overflow to infinity
+        uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+        if(mantissa & 0x1000)
+            ++half;                                                 // round to nearest
+        return (uint16_t)half;
+    }
+
+    static int16_t __toSnorm16(float value){
+        value = __max(-1.0f, __min(1.0f, value));
+        return (int16_t)floor(value * 32767.0f + 0.5f);
+    }
+
+    static uint32_t __toSnorm10(float value){
+        value = __max(-1.0f, __min(1.0f, value));
+        int packed = (int)floor(value * 511.0f + 0.5f);
+        return (uint32_t)packed & 0x3FF;
+    }
+
+    RVOID RMeshOptimizer::Quantize(RMeshBuildData& Mesh){
+        RUINT vertexCount = (RUINT)(Mesh.vertices.size() / Mesh.vertexStride);
+        std::vector<RMeshAttribute> attributes;
+        RUINT stride = 0;
+        for(size_t a=0; a<Mesh.attributes.size(); a++){
+            RMeshAttribute attr = Mesh.attributes[a];
+            RBOOL isFloat = attr.component == RMESH_FLOAT32;
+            if(isFloat && attr.semantic == 0 && attr.count == 3){
+                attr.component = RMESH_SNORM16;
+                attr.count = 4;                 // pad to 8 bytes so the stream stays 4-byte aligned
+            } else if(isFloat && (attr.semantic == 1 || attr.semantic == 4) && attr.count == 3){
+                attr.component = RMESH_SNORM10_10_10_2;
+                attr.count = 4;
+            } else if(isFloat && (attr.semantic == 2 || attr.semantic == 3) && attr.count <= 4){
+                attr.component = RMESH_FLOAT16;
+                attr.count = (attr.count + 1) & ~1u;
+            }
+            attr.offset = stride;
+            stride += RMeshFile::ComponentSize(attr.component, attr.count);
+            stride = (stride + 3) & ~3u;
+            attributes.push_back(attr);
+        }
+
+        float center[3], scale[3];
+        for(int k=0; k<3; k++){
+            center[k] = 0.5f * (Mesh.boundsMin[k] + Mesh.boundsMax[k]);
+            float half = 0.5f * (Mesh.boundsMax[k] - Mesh.boundsMin[k]);
+            scale[k] = half > 0.0f ? 1.0f / half : 0.0f;
+        }
+
+        std::vector<unsigned char> vertices(vertexCount * stride, 0);
+        for(RUINT v=0; v<vertexCount; v++){
+            const unsigned char* src = &Mesh.vertices[v * Mesh.vertexStride];
+            unsigned char* dst = &vertices[v * stride];
+            for(size_t a=0; a<attributes.size(); a++){
+                const RMeshAttribute& from = Mesh.attributes[a];
+                const RMeshAttribute& to = attributes[a];
+                if(from.component == to.component){
+                    memcpy(dst + to.offset, src + from.offset, RMeshFile::ComponentSize(from.component, from.count));
+                    continue;
+                }
+                // Only attributes of at most four floats are converted above.
+                float f[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                memcpy(f, src + from.offset, __min(from.count, 4u) * sizeof(float));
+                if(to.component == RMESH_SNORM16){
+                    int16_t q[4] = { 0, 0, 0, 32767 };
+                    for(int k=0; k<3; k++)
+                        q[k] = __toSnorm16((f[k] - center[k]) * scale[k]);
+                    memcpy(dst + to.offset, q, sizeof(q));
+                } else if(to.component == RMESH_SNORM10_10_10_2){
+                    uint32_t packed = __toSnorm10(f[0]) | (__toSnorm10(f[1]) << 10) | (__toSnorm10(f[2]) << 20);
+                    memcpy(dst + to.offset, &packed, 4);
+                } else if(to.component == RMESH_FLOAT16){
+                    for(RUINT k=0; k<to.count; k++){
+                        uint16_t h = __toHalf(f[k]);
+                        memcpy(dst + to.offset + k * 2, &h, 2);
+                    }
+                }
+            }
+        }
+        Mesh.attributes.swap(attributes);
+        Mesh.vertices.swap(vertices);
+        Mesh.vertexStride = stride;
+    }
+};
@@ -23,46 +23,50 @@
  */
 
 #include "../headers/RNode.h"
+#include "../headers/RScene.h"
 
 namespace Reactor{
 	
 	RNode::RNode(){
-		this->childNodes = new RArray<RNode>();
-	}
-	RNode::~RNode(){
-		delete this->childNodes;
+		this->childCount = 0;
 	}
 	
-	string RNode::GetName(){
+	string RNode::GetName() const{
 		return this->name;
 	}
 	
 	void RNode::SetName(const string& Name){
-		this->name = name;
+		this->name = Name;
 	}
 	
 	void RNode::SetParent(const RNode& ParentNode){
-		this->parent = &ParentNode;
+		RScene::Instance()->SetParent(this->self, ParentNode.self);
 	}
 	
 	const RNode& RNode::GetParent(){
-		return *this->parent;
+		const RNode* p = RScene::Instance()->GetNode(this->parent);
+		return p != NULL ? *p : *this;
 	}
 	
 	void RNode::AddChild(const RNode& ChildNode){
-		this->childNodes->Add(ChildNode);
+		RScene::Instance()->SetParent(ChildNode.self, this->self);
 	}
 	
-	const RNode& RNode::GetChild(RINT index){
-		return this->childNodes->GetAt(index);
+	const RNode* RNode::GetChild(RINT index){
+		if(index < 0 || index >= this->childCount)
+			return NULL;
+		RScene* scene = RScene::Instance();
+		RNode* child = scene->GetNode(this->firstChild);
+		for(int i=0; i<index && child != NULL; i++)
+			child = scene->GetNode(child->nextSibling);
+		return child;
 	}
 	
 	const RNode* RNode::GetChild(const string& name){
-		
-		for(int i=0; i<this->childNodes->GetSize(); i++){
-			RNode& t = this->childNodes->GetAt(i);
-			if(t.GetName() == name){
-				return &t;
+		RScene* scene = RScene::Instance();
+		for(RNode* child = scene->GetNode(this->firstChild); child != NULL; child = scene->GetNode(child->nextSibling)){
+			if(child->name == name){
+				return child;
 			}
 		}
 		return NULL;
@@ -74,4 +78,8 @@ namespace Reactor{
 		}
 		return false;
 	}
-}
\ No newline at end of file
+
+	RBOOL RNode::operator != (const RNode& n){
+		return !(*this == n);
+	}
+}
@@ -0,0 +1,306 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RParticleSystem.h"
+#include "../headers/RThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define R_PARTICLE_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace Reactor {
+
+    // Particles per worker chunk; a multiple of 4 so every chunk but the last is SIMD-only.
+    static const RINT R_PARTICLE_GRAIN = 8192;
+
+#ifdef R_PARTICLE_SSE
+    // Set bits in a 4-lane movemask.
+    static const int __laneCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+#endif
+
+    RParticleSettings::RParticleSettings(){
+        textureId = 0;
+        maxParticles = 100;
+        duration = 1.0f;
+        durationRandomness = 0.0f;
+        emitterVelocitySensitivity = 1.0f;
+        minHorizontalVelocity = maxHorizontalVelocity = 0.0f;
+        minVerticalVelocity = maxVerticalVelocity = 0.0f;
+        gravity = RVector3(0.0f, 0.0f, 0.0f);
+        drag = 0.0f;
+        endVelocity = 1.0f;
+        minColor = maxColor = RVector4(1.0f, 1.0f, 1.0f, 1.0f);
+        minRotateSpeed = maxRotateSpeed = 0.0f;
+        minStartSize = maxStartSize = 100.0f;
+        minEndSize = maxEndSize = 100.0f;
+    }
+
+    RFLOAT RParticleSink::Random(){
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return (RFLOAT)(seed >> 8) * (1.0f / 16777216.0f);
+    }
+
+    RVector3 RParticleSink::EmissionVelocity(const RParticleSettings& Settings, const RVector3& EmitterVelocity){
+        RVector3 velocity(EmitterVelocity.x * Settings.emitterVelocitySensitivity,
+                          EmitterVelocity.y * Settings.emitterVelocitySensitivity,
+                          EmitterVelocity.z * Settings.emitterVelocitySensitivity);
+        RFLOAT horizontal = Settings.minHorizontalVelocity + (Settings.maxHorizontalVelocity - Settings.minHorizontalVelocity) * Random();
+        RFLOAT angle = Random() * 6.28318531f;
+        velocity.x += horizontal * cosf(angle);
+        velocity.z += horizontal * sinf(angle);
+        velocity.y += Settings.minVerticalVelocity + (Settings.maxVerticalVelocity - Settings.minVerticalVelocity) * Random();
+        return velocity;
+    }
+
+    RParticleSystem::RParticleSystem(const RParticleSettings& Settings) : settings(Settings), count(0){
+        capacity = (RUINT)__max(4, (Settings.maxParticles + 3) & ~3);
+        size_t streamBytes = capacity * sizeof(RFLOAT);
+        block = RMemoryTracker::Allocate(RMEM_PARTICLES, streamBytes * RPS_COUNT + 15);
+        RBYTE* base = (RBYTE*)(((uintptr_t)block + 15) & ~(uintptr_t)15);
+        for(int s=0; s<RPS_COUNT; s++)
+            streams[s] = (RFLOAT*)(base + streamBytes * s);
+        dead = 0;
+        sorter.Reserve(capacity);
+    }
+
+    RParticleSystem::~RParticleSystem(){
+        RMemoryTracker::Free(block);
+    }
+
+    RBOOL RParticleSystem::AddParticle(const RVector3& Position, const RVector3& Velocity){
+        if(count >= capacity)
+            return false;
+
+        RVector3 velocity = EmissionVelocity(settings, Velocity);
+        RUINT i = count++;
+        RFLOAT r = Random();
+        streams[RPS_POSITION_X][i] = Position.x;
+        streams[RPS_POSITION_Y][i] = Position.y;
+        streams[RPS_POSITION_Z][i] = Position.z;
+        streams[RPS_VELOCITY_X][i] = velocity.x;
+        streams[RPS_VELOCITY_Y][i] = velocity.y;
+        streams[RPS_VELOCITY_Z][i] = velocity.z;
+        streams[RPS_AGE][i] = 0.0f;
+        streams[RPS_INV_LIFETIME][i] = (1.0f + Random() * settings.durationRandomness) / __max(settings.duration, 0.0001f);
+        streams[RPS_START_SIZE][i] = settings.minStartSize + (settings.maxStartSize - settings.minStartSize) * r;
+        streams[RPS_END_SIZE][i] = settings.minEndSize + (settings.maxEndSize - settings.minEndSize) * r;
+        streams[RPS_SIZE][i] = streams[RPS_START_SIZE][i];
+        streams[RPS_ROTATION][i] = 0.0f;
+        streams[RPS_ROTATE_SPEED][i] = settings.minRotateSpeed + (settings.maxRotateSpeed - settings.minRotateSpeed) * Random();
+        r = Random();
+        streams[RPS_COLOR_R][i] = settings.minColor.x + (settings.maxColor.x - settings.minColor.x) * r;
+        streams[RPS_COLOR_G][i] = settings.minColor.y + (settings.maxColor.y - settings.minColor.y) * r;
+        streams[RPS_COLOR_B][i] = settings.minColor.z + (settings.maxColor.z - settings.minColor.z) * r;
+        streams[RPS_COLOR_A][i] = settings.minColor.w + (settings.maxColor.w - settings.minColor.w) * r;
+        streams[RPS_ALPHA][i] = 0.0f;
+        return true;
+    }
+
+    RVOID RParticleSystem::Simulate(RINT Begin, RINT End, RFLOAT Dt, RFLOAT DragFactor){
+        RFLOAT* px = streams[RPS_POSITION_X];
+        RFLOAT* py = streams[RPS_POSITION_Y];
+        RFLOAT* pz = streams[RPS_POSITION_Z];
+        RFLOAT* vx = streams[RPS_VELOCITY_X];
+        RFLOAT* vy = streams[RPS_VELOCITY_Y];
+        RFLOAT* vz = streams[RPS_VELOCITY_Z];
+        RFLOAT* age = streams[RPS_AGE];
+        const RFLOAT* invLife = streams[RPS_INV_LIFETIME];
+        const RFLOAT* startSize = streams[RPS_START_SIZE];
+        const RFLOAT* endSize = streams[RPS_END_SIZE];
+        RFLOAT* size = streams[RPS_SIZE];
+        RFLOAT* rotation = streams[RPS_ROTATION];
+        const RFLOAT* rotateSpeed = streams[RPS_ROTATE_SPEED];
+        const RFLOAT* baseAlpha = streams[RPS_COLOR_A];
+        RFLOAT* alpha = streams[RPS_ALPHA];
+
+        const RFLOAT gx = settings.gravity.x * Dt, gy = settings.gravity.y * Dt, gz = settings.gravity.z * Dt;
+        const RFLOAT endScale = settings.endVelocity - 1.0f;
+        int expired = 0;
+        RINT i = Begin;
+
+#ifdef R_PARTICLE_SSE
+        const __m128 dt4 = _mm_set1_ps(Dt);
+        const __m128 drag4 = _mm_set1_ps(DragFactor);
+        const __m128 gx4 = _mm_set1_ps(gx), gy4 = _mm_set1_ps(gy), gz4 = _mm_set1_ps(gz);
+        const __m128 endScale4 = _mm_set1_ps(endScale);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 fade = _mm_set1_ps(6.7f);
+        // Chunks start at multiples of R_PARTICLE_GRAIN, so i stays 16-byte aligned.
+        for(; i + 4 <= End; i += 4){
+            __m128 a = _mm_add_ps(_mm_load_ps(age + i), dt4);
+            _mm_store_ps(age + i, a);
+            __m128 t = _mm_mul_ps(a, _mm_load_ps(invLife + i));
+            expired += __laneCount[_mm_movemask_ps(_mm_cmpge_ps(t, one))];
+            t = _mm_min_ps(t, one);
+
+            // Speed follows the XNA curve S * (1 + (endVelocity - 1) * t).
+            __m128 step = _mm_mul_ps(_mm_add_ps(one, _mm_mul_ps(endScale4, t)), dt4);
+            __m128 x = _mm_mul_ps(_mm_add_ps(_mm_load_ps(vx + i), gx4), drag4);
+            __m128 y = _mm_mul_ps(_mm_add_ps(_mm_load_ps(vy + i), gy4), drag4);
+            __m128 z = _mm_mul_ps(_mm_add_ps(_mm_load_ps(vz + i), gz4), drag4);
+            _mm_store_ps(vx + i, x);
+            _mm_store_ps(vy + i, y);
+            _mm_store_ps(vz + i, z);
+            _mm_store_ps(px + i, _mm_add_ps(_mm_load_ps(px + i), _mm_mul_ps(x, step)));
+            _mm_store_ps(py + i, _mm_add_ps(_mm_load_ps(py + i), _mm_mul_ps(y, step)));
+            _mm_store_ps(pz + i, _mm_add_ps(_mm_load_ps(pz + i), _mm_mul_ps(z, step)));
+
+            __m128 s0 = _mm_load_ps(startSize + i);
+            _mm_store_ps(size + i, _mm_add_ps(s0, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(endSize + i), s0), t)));
+            _mm_store_ps(rotation + i, _mm_add_ps(_mm_load_ps(rotation + i), _mm_mul_ps(_mm_load_ps(rotateSpeed + i), dt4)));
+
+            // Fade in quickly and out slowly: t * (1 - t)^2, normalized to peak at 1.
+            __m128 rest = _mm_sub_ps(one, t);
+            __m128 curve = _mm_mul_ps(_mm_mul_ps(t, _mm_mul_ps(rest, rest)), fade);
+            _mm_store_ps(alpha + i, _mm_mul_ps(_mm_load_ps(baseAlpha + i), curve));
+        }
+#endif
+        for(; i < End; i++){
+            age[i] += Dt;
+            RFLOAT t = age[i] * invLife[i];
+            if(t >= 1.0f){
+                ++expired;
+                t = 1.0f;
+            }
+            RFLOAT step = (1.0f + endScale * t) * Dt;
+            vx[i] = (vx[i] + gx) * DragFactor;
+            vy[i] = (vy[i] + gy) * DragFactor;
+            vz[i] = (vz[i] + gz) * DragFactor;
+            px[i] += vx[i] * step;
+            py[i] += vy[i] * step;
+            pz[i] += vz[i] * step;
+            size[i] = startSize[i] + (endSize[i] - startSize[i]) * t;
+            rotation[i] += rotateSpeed[i] * Dt;
+            alpha[i] = baseAlpha[i] * t * (1.0f - t) * (1.0f - t) * 6.7f;
+        }
+        if(expired)
+            dead.fetch_add(expired);
+    }
+
+    RVOID RParticleSystem::Compact(){
+        const RFLOAT* age = streams[RPS_AGE];
+        const RFLOAT* invLife = streams[RPS_INV_LIFETIME];
+        RUINT i = 0;
+        while(i < count){
+            if(age[i] * invLife[i] < 1.0f){
+                ++i;
+                continue;
+            }
+            --count;
+            if(i != count){
+                for(int s=0; s<RPS_COUNT; s++)
+                    streams[s][i] = streams[s][count];
+            }
+        }
+    }
+
+    RVOID RParticleSystem::Update(RFLOAT ElapsedSeconds){
+        if(count == 0 || ElapsedSeconds <= 0.0f)
+            return;
+        RFLOAT dragFactor = settings.drag > 0.0f ? expf(-settings.drag * ElapsedSeconds) : 1.0f;
+        dead = 0;
+        sorter.Reserve(capacity);
+        RThreadPool::Instance()->ParallelFor((RINT)count, R_PARTICLE_GRAIN, [this, ElapsedSeconds, dragFactor](RINT begin, RINT end){
+            Simulate(begin, end, ElapsedSeconds, dragFactor);
+        });
+        if(dead.load() > 0)
+            Compact();
+    }
+
+    RVOID RParticleSystem::Clear(){
+        count = 0;
+    }
+
+    const RUINT* RParticleSystem::SortBackToFront(const RVector3& Eye, const RVector3& ViewDir){
+        return sorter.SortBackToFront(streams[RPS_POSITION_X], streams[RPS_POSITION_Y], streams[RPS_POSITION_Z], count, Eye, ViewDir);
+    }
+
+    RUINT RParticleSystem::WriteVertices(RParticleVertex* Out, const RUINT* Order) const{
+        RThreadPool::Instance()->ParallelFor((RINT)count, R_PARTICLE_GRAIN, [this, Out, Order](RINT index, RINT end){
+            for(; index<end; index++){
+                RUINT i = Order ? Order[index] : (RUINT)index;
+                RParticleVertex& v = Out[index];
+                v.x = streams[RPS_POSITION_X][i];
+                v.y = streams[RPS_POSITION_Y][i];
+                v.z = streams[RPS_POSITION_Z][i];
+                v.size = streams[RPS_SIZE][i];
+                v.r = streams[RPS_COLOR_R][i];
+                v.g = streams[RPS_COLOR_G][i];
+                v.b = streams[RPS_COLOR_B][i];
+                v.a = streams[RPS_ALPHA][i];
+                v.rotation = streams[RPS_ROTATION][i];
+            }
+        });
+        return count;
+    }
+
+    RVector3 RParticleSystem::GetPosition(RUINT Index) const{
+        return RVector3(streams[RPS_POSITION_X][Index], streams[RPS_POSITION_Y][Index], streams[RPS_POSITION_Z][Index]);
+    }
+
+    RVector3 RParticleSystem::GetVelocity(RUINT Index) const{
+        return RVector3(streams[RPS_VELOCITY_X][Index], streams[RPS_VELOCITY_Y][Index], streams[RPS_VELOCITY_Z][Index]);
+    }
+
+    RVector4 RParticleSystem::GetColor(RUINT Index) const{
+        return RVector4(streams[RPS_COLOR_R][Index], streams[RPS_COLOR_G][Index], streams[RPS_COLOR_B][Index], streams[RPS_ALPHA][Index]);
+    }
+
+    RFLOAT RParticleSystem::GetSize(RUINT Index) const{
+        return streams[RPS_SIZE][Index];
+    }
+
+    RParticleEmitter::RParticleEmitter(RParticleSink* System, RFLOAT ParticlesPerSecond, const RVector3& InitialPosition)
+        : system(System), timeBetweenParticles(1.0f / ParticlesPerSecond), timeLeftOver(0.0f), previousPosition(InitialPosition), budget(0x7FFFFFFF){
+    }
+
+    RVOID RParticleEmitter::Update(RFLOAT ElapsedSeconds, const RVector3& NewPosition){
+        if(ElapsedSeconds > 0.0f){
+            RFLOAT inv = 1.0f / ElapsedSeconds;
+            RVector3 velocity((NewPosition.x - previousPosition.x) * inv,
+                              (NewPosition.y - previousPosition.y) * inv,
+                              (NewPosition.z - previousPosition.z) * inv);
+            RFLOAT timeToSpend = timeLeftOver + ElapsedSeconds;
+            RFLOAT currentTime = -timeLeftOver;
+            RINT spawned = 0;
+
+            // Spread the particles evenly along the path travelled this frame.
+            while(timeToSpend > timeBetweenParticles && spawned < budget){
+                currentTime += timeBetweenParticles;
+                timeToSpend -= timeBetweenParticles;
+                RFLOAT mu = currentTime * inv;
+                RVector3 position(previousPosition.x + (NewPosition.x - previousPosition.x) * mu,
+                                  previousPosition.y + (NewPosition.y - previousPosition.y) * mu,
+                                  previousPosition.z + (NewPosition.z - previousPosition.z) * mu);
+                system->AddParticle(position, velocity);
+                ++spawned;
+            }
+            timeLeftOver = __min(timeToSpend, timeBetweenParticles);
+        }
+        previousPosition = NewPosition;
+    }
+};
@@ -0,0 +1,413 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include "../headers/RPlatform.h"
+#include "../headers/RTimer.h"
+#include <thread>
+
+#if defined(__APPLE__)
+#include <OpenGL/OpenGL.h>
+#include <objc/runtime.h>
+#include <objc/message.h>
+#elif defined(FREEGLUT) && !defined(GLUT_ACTION_ON_WINDOW_CLOSE) && !defined(_WIN32)
+// freeglut's glut.h leaves out the extensions the event pump needs.
+extern "C" {
+	void glutMainLoopEvent(void);
+	void glutCloseFunc(void (*callback)(void));
+	void glutSetOption(GLenum what, int value);
+}
+#define GLUT_ACTION_ON_WINDOW_CLOSE		0x01F9
+#define GLUT_ACTION_CONTINUE_EXECUTION	2
+#endif
+
+// freeglut (glutMainLoopEvent) and Apple GLUT (glutCheckLoop) can pump events and return.
+// Any other GLUT only has glutMainLoop, so the frame loop runs from its idle callback.
+#if defined(__APPLE__) || defined(GLUT_ACTION_ON_WINDOW_CLOSE)
+#define R_GLUT_EVENT_PUMP 1
+#endif
+
+#if defined(__linux__)
+// Declared by hand instead of pulling in <GL/glx.h>: Xlib's macros
+// (DestroyAll among them) collide with engine method names.
+extern "C" {
+	void (*glXGetProcAddressARB(const GLubyte* procName))(void);
+	void* glXGetCurrentDisplay(void);
+	unsigned long glXGetCurrentDrawable(void);
+}
+#endif
+
+namespace Reactor
+{
+	#define R_GLUT_WAIT_SLICE	4.0f	// ms between event pumps while waiting
+
+	class RGLUTBackend : public RPlatformBackend
+	{
+	public:
+		RGLUTBackend() : window(0) {}
+
+		RRESULT Init(int* argc, char** argv)
+		{
+			glutInit(argc, argv);
+			glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+#if defined(GLUT_ACTION_ON_WINDOW_CLOSE)
+			// Closing the window must come back to our loop instead of calling exit().
+			glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_CONTINUE_EXECUTION);
+#endif
+			closed = false;
+			visible = true;
+			return R_OK;
+		}
+
+		RRESULT OpenWindow(const char* Title, const RECT& Rect, RBOOL Fullscreen)
+		{
+			glutInitWindowSize(Rect.right - Rect.left, Rect.bottom - Rect.top);
+			glutInitWindowPosition(Rect.left, Rect.top);
+			window = glutCreateWindow(Title);
+			if(window <= 0)
+				return R_INVALIDARG;
+			if(Fullscreen)
+				glutFullScreen();
+			closed = false;
+			visible = true;
+			glutDisplayFunc(OnDisplay);
+			glutReshapeFunc(OnReshape);
+			glutVisibilityFunc(OnVisibility);
+#if defined(__APPLE__)
+			glutWMCloseFunc(OnClose);
+#elif defined(R_GLUT_EVENT_PUMP)
+			glutCloseFunc(OnClose);
+#endif
+			return R_OK;
+		}
+
+		RVOID CloseWindow()
+		{
+			if(window > 0 && !closed)
+				glutDestroyWindow(window);
+			window = 0;
+		}
+
+		RBOOL PumpEvents()
+		{
+#if defined(R_GLUT_EVENT_PUMP)
+			if(window > 0 && !closed){
+#if defined(__APPLE__)
+				glutCheckLoop();
+#else
+				glutMainLoopEvent();
+#endif
+			}
+#endif
+			return !closed;
+		}
+
+		RBOOL RunLoop(RVOID (*Frame)())
+		{
+#if defined(R_GLUT_EVENT_PUMP)
+			return false;
+#else
+			// Events are delivered by glutMainLoop between idle calls; it never returns, and
+			// closing the window ends the process.
+			frame = Frame;
+			glutIdleFunc(OnIdle);
+			glutMainLoop();
+			return true;
+#endif
+		}
+
+		RVOID SwapBuffers()
+		{
+			if(window > 0 && !closed)
+				glutSwapBuffers();
+		}
+
+		RBOOL SetSwapInterval(RINT Interval)
+		{
+#if defined(__APPLE__)
+			// CGL has no late-swap-tearing control, so adaptive falls back to plain vsync.
+			GLint cglValue = __max(Interval, -Interval);
+			return CGLSetParameter(CGLGetCurrentContext(), kCGLCPSwapInterval, &cglValue) == kCGLNoError;
+#elif defined(_WIN32)
+			typedef BOOL (WINAPI *PFNSWAPINTERVAL)(int);
+			PFNSWAPINTERVAL wglSwapInterval = (PFNSWAPINTERVAL)wglGetProcAddress("wglSwapIntervalEXT");
+			return wglSwapInterval != NULL && wglSwapInterval(Interval);
+#elif defined(__linux__)
+			typedef void (*PFNSWAPINTERVAL)(void*, unsigned long, int);
+			PFNSWAPINTERVAL glXSwapInterval = (PFNSWAPINTERVAL)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalEXT");
+			if(glXSwapInterval == NULL)
+				return false;
+			glXSwapInterval(glXGetCurrentDisplay(), glXGetCurrentDrawable(), Interval);
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		RECT GetScreenSize()
+		{
+			return RECT(0, 0, glutGet(GLUT_SCREEN_WIDTH), glutGet(GLUT_SCREEN_HEIGHT));
+		}
+
+		RBOOL IsWindowVisible() { return visible; }
+		RBOOL IsWindowFocused()
+		{
+#if defined(_WIN32)
+			// GLUT has no focus events, but Windows can say whether our window is in front.
+			// A thread without the context (the simulation thread) cannot tell; it assumes so.
+			HDC dc = wglGetCurrentDC();
+			return dc == NULL || WindowFromDC(dc) == GetForegroundWindow();
+#elif defined(__APPLE__)
+			// Apple GLUT runs on NSApplication, which knows whether we are the active app.
+			// Asked through the Objective-C runtime so this file stays plain C++.
+			id app = ((id (*)(Class, SEL))objc_msgSend)(objc_getClass("NSApplication"), sel_registerName("sharedApplication"));
+			return app == NULL || ((BOOL (*)(id, SEL))objc_msgSend)(app, sel_registerName("isActive"));
+#else
+			// GLUT has no focus events; the pointer leaving the window is not a loss of focus.
+			return true;
+#endif
+		}
+		RBOOL HasContext() { return window > 0 && !closed; }
+		RFLOAT GetWaitSlice() { return R_GLUT_WAIT_SLICE; }
+
+		RVOID Shutdown()
+		{
+			CloseWindow();
+		}
+
+	private:
+		static RVOID OnDisplay()
+		{
+			// Frames are driven by RGame's loop; an expose only asks for one.
+			RPlatform::Instance()->NotifyEvent();
+		}
+
+		static RVOID OnReshape(int width, int height)
+		{
+			void (*handler)(int, int) = RPlatform::Instance()->GetResizeHandler();
+			if(handler != NULL)
+				handler(width, height);
+			RPlatform::Instance()->NotifyEvent();
+		}
+
+		static RVOID OnVisibility(int state)
+		{
+			visible = (state == GLUT_VISIBLE);
+			RPlatform::Instance()->NotifyEvent();
+		}
+
+		static RVOID OnClose()
+		{
+			closed = true;
+		}
+
+		static RVOID OnIdle()
+		{
+			frame();
+		}
+
+		int window;
+		static bool closed;
+		static bool visible;
+		static RVOID (*frame)();
+	};
+
+	bool RGLUTBackend::closed = false;
+	bool RGLUTBackend::visible = true;
+	RVOID (*RGLUTBackend::frame)() = NULL;
+
+	class RHeadlessBackend : public RPlatformBackend
+	{
+	public:
+		RRESULT Init(int* argc, char** argv) { return R_OK; }
+		RRESULT OpenWindow(const char* Title, const RECT& Rect, RBOOL Fullscreen)
+		{
+			size = Rect;
+			return R_OK;
+		}
+		RVOID CloseWindow() {}
+		RBOOL PumpEvents() { return true; }
+		RVOID SwapBuffers() {}
+		RBOOL SetSwapInterval(RINT Interval) { return false; }
+		RECT GetScreenSize() { return size; }
+		RBOOL IsWindowVisible() { return true; }
+		RBOOL IsWindowFocused() { return true; }
+		RBOOL HasContext() { return false; }
+		RFLOAT GetWaitSlice() { return 0.0f; }
+		RVOID Shutdown() {}
+
+	private:
+		RECT size;
+	};
+
+	RPlatform::RPlatform()
+	{
+		backend = NULL;
+		type = RPLATFORM_HEADLESS;
+		swapInterval = 1;
+		resizeHandler = NULL;
+		quit = false;
+		events = 0;
+	}
+
+	RPlatform::~RPlatform()
+	{
+		Shutdown();
+	}
+
+	RRESULT RPlatform::Init(RPLATFORM_BACKEND Backend, int* argc, char** argv)
+	{
+		RRESULT result;
+		if(Backend == RPLATFORM_GLUT)
+			result = Init(new RGLUTBackend(), argc, argv);
+		else if(Backend == RPLATFORM_HEADLESS)
+			result = Init(new RHeadlessBackend(), argc, argv);
+		else
+			return R_INVALIDARG;
+		if(!FAILED(result))
+			type = Backend;
+		return result;
+	}
+
+	RRESULT RPlatform::Init(RPlatformBackend* Backend, int* argc, char** argv)
+	{
+		if(Backend == NULL)
+			return R_INVALIDARG;
+		Shutdown();
+		RRESULT result = Backend->Init(argc, argv);
+		if(FAILED(result)){
+			delete Backend;
+			return result;
+		}
+		backend = Backend;
+		type = RPLATFORM_CUSTOM;
+		quit = false;
+		return R_OK;
+	}
+
+	RRESULT RPlatform::OpenWindow(const char* Title, const RECT& Rect, RBOOL Fullscreen)
+	{
+		if(backend == NULL)
+			return R_INVALIDARG;
+		return backend->OpenWindow(Title, Rect, Fullscreen);
+	}
+
+	RVOID RPlatform::CloseWindow()
+	{
+		if(backend != NULL)
+			backend->CloseWindow();
+	}
+
+	RBOOL RPlatform::PumpEvents()
+	{
+		if(backend == NULL)
+			return false;
+		if(!backend->PumpEvents())
+			quit = true;
+		return !quit;
+	}
+
+	RBOOL RPlatform::RunLoop(RVOID (*Frame)())
+	{
+		return backend != NULL && backend->RunLoop(Frame);
+	}
+
+	RVOID RPlatform::WaitEvents(double Milliseconds, RBOOL ReturnOnEvent)
+	{
+		double deadline = GetTime() + Milliseconds;
+		while(PumpEvents()){
+			if(ReturnOnEvent && events != 0)
+				return;
+			double left = deadline - GetTime();
+			if(left <= 0.0)
+				return;
+			RFLOAT slice = backend->GetWaitSlice();
+			if(slice > 0.0f)
+				left = __min(left, (double)slice);
+			std::unique_lock<std::mutex> guard(lock);
+			if(!quit && !(ReturnOnEvent && events != 0))
+				quitSignal.wait_for(guard, std::chrono::microseconds((long long)(left * 1000.0)));
+		}
+	}
+
+	RVOID RPlatform::NotifyEvent()
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		events++;
+		quitSignal.notify_all();
+	}
+
+	RVOID RPlatform::SwapBuffers()
+	{
+		if(backend != NULL)
+			backend->SwapBuffers();
+	}
+
+	RBOOL RPlatform::SetSwapInterval(RINT Interval)
+	{
+		swapInterval = Interval;
+		return backend != NULL && backend->SetSwapInterval(Interval);
+	}
+
+	RECT RPlatform::GetScreenSize()
+	{
+		return backend != NULL ? backend->GetScreenSize() : RECT(0, 0, 0, 0);
+	}
+
+	RBOOL RPlatform::IsWindowVisible()
+	{
+		return backend != NULL && backend->IsWindowVisible();
+	}
+
+	RBOOL RPlatform::IsWindowFocused()
+	{
+		return backend != NULL && backend->IsWindowFocused();
+	}
+
+	RBOOL RPlatform::HasContext()
+	{
+		return backend != NULL && backend->HasContext();
+	}
+
+	double RPlatform::GetTime()
+	{
+		return RTimer::Now();
+	}
+
+	RVOID RPlatform::RequestQuit()
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		quit = true;
+		quitSignal.notify_all();
+	}
+
+	RVOID RPlatform::Shutdown()
+	{
+		if(backend == NULL)
+			return;
+		backend->Shutdown();
+		delete backend;
+		backend = NULL;
+	}
+};
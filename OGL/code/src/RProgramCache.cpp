@@ -0,0 +1,414 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RProgramCache.h"
+
+#if defined(GL_PROGRAM_BINARY_RETRIEVABLE_HINT)
+#define R_PROGRAM_BINARY 1
+#endif
+
+#if defined(__APPLE__)
+#include <OpenGL/glext.h>
+// The legacy 2.1 context only has transform feedback as EXT_transform_feedback.
+#define R_TRANSFORM_FEEDBACK 1
+#define R_INTERLEAVED_ATTRIBS GL_INTERLEAVED_ATTRIBS_EXT
+#define rTransformFeedbackVaryings glTransformFeedbackVaryingsEXT
+#elif defined(GL_INTERLEAVED_ATTRIBS)
+#define R_TRANSFORM_FEEDBACK 1
+#define R_INTERLEAVED_ATTRIBS GL_INTERLEAVED_ATTRIBS
+#define rTransformFeedbackVaryings glTransformFeedbackVaryings
+#endif
+
+namespace Reactor {
+
+    static const char* __attribNames[] = {
+        "R_POSITION", "R_NORMAL", "R_TEXCOORD0", "R_TEXCOORD1",
+        "R_TANGENT", "R_COLOR", "R_BLENDINDICES", "R_BLENDWEIGHTS"
+    };
+
+    static const RUINT __binaryMagic = 0x42475052;   // "RPGB"
+    static const RUINT __binaryVersion = 1;
+
+    struct RProgramBinaryHeader
+    {
+        RUINT magic;
+        RUINT version;
+        uint64_t driverHash;
+        uint64_t sourceHash;
+        RUINT format;
+        RUINT length;
+    };
+
+    static uint64_t __fnv1a(const void* data, size_t length, uint64_t hash = 14695981039346656037ull){
+        const unsigned char* p = (const unsigned char*)data;
+        for(size_t i=0; i<length; i++){
+            hash ^= p[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint64_t __fnv1a(const std::string& s, uint64_t hash = 14695981039346656037ull){
+        // Hash the terminator too so ("ab","c") and ("a","bc") differ.
+        return __fnv1a(s.c_str(), s.size() + 1, hash);
+    }
+
+    static RBOOL __readFile(const std::string& path, std::string& out){
+        FILE* f = fopen(path.c_str(), "rb");
+        if(f == NULL)
+            return false;
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        out.resize(size > 0 ? size : 0);
+        size_t read = size > 0 ? fread(&out[0], 1, size, f) : 0;
+        fclose(f);
+        return read == (size_t)out.size();
+    }
+
+    RProgramKey::RProgramKey(){
+        vertexLayout = RVA_POSITION;
+    }
+
+    RProgramKey::RProgramKey(const std::string& Effect, RUINT VertexLayout){
+        effect = Effect;
+        vertexLayout = VertexLayout;
+    }
+
+    void RProgramKey::AddDefine(const std::string& Name, const std::string& Value){
+        std::pair<std::string, std::string> define(Name, Value);
+        defines.insert(std::lower_bound(defines.begin(), defines.end(), define), define);
+    }
+
+    void RProgramKey::AddFeedbackVarying(const std::string& Name){
+        feedbackVaryings.push_back(Name);
+    }
+
+    uint64_t RProgramKey::GetHash() const {
+        uint64_t hash = __fnv1a(effect);
+        for(size_t i=0; i<defines.size(); i++){
+            hash = __fnv1a(defines[i].first, hash);
+            hash = __fnv1a(defines[i].second, hash);
+        }
+        for(size_t i=0; i<feedbackVaryings.size(); i++)
+            hash = __fnv1a(feedbackVaryings[i], hash);
+        return __fnv1a(&vertexLayout, sizeof(vertexLayout), hash);
+    }
+
+    RProgramCache::RProgramCache(){
+        sourceDirectory = "shaders";
+        driverHash = 0;
+        parallelCompile = false;
+        memset(&stats, 0, sizeof(RProgramCacheStats));
+    }
+
+    RProgramCache::~RProgramCache(){
+        Clear();
+    }
+
+    RVOID RProgramCache::SetSourceDirectory(const std::string& Path){
+        sourceDirectory = Path;
+    }
+
+    RVOID RProgramCache::SetCacheDirectory(const std::string& Path){
+        cacheDirectory = Path;
+    }
+
+    RVOID RProgramCache::RegisterSource(const std::string& Effect, const std::string& VertexSource, const std::string& FragmentSource){
+        sources[Effect] = std::make_pair(VertexSource, FragmentSource);
+    }
+
+    uint64_t RProgramCache::DriverHash(){
+        if(driverHash == 0){
+            const char* vendor = (const char*)glGetString(GL_VENDOR);
+            const char* renderer = (const char*)glGetString(GL_RENDERER);
+            const char* version = (const char*)glGetString(GL_VERSION);
+            // Wrapped in std::string: a bare char* would pick the (data, length) overload.
+            driverHash = __fnv1a(std::string(vendor ? vendor : ""));
+            driverHash = __fnv1a(std::string(renderer ? renderer : ""), driverHash);
+            driverHash = __fnv1a(std::string(version ? version : ""), driverHash);
+
+#if defined(GL_COMPLETION_STATUS_KHR)
+            // Let the driver compile on its own threads; we poll GL_COMPLETION_STATUS_KHR.
+            const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+            if(extensions != NULL && (strstr(extensions, "GL_KHR_parallel_shader_compile") != NULL)){
+                glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+                parallelCompile = true;
+            }
+#endif
+        }
+        return driverHash;
+    }
+
+    RBOOL RProgramCache::LoadSource(const std::string& Effect, std::string& Vertex, std::string& Fragment){
+        std::map<std::string, std::pair<std::string, std::string> >::iterator it = sources.find(Effect);
+        if(it != sources.end()){
+            Vertex = it->second.first;
+            Fragment = it->second.second;
+            return true;
+        }
+        std::string base = sourceDirectory + "/" + Effect;
+        if(!__readFile(base + ".vert", Vertex) || !__readFile(base + ".frag", Fragment))
+            return false;
+        sources[Effect] = std::make_pair(Vertex, Fragment);
+        return true;
+    }
+
+    std::string RProgramCache::Preprocess(const std::string& Source, const RProgramKey& Key){
+        std::ostringstream header;
+        for(size_t i=0; i<Key.defines.size(); i++)
+            header << "#define " << Key.defines[i].first << " " << Key.defines[i].second << "\n";
+        for(int i=0; i<8; i++){
+            if(Key.vertexLayout & (1 << i))
+                header << "#define R_HAS_" << (__attribNames[i] + 2) << " 1\n";
+        }
+
+        // #version has to stay the first statement of the shader.
+        size_t insertAt = 0;
+        size_t version = Source.find("#version");
+        if(version != std::string::npos){
+            insertAt = Source.find('\n', version);
+            insertAt = (insertAt == std::string::npos) ? Source.size() : insertAt + 1;
+        }
+        std::string result = Source;
+        result.insert(insertAt, header.str());
+        return result;
+    }
+
+    std::string RProgramCache::BinaryPath(uint64_t KeyHash){
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.rpb", (unsigned long long)KeyHash);
+        return cacheDirectory + "/" + name;
+    }
+
+    RBOOL RProgramCache::LoadBinary(RProgram* Program){
+#ifdef R_PROGRAM_BINARY
+        if(cacheDirectory.empty())
+            return false;
+        std::string data;
+        if(!__readFile(BinaryPath(Program->keyHash), data) || data.size() < sizeof(RProgramBinaryHeader))
+            return false;
+
+        RProgramBinaryHeader header;
+        memcpy(&header, data.data(), sizeof(RProgramBinaryHeader));
+        if(header.magic != __binaryMagic || header.version != __binaryVersion ||
+           header.driverHash != DriverHash() || header.sourceHash != Program->sourceHash ||
+           header.length != data.size() - sizeof(RProgramBinaryHeader))
+            return false;
+
+        glProgramBinary(Program->id, header.format, data.data() + sizeof(RProgramBinaryHeader), header.length);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(Program->id, GL_LINK_STATUS, &linked);
+        // The driver may still reject a binary it produced (e.g. after an update that kept
+        // the version string); fall back to compiling from source.
+        return linked == GL_TRUE;
+#else
+        return false;
+#endif
+    }
+
+    RVOID RProgramCache::SaveBinary(RProgram* Program){
+#ifdef R_PROGRAM_BINARY
+        if(cacheDirectory.empty())
+            return;
+        GLint length = 0;
+        glGetProgramiv(Program->id, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0)
+            return;
+
+        std::vector<char> data(sizeof(RProgramBinaryHeader) + length);
+        RProgramBinaryHeader header;
+        GLenum format = 0;
+        glGetProgramBinary(Program->id, length, NULL, &format, &data[sizeof(RProgramBinaryHeader)]);
+        header.magic = __binaryMagic;
+        header.version = __binaryVersion;
+        header.driverHash = DriverHash();
+        header.sourceHash = Program->sourceHash;
+        header.format = format;
+        header.length = (RUINT)length;
+        memcpy(&data[0], &header, sizeof(RProgramBinaryHeader));
+
+        // Write to a temporary name first so a crash never leaves a truncated binary behind.
+        std::string path = BinaryPath(Program->keyHash);
+        std::string temp = path + ".tmp";
+        FILE* f = fopen(temp.c_str(), "wb");
+        if(f == NULL)
+            return;
+        size_t written = fwrite(&data[0], 1, data.size(), f);
+        fclose(f);
+        if(written == data.size())
+            rename(temp.c_str(), path.c_str());
+        else
+            remove(temp.c_str());
+#endif
+    }
+
+    RProgram* RProgramCache::Request(const RProgramKey& Key){
+        ++stats.requests;
+        uint64_t keyHash = Key.GetHash();
+        std::map<uint64_t, RProgram*>::iterator it = programs.find(keyHash);
+        if(it != programs.end()){
+            ++stats.memoryHits;
+            return it->second;
+        }
+
+        RProgram* program = new RProgram();
+        program->id = 0;
+        program->vertexShader = 0;
+        program->fragmentShader = 0;
+        program->state = RPROGRAM_FAILED;
+        program->keyHash = keyHash;
+        program->sourceHash = 0;
+        programs[keyHash] = program;
+
+        std::string vertex, fragment;
+        if(!LoadSource(Key.effect, vertex, fragment)){
+            program->log = "missing source for effect " + Key.effect;
+            ++stats.failures;
+            return program;
+        }
+        vertex = Preprocess(vertex, Key);
+        fragment = Preprocess(fragment, Key);
+        program->sourceHash = __fnv1a(fragment, __fnv1a(vertex));
+
+        DriverHash();
+        program->id = glCreateProgram();
+        if(LoadBinary(program)){
+            program->state = RPROGRAM_READY;
+            ++stats.binaryLoads;
+            return program;
+        }
+
+        const char* vs = vertex.c_str();
+        const char* fs = fragment.c_str();
+        program->vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(program->vertexShader, 1, &vs, NULL);
+        glCompileShader(program->vertexShader);
+        program->fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(program->fragmentShader, 1, &fs, NULL);
+        glCompileShader(program->fragmentShader);
+
+        glAttachShader(program->id, program->vertexShader);
+        glAttachShader(program->id, program->fragmentShader);
+        for(int i=0; i<8; i++){
+            if(Key.vertexLayout & (1 << i))
+                glBindAttribLocation(program->id, i, __attribNames[i]);
+        }
+#ifdef R_TRANSFORM_FEEDBACK
+        if(!Key.feedbackVaryings.empty()){
+            std::vector<const GLchar*> varyings;
+            for(size_t i=0; i<Key.feedbackVaryings.size(); i++)
+                varyings.push_back(Key.feedbackVaryings[i].c_str());
+            rTransformFeedbackVaryings(program->id, (GLsizei)varyings.size(), &varyings[0], R_INTERLEAVED_ATTRIBS);
+        }
+#endif
+#ifdef R_PROGRAM_BINARY
+        glProgramParameteri(program->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+        // No status queries here: those would force the driver to finish the compile now.
+        glLinkProgram(program->id);
+        program->state = RPROGRAM_PENDING;
+        ++stats.compiles;
+        return program;
+    }
+
+    RVOID RProgramCache::Resolve(RProgram* Program){
+        GLint linked = GL_FALSE;
+        glGetProgramiv(Program->id, GL_LINK_STATUS, &linked);
+        if(linked == GL_TRUE){
+            Program->state = RPROGRAM_READY;
+            SaveBinary(Program);
+        } else {
+            GLint length = 0;
+            glGetProgramiv(Program->id, GL_INFO_LOG_LENGTH, &length);
+            Program->log.resize(length > 0 ? length : 0);
+            if(length > 0)
+                glGetProgramInfoLog(Program->id, length, NULL, &Program->log[0]);
+            Program->state = RPROGRAM_FAILED;
+            ++stats.failures;
+        }
+        if(Program->vertexShader != 0){
+            glDetachShader(Program->id, Program->vertexShader);
+            glDeleteShader(Program->vertexShader);
+            Program->vertexShader = 0;
+        }
+        if(Program->fragmentShader != 0){
+            glDetachShader(Program->id, Program->fragmentShader);
+            glDeleteShader(Program->fragmentShader);
+            Program->fragmentShader = 0;
+        }
+    }
+
+    RBOOL RProgramCache::IsReady(RProgram* Program){
+        if(Program->state == RPROGRAM_PENDING){
+#if defined(GL_COMPLETION_STATUS_KHR)
+            if(parallelCompile){
+                GLint done = GL_FALSE;
+                glGetProgramiv(Program->id, GL_COMPLETION_STATUS_KHR, &done);
+                if(done != GL_TRUE)
+                    return false;
+            }
+#endif
+            Resolve(Program);
+        }
+        return Program->state == RPROGRAM_READY;
+    }
+
+    GLuint RProgramCache::Bind(RProgram* Program){
+        if(Program->state == RPROGRAM_PENDING)
+            Resolve(Program);
+        if(Program->state != RPROGRAM_READY)
+            return 0;
+        glUseProgram(Program->id);
+        return Program->id;
+    }
+
+    RVOID RProgramCache::Update(){
+        // Only meaningful with parallel compile; otherwise IsReady would block on each program.
+        if(!parallelCompile)
+            return;
+        for(std::map<uint64_t, RProgram*>::iterator it = programs.begin(); it != programs.end(); ++it){
+            if(it->second->state == RPROGRAM_PENDING)
+                IsReady(it->second);
+        }
+    }
+
+    RVOID RProgramCache::Clear(){
+        for(std::map<uint64_t, RProgram*>::iterator it = programs.begin(); it != programs.end(); ++it){
+            RProgram* program = it->second;
+            if(program->vertexShader != 0)
+                glDeleteShader(program->vertexShader);
+            if(program->fragmentShader != 0)
+                glDeleteShader(program->fragmentShader);
+            if(program->id != 0)
+                glDeleteProgram(program->id);
+            delete program;
+        }
+        programs.clear();
+    }
+
+    const RProgramCacheStats& RProgramCache::GetStats(){
+        return stats;
+    }
+};
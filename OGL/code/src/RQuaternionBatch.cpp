@@ -0,0 +1,213 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RQuaternionBatch.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define R_QUATERNION_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace Reactor {
+
+    // Eberly's coefficients: u[i] = 1 / ((i + 1)(2i + 3)), v[i] = (i + 1) / (2i + 3), with the
+    // last pair scaled by 1 + mu to absorb the truncated tail of the series.
+    static const RFLOAT __onePlusMu = 1.90110745351730037f;
+    static const RFLOAT __u[8] = { 1.0f / (1 * 3), 1.0f / (2 * 5), 1.0f / (3 * 7), 1.0f / (4 * 9),
+                                   1.0f / (5 * 11), 1.0f / (6 * 13), 1.0f / (7 * 15), __onePlusMu / (8 * 17) };
+    static const RFLOAT __v[8] = { 1.0f / 3, 2.0f / 5, 3.0f / 7, 4.0f / 9,
+                                   5.0f / 11, 6.0f / 13, 7.0f / 15, __onePlusMu * 8 / 17 };
+
+    // Weight of one endpoint: s * (1 + b0 (1 + b1 (... (1 + b7)))), b_i = (u_i s^2 - v_i)(cos - 1).
+    static inline RFLOAT __slerpWeight(RFLOAT S, RFLOAT CosMinusOne){
+        RFLOAT s2 = S * S;
+        RFLOAT r = 1.0f;
+        for(int i=7; i>=0; i--)
+            r = 1.0f + (__u[i] * s2 - __v[i]) * CosMinusOne * r;
+        return S * r;
+    }
+
+    static void __scalar(const RQuaternionStreams& A, const RQuaternionStreams& B, const RFLOAT* T, RFLOAT Weight,
+                         const RQuaternionStreams& Out, RUINT Begin, RUINT Count, RBOOL Spherical){
+        for(RUINT i=Begin; i<Count; i++){
+            RFLOAT t = T ? T[i] : Weight;
+            RFLOAT ax = A.x[i], ay = A.y[i], az = A.z[i], aw = A.w[i];
+            RFLOAT bx = B.x[i], by = B.y[i], bz = B.z[i], bw = B.w[i];
+            RFLOAT dot = ax * bx + ay * by + az * bz + aw * bw;
+            RFLOAT sign = dot < 0.0f ? -1.0f : 1.0f;
+            RFLOAT wa = 1.0f - t, wb = t;
+            if(Spherical){
+                RFLOAT c = __min(fabsf(dot), 1.0f) - 1.0f;
+                wa = __slerpWeight(1.0f - t, c);
+                wb = __slerpWeight(t, c);
+            }
+            wb *= sign;
+            RFLOAT x = ax * wa + bx * wb, y = ay * wa + by * wb, z = az * wa + bz * wb, w = aw * wa + bw * wb;
+            RFLOAT inv = 1.0f / sqrtf(x * x + y * y + z * z + w * w);
+            Out.x[i] = x * inv;
+            Out.y[i] = y * inv;
+            Out.z[i] = z * inv;
+            Out.w[i] = w * inv;
+        }
+    }
+
+#ifdef R_QUATERNION_SSE
+    static inline __m128 __slerpWeight4(__m128 S, __m128 CosMinusOne){
+        __m128 s2 = _mm_mul_ps(S, S);
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 r = one;
+        for(int i=7; i>=0; i--){
+            __m128 b = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(__u[i]), s2), _mm_set1_ps(__v[i])), CosMinusOne);
+            r = _mm_add_ps(one, _mm_mul_ps(b, r));
+        }
+        return _mm_mul_ps(S, r);
+    }
+
+    static RUINT __blend4(const RQuaternionStreams& A, const RQuaternionStreams& B, const RFLOAT* T, RFLOAT Weight,
+                          const RQuaternionStreams& Out, RUINT Count, RBOOL Spherical){
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        RUINT i = 0;
+        for(; i + 4 <= Count; i+=4){
+            __m128 t = T ? _mm_loadu_ps(T + i) : _mm_set1_ps(Weight);
+            __m128 ax = _mm_loadu_ps(A.x + i), ay = _mm_loadu_ps(A.y + i), az = _mm_loadu_ps(A.z + i), aw = _mm_loadu_ps(A.w + i);
+            __m128 bx = _mm_loadu_ps(B.x + i), by = _mm_loadu_ps(B.y + i), bz = _mm_loadu_ps(B.z + i), bw = _mm_loadu_ps(B.w + i);
+            __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+            __m128 flip = _mm_and_ps(dot, sign);
+            __m128 wa = _mm_sub_ps(one, t), wb = t;
+            if(Spherical){
+                __m128 c = _mm_sub_ps(_mm_min_ps(_mm_andnot_ps(sign, dot), one), one);
+                wa = __slerpWeight4(wa, c);
+                wb = __slerpWeight4(wb, c);
+            }
+            wb = _mm_xor_ps(wb, flip);
+            __m128 x = _mm_add_ps(_mm_mul_ps(ax, wa), _mm_mul_ps(bx, wb));
+            __m128 y = _mm_add_ps(_mm_mul_ps(ay, wa), _mm_mul_ps(by, wb));
+            __m128 z = _mm_add_ps(_mm_mul_ps(az, wa), _mm_mul_ps(bz, wb));
+            __m128 w = _mm_add_ps(_mm_mul_ps(aw, wa), _mm_mul_ps(bw, wb));
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))));
+            __m128 inv = _mm_div_ps(one, length);
+            _mm_storeu_ps(Out.x + i, _mm_mul_ps(x, inv));
+            _mm_storeu_ps(Out.y + i, _mm_mul_ps(y, inv));
+            _mm_storeu_ps(Out.z + i, _mm_mul_ps(z, inv));
+            _mm_storeu_ps(Out.w + i, _mm_mul_ps(w, inv));
+        }
+        return i;
+    }
+#endif
+
+    RVOID RQuaternionBatch::Nlerp(const RQuaternionStreams& A, const RQuaternionStreams& B, const RFLOAT* T, RFLOAT Weight, const RQuaternionStreams& Out, RUINT Count){
+        RUINT i = 0;
+#ifdef R_QUATERNION_SSE
+        i = __blend4(A, B, T, Weight, Out, Count, false);
+#endif
+        __scalar(A, B, T, Weight, Out, i, Count, false);
+    }
+
+    RVOID RQuaternionBatch::Slerp(const RQuaternionStreams& A, const RQuaternionStreams& B, const RFLOAT* T, RFLOAT Weight, const RQuaternionStreams& Out, RUINT Count){
+        RUINT i = 0;
+#ifdef R_QUATERNION_SSE
+        i = __blend4(A, B, T, Weight, Out, Count, true);
+#endif
+        __scalar(A, B, T, Weight, Out, i, Count, true);
+    }
+
+    RVOID RQuaternionBatch::Normalize(const RQuaternionStreams& Q, RUINT Count){
+        RUINT i = 0;
+#ifdef R_QUATERNION_SSE
+        const __m128 one = _mm_set1_ps(1.0f);
+        for(; i + 4 <= Count; i+=4){
+            __m128 x = _mm_loadu_ps(Q.x + i), y = _mm_loadu_ps(Q.y + i), z = _mm_loadu_ps(Q.z + i), w = _mm_loadu_ps(Q.w + i);
+            __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)))));
+            _mm_storeu_ps(Q.x + i, _mm_mul_ps(x, inv));
+            _mm_storeu_ps(Q.y + i, _mm_mul_ps(y, inv));
+            _mm_storeu_ps(Q.z + i, _mm_mul_ps(z, inv));
+            _mm_storeu_ps(Q.w + i, _mm_mul_ps(w, inv));
+        }
+#endif
+        for(; i<Count; i++){
+            RFLOAT inv = 1.0f / sqrtf(Q.x[i] * Q.x[i] + Q.y[i] * Q.y[i] + Q.z[i] * Q.z[i] + Q.w[i] * Q.w[i]);
+            Q.x[i] *= inv;
+            Q.y[i] *= inv;
+            Q.z[i] *= inv;
+            Q.w[i] *= inv;
+        }
+    }
+
+    RVOID RQuaternionBatch::ToMatrix(const RQuaternionStreams& Q, RUINT Count, RMatrix* Out){
+        RUINT i = 0;
+#ifdef R_QUATERNION_SSE
+        const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+        for(; i + 4 <= Count; i+=4){
+            __m128 x = _mm_loadu_ps(Q.x + i), y = _mm_loadu_ps(Q.y + i), z = _mm_loadu_ps(Q.z + i), w = _mm_loadu_ps(Q.w + i);
+            __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+            __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+            __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+            __m128 c0 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+            __m128 c1 = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+            __m128 c2 = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+            __m128 c3 = zero;
+            __m128 c4 = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+            __m128 c5 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+            __m128 c6 = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+            __m128 c7 = zero;
+            __m128 c8 = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+            __m128 c9 = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+            __m128 c10 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+            __m128 c11 = zero;
+            _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+            _MM_TRANSPOSE4_PS(c4, c5, c6, c7);
+            _MM_TRANSPOSE4_PS(c8, c9, c10, c11);
+            // Register k of each group now holds quaternion i + k's column.
+            __m128 columns[4][3] = { { c0, c4, c8 }, { c1, c5, c9 }, { c2, c6, c10 }, { c3, c7, c11 } };
+            const __m128 last = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+            for(int k=0; k<4; k++){
+                for(int c=0; c<3; c++)
+                    _mm_storeu_ps(Out[i + k].m + c * 4, columns[k][c]);
+                _mm_storeu_ps(Out[i + k].m + 12, last);
+            }
+        }
+#endif
+        for(; i<Count; i++){
+            RFLOAT x = Q.x[i], y = Q.y[i], z = Q.z[i], w = Q.w[i];
+            RFLOAT* m = Out[i].m;
+            m[0] = 1.0f - 2.0f * (y * y + z * z);
+            m[1] = 2.0f * (x * y + w * z);
+            m[2] = 2.0f * (x * z - w * y);
+            m[3] = 0.0f;
+            m[4] = 2.0f * (x * y - w * z);
+            m[5] = 1.0f - 2.0f * (x * x + z * z);
+            m[6] = 2.0f * (y * z + w * x);
+            m[7] = 0.0f;
+            m[8] = 2.0f * (x * z + w * y);
+            m[9] = 2.0f * (y * z - w * x);
+            m[10] = 1.0f - 2.0f * (x * x + y * y);
+            m[11] = 0.0f;
+            m[12] = 0.0f;
+            m[13] = 0.0f;
+            m[14] = 0.0f;
+            m[15] = 1.0f;
+        }
+    }
+};
@@ -0,0 +1,178 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include "../headers/RReplay.h"
+
+namespace Reactor
+{
+    RInputLog::RInputLog() : file(NULL), writing(false), frameCount(0), frameIndex(0){
+    }
+
+    RInputLog::~RInputLog(){
+        Close();
+    }
+
+    RRESULT RInputLog::Create(const std::string& Path){
+        Close();
+        file = fopen(Path.c_str(), "wb");
+        if(file == NULL)
+            return R_INVALIDARG;
+        RReplayFileHeader header = { RREPLAY_MAGIC, RREPLAY_VERSION, 0 };
+        if(fwrite(&header, sizeof(header), 1, file) != 1){
+            fclose(file);
+            file = NULL;
+            return R_INVALIDARG;
+        }
+        writing = true;
+        frameCount = frameIndex = 0;
+        return R_OK;
+    }
+
+    RRESULT RInputLog::Open(const std::string& Path){
+        Close();
+        file = fopen(Path.c_str(), "rb");
+        if(file == NULL)
+            return R_INVALIDARG;
+        RReplayFileHeader header;
+        if(fread(&header, sizeof(header), 1, file) != 1 || header.magic != RREPLAY_MAGIC || header.version != RREPLAY_VERSION){
+            fclose(file);
+            file = NULL;
+            return R_INVALIDARG;
+        }
+        writing = false;
+        frameCount = header.frameCount;
+        frameIndex = 0;
+        return R_OK;
+    }
+
+    RVOID RInputLog::Close(){
+        if(file == NULL)
+            return;
+        if(writing){
+            // A log that was never closed keeps a count of 0 and is read to the end of the file.
+            RReplayFileHeader header = { RREPLAY_MAGIC, RREPLAY_VERSION, frameCount };
+            fseek(file, 0, SEEK_SET);
+            fwrite(&header, sizeof(header), 1, file);
+        }
+        fclose(file);
+        file = NULL;
+        writing = false;
+    }
+
+    RRESULT RInputLog::WriteFrame(RFLOAT Delta, const std::vector<RInputEvent>& Events, double FrameStart){
+        if(file == NULL || !writing)
+            return R_INVALIDARG;
+        buffer.resize(Events.size());
+        for(size_t i=0; i<Events.size(); i++){
+            const RInputEvent& e = Events[i];
+            RReplayEvent& r = buffer[i];
+            r.time = (RFLOAT)(e.time - FrameStart);
+            r.code = e.code;
+            r.type = e.type;
+            r.pad = 0;
+            r.x = e.x;
+            r.y = e.y;
+        }
+        RReplayFrameHeader frame = { Delta, (uint32_t)buffer.size() };
+        RBOOL ok = fwrite(&frame, sizeof(frame), 1, file) == 1 &&
+                   (buffer.empty() || fwrite(&buffer[0], sizeof(RReplayEvent), buffer.size(), file) == buffer.size());
+        if(!ok)
+            return R_INVALIDARG;
+        frameCount++;
+        return R_OK;
+    }
+
+    RBOOL RInputLog::ReadFrame(RFLOAT& Delta, std::vector<RInputEvent>& Events, double FrameStart){
+        Events.clear();
+        if(file == NULL || writing || (frameCount > 0 && frameIndex >= frameCount))
+            return false;
+        RReplayFrameHeader frame;
+        if(fread(&frame, sizeof(frame), 1, file) != 1 || frame.eventCount > R_INPUT_QUEUE_SIZE)
+            return false;
+        buffer.resize(frame.eventCount);
+        if(!buffer.empty() && fread(&buffer[0], sizeof(RReplayEvent), buffer.size(), file) != buffer.size())
+            return false;
+        Events.resize(buffer.size());
+        for(size_t i=0; i<buffer.size(); i++){
+            const RReplayEvent& r = buffer[i];
+            RInputEvent& e = Events[i];
+            e.time = FrameStart + r.time;
+            e.code = r.code;
+            e.type = r.type;
+            e.pad = 0;
+            e.x = r.x;
+            e.y = r.y;
+        }
+        Delta = frame.delta;
+        frameIndex++;
+        return true;
+    }
+
+    static RFLOAT __percentile(const std::vector<RFLOAT>& Sorted, RFLOAT P){
+        size_t i = (size_t)(P * (Sorted.size() - 1) + 0.5f);
+        return Sorted[__min(i, Sorted.size() - 1)];
+    }
+
+    RRESULT RInputLog::WriteReport(const std::string& Path, const std::vector<RReplayFrameTiming>& Frames, RFLOAT WallTime, RReplayReport* Report){
+        RReplayReport r;
+        memset(&r, 0, sizeof(r));
+        r.frames = (RUINT)Frames.size();
+        r.wallTime = WallTime;
+        if(!Frames.empty()){
+            std::vector<RFLOAT> totals(Frames.size());
+            double sum = 0.0;
+            for(size_t i=0; i<Frames.size(); i++){
+                totals[i] = Frames[i].total;
+                sum += totals[i];
+                if(i > 0 && Frames[i].allocations > 0)
+                    r.allocatingFrames++;
+            }
+            std::sort(totals.begin(), totals.end());
+            r.mean = (RFLOAT)(sum / totals.size());
+            r.p50 = __percentile(totals, 0.50f);
+            r.p95 = __percentile(totals, 0.95f);
+            r.p99 = __percentile(totals, 0.99f);
+            r.max = totals.back();
+        }
+        if(Report != NULL)
+            *Report = r;
+        if(Path.empty())
+            return R_OK;
+
+        FILE* f = fopen(Path.c_str(), "w");
+        if(f == NULL)
+            return R_INVALIDARG;
+        fprintf(f, "# frames %u, wall %.3f ms, frame ms: mean %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f, allocating frames %u\n",
+                r.frames, r.wallTime, r.mean, r.p50, r.p95, r.p99, r.max, r.allocatingFrames);
+        fprintf(f, "frame,delta_ms,update_ms,animation_ms,render_ms,total_ms,allocations\n");
+        for(size_t i=0; i<Frames.size(); i++){
+            const RReplayFrameTiming& t = Frames[i];
+            fprintf(f, "%u,%.3f,%.4f,%.4f,%.4f,%.4f,%u\n", (RUINT)i, t.delta, t.update, t.animation, t.render, t.total, t.allocations);
+        }
+        RBOOL ok = ferror(f) == 0;
+        fclose(f);
+        return ok ? R_OK : R_INVALIDARG;
+    }
+};
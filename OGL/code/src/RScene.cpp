@@ -0,0 +1,184 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include "../headers/RScene.h"
+
+namespace Reactor
+{
+    RScene::RScene()
+    : nodes(RMEM_SCENE), lights(RMEM_SCENE), emitters(RMEM_PARTICLES), meshes(RMEM_MESHES), textures(RMEM_TEXTURES), orderDirty(false){
+    }
+
+    RScene::~RScene(){
+    }
+
+    RNodeHandle RScene::CreateNode(const string& Name, RNodeHandle Parent){
+        RNodeHandle handle = nodes.Create();
+        RNode* node = nodes.Get(handle);
+        if(node == NULL)
+            return handle;
+        node->self = handle;
+        node->name = Name;
+        orderDirty = true;
+        if(!Parent.IsNull() && FAILED(SetParent(handle, Parent))){
+            nodes.Destroy(handle);
+            return RNodeHandle();
+        }
+        return handle;
+    }
+
+    RVOID RScene::Unlink(RNode& Node){
+        RNode* parent = nodes.Get(Node.parent);
+        if(parent == NULL)
+            return;
+        if(parent->firstChild == Node.self){
+            parent->firstChild = Node.nextSibling;
+        } else {
+            RNode* prev = nodes.Get(parent->firstChild);
+            while(prev != NULL && prev->nextSibling != Node.self)
+                prev = nodes.Get(prev->nextSibling);
+            if(prev != NULL)
+                prev->nextSibling = Node.nextSibling;
+        }
+        parent->childCount--;
+        Node.parent = RNodeHandle();
+        Node.nextSibling = RNodeHandle();
+    }
+
+    RVOID RScene::DestroyNode(RNodeHandle Node){
+        RNode* node = nodes.Get(Node);
+        if(node == NULL)
+            return;
+        Unlink(*node);
+        // Collect the subtree first; destroying while walking would follow freed links.
+        std::vector<RNodeHandle> doomed(1, Node);
+        for(size_t i=0; i<doomed.size(); i++){
+            for(RNode* child = nodes.Get(nodes.Get(doomed[i])->firstChild); child != NULL; child = nodes.Get(child->nextSibling))
+                doomed.push_back(child->self);
+        }
+        for(size_t i=0; i<doomed.size(); i++)
+            nodes.Destroy(doomed[i]);
+        orderDirty = true;
+    }
+
+    RRESULT RScene::SetParent(RNodeHandle Node, RNodeHandle Parent){
+        RNode* node = nodes.Get(Node);
+        if(node == NULL || (!Parent.IsNull() && !nodes.IsValid(Parent)))
+            return R_INVALIDARG;
+        for(RNode* p = nodes.Get(Parent); p != NULL; p = nodes.Get(p->parent)){
+            if(p->self == Node)
+                return R_INVALIDARG;
+        }
+        Unlink(*node);
+        RNode* parent = nodes.Get(Parent);
+        if(parent != NULL){
+            // Appended, so children keep the order they were added in.
+            node->parent = Parent;
+            RNode* last = nodes.Get(parent->firstChild);
+            while(last != NULL && !last->nextSibling.IsNull())
+                last = nodes.Get(last->nextSibling);
+            if(last != NULL)
+                last->nextSibling = Node;
+            else
+                parent->firstChild = Node;
+            parent->childCount++;
+        }
+        orderDirty = true;
+        return R_OK;
+    }
+
+    RVOID RScene::RebuildOrder(){
+        // Slot order sweeps the slabs front to back. It is a valid parent-before-child order
+        // whenever every parent sits in a lower slot, which is the usual case of parents
+        // being created first.
+        order.clear();
+        order.reserve(nodes.GetCount());
+        RBOOL sorted = true;
+        nodes.ForEach([this, &sorted](RNode& node, RNodeHandle handle){
+            RNodeLink link = { &node, nodes.Get(node.parent) };
+            if(link.parent != NULL && node.parent.GetIndex() > handle.GetIndex())
+                sorted = false;
+            order.push_back(link);
+        });
+        if(!sorted){
+            // Otherwise go level by level, still in slot order within a level.
+            depths.assign(nodes.GetSlotCount(), 0);
+            stack.clear();
+            for(size_t i=0; i<order.size(); i++){
+                if(order[i].parent == NULL)
+                    stack.push_back(order[i].node);
+            }
+            while(!stack.empty()){
+                RNode* node = stack.back();
+                stack.pop_back();
+                for(RNode* child = nodes.Get(node->firstChild); child != NULL; child = nodes.Get(child->nextSibling)){
+                    depths[child->self.GetIndex()] = depths[node->self.GetIndex()] + 1;
+                    stack.push_back(child);
+                }
+            }
+            const std::vector<RUINT>& depth = depths;
+            std::stable_sort(order.begin(), order.end(), [&depth](const RNodeLink& a, const RNodeLink& b){
+                return depth[a.node->self.GetIndex()] < depth[b.node->self.GetIndex()];
+            });
+        }
+        orderDirty = false;
+    }
+
+    RVOID RScene::UpdateTransforms(){
+        if(orderDirty)
+            RebuildOrder();
+        for(size_t i=0; i<order.size(); i++){
+            const RNodeLink& link = order[i];
+            if(link.parent != NULL)
+                RAffine3x4::Multiply(link.parent->world, link.node->local, &link.node->world);
+            else
+                link.node->world = link.node->local;
+        }
+    }
+
+    RMeshHandle RScene::AddMesh(const RAssetHandle& Asset){
+        RMeshHandle handle = meshes.Create();
+        if(RSceneMesh* mesh = meshes.Get(handle))
+            mesh->asset = Asset;
+        return handle;
+    }
+
+    RTextureHandle RScene::AddTexture(const RAssetHandle& Asset){
+        RTextureHandle handle = textures.Create();
+        if(RSceneTexture* texture = textures.Get(handle))
+            texture->asset = Asset;
+        return handle;
+    }
+
+    RVOID RScene::Clear(){
+        nodes.Clear();
+        lights.Clear();
+        emitters.Clear();
+        meshes.Clear();
+        textures.Clear();
+        order.clear();
+        orderDirty = false;
+    }
+};
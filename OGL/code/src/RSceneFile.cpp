@@ -0,0 +1,514 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include "../headers/RSceneFile.h"
+#include "../headers/RMemoryTracker.h"
+#include "../headers/RThreadPool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace Reactor {
+
+    #define RSCENE_NONE 0xFFFFFFFFu
+
+    static uint64_t __fnv1a(const unsigned char* p, uint64_t length){
+        uint64_t hash = 14695981039346656037ull;
+        for(uint64_t i=0; i<length; i++){
+            hash ^= p[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint64_t __align(uint64_t offset){
+        return (offset + RSCENE_ALIGNMENT - 1) & ~(uint64_t)(RSCENE_ALIGNMENT - 1);
+    }
+
+    // Written so that neither side can wrap: offsets come straight from the file.
+    static RBOOL __inRange(uint64_t Offset, uint64_t Bytes, uint64_t Size){
+        return Offset <= Size && Bytes <= Size - Offset;
+    }
+
+    #define RSCENE_NODE_REFS 6	// RSceneRefs per RSceneFileNode, each with a fixed relocation slot
+    #define RSCENE_GRAIN 1024
+
+    /** Points Ref at Target (a file offset, 0 for null) and fills its relocation slot. */
+    template<class T> static void __ref(unsigned char* Image, uint32_t* Relocation, RSceneRef<T>& Ref, uint64_t Target){
+        Ref.offset = Target;
+        *Relocation = (uint32_t)((unsigned char*)&Ref - Image);
+    }
+
+    /** Whether P is null or the start of an element of the Count elements at First. */
+    template<class T> static bool __inArray(const T* P, const T* First, uint32_t Count){
+        if(P == NULL)
+            return true;
+        uintptr_t at = (uintptr_t)P, begin = (uintptr_t)First;
+        return at >= begin && at < begin + (uintptr_t)Count * sizeof(T) && (at - begin) % sizeof(T) == 0;
+    }
+
+    RBOOL RSceneSave::IsDone(){
+        std::unique_lock<std::mutex> guard(lock);
+        return done;
+    }
+
+    RVOID RSceneSave::Wait(){
+        std::unique_lock<std::mutex> guard(lock);
+        while(!done)
+            finished.wait(guard);
+    }
+
+    RVOID RSceneSave::Finish(RRESULT Result){
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            result = Result;
+            done = true;
+        }
+        finished.notify_all();
+    }
+
+    RSceneFile::RSceneFile(){
+        base = NULL;
+        header = NULL;
+        size = 0;
+        mapped = false;
+#ifdef _WIN32
+        file = NULL;
+        mapping = NULL;
+#endif
+    }
+
+    RSceneFile::~RSceneFile(){
+        Close();
+    }
+
+    RRESULT RSceneFile::Open(const std::string& Path, RBOOL Map){
+        Close();
+        if(Map){
+#ifdef _WIN32
+            HANDLE f = CreateFileA(Path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if(f == INVALID_HANDLE_VALUE)
+                return R_INVALIDARG;
+            LARGE_INTEGER length;
+            GetFileSizeEx(f, &length);
+            HANDLE m = CreateFileMappingA(f, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+            if(m == NULL){
+                CloseHandle(f);
+                return R_OUTOFMEMORY;
+            }
+            // Copy-on-write: relocation patches the view, never the file.
+            base = (unsigned char*)MapViewOfFile(m, FILE_MAP_COPY, 0, 0, 0);
+            file = f;
+            mapping = m;
+            size = (uint64_t)length.QuadPart;
+#else
+            // Through stdio rather than open/close: <unistd.h> and <fcntl.h> define R_OK.
+            FILE* f = fopen(Path.c_str(), "rb");
+            if(f == NULL)
+                return R_INVALIDARG;
+            struct stat st;
+            if(fstat(fileno(f), &st) != 0 || st.st_size <= 0){
+                fclose(f);
+                return R_INVALIDARG;
+            }
+            size = (uint64_t)st.st_size;
+            // Private and writable: relocation patches our copy of the pages, never the file.
+            void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+            fclose(f);
+            if(p == MAP_FAILED){
+                size = 0;
+                return R_OUTOFMEMORY;
+            }
+            madvise(p, size, MADV_WILLNEED);
+            base = (unsigned char*)p;
+#endif
+            mapped = true;
+        } else {
+            FILE* f = fopen(Path.c_str(), "rb");
+            if(f == NULL)
+                return R_INVALIDARG;
+            fseek(f, 0, SEEK_END);
+            long length = ftell(f);
+            fseek(f, 0, SEEK_SET);
+            if(length <= 0){
+                fclose(f);
+                return R_INVALIDARG;
+            }
+            size = (uint64_t)length;
+            base = (unsigned char*)RMemoryTracker::Allocate(RMEM_SCENE, (size_t)size);
+            size_t read = base != NULL ? fread(base, 1, (size_t)size, f) : 0;
+            fclose(f);
+            if(read != size){
+                Close();
+                return base == NULL ? R_OUTOFMEMORY : R_INVALIDARG;
+            }
+        }
+        if(base == NULL){
+            Close();
+            return R_OUTOFMEMORY;
+        }
+
+        header = (const RSceneFileHeader*)base;
+        RRESULT hr = Relocate();
+        if(FAILED(hr))
+            Close();
+        return hr;
+    }
+
+    RRESULT RSceneFile::Relocate(){
+        const RSceneFileHeader& h = *header;
+        RBOOL valid = size >= sizeof(RSceneFileHeader) &&
+            h.magic == RSCENE_MAGIC && h.version == RSCENE_VERSION && h.fileSize == size &&
+            h.nodeOffset % 8 == 0 && h.resourceOffset % 8 == 0 &&
+            h.relocationOffset % 4 == 0 &&
+            __inRange(h.nodeOffset, (uint64_t)h.nodeCount * sizeof(RSceneFileNode), size) &&
+            __inRange(h.resourceOffset, (uint64_t)h.resourceCount * sizeof(RSceneFileResource), size) &&
+            __inRange(h.stringOffset, h.stringBytes, size) &&
+            __inRange(h.relocationOffset, (uint64_t)h.relocationCount * sizeof(uint32_t), size) &&
+            (h.stringBytes == 0 || base[h.stringOffset + h.stringBytes - 1] == 0);
+        if(!valid)
+            return R_INVALIDARG;
+
+        const uint32_t* relocations = (const uint32_t*)(base + h.relocationOffset);
+        for(uint32_t i=0; i<h.relocationCount; i++){
+            uint32_t at = relocations[i];
+            if(at % 8 != 0 || at < sizeof(RSceneFileHeader) || (uint64_t)at + 8 > h.relocationOffset)
+                return R_INVALIDARG;
+            uint64_t target;
+            memcpy(&target, base + at, sizeof(target));
+            if(target >= size)
+                return R_INVALIDARG;
+            if(target != 0)
+                ((RSceneRef<unsigned char>*)(base + at))->pointer = base + target;
+        }
+
+        // Every reference must now land on an element of its section, so nothing
+        // reading the image has to check again.
+        const RSceneFileNode* nodes = GetNodes();
+        const RSceneFileResource* resources = GetResources();
+        const char* strings = (const char*)base + h.stringOffset;
+        const char* stringsEnd = strings + h.stringBytes;
+        for(uint32_t i=0; i<h.resourceCount; i++){
+            const char* path = resources[i].path.Get();
+            if(path < strings || path >= stringsEnd)
+                return R_INVALIDARG;
+        }
+        for(uint32_t i=0; i<h.nodeCount; i++){
+            const RSceneFileNode& node = nodes[i];
+            if(node.name.Get() < strings || node.name.Get() >= stringsEnd ||
+               !__inArray(node.parent.Get(), nodes, i) ||
+               !__inArray(node.firstChild.Get(), nodes, h.nodeCount) ||
+               !__inArray(node.nextSibling.Get(), nodes, h.nodeCount) ||
+               !__inArray<RSceneFileResource>(node.mesh.Get(), resources, h.resourceCount) ||
+               !__inArray<RSceneFileResource>(node.texture.Get(), resources, h.resourceCount))
+                return R_INVALIDARG;
+        }
+
+        // Parents come first, so the parent links cannot cycle. Each child list must hold
+        // exactly childCount nodes that name this node as their parent, and the lists
+        // together must hold every node that has a parent; that rules out sibling cycles
+        // and nodes missing from, or shared between, lists.
+        uint64_t children = 0, linked = 0;
+        for(uint32_t i=0; i<h.nodeCount; i++){
+            const RSceneFileNode& node = nodes[i];
+            if(node.parent.Get() != NULL)
+                children++;
+            if(node.childCount > h.nodeCount)
+                return R_INVALIDARG;
+            const RSceneFileNode* child = node.firstChild.Get();
+            for(uint32_t k=0; k<node.childCount; k++){
+                if(child == NULL || child->parent.Get() != &node)
+                    return R_INVALIDARG;
+                child = child->nextSibling.Get();
+            }
+            if(child != NULL)
+                return R_INVALIDARG;
+            linked += node.childCount;
+        }
+        if(linked != children)
+            return R_INVALIDARG;
+        return R_OK;
+    }
+
+    RVOID RSceneFile::Close(){
+        if(mapped){
+#ifdef _WIN32
+            if(base != NULL)
+                UnmapViewOfFile(base);
+            if(mapping != NULL)
+                CloseHandle((HANDLE)mapping);
+            if(file != NULL)
+                CloseHandle((HANDLE)file);
+            file = mapping = NULL;
+#else
+            if(base != NULL)
+                munmap(base, size);
+#endif
+        } else if(base != NULL){
+            RMemoryTracker::Free(base);
+        }
+        base = NULL;
+        header = NULL;
+        size = 0;
+        mapped = false;
+    }
+
+    RBOOL RSceneFile::Verify() const {
+        if(header == NULL)
+            return false;
+        // The hash covers the image as written, so undo the relocations on a copy first.
+        std::vector<unsigned char> image(base, base + size);
+        const uint32_t* relocations = (const uint32_t*)(base + header->relocationOffset);
+        for(uint32_t i=0; i<header->relocationCount; i++){
+            RSceneRef<unsigned char>* ref = (RSceneRef<unsigned char>*)&image[relocations[i]];
+            uint64_t offset = ref->pointer != NULL ? (uint64_t)(ref->pointer - base) : 0;
+            memcpy(ref, &offset, sizeof(offset));
+        }
+        return __fnv1a(&image[0] + sizeof(RSceneFileHeader), size - sizeof(RSceneFileHeader)) == header->contentHash;
+    }
+
+    const RSceneFileNode* RSceneFile::GetNodes() const {
+        return (const RSceneFileNode*)(base + header->nodeOffset);
+    }
+
+    const RSceneFileResource* RSceneFile::GetResources() const {
+        return (const RSceneFileResource*)(base + header->resourceOffset);
+    }
+
+    RRESULT RSceneFile::Instantiate(RScene& Scene) const {
+        if(header == NULL)
+            return R_INVALIDARG;
+        const RSceneFileNode* nodes = GetNodes();
+        const RSceneFileResource* resources = GetResources();
+        uint32_t nodeCount = header->nodeCount;
+        uint32_t resourceCount = header->resourceCount;
+
+        Scene.Clear();
+        std::vector<RMeshHandle> meshes(resourceCount);
+        std::vector<RTextureHandle> textures(resourceCount);
+        for(uint32_t i=0; i<resourceCount; i++){
+            const char* path = resources[i].path.Get();
+            RAssetHandle asset = *path != 0 ? RAssetLoader::Instance()->Load(path) : RAssetHandle();
+            if(resources[i].type == RASSET_MESH)
+                meshes[i] = Scene.AddMesh(asset);
+            else
+                textures[i] = Scene.AddTexture(asset);
+        }
+
+        // Clear left the free list in slot order, so node i of the file lands in slot i
+        // (given an empty pool) and UpdateTransforms sweeps it front to back.
+        Scene.nodes.Reserve(nodeCount);
+        std::vector<RNodeHandle> handles(nodeCount);
+        for(uint32_t i=0; i<nodeCount; i++){
+            handles[i] = Scene.nodes.Create();
+            if(handles[i].IsNull())
+                return R_OUTOFMEMORY;
+        }
+        // Nodes only write themselves from here on, so the links are filled in parallel.
+        RPool<RNode>& pool = Scene.nodes;
+        RThreadPool::Instance()->ParallelFor((RINT)nodeCount, RSCENE_GRAIN, [&](RINT begin, RINT end){
+            for(RINT i=begin; i<end; i++){
+                const RSceneFileNode& src = nodes[i];
+                RNode& node = *pool.Get(handles[i]);
+                node.self = handles[i];
+                node.name = src.name.Get();
+                if(src.parent.Get() != NULL)
+                    node.parent = handles[src.parent.Get() - nodes];
+                if(src.firstChild.Get() != NULL)
+                    node.firstChild = handles[src.firstChild.Get() - nodes];
+                if(src.nextSibling.Get() != NULL)
+                    node.nextSibling = handles[src.nextSibling.Get() - nodes];
+                node.childCount = (RINT)src.childCount;
+                if(src.mesh.Get() != NULL)
+                    node.mesh = meshes[src.mesh.Get() - resources];
+                if(src.texture.Get() != NULL)
+                    node.texture = textures[src.texture.Get() - resources];
+                memcpy(node.local.m, src.local, sizeof(src.local));
+            }
+        });
+        Scene.orderDirty = true;
+        Scene.UpdateTransforms();
+        return R_OK;
+    }
+
+    RRESULT RSceneFile::Capture(RScene& Scene, std::vector<unsigned char>& Image){
+        if(Scene.orderDirty)
+            Scene.RebuildOrder();
+        const std::vector<RScene::RNodeLink>& order = Scene.order;
+
+        // Resources first: every mesh and texture in the scene, shared ones once.
+        struct RResourceEntry
+        {
+            const std::string* path;
+            uint32_t type;
+        };
+        static const std::string none;
+        std::vector<RResourceEntry> resources;
+        std::vector<uint32_t> meshIndex(Scene.meshes.GetSlotCount(), RSCENE_NONE);
+        std::vector<uint32_t> textureIndex(Scene.textures.GetSlotCount(), RSCENE_NONE);
+        uint64_t stringBytes = 0;
+        Scene.meshes.ForEach([&](RSceneMesh& mesh, RMeshHandle handle){
+            RResourceEntry entry = { mesh.asset ? &mesh.asset->path : &none, RASSET_MESH };
+            meshIndex[handle.GetIndex()] = (uint32_t)resources.size();
+            resources.push_back(entry);
+            stringBytes += entry.path->size() + 1;
+        });
+        Scene.textures.ForEach([&](RSceneTexture& texture, RTextureHandle handle){
+            RResourceEntry entry = { texture.asset ? &texture.asset->path : &none, RASSET_TEXTURE };
+            textureIndex[handle.GetIndex()] = (uint32_t)resources.size();
+            resources.push_back(entry);
+            stringBytes += entry.path->size() + 1;
+        });
+        // Names follow the resource paths; the running total is where each one goes.
+        std::vector<uint32_t> nodeIndex(Scene.nodes.GetSlotCount(), RSCENE_NONE);
+        std::vector<uint64_t> nameAt(order.size());
+        uint64_t resourceBytes = stringBytes;
+        for(size_t i=0; i<order.size(); i++){
+            nodeIndex[order[i].node->self.GetIndex()] = (uint32_t)i;
+            nameAt[i] = stringBytes - resourceBytes;
+            stringBytes += order[i].node->name.size() + 1;
+        }
+
+        RSceneFileHeader h;
+        memset(&h, 0, sizeof(RSceneFileHeader));
+        h.magic = RSCENE_MAGIC;
+        h.version = RSCENE_VERSION;
+        h.nodeCount = (uint32_t)order.size();
+        h.resourceCount = (uint32_t)resources.size();
+        h.nodeOffset = __align(sizeof(RSceneFileHeader));
+        h.resourceOffset = __align(h.nodeOffset + (uint64_t)h.nodeCount * sizeof(RSceneFileNode));
+        h.stringOffset = __align(h.resourceOffset + (uint64_t)h.resourceCount * sizeof(RSceneFileResource));
+        h.stringBytes = stringBytes;
+        h.relocationOffset = __align(h.stringOffset + h.stringBytes);
+        h.relocationCount = h.resourceCount + h.nodeCount * RSCENE_NODE_REFS;
+        h.fileSize = h.relocationOffset + (uint64_t)h.relocationCount * sizeof(uint32_t);
+        // Relocations are 32-bit offsets.
+        if(h.relocationOffset > 0xFFFFFFFFull)
+            return R_OUTOFMEMORY;
+
+        Image.assign(h.fileSize, 0);
+        unsigned char* image = &Image[0];
+        uint32_t* relocations = (uint32_t*)(image + h.relocationOffset);
+        memcpy(image, &h, sizeof(RSceneFileHeader));
+
+        RSceneFileResource* outResources = (RSceneFileResource*)(image + h.resourceOffset);
+        uint64_t string = h.stringOffset;
+        for(size_t i=0; i<resources.size(); i++){
+            outResources[i].type = resources[i].type;
+            size_t length = resources[i].path->size() + 1;
+            memcpy(image + string, resources[i].path->c_str(), length);
+            __ref(image, relocations++, outResources[i].path, string);
+            string += length;
+        }
+
+        // Every node has its own slice of the image and of the relocation table, so the
+        // copy is split across RThreadPool; the scene is only read.
+        RPool<RNode>& pool = Scene.nodes;
+        RPool<RSceneMesh>& meshPool = Scene.meshes;
+        RPool<RSceneTexture>& texturePool = Scene.textures;
+        RSceneFileNode* outNodes = (RSceneFileNode*)(image + h.nodeOffset);
+        const uint64_t nameBase = string;
+        const RSceneFileHeader& layout = h;
+        auto nodeRef = [&](RNodeHandle Handle) -> uint64_t {
+            return pool.IsValid(Handle) ? layout.nodeOffset + (uint64_t)nodeIndex[Handle.GetIndex()] * sizeof(RSceneFileNode) : 0;
+        };
+        auto resourceRef = [&](uint32_t Index) -> uint64_t {
+            return layout.resourceOffset + (uint64_t)Index * sizeof(RSceneFileResource);
+        };
+        RThreadPool::Instance()->ParallelFor((RINT)order.size(), RSCENE_GRAIN, [&](RINT begin, RINT end){
+            for(RINT i=begin; i<end; i++){
+                const RNode& node = *order[i].node;
+                RSceneFileNode& out = outNodes[i];
+                uint32_t* slots = relocations + (size_t)i * RSCENE_NODE_REFS;
+                uint64_t name = nameBase + nameAt[i];
+                memcpy(image + name, node.name.c_str(), node.name.size() + 1);
+                __ref(image, slots, out.name, name);
+                __ref(image, slots + 1, out.parent, nodeRef(node.parent));
+                __ref(image, slots + 2, out.firstChild, nodeRef(node.firstChild));
+                __ref(image, slots + 3, out.nextSibling, nodeRef(node.nextSibling));
+                __ref(image, slots + 4, out.mesh, meshPool.IsValid(node.mesh) ? resourceRef(meshIndex[node.mesh.GetIndex()]) : 0);
+                __ref(image, slots + 5, out.texture, texturePool.IsValid(node.texture) ? resourceRef(textureIndex[node.texture.GetIndex()]) : 0);
+                out.childCount = (uint32_t)node.childCount;
+                memcpy(out.local, node.local.m, sizeof(out.local));
+            }
+        });
+        return R_OK;
+    }
+
+    RRESULT RSceneFile::Write(std::vector<unsigned char>& Image, const std::string& Path){
+        if(Image.size() < sizeof(RSceneFileHeader))
+            return R_INVALIDARG;
+        RSceneFileHeader* h = (RSceneFileHeader*)&Image[0];
+        h->contentHash = __fnv1a(&Image[0] + sizeof(RSceneFileHeader), Image.size() - sizeof(RSceneFileHeader));
+
+        std::string temporary = Path + ".tmp";
+        FILE* f = fopen(temporary.c_str(), "wb");
+        if(f == NULL)
+            return R_INVALIDARG;
+        size_t written = fwrite(&Image[0], 1, Image.size(), f);
+        RBOOL flushed = fflush(f) == 0;
+        fclose(f);
+        if(written != Image.size() || !flushed){
+            remove(temporary.c_str());
+            return R_OUTOFMEMORY;
+        }
+#ifdef _WIN32
+        RBOOL renamed = MoveFileExA(temporary.c_str(), Path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        RBOOL renamed = rename(temporary.c_str(), Path.c_str()) == 0;
+#endif
+        if(!renamed){
+            remove(temporary.c_str());
+            return R_INVALIDARG;
+        }
+        return R_OK;
+    }
+
+    RRESULT RSceneFile::Save(RScene& Scene, const std::string& Path){
+        std::vector<unsigned char> image;
+        RRESULT hr = Capture(Scene, image);
+        if(FAILED(hr))
+            return hr;
+        return Write(image, Path);
+    }
+
+    RSceneSaveHandle RSceneFile::SaveAsync(RScene& Scene, const std::string& Path){
+        RSceneSaveHandle save(new RSceneSave());
+        std::shared_ptr<std::vector<unsigned char> > image(new std::vector<unsigned char>());
+        RRESULT hr = Capture(Scene, *image);
+        if(FAILED(hr)){
+            save->Finish(hr);
+            return save;
+        }
+        RThreadPool::Instance()->Enqueue([save, image, Path](){
+            save->Finish(Write(*image, Path));
+        });
+        return save;
+    }
+};
@@ -0,0 +1,167 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RSkinning.h"
+#include "../headers/RThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define R_SKINNING_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace Reactor {
+
+    static void __skinScalar(const RDualQuaternion* Palette, const RSkinStreams& In, RUINT Begin, RUINT End, RFLOAT* OutPositions, RFLOAT* OutNormals){
+        for(RUINT v=Begin; v<End; v++){
+            RDualQuaternion bones[4];
+            for(int k=0; k<4; k++)
+                bones[k] = Palette[In.indices[v * 4 + k]];
+            RDualQuaternion blend = RDualQuaternion::Blend(bones, In.weights + v * 4, 4);
+            const RFLOAT* p = In.positions + v * 3;
+            RVector3 position = blend.TransformPoint(RVector3(p[0], p[1], p[2]));
+            OutPositions[v * 3] = position.x;
+            OutPositions[v * 3 + 1] = position.y;
+            OutPositions[v * 3 + 2] = position.z;
+            if(In.normals && OutNormals){
+                const RFLOAT* n = In.normals + v * 3;
+                RVector3 normal = blend.TransformVector(RVector3(n[0], n[1], n[2]));
+                OutNormals[v * 3] = normal.x;
+                OutNormals[v * 3 + 1] = normal.y;
+                OutNormals[v * 3 + 2] = normal.z;
+            }
+        }
+    }
+
+#ifdef R_SKINNING_SSE
+    // Rotates (x, y, z) by the unit quaternion (w, qx, qy, qz): v + 2 q x (q x v + w v).
+    static inline void __rotate(__m128 w, __m128 qx, __m128 qy, __m128 qz, __m128& x, __m128& y, __m128& z){
+        __m128 cx = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qy, z), _mm_mul_ps(qz, y)), _mm_mul_ps(w, x));
+        __m128 cy = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qz, x), _mm_mul_ps(qx, z)), _mm_mul_ps(w, y));
+        __m128 cz = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qx, y), _mm_mul_ps(qy, x)), _mm_mul_ps(w, z));
+        __m128 two = _mm_set1_ps(2.0f);
+        x = _mm_add_ps(x, _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qy, cz), _mm_mul_ps(qz, cy))));
+        y = _mm_add_ps(y, _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qz, cx), _mm_mul_ps(qx, cz))));
+        z = _mm_add_ps(z, _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qx, cy), _mm_mul_ps(qy, cx))));
+    }
+
+    static inline __m128 __gather3(const RFLOAT* Stream, RUINT V, int Component){
+        return _mm_setr_ps(Stream[V * 3 + Component], Stream[(V + 1) * 3 + Component],
+                           Stream[(V + 2) * 3 + Component], Stream[(V + 3) * 3 + Component]);
+    }
+
+    static inline void __scatter3(RFLOAT* Stream, RUINT V, __m128 X, __m128 Y, __m128 Z){
+        alignas(16) RFLOAT x[4], y[4], z[4];
+        _mm_store_ps(x, X);
+        _mm_store_ps(y, Y);
+        _mm_store_ps(z, Z);
+        for(int i=0; i<4; i++){
+            Stream[(V + i) * 3] = x[i];
+            Stream[(V + i) * 3 + 1] = y[i];
+            Stream[(V + i) * 3 + 2] = z[i];
+        }
+    }
+
+    static void __skinSSE(const RDualQuaternion* Palette, const RSkinStreams& In, RUINT Begin, RUINT End, RFLOAT* OutPositions, RFLOAT* OutNormals){
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        RUINT v = Begin;
+        for(; v + 4 <= End; v+=4){
+            __m128 rw = _mm_setzero_ps(), rx = rw, ry = rw, rz = rw;
+            __m128 dw = rw, dx = rw, dy = rw, dz = rw;
+            __m128 fw = rw, fx = rw, fy = rw, fz = rw;
+            for(int k=0; k<4; k++){
+                // Four bones, one per vertex, transposed to SoA. RQuaternion is w x y z.
+                const RFLOAT* b0 = &Palette[In.indices[v * 4 + k]].real.w;
+                const RFLOAT* b1 = &Palette[In.indices[(v + 1) * 4 + k]].real.w;
+                const RFLOAT* b2 = &Palette[In.indices[(v + 2) * 4 + k]].real.w;
+                const RFLOAT* b3 = &Palette[In.indices[(v + 3) * 4 + k]].real.w;
+                __m128 qw = _mm_load_ps(b0), qx = _mm_load_ps(b1), qy = _mm_load_ps(b2), qz = _mm_load_ps(b3);
+                _MM_TRANSPOSE4_PS(qw, qx, qy, qz);
+                __m128 ew = _mm_load_ps(b0 + 4), ex = _mm_load_ps(b1 + 4), ey = _mm_load_ps(b2 + 4), ez = _mm_load_ps(b3 + 4);
+                _MM_TRANSPOSE4_PS(ew, ex, ey, ez);
+
+                __m128 weight = _mm_setr_ps(In.weights[v * 4 + k], In.weights[(v + 1) * 4 + k],
+                                            In.weights[(v + 2) * 4 + k], In.weights[(v + 3) * 4 + k]);
+                if(k == 0){
+                    fw = qw; fx = qx; fy = qy; fz = qz;
+                } else {
+                    // Antipodal to the first influence: subtract instead of add.
+                    __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qw, fw), _mm_mul_ps(qx, fx)), _mm_add_ps(_mm_mul_ps(qy, fy), _mm_mul_ps(qz, fz)));
+                    weight = _mm_xor_ps(weight, _mm_and_ps(dot, sign));
+                }
+                rw = _mm_add_ps(rw, _mm_mul_ps(qw, weight));
+                rx = _mm_add_ps(rx, _mm_mul_ps(qx, weight));
+                ry = _mm_add_ps(ry, _mm_mul_ps(qy, weight));
+                rz = _mm_add_ps(rz, _mm_mul_ps(qz, weight));
+                dw = _mm_add_ps(dw, _mm_mul_ps(ew, weight));
+                dx = _mm_add_ps(dx, _mm_mul_ps(ex, weight));
+                dy = _mm_add_ps(dy, _mm_mul_ps(ey, weight));
+                dz = _mm_add_ps(dz, _mm_mul_ps(ez, weight));
+            }
+
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rw, rw), _mm_mul_ps(rx, rx)), _mm_add_ps(_mm_mul_ps(ry, ry), _mm_mul_ps(rz, rz))));
+            __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), length);
+            rw = _mm_mul_ps(rw, inv); rx = _mm_mul_ps(rx, inv); ry = _mm_mul_ps(ry, inv); rz = _mm_mul_ps(rz, inv);
+            dw = _mm_mul_ps(dw, inv); dx = _mm_mul_ps(dx, inv); dy = _mm_mul_ps(dy, inv); dz = _mm_mul_ps(dz, inv);
+
+            // Translation: 2 (rw d - dw r + r x d).
+            __m128 two = _mm_set1_ps(2.0f);
+            __m128 tx = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dx), _mm_mul_ps(dw, rx)), _mm_sub_ps(_mm_mul_ps(ry, dz), _mm_mul_ps(rz, dy))));
+            __m128 ty = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dy), _mm_mul_ps(dw, ry)), _mm_sub_ps(_mm_mul_ps(rz, dx), _mm_mul_ps(rx, dz))));
+            __m128 tz = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dz), _mm_mul_ps(dw, rz)), _mm_sub_ps(_mm_mul_ps(rx, dy), _mm_mul_ps(ry, dx))));
+
+            __m128 px = __gather3(In.positions, v, 0), py = __gather3(In.positions, v, 1), pz = __gather3(In.positions, v, 2);
+            __rotate(rw, rx, ry, rz, px, py, pz);
+            __scatter3(OutPositions, v, _mm_add_ps(px, tx), _mm_add_ps(py, ty), _mm_add_ps(pz, tz));
+
+            if(In.normals && OutNormals){
+                __m128 nx = __gather3(In.normals, v, 0), ny = __gather3(In.normals, v, 1), nz = __gather3(In.normals, v, 2);
+                __rotate(rw, rx, ry, rz, nx, ny, nz);
+                __scatter3(OutNormals, v, nx, ny, nz);
+            }
+        }
+        __skinScalar(Palette, In, v, End, OutPositions, OutNormals);
+    }
+#endif
+
+    RVOID RSkinning::BuildDualQuaternionPalette(const RMatrix* Palette, RINT Count, RDualQuaternion* Out){
+        for(RINT i=0; i<Count; i++)
+            Out[i].FromMatrix(Palette[i]);
+    }
+
+    RVOID RSkinning::SkinDualQuaternion(const RDualQuaternion* Palette, const RSkinStreams& In, RFLOAT* OutPositions, RFLOAT* OutNormals){
+        RSkinStreams streams = In;
+        auto task = [Palette, streams, OutPositions, OutNormals](RINT begin, RINT end){
+#ifdef R_SKINNING_SSE
+            __skinSSE(Palette, streams, (RUINT)begin, (RUINT)end, OutPositions, OutNormals);
+#else
+            __skinScalar(Palette, streams, (RUINT)begin, (RUINT)end, OutPositions, OutNormals);
+#endif
+        };
+        // Small meshes are not worth waking the workers for.
+        if(In.count < 8192)
+            task(0, (RINT)In.count);
+        else
+            RThreadPool::Instance()->ParallelFor((RINT)In.count, 4096, task);
+    }
+};
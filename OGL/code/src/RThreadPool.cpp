@@ -0,0 +1,156 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "../headers/RThreadPool.h"
+
+namespace Reactor {
+
+    RThreadPool::RThreadPool(){
+        running = false;
+    }
+
+    RThreadPool::~RThreadPool(){
+        Shutdown();
+    }
+
+    RVOID RThreadPool::Init(RINT threadCount){
+        std::unique_lock<std::mutex> guard(lock);
+        if(running)
+            return;
+        if(threadCount <= 0)
+            threadCount = __max(1, (RINT)std::thread::hardware_concurrency() - 1);
+        running = true;
+        ranges.reserve(64);
+        for(int i=0; i<threadCount; i++)
+            workers.push_back(std::thread(&RThreadPool::WorkerMain, this));
+    }
+
+    RVOID RThreadPool::Shutdown(){
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if(!running)
+                return;
+            running = false;
+        }
+        wake.notify_all();
+        for(size_t i=0; i<workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+        tasks.clear();
+    }
+
+    RINT RThreadPool::GetThreadCount(){
+        if(!running)
+            Init();
+        return (RINT)workers.size();
+    }
+
+    RVOID RThreadPool::Enqueue(const RTask& task){
+        if(!running)
+            Init();
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            tasks.push_back(task);
+        }
+        wake.notify_one();
+    }
+
+    RVOID RThreadPool::WorkerMain(){
+        for(;;){
+            RTask task;
+            RRange* range = NULL;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                while(running && tasks.empty() && ranges.empty())
+                    wake.wait(guard);
+                if(!running)
+                    return;
+                if(!ranges.empty()){
+                    range = ranges.back();
+                    range->helpers.fetch_add(1);
+                } else {
+                    task = tasks.front();
+                    tasks.pop_front();
+                }
+            }
+            if(range == NULL){
+                task();
+                continue;
+            }
+            Drain(*range);
+            {
+                // Exhausted; stop other workers from picking it up again.
+                std::unique_lock<std::mutex> guard(lock);
+                std::vector<RRange*>::iterator it = std::find(ranges.begin(), ranges.end(), range);
+                if(it != ranges.end())
+                    ranges.erase(it);
+            }
+            range->helpers.fetch_sub(1);
+        }
+    }
+
+    RVOID RThreadPool::Drain(RRange& range){
+        for(;;){
+            int chunk = range.next.fetch_add(1);
+            if(chunk >= range.chunks)
+                return;
+            RINT begin = chunk * range.grain;
+            range.invoke(range.task, begin, __min(begin + range.grain, range.count));
+            range.done.fetch_add(1);
+        }
+    }
+
+    RVOID RThreadPool::Run(RRange& range){
+        if(range.chunks == 1){
+            range.invoke(range.task, 0, range.count);
+            return;
+        }
+
+        RINT helpers = __min(GetThreadCount(), range.chunks - 1);
+        if(helpers > 0){
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                ranges.push_back(&range);
+            }
+            wake.notify_all();
+        }
+
+        Drain(range);
+        // Only this range's chunks run here: an unrelated queued task (a file decode, a
+        // snapshot write) could hold the caller for far longer than the range takes.
+        while(range.done.load() < range.chunks)
+            std::this_thread::yield();
+        if(helpers > 0){
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                std::vector<RRange*>::iterator it = std::find(ranges.begin(), ranges.end(), &range);
+                if(it != ranges.end())
+                    ranges.erase(it);
+            }
+            // range is on our stack; wait for workers that picked it up to let go of it.
+            while(range.helpers.load() != 0)
+                std::this_thread::yield();
+        }
+    }
+};
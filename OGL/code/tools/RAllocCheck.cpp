@@ -0,0 +1,125 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+// ralloccheck: runs a frame loop over the engine's per-frame paths and fails if any frame
+// after the warm-up touches the heap.
+//
+//   ralloccheck [frames]
+//
+// Needs a build with R_COUNT_ALLOCATIONS; without it nothing is counted and it exits 2.
+// Each frame runs ParallelFor, frame vectors and nested scratch scopes, a depth sort that
+// alternates between the coherent and radix paths, and a frame packet whose draws are
+// sorted.
+
+#include "../headers/RMemory.h"
+#include "../headers/RThreadPool.h"
+#include "../headers/RDepthSort.h"
+#include "../headers/RFramePacket.h"
+
+using namespace Reactor;
+
+static const RUINT __warmup = 3;
+static const RUINT __elements = 20000;
+static const RUINT __draws = 512;
+
+int main(int argc, char** argv){
+    RUINT frames = argc > 1 ? (RUINT)atoi(argv[1]) : 200;
+    if(!RAllocationCounter::IsEnabled()){
+        fprintf(stderr, "ralloccheck: build with R_COUNT_ALLOCATIONS to count allocations\n");
+        return 2;
+    }
+
+    std::vector<RFLOAT> x(__elements), y(__elements), z(__elements);
+    std::vector<RFLOAT> sums(__elements);
+    RDepthSorter sorter;
+    sorter.Reserve(__elements);
+    RFramePacket packet;
+    uint32_t seed = 1;
+
+    RUINT allocatingFrames = 0;
+    RUINT threads = 0;
+    for(RUINT frame=0; frame<frames; frame++){
+        uint64_t before = RAllocationCounter::GetCount();
+
+        // Mostly still scene with an occasional reshuffle, so both sort paths run.
+        for(RUINT i=0; i<__elements; i++){
+            if(frame == 0 || frame % 10 == 0){
+                seed = seed * 1664525u + 1013904223u;
+                x[i] = (RFLOAT)(seed >> 8) / 16777216.0f;
+            }
+            y[i] = (RFLOAT)i * 0.001f;
+            z[i] = x[i] * 0.5f + (RFLOAT)(frame % 3) * 0.0001f;
+        }
+        RFLOAT* out = &sums[0];
+        const RFLOAT* px = &x[0];
+        RThreadPool::Instance()->ParallelFor((RINT)__elements, 1024, [=](RINT begin, RINT end){
+            RScratchScope scope;
+            RFrameVector<RFLOAT> local;
+            local.reserve(end - begin);
+            for(RINT i=begin; i<end; i++)
+                local.push_back(px[i] * 2.0f);
+            for(RINT i=begin; i<end; i++)
+                out[i] = local[i - begin];
+        });
+        {
+            RScratchScope outer;
+            RFLOAT* a = RFrameArena::Allocate<RFLOAT>(256);
+            {
+                RScratchScope inner;
+                RFLOAT* b = RFrameArena::Allocate<RFLOAT>(256);
+                for(RUINT i=0; i<256; i++)
+                    a[i] = b[i] = (RFLOAT)i;
+            }
+        }
+        sorter.SortBackToFront(&x[0], &y[0], &z[0], __elements, RVector3(0, 0, 10), RVector3(0, 0, -1));
+
+        packet.Reset();
+        for(RUINT i=0; i<__draws; i++){
+            RDrawItem& draw = packet.AddDraw();
+            draw.drawId = i;
+            draw.sortKey = (uint64_t)((i * 7919u + frame) % 64u);
+            RFLOAT data[4] = { (RFLOAT)i, 0.0f, 0.0f, 1.0f };
+            packet.AddDynamic(data, sizeof(data));
+        }
+        packet.SortDraws();
+
+        RFrameArena::EndFrame();
+        uint64_t allocations = RAllocationCounter::GetCount() - before;
+        // A pool thread that touches the arena for the first time gets its block then; that
+        // is warm-up too, however late the scheduler hands it work.
+        RUINT arenaThreads = RFrameArena::GetStats().threads;
+        RBOOL joined = arenaThreads != threads;
+        threads = arenaThreads;
+        if(frame >= __warmup && allocations > 0 && !joined){
+            fprintf(stdout, "frame %u: %llu allocations\n", frame, (unsigned long long)allocations);
+            allocatingFrames++;
+        }
+    }
+
+    RFrameArenaStats stats = RFrameArena::GetStats();
+    fprintf(stdout, "%u frames, %u allocating after frame %u; arena %zu bytes over %u threads, %u overflows\n",
+            frames, allocatingFrames, __warmup, stats.capacity, stats.threads, stats.overflows);
+    RThreadPool::Instance()->Shutdown();
+    return allocatingFrames == 0 ? 0 : 1;
+}
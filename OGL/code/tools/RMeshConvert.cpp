@@ -0,0 +1,293 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+// rmeshconv: converts Wavefront .obj and text DirectX .x meshes to .rmesh.
+//
+//   rmeshconv <input.obj|input.x> <output.rmesh>
+//
+// Faces are triangulated as fans and identical position/normal/uv corners are welded.
+// Binary and compressed .x files (xof ....bin / bzip) have to be re-exported as text.
+
+#include "../headers/RMeshFile.h"
+
+using namespace Reactor;
+
+struct RCorner
+{
+    int position, normal, texcoord;
+};
+
+struct RSourceMesh
+{
+    std::vector<float> positions;   // xyz
+    std::vector<float> normals;     // xyz
+    std::vector<float> texcoords;   // uv
+    std::vector<RCorner> corners;   // three per triangle
+};
+
+static int __objIndex(int index, size_t count){
+    // OBJ indices are 1-based; negative ones count back from the end.
+    return index > 0 ? index - 1 : (int)count + index;
+}
+
+static bool LoadObj(const std::string& path, RSourceMesh& mesh){
+    FILE* f = fopen(path.c_str(), "r");
+    if(f == NULL)
+        return false;
+    char line[1024];
+    while(fgets(line, sizeof(line), f)){
+        float a, b, c;
+        if(strncmp(line, "v ", 2) == 0 && sscanf(line + 2, "%f %f %f", &a, &b, &c) == 3){
+            mesh.positions.push_back(a); mesh.positions.push_back(b); mesh.positions.push_back(c);
+        } else if(strncmp(line, "vn ", 3) == 0 && sscanf(line + 3, "%f %f %f", &a, &b, &c) == 3){
+            mesh.normals.push_back(a); mesh.normals.push_back(b); mesh.normals.push_back(c);
+        } else if(strncmp(line, "vt ", 3) == 0 && sscanf(line + 3, "%f %f", &a, &b) == 2){
+            mesh.texcoords.push_back(a); mesh.texcoords.push_back(b);
+        } else if(strncmp(line, "f ", 2) == 0){
+            std::vector<RCorner> face;
+            std::istringstream in(line + 2);
+            std::string token;
+            while(in >> token){
+                RCorner corner = { -1, -1, -1 };
+                int p = 0, t = 0, n = 0;
+                if(sscanf(token.c_str(), "%d/%d/%d", &p, &t, &n) == 3){
+                } else if(sscanf(token.c_str(), "%d//%d", &p, &n) == 2){
+                } else if(sscanf(token.c_str(), "%d/%d", &p, &t) == 2){
+                } else if(sscanf(token.c_str(), "%d", &p) != 1){
+                    continue;
+                }
+                corner.position = __objIndex(p, mesh.positions.size() / 3);
+                corner.texcoord = t ? __objIndex(t, mesh.texcoords.size() / 2) : -1;
+                corner.normal = n ? __objIndex(n, mesh.normals.size() / 3) : -1;
+                face.push_back(corner);
+            }
+            for(size_t i=2; i<face.size(); i++){
+                mesh.corners.push_back(face[0]);
+                mesh.corners.push_back(face[i-1]);
+                mesh.corners.push_back(face[i]);
+            }
+        }
+    }
+    fclose(f);
+    return !mesh.corners.empty();
+}
+
+// Minimal reader for the text .x template data we export: Mesh, MeshNormals and
+// MeshTextureCoords. Everything is read as a stream of numbers separated by ';' and ','.
+class RXReader
+{
+public:
+    RXReader(const std::string& text) : data(text), pos(0) {}
+
+    bool Find(const char* block){
+        size_t at = data.find(block, pos);
+        if(at == std::string::npos)
+            return false;
+        pos = data.find('{', at);
+        if(pos == std::string::npos)
+            return false;
+        ++pos;
+        return true;
+    }
+
+    double Number(){
+        while(pos < data.size() && !(isdigit((unsigned char)data[pos]) || data[pos] == '-' || data[pos] == '.'))
+            ++pos;
+        char* end = NULL;
+        double value = strtod(data.c_str() + pos, &end);
+        pos = end - data.c_str();
+        return value;
+    }
+
+    // A count read from the file, or -1 when the rest of the text cannot hold that many
+    // items of PerItem numbers (each number takes at least two characters).
+    int Count(int PerItem){
+        double value = Number();
+        double room = (double)(data.size() - __min(pos, data.size())) / (2.0 * PerItem);
+        return (value < 0.0 || value > room) ? -1 : (int)value;
+    }
+
+    std::string data;
+    size_t pos;
+};
+
+static bool __readXFaces(RXReader& x, std::vector<std::vector<int> >& faces){
+    int count = x.Count(2);
+    if(count < 0)
+        return false;
+    faces.resize(count);
+    for(int i=0; i<count; i++){
+        int n = x.Count(1);
+        if(n < 0)
+            return false;
+        for(int k=0; k<n; k++)
+            faces[i].push_back((int)x.Number());
+    }
+    return true;
+}
+
+static bool LoadX(const std::string& path, RSourceMesh& mesh){
+    FILE* f = fopen(path.c_str(), "rb");
+    if(f == NULL)
+        return false;
+    std::string text;
+    char buffer[4096];
+    size_t n;
+    while((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        text.append(buffer, n);
+    fclose(f);
+    if(text.size() < 16 || text.compare(0, 4, "xof ") != 0 || text.compare(8, 4, "txt ") != 0){
+        fprintf(stderr, "%s: only text .x files are supported\n", path.c_str());
+        return false;
+    }
+
+    RXReader x(text);
+    if(!x.Find("Mesh "))
+        return false;
+    int vertexCount = x.Count(3);
+    if(vertexCount < 0)
+        return false;
+    for(int i=0; i<vertexCount * 3; i++)
+        mesh.positions.push_back((float)x.Number());
+    std::vector<std::vector<int> > faces, normalFaces;
+    if(!__readXFaces(x, faces))
+        return false;
+
+    size_t meshStart = x.pos;
+    if(x.Find("MeshNormals")){
+        int count = x.Count(3);
+        if(count < 0)
+            return false;
+        for(int i=0; i<count * 3; i++)
+            mesh.normals.push_back((float)x.Number());
+        if(!__readXFaces(x, normalFaces))
+            return false;
+    }
+    x.pos = meshStart;
+    if(x.Find("MeshTextureCoords")){
+        int count = x.Count(2);
+        if(count < 0)
+            return false;
+        for(int i=0; i<count * 2; i++)
+            mesh.texcoords.push_back((float)x.Number());
+    }
+
+    for(size_t i=0; i<faces.size(); i++){
+        const std::vector<int>& face = faces[i];
+        for(size_t k=2; k<face.size(); k++){
+            size_t corner[3] = { 0, k - 1, k };
+            for(int c=0; c<3; c++){
+                RCorner rc;
+                rc.position = face[corner[c]];
+                // Texture coordinates are per position in .x.
+                rc.texcoord = mesh.texcoords.empty() ? -1 : face[corner[c]];
+                rc.normal = (i < normalFaces.size() && corner[c] < normalFaces[i].size()) ? normalFaces[i][corner[c]] : -1;
+                mesh.corners.push_back(rc);
+            }
+        }
+    }
+    return !mesh.corners.empty();
+}
+
+static bool Build(const RSourceMesh& src, RMeshBuildData& out){
+    bool hasNormals = !src.normals.empty();
+    bool hasTexcoords = !src.texcoords.empty();
+
+    RMeshAttribute position = { 0, RMESH_FLOAT32, 3, 0 };
+    out.attributes.push_back(position);
+    out.vertexStride = 12;
+    if(hasNormals){
+        RMeshAttribute normal = { 1, RMESH_FLOAT32, 3, out.vertexStride };
+        out.attributes.push_back(normal);
+        out.vertexStride += 12;
+    }
+    if(hasTexcoords){
+        RMeshAttribute texcoord = { 2, RMESH_FLOAT32, 2, out.vertexStride };
+        out.attributes.push_back(texcoord);
+        out.vertexStride += 8;
+    }
+
+    std::map<std::string, uint32_t> welded;
+    std::vector<float> vertex(out.vertexStride / 4);
+    for(size_t i=0; i<src.corners.size(); i++){
+        const RCorner& c = src.corners[i];
+        if(c.position < 0 || (size_t)c.position * 3 >= src.positions.size())
+            return false;
+        size_t k = 0;
+        for(int j=0; j<3; j++)
+            vertex[k++] = src.positions[c.position * 3 + j];
+        if(hasNormals){
+            bool valid = c.normal >= 0 && (size_t)c.normal * 3 < src.normals.size();
+            for(int j=0; j<3; j++)
+                vertex[k++] = valid ? src.normals[c.normal * 3 + j] : 0.0f;
+        }
+        if(hasTexcoords){
+            bool valid = c.texcoord >= 0 && (size_t)c.texcoord * 2 < src.texcoords.size();
+            for(int j=0; j<2; j++)
+                vertex[k++] = valid ? src.texcoords[c.texcoord * 2 + j] : 0.0f;
+        }
+
+        std::string key((const char*)&vertex[0], out.vertexStride);
+        std::map<std::string, uint32_t>::iterator it = welded.find(key);
+        if(it == welded.end()){
+            uint32_t index = (uint32_t)(out.vertices.size() / out.vertexStride);
+            welded[key] = index;
+            out.vertices.insert(out.vertices.end(), key.begin(), key.end());
+            out.indices.push_back(index);
+        } else {
+            out.indices.push_back(it->second);
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv){
+    if(argc != 3){
+        fprintf(stderr, "usage: %s <input.obj|input.x> <output.rmesh>\n", argv[0]);
+        return 1;
+    }
+    std::string input = argv[1];
+    std::string ext = input.substr(input.find_last_of('.') + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    RSourceMesh source;
+    bool loaded = (ext == "obj") ? LoadObj(input, source) : (ext == "x") ? LoadX(input, source) : false;
+    if(!loaded){
+        fprintf(stderr, "%s: could not load mesh\n", input.c_str());
+        return 1;
+    }
+
+    RMeshBuildData mesh;
+    if(!Build(source, mesh)){
+        fprintf(stderr, "%s: face references a missing vertex\n", input.c_str());
+        return 1;
+    }
+    if(FAILED(RMeshFile::Write(argv[2], mesh))){
+        fprintf(stderr, "%s: could not write\n", argv[2]);
+        return 1;
+    }
+    fprintf(stdout, "%s: %u vertices, %u triangles, stride %u\n", argv[2],
+            (unsigned)(mesh.vertices.size() / mesh.vertexStride), (unsigned)(mesh.indices.size() / 3), mesh.vertexStride);
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ Reactor 3D MIT License
+
+ Copyright (c) 2010 Reiser Games
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+// rmeshopt: runs the RMeshOptimizer stages over an .rmesh file.
+//
+//   rmeshopt [--quantize] [--no-overdraw] [--cache N] <input.rmesh> <output.rmesh>
+//
+// Prints ACMR / ATVR for the index stream before and after so regressions show up in
+// the asset build log. Each LOD range is optimized on its own.
+
+#include "../headers/RMeshOptimizer.h"
+
+using namespace Reactor;
+
+static void __report(const char* label, const RMeshBuildData& mesh, RUINT cacheSize){
+    RUINT vertexCount = (RUINT)(mesh.vertices.size() / mesh.vertexStride);
+    RVertexCacheStats stats = RMeshOptimizer::AnalyzeVertexCache(mesh.indices, vertexCount, cacheSize);
+    fprintf(stdout, "%-6s ACMR %.3f  ATVR %.3f  (%u vertices, %u triangles, stride %u)\n", label,
+            stats.acmr, stats.atvr, vertexCount, (unsigned)(mesh.indices.size() / 3), mesh.vertexStride);
+}
+
+int main(int argc, char** argv){
+    bool quantize = false;
+    bool overdraw = true;
+    RUINT cacheSize = 16;
+    std::vector<std::string> paths;
+    for(int i=1; i<argc; i++){
+        std::string arg = argv[i];
+        if(arg == "--quantize")
+            quantize = true;
+        else if(arg == "--no-overdraw")
+            overdraw = false;
+        else if(arg == "--cache" && i + 1 < argc)
+            cacheSize = (RUINT)__max(3, atoi(argv[++i]));
+        else
+            paths.push_back(arg);
+    }
+    if(paths.size() != 2){
+        fprintf(stderr, "usage: %s [--quantize] [--no-overdraw] [--cache N] <input.rmesh> <output.rmesh>\n", argv[0]);
+        return 1;
+    }
+
+    RMeshBuildData mesh;
+    if(FAILED(RMeshFile::Read(paths[0], mesh))){
+        fprintf(stderr, "%s: could not read\n", paths[0].c_str());
+        return 1;
+    }
+    RUINT vertexCount = (RUINT)(mesh.vertices.size() / mesh.vertexStride);
+    if(!RMeshOptimizer::ValidateIndices(mesh.indices, vertexCount)){
+        fprintf(stderr, "%s: index out of range of the %u vertices\n", paths[0].c_str(), vertexCount);
+        return 1;
+    }
+    __report("before", mesh, cacheSize);
+
+    if(mesh.lods.empty()){
+        std::vector<RUINT> clusters;
+        RMeshOptimizer::OptimizeVertexCache(mesh.indices, vertexCount, clusters, cacheSize);
+        if(overdraw)
+            RMeshOptimizer::OptimizeOverdraw(mesh, clusters);
+    } else {
+        // Optimize each LOD range separately, then splice the results back in place.
+        std::vector<uint32_t> all = mesh.indices;
+        for(size_t l=0; l<mesh.lods.size(); l++){
+            const RMeshLod& lod = mesh.lods[l];
+            mesh.indices.assign(all.begin() + lod.firstIndex, all.begin() + lod.firstIndex + lod.indexCount);
+            std::vector<RUINT> clusters;
+            RMeshOptimizer::OptimizeVertexCache(mesh.indices, vertexCount, clusters, cacheSize);
+            if(overdraw)
+                RMeshOptimizer::OptimizeOverdraw(mesh, clusters);
+            std::copy(mesh.indices.begin(), mesh.indices.end(), all.begin() + lod.firstIndex);
+        }
+        mesh.indices.swap(all);
+    }
+    RMeshOptimizer::OptimizeVertexFetch(mesh);
+    if(quantize)
+        RMeshOptimizer::Quantize(mesh);
+    __report("after", mesh, cacheSize);
+
+    if(FAILED(RMeshFile::Write(paths[1], mesh))){
+        fprintf(stderr, "%s: could not write\n", paths[1].c_str());
+        return 1;
+    }
+    return 0;
+}